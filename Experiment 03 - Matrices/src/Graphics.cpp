@@ -11,7 +11,8 @@ Graphics Graphics::Instance = *(new Graphics());
 
 /** Graphics constructor **/
 Graphics::Graphics() {
-	Status = -1;
+	Status  = -1;
+	Invalid = true;
 }
 
 /** Initializes the class and creates the game window **/
@@ -25,6 +26,11 @@ void Graphics::update() {
 	Instance.draw();
 }
 
+/** Checks whether the window needs drawing again **/
+bool Graphics::isInvalid() {
+	return Instance.Invalid;
+}
+
 /** Access to the GLFW window for use elsewhere **/
 GLFWwindow* Graphics::getWindow() {
 	return Instance.Window;
@@ -101,6 +107,9 @@ int Graphics::createWindow() {
 	// Set the context as current
 	glfwMakeContextCurrent(Window);
 
+	// Draw again whenever the window's contents are lost
+	glfwSetWindowRefreshCallback(Window, refresh);
+
 	// Initialize GLEW
 	glewExperimental = GL_TRUE;
 	if (glewInit() != GLEW_OK) {
@@ -155,4 +164,10 @@ void Graphics::draw() {
 
 	// Swap buffers
 	glfwSwapBuffers(Window);
+	Invalid = false;
+}
+
+/** Handles the window contents needing to be drawn again **/
+void Graphics::refresh(GLFWwindow* window) {
+	Instance.Invalid = true;
 }
@@ -23,6 +23,9 @@ class Graphics {
 		/** Updates the screen **/
 		static void update();
 
+		/** Checks whether the window needs drawing again **/
+		static bool isInvalid();
+
 		/** Access method to grab the GLFW Window for use elsewhere **/
 		static GLFWwindow* getWindow();
 
@@ -38,6 +41,7 @@ class Graphics {
 		GLuint VertexArrayID, ProgramID, VertexBuffer, MVPUniformID;
 		glm::mat4 MVP;
 		int Status;
+		bool Invalid;
 
 		/** Private constructor to ensure only one instance exists **/
 		Graphics();                                  // No constructing
@@ -46,6 +50,9 @@ class Graphics {
 		int  createWindow();
 		void initOpenGL();
 		void draw();
+
+		/** Window callbacks **/
+		static void refresh(GLFWwindow* window);
 };
 
 #endif // GRAPHICS_H_INCLUDED
@@ -0,0 +1,201 @@
+/*=================================                                       ----*\
+ * ANTI-ALIASING CLASS                                                        *
+ * - This class runs post-process anti-aliasing over a single sample scene.   *
+ *   FXAA is one pass over the image, while the SMAA-style mode detects       *
+ *   edges, measures the lines they form, and blends along them in three.     *
+\*----                                       =================================*/
+
+#include "AntiAliasing.h"
+
+/** AntiAliasing constructor, OpenGL objects are created in build() **/
+AntiAliasing::AntiAliasing() {
+	CurrentMode  = NONE;
+	Width        = 0;
+	Height       = 0;
+	RegionWidth  = 0;
+	RegionHeight = 0;
+
+	memset(&FXAAPass,   0, sizeof(Pass));
+	memset(&EdgePass,   0, sizeof(Pass));
+	memset(&WeightPass, 0, sizeof(Pass));
+	memset(&BlendPass,  0, sizeof(Pass));
+	memset(Steps,       0, sizeof(Steps));
+}
+
+/** AntiAliasing destructor **/
+AntiAliasing::~AntiAliasing() {
+	releasePrograms();
+}
+
+/** Reads a mode such as "fxaa" or "msaa4" from the command line **/
+bool AntiAliasing::parseMode(const char* name, Mode& mode, GLsizei& samples) {
+	samples = 0;
+
+	if (strcmp(name, "none") == 0) {
+		mode = NONE;
+	} else if (strcmp(name, "fxaa") == 0) {
+		mode = FXAA;
+	} else if (strcmp(name, "smaa") == 0) {
+		mode = SMAA;
+	} else if (strncmp(name, "msaa", 4) == 0) {
+		// The sample count follows the name, 4x when left out
+		samples = (name[4] != '\0' ? atoi(name + 4) : 4);
+		if (samples < 2)
+			return false;
+		mode = MSAA;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/** Readable name of a mode **/
+const char* AntiAliasing::getModeName(Mode mode) {
+	switch (mode) {
+		case MSAA: return "MSAA";
+		case FXAA: return "FXAA";
+		case SMAA: return "SMAA";
+		default:   return "None";
+	}
+}
+
+/** Creates the passes for a post-process mode **/
+bool AntiAliasing::build(Mode mode, GLsizei width, GLsizei height) {
+	releasePrograms();
+
+	CurrentMode = mode;
+	Width       = width;
+	Height      = height;
+
+	// Multisampling and no anti-aliasing have nothing to do after resolve
+	if (mode == FXAA)
+		return loadPass(FXAAPass, "FXAA.fshader");
+
+	if (mode == SMAA) {
+		return loadPass(EdgePass,   "SMAAEdges.fshader")   &&
+			loadPass(WeightPass, "SMAAWeights.fshader") &&
+			loadPass(BlendPass,  "SMAABlend.fshader");
+	}
+
+	return true;
+}
+
+/** Follows the scene size for the intermediate targets **/
+void AntiAliasing::resize(GLsizei width, GLsizei height) {
+	Width  = width;
+	Height = height;
+}
+
+/** Adds the passes that anti-alias the given area of a scene texture **/
+RenderGraph::Resource AntiAliasing::addPasses(RenderGraph& graph,
+	RenderGraph::Resource source, GLsizei width, GLsizei height)
+{
+	RegionWidth  = width;
+	RegionHeight = height;
+
+	if (CurrentMode == FXAA && FXAAPass.ProgramID != 0)
+		return addStep(graph, 0, "FXAA", FXAAPass, source, -1, GL_RGBA8);
+
+	if (CurrentMode != SMAA || BlendPass.ProgramID == 0)
+		return source;
+
+	// Find edges, weigh them by the lines they belong to, then blend. The
+	// edges share a format with the output so the two can alias, as the
+	// edges are dead by the time the blend writes
+	RenderGraph::Resource edges = addStep(graph, 0, "SMAA Edges", EdgePass,
+		source, -1, GL_RGBA8);
+	RenderGraph::Resource weights = addStep(graph, 1, "SMAA Weights",
+		WeightPass, edges, -1, GL_RGBA8);
+	return addStep(graph, 2, "SMAA Blend", BlendPass, source, weights,
+		GL_RGBA8);
+}
+
+/** Releases the pass programs **/
+void AntiAliasing::releasePrograms() {
+	Pass* passes[] = { &FXAAPass, &EdgePass, &WeightPass, &BlendPass };
+
+	for (int p = 0; p < 4; p++) {
+		if (passes[p]->ProgramID != 0)
+			Shaders::deleteProgram(passes[p]->ProgramID);
+		memset(passes[p], 0, sizeof(Pass));
+	}
+}
+
+/** Loads a full screen pass and looks up its uniforms **/
+bool AntiAliasing::loadPass(Pass& pass, const char* fragmentShader) {
+	bool compiled = Shaders::loadShader("Fullscreen.vshader", GL_VERTEX_SHADER);
+	compiled = Shaders::loadShader(fragmentShader, GL_FRAGMENT_SHADER) &&
+		compiled;
+	pass.ProgramID = Shaders::createProgram();
+
+	if (!compiled) {
+		LOG_ERROR(RENDER, "Failed to compile %s", fragmentShader);
+		return false;
+	}
+
+	// Get handles for our uniforms
+	pass.SourceUniformID = glGetUniformLocation(pass.ProgramID, "source");
+	pass.AuxUniformID    = glGetUniformLocation(pass.ProgramID, "aux");
+	pass.RegionUniformID = glGetUniformLocation(pass.ProgramID, "region");
+	pass.TexelUniformID  = glGetUniformLocation(pass.ProgramID, "texel");
+	return true;
+}
+
+/** Declares a full screen pass writing a new full size target **/
+RenderGraph::Resource AntiAliasing::addStep(RenderGraph& graph, int index,
+	const char* name, const Pass& program, RenderGraph::Resource source,
+	RenderGraph::Resource aux, GLenum format)
+{
+	RenderGraph::TextureDesc desc = { Width, Height, format };
+	RenderGraph::Resource output = graph.createTexture(name, desc);
+
+	Step& step   = Steps[index];
+	step.Owner   = this;
+	step.Program = &program;
+	step.Source  = source;
+	step.Aux     = aux;
+
+	// Every pixel in the region is written, so the target needs no clear
+	RenderGraph::PassID pass = graph.addPass(name, runStep, &step);
+	graph.read(pass, source);
+	if (aux >= 0)
+		graph.read(pass, aux);
+	graph.write(pass, output, false);
+
+	return output;
+}
+
+/** Runs a full screen pass over the rendered area **/
+void AntiAliasing::runStep(RenderGraph& graph, void* data) {
+	const Step&         step  = *static_cast<const Step*>(data);
+	const Pass&         pass  = *step.Program;
+	const AntiAliasing& owner = *step.Owner;
+
+	glViewport(0, 0, owner.RegionWidth, owner.RegionHeight);
+	glDisable(GL_DEPTH_TEST);
+
+	// Use the pass shader
+	glUseProgram(pass.ProgramID);
+	glUniform1i(pass.SourceUniformID, 0);
+	glUniform1i(pass.AuxUniformID, 1);
+	glUniform2i(pass.RegionUniformID, owner.RegionWidth, owner.RegionHeight);
+	glUniform2f(pass.TexelUniformID,
+		1.0f / static_cast<float>(owner.Width),
+		1.0f / static_cast<float>(owner.Height));
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D,
+		step.Aux >= 0 ? graph.getTexture(step.Aux) : 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, graph.getTexture(step.Source));
+
+	// One triangle covering the screen, generated from the vertex ID
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,86 @@
+#ifndef ANTIALIASING_H_INCLUDED
+#define ANTIALIASING_H_INCLUDED
+
+/*=================================                                       ----*\
+ * ANTI-ALIASING CLASS                                                        *
+ * - This class runs post-process anti-aliasing over a single sample scene.   *
+ *   FXAA is one pass over the image, while the SMAA-style mode detects       *
+ *   edges, measures the lines they form, and blends along them in three.     *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Log.h"
+#include "Shaders.h"
+#include "RenderGraph.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+class AntiAliasing {
+	public:
+		/** Available anti-aliasing modes **/
+		enum Mode {
+			NONE, // Aliased
+			MSAA, // Multisampled scene target, resolved before post
+			FXAA, // Fast approximate, one post pass
+			SMAA  // Edge, weight and blend post passes
+		};
+
+		AntiAliasing();
+		~AntiAliasing();
+
+		/** Reads a mode such as "fxaa" or "msaa4" from the command line **/
+		static bool parseMode(const char* name, Mode& mode, GLsizei& samples);
+
+		/** Readable name of a mode **/
+		static const char* getModeName(Mode mode);
+
+		/** Creates the passes for a post-process mode **/
+		bool build(Mode mode, GLsizei width, GLsizei height);
+
+		/** Follows the scene size for the intermediate targets **/
+		void resize(GLsizei width, GLsizei height);
+
+		/** Adds the passes that anti-alias the given area of a scene texture
+		    and returns the resource holding the result, laid out like the
+		    scene **/
+		RenderGraph::Resource addPasses(RenderGraph& graph,
+			RenderGraph::Resource source, GLsizei width, GLsizei height);
+	protected:
+	private:
+		/** A full screen pass and its uniform locations **/
+		struct Pass {
+			GLuint ProgramID;
+			GLint  SourceUniformID, AuxUniformID;
+			GLint  RegionUniformID, TexelUniformID;
+		};
+
+		/** A pass as added to the render graph **/
+		struct Step {
+			AntiAliasing*         Owner;
+			const Pass*           Program;
+			RenderGraph::Resource Source, Aux;
+		};
+
+		/** Internal variables for the post passes **/
+		Mode    CurrentMode;
+		GLsizei Width, Height;
+		GLsizei RegionWidth, RegionHeight;
+		Pass    FXAAPass, EdgePass, WeightPass, BlendPass;
+		Step    Steps[3];
+
+		/** Prevent copying, the class owns OpenGL objects **/
+		AntiAliasing(const AntiAliasing& source);            // No copying
+		AntiAliasing& operator=(const AntiAliasing& source); // No assignment
+
+		/** Internal functions used for creation and processing **/
+		void releasePrograms();
+		bool loadPass(Pass& pass, const char* fragmentShader);
+		RenderGraph::Resource addStep(RenderGraph& graph, int index,
+			const char* name, const Pass& program, RenderGraph::Resource source,
+			RenderGraph::Resource aux, GLenum format);
+		static void runStep(RenderGraph& graph, void* data);
+};
+
+#endif // ANTIALIASING_H_INCLUDED
@@ -0,0 +1,482 @@
+/*=================================                                       ----*\
+ * BATCH CLASS                                                                *
+ * - This class merges static meshes into shared vertex and index buffers and *
+ *   submits every object in the batch with a single multi-draw indirect call *
+ *   instead of one draw call per object.                                     *
+\*----                                       =================================*/
+
+#include "Batch.h"
+
+/** Batch constructor, OpenGL objects are created in build() **/
+Batch::Batch() {
+	VertexArrayID     = 0;
+	ProgramID         = 0;
+	VPUniformID       = 0;
+	Textures          = NULL;
+	Views             = NULL;
+	ViewProgramID     = 0;
+	ViewCommandBuffer = 0;
+	Sun               = NULL;
+	DepthProgramID    = 0;
+	DepthVPUniformID  = 0;
+	VertexBuffer      = 0;
+	IndexBuffer       = 0;
+	DrawIDBuffer      = 0;
+	CommandBuffer     = 0;
+	DrawDataBuffer    = 0;
+	BoundsBuffer      = 0;
+	ChangedBegin      = 0;
+	ChangedEnd        = 0;
+	Built             = false;
+}
+
+/** Batch destructor **/
+Batch::~Batch() {
+	release();
+}
+
+/** Checks whether the context can run the batching path **/
+bool Batch::isSupported() {
+	// Multi-draw indirect, base instance and storage buffers are all core
+	// 4.3, and the batch shaders are written against it, so the extensions
+	// alone on an older context aren't enough
+	return GLEW_VERSION_4_3 != 0;
+}
+
+/** Adds mesh data to the shared buffers and returns the mesh ID **/
+GLuint Batch::addMesh(const GLfloat* positions, const GLfloat* colors,
+	GLsizei vertexCount, const GLuint* indices, GLsizei indexCount)
+{
+	Mesh mesh;
+	mesh.Count      = static_cast<GLuint>(indexCount);
+	mesh.FirstIndex = static_cast<GLuint>(Indices.size());
+	mesh.BaseVertex = static_cast<GLint>(Vertices.size());
+
+	// Bounding sphere around the center of the mesh's box
+	glm::vec3 low(positions[0], positions[1], positions[2]);
+	glm::vec3 high = low;
+	for (GLsizei v = 1; v < vertexCount; v++) {
+		glm::vec3 p(positions[3 * v], positions[3 * v + 1],
+			positions[3 * v + 2]);
+		low  = glm::min(low, p);
+		high = glm::max(high, p);
+	}
+	glm::vec3 center = (low + high) * 0.5f;
+	float     radius = 0.0f;
+	for (GLsizei v = 0; v < vertexCount; v++) {
+		glm::vec3 p(positions[3 * v], positions[3 * v + 1],
+			positions[3 * v + 2]);
+		radius = glm::max(radius, glm::length(p - center));
+	}
+
+	// Append the vertices packed to 12 bytes each, indices stay relative to
+	// the mesh. Rounding moves a position by up to half a step per axis,
+	// so the sphere grows by that much
+	Vertices.resize(Vertices.size() + vertexCount);
+	QuantizedVertex* packed = &Vertices[mesh.BaseVertex];
+	mesh.Dequantize = VertexPacker::quantizePositions(positions, vertexCount,
+		packed->Position, sizeof(QuantizedVertex));
+	VertexPacker::packColors(colors, vertexCount, packed->Color,
+		sizeof(QuantizedVertex));
+	Indices.insert(Indices.end(), indices, indices + indexCount);
+
+	glm::vec3 step(mesh.Dequantize[0][0], mesh.Dequantize[1][1],
+		mesh.Dequantize[2][2]);
+	mesh.Sphere = glm::vec4(center, radius + glm::length(step) * 0.5f);
+
+	Meshes.push_back(mesh);
+	return static_cast<GLuint>(Meshes.size() - 1);
+}
+
+/** Places a static instance of a mesh and returns the draw ID **/
+GLuint Batch::addDraw(GLuint mesh, const glm::mat4& model,
+	GLuint material)
+{
+	GLuint drawID = static_cast<GLuint>(Commands.size());
+
+	DrawCommand command;
+	command.Count         = Meshes[mesh].Count;
+	command.InstanceCount = 1;
+	command.FirstIndex    = Meshes[mesh].FirstIndex;
+	command.BaseVertex    = Meshes[mesh].BaseVertex;
+	command.BaseInstance  = drawID;
+	Commands.push_back(command);
+
+	DrawData data;
+	data.Material   = material;
+	data.Padding[0] = 0;
+	data.Padding[1] = 0;
+	data.Padding[2] = 0;
+	Draws.push_back(data);
+	Bounds.push_back(glm::vec4(0.0f));
+	DrawMeshes.push_back(mesh);
+	place(drawID, model);
+
+	return drawID;
+}
+
+/** Textures the draws with materials **/
+void Batch::setMaterials(const Materials* materials) {
+	Textures = materials;
+}
+
+/** Draws the batch across views as well **/
+void Batch::setViews(const MultiView* views) {
+	Views = views;
+}
+
+/** Darkens the draws where shadow maps say the light is blocked **/
+void Batch::setShadows(const Shadows* shadows) {
+	Sun = shadows;
+}
+
+/** Moves a draw, the change reaches OpenGL with the next upload() **/
+void Batch::setModel(GLuint draw, const glm::mat4& model) {
+	place(draw, model);
+
+	// Grow the range of draws waiting to be uploaded
+	if (draw < ChangedBegin)
+		ChangedBegin = draw;
+	if (draw + 1 > ChangedEnd)
+		ChangedEnd = draw + 1;
+}
+
+/** Sends the draws moved since the last upload to OpenGL **/
+void Batch::upload() {
+	if (!Built || ChangedBegin >= ChangedEnd)
+		return;
+
+	// One range covers every change, so scattered moves upload the draws
+	// in between as well
+	GLintptr   first = ChangedBegin;
+	GLsizeiptr count = ChangedEnd - ChangedBegin;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, DrawDataBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(DrawData),
+		count * sizeof(DrawData), &Draws[first]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, BoundsBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(glm::vec4),
+		count * sizeof(glm::vec4), &Bounds[first]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	ChangedBegin = static_cast<GLuint>(Commands.size());
+	ChangedEnd   = 0;
+}
+
+/** Uploads the merged buffers and draw commands to OpenGL **/
+bool Batch::build() {
+	if (!isSupported()) {
+		LOG_ERROR(RENDER, "Multi-draw indirect is not supported");
+		return false;
+	}
+
+	if (Commands.empty())
+		return false;
+
+	// Load the batch shaders once, textured when there are materials and
+	// shadowed when there are shadow maps
+	if (ProgramID == 0) {
+		std::string defines = (Textures ? "MATERIALS" : "");
+		if (Sun)
+			defines += (defines.empty() ? "SHADOWS" : " SHADOWS");
+		Shaders::loadShader("Batch.vshader", GL_VERTEX_SHADER,
+			defines.c_str());
+		Shaders::loadShader("Batch.fshader", GL_FRAGMENT_SHADER,
+			defines.c_str());
+		ProgramID   = Shaders::createProgram();
+		VPUniformID = glGetUniformLocation(ProgramID, "VP");
+
+		// The texture array always comes from the first unit
+		glUseProgram(ProgramID);
+		glUniform1i(glGetUniformLocation(ProgramID, "textures"), 0);
+		glUseProgram(0);
+	}
+
+	// The same shaders again, with every command drawing once per view.
+	// The cascades follow a single camera, so the views go unshadowed
+	if (Views && ViewProgramID == 0) {
+		const char* defines = (Textures ? "MATERIALS" : "");
+		ViewProgramID = Views->createProgram("Batch.vshader", "Batch.fshader",
+			defines);
+		glUseProgram(ViewProgramID);
+		glUniform1i(glGetUniformLocation(ViewProgramID, "textures"), 0);
+		glUseProgram(0);
+	}
+
+	// Positions only, for drawing into shadow maps
+	if (Sun && DepthProgramID == 0) {
+		Shaders::loadShader("Batch.vshader", GL_VERTEX_SHADER);
+		Shaders::loadShader("Depth.fshader", GL_FRAGMENT_SHADER);
+		DepthProgramID   = Shaders::createProgram();
+		DepthVPUniformID = glGetUniformLocation(DepthProgramID, "VP");
+	}
+
+	if (VertexArrayID == 0) {
+		glGenVertexArrays(1, &VertexArrayID);
+		glGenBuffers(1, &VertexBuffer);
+		glGenBuffers(1, &IndexBuffer);
+		glGenBuffers(1, &DrawIDBuffer);
+		glGenBuffers(1, &CommandBuffer);
+		glGenBuffers(1, &DrawDataBuffer);
+		glGenBuffers(1, &BoundsBuffer);
+	}
+
+	// The batch keeps its own vertex array, so remember the caller's
+	GLint previousVAO = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	glBindVertexArray(VertexArrayID);
+
+	// Both attributes interleave in one buffer
+	glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(QuantizedVertex),
+		&Vertices[0], GL_STATIC_DRAW);
+
+	// Vertices as plain integers the model matrix scales, then colors
+	QuantizedFormat::setPointers();
+
+	// Third attribute: draw ID, stepped once per instance so that each
+	// command's base instance selects its own entry
+	std::vector<DrawID> drawIDs(Commands.size());
+	for (size_t i = 0; i < drawIDs.size(); i++)
+		drawIDs[i].Index = static_cast<GLuint>(i);
+
+	glBindBuffer(GL_ARRAY_BUFFER, DrawIDBuffer);
+	glBufferData(GL_ARRAY_BUFFER, drawIDs.size() * sizeof(DrawID),
+		&drawIDs[0], GL_STATIC_DRAW);
+	DrawIDFormat::setPointers();
+	DrawIDFormat::setDivisor(1);
+
+	// Shared index buffer, captured by the vertex array
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, Indices.size() * sizeof(GLuint),
+		&Indices[0], GL_STATIC_DRAW);
+
+	glBindVertexArray(previousVAO);
+
+	// Draw commands
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, CommandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, Commands.size() * sizeof(DrawCommand),
+		&Commands[0], GL_STATIC_DRAW);
+
+	// Commands drawing an instance per view, everything else the same
+	if (ViewProgramID != 0) {
+		std::vector<DrawCommand> viewCommands(Commands);
+		for (size_t i = 0; i < viewCommands.size(); i++)
+			viewCommands[i].InstanceCount = Views->getCount();
+
+		if (ViewCommandBuffer == 0)
+			glGenBuffers(1, &ViewCommandBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ViewCommandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER,
+			viewCommands.size() * sizeof(DrawCommand), &viewCommands[0],
+			GL_STATIC_DRAW);
+		MemoryTracker::track(MemoryTracker::BUFFER, ViewCommandBuffer,
+			"Batch draws", viewCommands.size() * sizeof(DrawCommand));
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	// Per-draw data
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, DrawDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, Draws.size() * sizeof(DrawData),
+		&Draws[0], GL_STATIC_DRAW);
+
+	// Per-draw bounds, read by GPU culling
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, BoundsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, Bounds.size() * sizeof(glm::vec4),
+		&Bounds[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The buffers mirror the arrays, which stay behind for later updates
+	MemoryTracker::track(MemoryTracker::BUFFER, VertexBuffer, "Batch vertices",
+		Vertices.size() * sizeof(QuantizedVertex));
+	MemoryTracker::track(MemoryTracker::BUFFER, DrawIDBuffer, "Batch draws",
+		drawIDs.size() * sizeof(DrawID));
+	MemoryTracker::track(MemoryTracker::BUFFER, IndexBuffer, "Batch indices",
+		Indices.size() * sizeof(GLuint));
+	MemoryTracker::track(MemoryTracker::BUFFER, CommandBuffer, "Batch draws",
+		Commands.size() * sizeof(DrawCommand));
+	MemoryTracker::track(MemoryTracker::BUFFER, DrawDataBuffer, "Batch draws",
+		Draws.size() * sizeof(DrawData));
+	MemoryTracker::track(MemoryTracker::BUFFER, BoundsBuffer, "Batch draws",
+		Bounds.size() * sizeof(glm::vec4));
+	MemoryTracker::track(MemoryTracker::CLIENT, reinterpret_cast<size_t>(this),
+		"Batch", Vertices.capacity() * sizeof(QuantizedVertex) +
+		Indices.capacity() * sizeof(GLuint) +
+		Meshes.capacity() * sizeof(Mesh) +
+		Commands.capacity() * sizeof(DrawCommand) +
+		Draws.capacity() * sizeof(DrawData) +
+		Bounds.capacity() * sizeof(glm::vec4) +
+		DrawMeshes.capacity() * sizeof(GLuint));
+
+	// Everything is current, so nothing waits to be uploaded
+	ChangedBegin = static_cast<GLuint>(Commands.size());
+	ChangedEnd   = 0;
+
+	Built = true;
+	return true;
+}
+
+/** Submits the whole batch **/
+void Batch::draw(const glm::mat4& viewProjection) {
+	draw(viewProjection, CommandBuffer, 0);
+}
+
+/** Submits the batch from another command buffer **/
+void Batch::draw(const glm::mat4& viewProjection, GLuint commandBuffer,
+	GLuint countBuffer)
+{
+	if (!Built)
+		return;
+
+	// Use the batch shader
+	glUseProgram(ProgramID);
+	glUniformMatrix4fv(VPUniformID, 1, GL_FALSE, &viewProjection[0][0]);
+
+	// Shadow maps from the texture unit and uniform binding Shadow.glsl
+	// expects
+	if (Sun)
+		Sun->bind(2, 1);
+	submit(commandBuffer, countBuffer, 1);
+}
+
+/** Submits the whole batch once for every view **/
+void Batch::drawViews() {
+	if (!Built || ViewProgramID == 0)
+		return;
+
+	// The view matrices come from the views' uniform buffer
+	glUseProgram(ViewProgramID);
+	submit(ViewCommandBuffer, 0, static_cast<GLuint>(Views->getCount()));
+}
+
+/** Submits the whole batch writing depth only **/
+void Batch::drawDepth(const glm::mat4& viewProjection) {
+	if (!Built || DepthProgramID == 0)
+		return;
+
+	// Materials don't change depth, so the casters skip them
+	const Materials* textures = Textures;
+	Textures = NULL;
+	glUseProgram(DepthProgramID);
+	glUniformMatrix4fv(DepthVPUniformID, 1, GL_FALSE, &viewProjection[0][0]);
+	submit(CommandBuffer, 0, 1);
+	Textures = textures;
+}
+
+/** Binds the batch's buffers and issues the multi-draw, with the draw ID
+    stepping once every given number of instances **/
+void Batch::submit(GLuint commandBuffer, GLuint countBuffer,
+	GLuint instances)
+{
+	GLint previousVAO = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	glBindVertexArray(VertexArrayID);
+	if (instances != 1)
+		DrawIDFormat::setDivisor(instances);
+
+	// Per-draw data lives at storage binding 0, materials at 1, so every
+	// draw finds its own material without a bind in between
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, DrawDataBuffer);
+	if (Textures)
+		Textures->bind(0, 1);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+
+	if (countBuffer != 0) {
+		// Let the GPU supply the draw count, capped at the batch size
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, countBuffer);
+		glMultiDrawElementsIndirectCountARB(
+			GL_TRIANGLES,                           // mode
+			GL_UNSIGNED_INT,                        // index type
+			(void*) 0,                              // command buffer offset
+			0,                                      // count buffer offset
+			static_cast<GLsizei>(Commands.size()), // max draw count
+			0                                       // tightly packed commands
+		);
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+	} else {
+		// Draw every object in the batch at once
+		glMultiDrawElementsIndirect(
+			GL_TRIANGLES,                           // mode
+			GL_UNSIGNED_INT,                        // index type
+			(void*) 0,                              // command buffer offset
+			static_cast<GLsizei>(Commands.size()), // draw count
+			0                                       // tightly packed commands
+		);
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	if (instances != 1)
+		DrawIDFormat::setDivisor(1);
+	glBindVertexArray(previousVAO);
+	if (Textures)
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+/** Command buffer holding every draw in the batch **/
+GLuint Batch::getCommandBuffer() const {
+	return CommandBuffer;
+}
+
+/** Storage buffer holding a world space sphere per draw **/
+GLuint Batch::getBoundsBuffer() const {
+	return BoundsBuffer;
+}
+
+/** Number of draws recorded in the batch **/
+GLsizei Batch::getDrawCount() const {
+	return static_cast<GLsizei>(Commands.size());
+}
+
+/** Sets a draw's model matrix and world space bounds **/
+void Batch::place(GLuint draw, const glm::mat4& model) {
+	const Mesh& mesh = Meshes[DrawMeshes[draw]];
+
+	// The model matrix also restores the quantized positions
+	Draws[draw].Model = model * mesh.Dequantize;
+
+	// Move the bounding sphere into world space, scaled by the largest axis
+	const glm::vec4& sphere = mesh.Sphere;
+	glm::vec4 center = model * glm::vec4(sphere.x, sphere.y, sphere.z, 1.0f);
+	float scale = glm::max(glm::length(model[0]),
+		glm::max(glm::length(model[1]), glm::length(model[2])));
+	Bounds[draw] = glm::vec4(center.x, center.y, center.z, sphere.w * scale);
+}
+
+/** Releases the OpenGL objects owned by the batch **/
+void Batch::release() {
+	if (VertexArrayID != 0) {
+		GLuint buffers[] = {
+			VertexBuffer, IndexBuffer, DrawIDBuffer,
+			CommandBuffer, DrawDataBuffer, BoundsBuffer
+		};
+		glDeleteBuffers(6, buffers);
+		MemoryTracker::release(MemoryTracker::BUFFER, 6, buffers);
+		MemoryTracker::release(MemoryTracker::CLIENT,
+			reinterpret_cast<size_t>(this));
+		glDeleteVertexArrays(1, &VertexArrayID);
+		VertexArrayID = 0;
+	}
+
+	if (ViewCommandBuffer != 0) {
+		glDeleteBuffers(1, &ViewCommandBuffer);
+		MemoryTracker::release(MemoryTracker::BUFFER, 1, &ViewCommandBuffer);
+		ViewCommandBuffer = 0;
+	}
+
+	if (ProgramID != 0) {
+		Shaders::deleteProgram(ProgramID);
+		ProgramID = 0;
+	}
+
+	if (ViewProgramID != 0) {
+		Shaders::deleteProgram(ViewProgramID);
+		ViewProgramID = 0;
+	}
+
+	if (DepthProgramID != 0) {
+		Shaders::deleteProgram(DepthProgramID);
+		DepthProgramID = 0;
+	}
+
+	Built = false;
+}
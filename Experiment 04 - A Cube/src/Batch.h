@@ -0,0 +1,149 @@
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+/*=================================                                       ----*\
+ * BATCH CLASS                                                                *
+ * - This class merges static meshes into shared vertex and index buffers and *
+ *   submits every object in the batch with a single multi-draw indirect call *
+ *   instead of one draw call per object.                                     *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+#include "Log.h"
+#include "Shaders.h"
+#include "VertexPacker.h"
+#include "Materials.h"
+#include "MultiView.h"
+#include "Shadows.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+class Batch {
+	public:
+		/** Layout of one GL_DRAW_INDIRECT_BUFFER entry **/
+		struct DrawCommand {
+			GLuint Count;         // Index count
+			GLuint InstanceCount; // Zero skips the draw
+			GLuint FirstIndex;    // Offset into the shared index buffer
+			GLint  BaseVertex;    // Offset into the shared vertex buffers
+			GLuint BaseInstance;  // Doubles as the draw ID
+		};
+
+		/** Per-draw data, laid out to match std430 in Batch.vshader **/
+		struct DrawData {
+			glm::mat4 Model;
+			GLuint    Material;
+			GLuint    Padding[3];
+		};
+
+		Batch();
+		~Batch();
+
+		/** Checks whether the context can run the batching path **/
+		static bool isSupported();
+
+		/** Adds mesh data to the shared buffers and returns the mesh ID **/
+		GLuint addMesh(const GLfloat* positions, const GLfloat* colors,
+			GLsizei vertexCount, const GLuint* indices, GLsizei indexCount);
+
+		/** Places a static instance of a mesh and returns the draw ID **/
+		GLuint addDraw(GLuint mesh, const glm::mat4& model,
+			GLuint material = 0);
+
+		/** Textures the draws with materials, which must outlive the batch.
+		    Without them draws only use their vertex colors **/
+		void setMaterials(const Materials* materials);
+
+		/** Draws the batch across views as well, which must outlive the
+		    batch. Call before build() **/
+		void setViews(const MultiView* views);
+
+		/** Darkens the draws where shadow maps, which must outlive the batch,
+		    say the light is blocked. Call before build() **/
+		void setShadows(const Shadows* shadows);
+
+		/** Uploads the merged buffers and draw commands to OpenGL **/
+		bool build();
+
+		/** Moves a draw, the change reaches OpenGL with the next upload() **/
+		void setModel(GLuint draw, const glm::mat4& model);
+
+		/** Sends the draws moved since the last upload to OpenGL **/
+		void upload();
+
+		/** Submits the whole batch **/
+		void draw(const glm::mat4& viewProjection);
+
+		/** Submits the batch from another command buffer, such as one filled
+		    by GPU culling. A non-zero count buffer supplies the draw count **/
+		void draw(const glm::mat4& viewProjection, GLuint commandBuffer,
+			GLuint countBuffer);
+
+		/** Submits the whole batch once for every view, between the views'
+		    begin() and end() **/
+		void drawViews();
+
+		/** Submits the whole batch writing depth only, as a shadow caster **/
+		void drawDepth(const glm::mat4& viewProjection);
+
+		/** Buffers shared with GPU-side processing **/
+		GLuint getCommandBuffer() const;
+		GLuint getBoundsBuffer() const;
+
+		/** Number of draws recorded in the batch **/
+		GLsizei getDrawCount() const;
+	protected:
+	private:
+		/** Location of a mesh inside the shared buffers **/
+		struct Mesh {
+			GLuint    Count;
+			GLuint    FirstIndex;
+			GLint     BaseVertex;
+			glm::vec4 Sphere;     // Model space center and radius
+			glm::mat4 Dequantize; // Restores the 16 bit positions
+		};
+
+		/** Per-instance attribute feeding vertexDrawID in Batch.vshader **/
+		struct DrawID {
+			GLuint Index;
+		};
+
+		typedef VertexFormat<DrawID,
+			VERTEX_ATTRIBUTE(DrawID, Index, 2, 1, GL_UNSIGNED_INT, INTEGER)
+		> DrawIDFormat;
+
+		/** Internal variables for batch processing **/
+		GLuint VertexArrayID, ProgramID, VPUniformID;
+		const Materials* Textures;
+		const MultiView* Views;
+		GLuint ViewProgramID, ViewCommandBuffer; // Instanced per view
+		const Shadows* Sun;
+		GLuint DepthProgramID, DepthVPUniformID; // Shadow casting
+		GLuint VertexBuffer, IndexBuffer, DrawIDBuffer;
+		GLuint CommandBuffer, DrawDataBuffer, BoundsBuffer;
+		std::vector<QuantizedVertex> Vertices;
+		std::vector<GLuint>          Indices;
+		std::vector<Mesh>            Meshes;
+		std::vector<DrawCommand>     Commands;
+		std::vector<DrawData>        Draws;
+		std::vector<glm::vec4>       Bounds; // World space spheres per draw
+		std::vector<GLuint>          DrawMeshes;
+		GLuint ChangedBegin, ChangedEnd;  // Draws waiting to be uploaded
+		bool Built;
+
+		/** Prevent copying, the batch owns OpenGL objects **/
+		Batch(const Batch& source);            // No copying
+		Batch& operator=(const Batch& source); // No assignment
+
+		/** Internal functions used for placing draws and cleanup **/
+		void place(GLuint draw, const glm::mat4& model);
+		void submit(GLuint commandBuffer, GLuint countBuffer,
+			GLuint instances);
+		void release();
+};
+
+#endif // BATCH_H_INCLUDED
@@ -0,0 +1,600 @@
+/*=================================                                       ----*\
+ * BENCHMARK TOOL                                                             *
+ * - This program runs fixed scenarios taken from the experiments, from an    *
+ *   empty window up to thousands of cubes, each for the same number of       *
+ *   frames into an offscreen framebuffer. It prints CPU and GPU frame time   *
+ *   percentiles, draw calls, state changes, uploads and memory per scenario, *
+ *   writes them as JSON, and compares them against a stored baseline with a  *
+ *   tolerance per metric, failing when any of them regressed.                *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "Log.h"
+#include "Shaders.h"
+#include "MemoryTracker.h"
+#include "Random.h"
+#include "Tools.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+/** Count this file's OpenGL calls in the recorder **/
+#define GLRECORDER_HOOKS
+#include "GLRecorder.h"
+
+/** Size of the offscreen framebuffer every scenario draws into **/
+static const GLsizei targetWidth  = 640;
+static const GLsizei targetHeight = 480;
+
+/** Frames drawn before measuring, so the driver has settled **/
+static const int warmupFrames = 10;
+
+/** What a scenario draws every frame **/
+enum Workload {
+	EMPTY,    // Clearing only, as in Experiment 01
+	TRIANGLE, // One triangle, as in Experiment 02
+	CUBES,    // Cubes with a matrix each, as in Experiments 03 and 04
+	CHURN     // Cubes whose colors are uploaded again every frame, as the
+	          // render test in Experiment 04 first did
+};
+
+/** A fixed workload **/
+struct Scenario {
+	const char* Name;
+	Workload    Work;
+	int         Count; // Objects drawn
+};
+
+/** Every scenario, run in this order **/
+static const Scenario scenarios[] = {
+	{ "empty",           EMPTY,    0     },
+	{ "triangle",        TRIANGLE, 1     },
+	{ "cube",            CUBES,    1     },
+	{ "color-churn",     CHURN,    1     },
+	{ "cubes-100",       CUBES,    100   },
+	{ "cubes-1000",      CUBES,    1000  },
+	{ "cubes-10000",     CUBES,    10000 },
+	{ "color-churn-100", CHURN,    100   }
+};
+
+/** What is measured, in the order it's written **/
+enum Metric {
+	CPU_MEAN, CPU_P50, CPU_P90, CPU_P99, CPU_MAX,
+	GPU_MEAN, GPU_P50, GPU_P90, GPU_P99, GPU_MAX,
+	DRAW_CALLS, STATE_CHANGES, UPLOADS, MEMORY,
+	METRIC_COUNT
+};
+
+/** Names of the metrics in the JSON **/
+static const char* const metricNames[METRIC_COUNT] = {
+	"cpu_mean_ms", "cpu_p50_ms", "cpu_p90_ms", "cpu_p99_ms", "cpu_max_ms",
+	"gpu_mean_ms", "gpu_p50_ms", "gpu_p90_ms", "gpu_p99_ms", "gpu_max_ms",
+	"draw_calls", "state_changes", "uploads", "memory_bytes"
+};
+
+/** How far a metric may rise over the baseline before it counts as a
+    regression, a fraction of the baseline plus some slack in its own
+    units. Timings get room for noise, counted calls get none **/
+struct Tolerance {
+	Metric Measure;
+	double Fraction;
+	double Slack;
+};
+
+static const Tolerance tolerances[] = {
+	{ CPU_P50,       0.10, 0.02 },
+	{ CPU_P99,       0.25, 0.10 },
+	{ GPU_P50,       0.10, 0.02 },
+	{ GPU_P99,       0.25, 0.10 },
+	{ DRAW_CALLS,    0.00, 0.00 },
+	{ STATE_CHANGES, 0.00, 0.00 },
+	{ UPLOADS,       0.00, 0.00 },
+	{ MEMORY,        0.05, 0.00 }
+};
+
+/** Calls that change state rather than draw or upload **/
+static const GLRecorder::Command stateCommands[] = {
+	GLRecorder::USE_PROGRAM, GLRecorder::UNIFORM_MATRIX4,
+	GLRecorder::UNIFORM_UINT, GLRecorder::BIND_BUFFER,
+	GLRecorder::BIND_VERTEX_ARRAY, GLRecorder::ENABLE_ATTRIBUTE,
+	GLRecorder::DISABLE_ATTRIBUTE, GLRecorder::ATTRIBUTE_POINTER,
+	GLRecorder::CLEAR_COLOR, GLRecorder::ENABLE, GLRecorder::DEPTH_FUNC,
+	GLRecorder::VIEWPORT
+};
+
+/** A scenario's measurements **/
+struct Result {
+	const char* Name;
+	double      Values[METRIC_COUNT];
+};
+
+/** Baseline measurements by scenario, then by metric name **/
+typedef std::map<std::string, std::map<std::string, double> > Baseline;
+
+/** The cube of Experiment 04, 12 triangles **/
+static const GLfloat cubeVertices[] = {
+	-1.0f, -1.0f, -1.0f,  -1.0f, -1.0f,  1.0f,  -1.0f,  1.0f,  1.0f,
+	 1.0f,  1.0f, -1.0f,  -1.0f, -1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,
+	 1.0f, -1.0f,  1.0f,  -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,
+	 1.0f,  1.0f, -1.0f,   1.0f, -1.0f, -1.0f,  -1.0f, -1.0f, -1.0f,
+	-1.0f, -1.0f, -1.0f,  -1.0f,  1.0f,  1.0f,  -1.0f,  1.0f, -1.0f,
+	 1.0f, -1.0f,  1.0f,  -1.0f, -1.0f,  1.0f,  -1.0f, -1.0f, -1.0f,
+	-1.0f,  1.0f,  1.0f,  -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,
+	 1.0f,  1.0f,  1.0f,   1.0f, -1.0f, -1.0f,   1.0f,  1.0f, -1.0f,
+	 1.0f, -1.0f, -1.0f,   1.0f,  1.0f,  1.0f,   1.0f, -1.0f,  1.0f,
+	 1.0f,  1.0f,  1.0f,   1.0f,  1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,
+	 1.0f,  1.0f,  1.0f,  -1.0f,  1.0f, -1.0f,  -1.0f,  1.0f,  1.0f,
+	 1.0f,  1.0f,  1.0f,  -1.0f,  1.0f,  1.0f,   1.0f, -1.0f,  1.0f
+};
+
+/** The triangle of Experiment 02 **/
+static const GLfloat triangleVertices[] = {
+	-1.0f, -1.0f, 0.0f,   1.0f, -1.0f, 0.0f,   0.0f,  1.0f, 0.0f
+};
+
+/** OpenGL objects and data a scenario draws with **/
+struct Scene {
+	GLuint  ProgramID, MVPUniformID;
+	GLuint  VertexArrayID, PositionBuffer, ColorBuffer;
+	GLsizei VertexCount;
+	std::vector<glm::mat4> MVPs;   // One per object
+	std::vector<GLfloat>   Colors; // One object's worth
+	Random  Picker;
+};
+
+/** Creates the offscreen context every scenario draws into, with the
+    renderer's starting state **/
+GLFWwindow* createContext() {
+	GLuint renderbuffers[2];
+	GLFWwindow* window = Tools::createContext("Benchmark", targetWidth,
+		targetHeight, renderbuffers);
+	if (!window)
+		return NULL;
+
+	MemoryTracker::initialize();
+	MemoryTracker::track(MemoryTracker::RENDERBUFFER, renderbuffers[0],
+		"Benchmark", MemoryTracker::getImageBytes(GL_RGBA8, targetWidth,
+			targetHeight, 1, 1));
+	MemoryTracker::track(MemoryTracker::RENDERBUFFER, renderbuffers[1],
+		"Benchmark", MemoryTracker::getImageBytes(GL_DEPTH24_STENCIL8,
+			targetWidth, targetHeight, 1, 1));
+
+	glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	return window;
+}
+
+/** Creates what a scenario draws with, false when it can't **/
+bool setUp(const Scenario& scenario, Scene& scene) {
+	scene.ProgramID     = 0;
+	scene.VertexArrayID = 0;
+	scene.VertexCount   = 0;
+	if (scenario.Work == EMPTY)
+		return true;
+
+	bool compiled = Shaders::loadShader("Transform.vshader",
+		GL_VERTEX_SHADER);
+	compiled = Shaders::loadShader("Color.fshader", GL_FRAGMENT_SHADER) &&
+		compiled;
+	scene.ProgramID    = Shaders::createProgram();
+	scene.MVPUniformID = glGetUniformLocation(scene.ProgramID, "MVP");
+	if (!compiled)
+		return false;
+
+	const GLfloat* positions = (scenario.Work == TRIANGLE ?
+		triangleVertices : cubeVertices);
+	scene.VertexCount = (scenario.Work == TRIANGLE ? 3 : 36);
+	GLsizeiptr bytes  = scene.VertexCount * 3 * sizeof(GLfloat);
+
+	// Colors start out random, churning replaces them every draw
+	scene.Picker.setSeed(1);
+	scene.Colors.resize(scene.VertexCount * 3);
+	scene.Picker.fillUnits(&scene.Colors[0], scene.Colors.size());
+
+	glGenVertexArrays(1, &scene.VertexArrayID);
+	glBindVertexArray(scene.VertexArrayID);
+
+	glGenBuffers(1, &scene.PositionBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, scene.PositionBuffer);
+	glBufferData(GL_ARRAY_BUFFER, bytes, positions, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	MemoryTracker::track(MemoryTracker::BUFFER, scene.PositionBuffer,
+		"Benchmark", bytes);
+
+	glGenBuffers(1, &scene.ColorBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, scene.ColorBuffer);
+	glBufferData(GL_ARRAY_BUFFER, bytes, &scene.Colors[0],
+		scenario.Work == CHURN ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	MemoryTracker::track(MemoryTracker::BUFFER, scene.ColorBuffer,
+		"Benchmark", bytes);
+
+	// The objects share the space one cube takes in Experiment 04, in a
+	// square grid, so the pixels drawn stay about the same as they scale
+	glm::mat4 vp = glm::perspective(45.0f,
+		static_cast<float>(targetWidth) / targetHeight, 0.1f, 100.0f) *
+		glm::lookAt(glm::vec3(4, 3, -3), glm::vec3(0, 0, 0),
+			glm::vec3(0, 1, 0));
+
+	int   side = static_cast<int>(std::ceil(std::sqrt(
+		static_cast<double>(scenario.Count))));
+	float size = 1.0f / side;
+	scene.MVPs.resize(scenario.Count);
+	for (int o = 0; o < scenario.Count; o++) {
+		glm::vec3 place(size * (2 * (o % side) + 1) - 1.0f, 0.0f,
+			size * (2 * (o / side) + 1) - 1.0f);
+		scene.MVPs[o] = vp * glm::translate(glm::mat4(1.0f), place) *
+			glm::scale(glm::mat4(1.0f), glm::vec3(size, size, size));
+	}
+
+	return true;
+}
+
+/** Draws one frame of a scenario **/
+void drawFrame(const Scenario& scenario, Scene& scene) {
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if (scenario.Work == EMPTY)
+		return;
+
+	glUseProgram(scene.ProgramID);
+	glBindVertexArray(scene.VertexArrayID);
+	if (scenario.Work == CHURN)
+		glBindBuffer(GL_ARRAY_BUFFER, scene.ColorBuffer);
+
+	GLsizeiptr bytes = scene.Colors.size() * sizeof(GLfloat);
+	for (size_t o = 0; o < scene.MVPs.size(); o++) {
+		if (scenario.Work == CHURN) {
+			scene.Picker.fillUnits(&scene.Colors[0], scene.Colors.size());
+			glBufferData(GL_ARRAY_BUFFER, bytes, &scene.Colors[0],
+				GL_STREAM_DRAW);
+		}
+
+		glUniformMatrix4fv(scene.MVPUniformID, 1, GL_FALSE,
+			&scene.MVPs[o][0][0]);
+		glDrawArrays(GL_TRIANGLES, 0, scene.VertexCount);
+	}
+}
+
+/** Deletes what a scenario drew with **/
+void tearDown(Scene& scene) {
+	if (scene.ProgramID != 0)
+		Shaders::deleteProgram(scene.ProgramID);
+
+	if (scene.VertexArrayID != 0) {
+		GLuint buffers[2] = { scene.PositionBuffer, scene.ColorBuffer };
+		glDeleteBuffers(2, buffers);
+		MemoryTracker::release(MemoryTracker::BUFFER, 2, buffers);
+		glDeleteVertexArrays(1, &scene.VertexArrayID);
+	}
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+/** Mean, middle and tail of some frame times **/
+void summarize(std::vector<double>& times, double* values) {
+	std::sort(times.begin(), times.end());
+
+	double sum = 0.0;
+	for (size_t t = 0; t < times.size(); t++)
+		sum += times[t];
+
+	size_t last = times.size() - 1;
+	values[0] = sum / times.size();
+	values[1] = times[last * 50 / 100];
+	values[2] = times[last * 90 / 100];
+	values[3] = times[last * 99 / 100];
+	values[4] = times[last];
+}
+
+/** Runs a scenario for a number of frames and measures it **/
+bool run(const Scenario& scenario, int frames, Result& result) {
+	result.Name = scenario.Name;
+
+	Scene scene;
+	if (!setUp(scenario, scene)) {
+		tearDown(scene);
+		return false;
+	}
+
+	for (int f = 0; f < warmupFrames; f++)
+		drawFrame(scenario, scene);
+	glFinish();
+
+	// One timer per frame, read back once everything is submitted so
+	// waiting on results never stalls the frames. A flush stands in for
+	// the swap.
+	std::vector<GLuint> queries(frames);
+	glGenQueries(frames, &queries[0]);
+	std::vector<double> cpuTimes(frames), gpuTimes(frames);
+
+	GLRecorder::resetCounts();
+	for (int f = 0; f < frames; f++) {
+		double begin = glfwGetTime();
+		glBeginQuery(GL_TIME_ELAPSED, queries[f]);
+		drawFrame(scenario, scene);
+		glEndQuery(GL_TIME_ELAPSED);
+		glFlush();
+		cpuTimes[f] = (glfwGetTime() - begin) * 1000.0;
+	}
+	glFinish();
+
+	// Calls per frame, before reading back adds any
+	double draws = 0.0, states = 0.0;
+	draws = static_cast<double>(GLRecorder::getCount(GLRecorder::DRAW_ARRAYS));
+	const int stateCount = sizeof(stateCommands) / sizeof(stateCommands[0]);
+	for (int c = 0; c < stateCount; c++)
+		states += static_cast<double>(GLRecorder::getCount(stateCommands[c]));
+	result.Values[DRAW_CALLS]    = draws / frames;
+	result.Values[STATE_CHANGES] = states / frames;
+	result.Values[UPLOADS]       = static_cast<double>(
+		GLRecorder::getCount(GLRecorder::BUFFER_DATA)) / frames;
+	result.Values[MEMORY]        = static_cast<double>(
+		MemoryTracker::getDeviceCurrent());
+
+	for (int f = 0; f < frames; f++) {
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(queries[f], GL_QUERY_RESULT, &elapsed);
+		gpuTimes[f] = elapsed / 1000000.0;
+	}
+	glDeleteQueries(frames, &queries[0]);
+
+	summarize(cpuTimes, result.Values + CPU_MEAN);
+	summarize(gpuTimes, result.Values + GPU_MEAN);
+
+	tearDown(scene);
+	return true;
+}
+
+/** Writes the results as JSON, one flat object per scenario **/
+bool writeResults(const char* path, const std::vector<Result>& results,
+	int frames)
+{
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "Failed to write %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "{\n\t\"version\": 1,\n\t\"renderer\": ");
+	Tools::writeString(file, reinterpret_cast<const char*>(
+		glGetString(GL_RENDERER)));
+	fprintf(file, ",\n\t\"frames\": %d,\n\t\"scenarios\": [\n", frames);
+
+	for (size_t r = 0; r < results.size(); r++) {
+		fprintf(file, "\t\t{\n\t\t\t\"name\": ");
+		Tools::writeString(file, results[r].Name);
+		for (int m = 0; m < METRIC_COUNT; m++)
+			fprintf(file, ",\n\t\t\t\"%s\": %.10g", metricNames[m],
+				results[r].Values[m]);
+		fprintf(file, "\n\t\t}%s\n", r + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+	return true;
+}
+
+/** Reads the scenarios back out of a file writeResults() wrote. Only that
+    flat layout is understood, not JSON in general **/
+bool readBaseline(const char* path, Baseline& baseline,
+	std::string& renderer)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "Failed to open baseline %s\n", path);
+		return false;
+	}
+
+	std::string text;
+	char        chunk[4096];
+	size_t      read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		text.append(chunk, read);
+	fclose(file);
+
+	// Every string value is read the same way, escapes dropped
+	struct Strings {
+		static size_t read(const std::string& text, size_t quote,
+			std::string& value)
+		{
+			value.clear();
+			size_t at = quote + 1;
+			for (; at < text.size() && text[at] != '"'; at++) {
+				if (text[at] == '\\')
+					at++;
+				if (at < text.size())
+					value += text[at];
+			}
+			return at + 1;
+		}
+	};
+
+	size_t at = text.find("\"renderer\"");
+	if (at != std::string::npos)
+		Strings::read(text, text.find('"', text.find(':', at)), renderer);
+
+	at = text.find("\"scenarios\"");
+	if (at == std::string::npos) {
+		fprintf(stderr, "%s has no scenarios\n", path);
+		return false;
+	}
+
+	for (;;) {
+		size_t open  = text.find('{', at);
+		size_t close = text.find('}', open);
+		if (open == std::string::npos || close == std::string::npos)
+			break;
+
+		std::string name;
+		std::map<std::string, double> values;
+		size_t key = text.find('"', open);
+		while (key < close) {
+			std::string field;
+			size_t colon = Strings::read(text, key, field);
+			size_t value = text.find_first_not_of(" \t\r\n:", colon);
+			if (value >= close)
+				break;
+
+			if (text[value] == '"') {
+				std::string content;
+				key = Strings::read(text, value, content);
+				if (field == "name")
+					name = content;
+			} else {
+				char* end = NULL;
+				values[field] = strtod(text.c_str() + value, &end);
+				key = end - text.c_str();
+			}
+			key = text.find('"', key);
+		}
+
+		if (!name.empty())
+			baseline[name] = values;
+		at = close + 1;
+	}
+
+	return true;
+}
+
+/** Prints every metric that rose past its tolerance over the baseline,
+    and returns how many did **/
+int compare(const std::vector<Result>& results, const Baseline& baseline) {
+	int regressions = 0;
+	const int toleranceCount = sizeof(tolerances) / sizeof(tolerances[0]);
+
+	fprintf(stdout, "\n%-16s %-14s %12s %12s %9s\n", "Scenario", "Metric",
+		"Baseline", "Now", "Change");
+	for (size_t r = 0; r < results.size(); r++) {
+		Baseline::const_iterator found = baseline.find(results[r].Name);
+		if (found == baseline.end()) {
+			fprintf(stdout, "%-16s not in the baseline\n", results[r].Name);
+			continue;
+		}
+
+		for (int t = 0; t < toleranceCount; t++) {
+			const char* name = metricNames[tolerances[t].Measure];
+			std::map<std::string, double>::const_iterator stored =
+				found->second.find(name);
+			if (stored == found->second.end())
+				continue;
+
+			double before = stored->second;
+			double now    = results[r].Values[tolerances[t].Measure];
+			double limit  = before * (1.0 + tolerances[t].Fraction) +
+				tolerances[t].Slack;
+			if (now <= limit)
+				continue;
+
+			fprintf(stdout, "%-16s %-14s %12.4g %12.4g %+8.1f%%\n",
+				results[r].Name, name, before, now,
+				before > 0.0 ? 100.0 * (now - before) / before : 100.0);
+			regressions++;
+		}
+	}
+
+	if (regressions == 0)
+		fprintf(stdout, "No regressions against the baseline\n");
+	else
+		fprintf(stdout, "%d regressions against the baseline\n", regressions);
+	return regressions;
+}
+
+int main(int argc, char* argv[]) {
+	int         frames       = 300;
+	const char* jsonPath     = NULL;
+	const char* baselinePath = NULL;
+	const char* only         = NULL;
+
+	// Read the command line
+	for (int a = 1; a < argc; a++) {
+		if (strncmp(argv[a], "--frames=", 9) == 0)
+			frames = atoi(argv[a] + 9);
+		else if (strncmp(argv[a], "--json=", 7) == 0)
+			jsonPath = argv[a] + 7;
+		else if (strncmp(argv[a], "--baseline=", 11) == 0)
+			baselinePath = argv[a] + 11;
+		else if (strncmp(argv[a], "--scenario=", 11) == 0)
+			only = argv[a] + 11;
+		else {
+			fprintf(stderr, "Usage: Benchmark [--frames=N] [--json=out.json] "
+				"[--baseline=baseline.json] [--scenario=name]\n");
+			return -1;
+		}
+	}
+
+	if (frames <= 0) {
+		fprintf(stderr, "Scenarios need at least one frame\n");
+		return -1;
+	}
+
+	// Only problems are worth printing between the tables
+	Log::start();
+	Log::setLevel(Log::LEVEL_WARNING);
+
+	// Read the baseline first, so a bad path fails before the long part
+	Baseline    baseline;
+	std::string baselineRenderer;
+	if (baselinePath &&
+		!readBaseline(baselinePath, baseline, baselineRenderer))
+		return -1;
+
+	if (!createContext())
+		return -1;
+
+	const char* renderer = reinterpret_cast<const char*>(
+		glGetString(GL_RENDERER));
+	fprintf(stdout, "%d frames per scenario on %s\n", frames, renderer);
+	fprintf(stdout, "%-16s %9s %9s %9s %9s %8s %8s %8s %10s\n", "Scenario",
+		"CPU 50%", "CPU 99%", "GPU 50%", "GPU 99%", "Draws", "States",
+		"Uploads", "Memory KB");
+
+	std::vector<Result> results;
+	const int scenarioCount = sizeof(scenarios) / sizeof(scenarios[0]);
+	for (int s = 0; s < scenarioCount; s++) {
+		if (only && strcmp(only, scenarios[s].Name) != 0)
+			continue;
+
+		Result result;
+		bool   ran = run(scenarios[s], frames, result);
+		Log::flush();
+		if (!ran) {
+			fprintf(stderr, "Failed to set up %s\n", scenarios[s].Name);
+			return -1;
+		}
+
+		fprintf(stdout, "%-16s %9.3f %9.3f %9.3f %9.3f %8.0f %8.0f %8.0f "
+			"%10.1f\n", result.Name, result.Values[CPU_P50],
+			result.Values[CPU_P99], result.Values[GPU_P50],
+			result.Values[GPU_P99], result.Values[DRAW_CALLS],
+			result.Values[STATE_CHANGES], result.Values[UPLOADS],
+			result.Values[MEMORY] / 1024.0);
+		results.push_back(result);
+	}
+
+	if (jsonPath && !writeResults(jsonPath, results, frames))
+		return -1;
+
+	int regressions = 0;
+	if (baselinePath) {
+		if (baselineRenderer != renderer)
+			fprintf(stdout, "The baseline ran on %s, timings may not "
+				"compare\n", baselineRenderer.c_str());
+		regressions = compare(results, baseline);
+	}
+
+	Log::stop();
+	glfwTerminate();
+	return (regressions > 0 ? 1 : 0);
+}
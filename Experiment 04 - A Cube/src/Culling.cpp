@@ -0,0 +1,323 @@
+/*=================================                                       ----*\
+ * CULLING CLASS                                                              *
+ * - This class culls the draws of a batch on the GPU in two phases. Draws    *
+ *   that were visible last frame are tested against the view frustum and     *
+ *   drawn first, and their depth is reduced into a pyramid (Hi-Z). Every     *
+ *   other draw is then tested against that pyramid and drawn when it shows,  *
+ *   so nothing that comes into view waits a frame. Survivors are compacted   *
+ *   into an indirect draw buffer that is consumed without reading anything   *
+ *   back to the CPU.                                                         *
+\*----                                       =================================*/
+
+#include "Culling.h"
+
+/** Culling constructor, OpenGL objects are created in build() **/
+Culling::Culling() {
+	Target           = NULL;
+	CullProgramID    = 0;
+	HiZProgramID     = 0;
+	OutputBuffer     = 0;
+	CountBuffer      = 0;
+	VisibilityBuffer = 0;
+	DepthFramebuffer = 0;
+	DepthTexture     = 0;
+	HiZTexture       = 0;
+	HiZWidth         = 0;
+	HiZHeight        = 0;
+	HiZLevels        = 0;
+	UseCountBuffer   = false;
+}
+
+/** Culling destructor **/
+Culling::~Culling() {
+	release();
+}
+
+/** Checks whether the context can run compute culling **/
+bool Culling::isSupported() {
+	// Compute shaders, storage buffers and image stores are all core 4.3,
+	// which Mesa's software renderer also provides
+	return GLEW_VERSION_4_3 && Batch::isSupported();
+}
+
+/** Creates the culling buffers and depth pyramid for a batch **/
+bool Culling::build(Batch* batch, GLsizei hiZWidth, GLsizei hiZHeight) {
+	if (!isSupported()) {
+		LOG_ERROR(RENDER, "Compute culling is not supported");
+		return false;
+	}
+
+	Target = batch;
+
+	// Load the culling and pyramid shaders through the usual factory
+	if (!Shaders::loadShader("Cull.cshader", GL_COMPUTE_SHADER))
+		LOG_ERROR(RENDER, "Failed to compile the culling shader");
+	CullProgramID = Shaders::createProgram();
+
+	if (!Shaders::loadShader("HiZ.cshader", GL_COMPUTE_SHADER))
+		LOG_ERROR(RENDER, "Failed to compile the depth pyramid shader");
+	HiZProgramID = Shaders::createProgram();
+
+	// Get handles for our uniforms
+	VPUniformID          = glGetUniformLocation(CullProgramID, "VP");
+	FrustumUniformID     = glGetUniformLocation(CullProgramID, "frustum");
+	TotalUniformID       = glGetUniformLocation(CullProgramID, "totalDraws");
+	LateUniformID        = glGetUniformLocation(CullProgramID, "late");
+	HiZSizeUniformID     = glGetUniformLocation(CullProgramID, "hiZSize");
+	HiZLevelsUniformID   = glGetUniformLocation(CullProgramID, "hiZLevels");
+	HiZUniformID         = glGetUniformLocation(CullProgramID, "hiZ");
+	SourceUniformID      = glGetUniformLocation(HiZProgramID, "source");
+	SourceLevelUniformID = glGetUniformLocation(HiZProgramID, "sourceLevel");
+
+	// Compacted commands, one slot for every draw in the batch
+	GLsizeiptr commandSize =
+		batch->getDrawCount() * sizeof(Batch::DrawCommand);
+	glGenBuffers(1, &OutputBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, OutputBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, commandSize, NULL,
+		GL_DYNAMIC_COPY);
+
+	// Survivor count, doubling as the indirect draw count when supported
+	glGenBuffers(1, &CountBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, CountBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL,
+		GL_DYNAMIC_COPY);
+
+	// Every draw starts out visible, so the first frame draws all of them
+	// in the first phase
+	std::vector<GLuint> visible(batch->getDrawCount(), 1);
+	glGenBuffers(1, &VisibilityBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, VisibilityBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, visible.size() * sizeof(GLuint),
+		&visible[0], GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	MemoryTracker::track(MemoryTracker::BUFFER, OutputBuffer,
+		"Culled commands", commandSize);
+	MemoryTracker::track(MemoryTracker::BUFFER, CountBuffer,
+		"Culled commands", sizeof(GLuint));
+	MemoryTracker::track(MemoryTracker::BUFFER, VisibilityBuffer,
+		"Culled commands", visible.size() * sizeof(GLuint));
+	UseCountBuffer = GLEW_ARB_indirect_parameters;
+
+	// Round the pyramid up to powers of two so every level halves cleanly
+	HiZWidth  = 1;
+	HiZHeight = 1;
+	while (HiZWidth  < hiZWidth)  HiZWidth  *= 2;
+	while (HiZHeight < hiZHeight) HiZHeight *= 2;
+
+	HiZLevels = 1;
+	for (GLsizei size = glm::max(HiZWidth, HiZHeight); size > 1; size /= 2)
+		HiZLevels++;
+
+	// Depth target the survivors are rendered into each frame
+	glGenTextures(1, &DepthTexture);
+	glBindTexture(GL_TEXTURE_2D, DepthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, HiZWidth,
+		HiZHeight);
+	MemoryTracker::track(MemoryTracker::TEXTURE, DepthTexture, "HiZ depth",
+		MemoryTracker::getImageBytes(GL_DEPTH_COMPONENT32F, HiZWidth, HiZHeight,
+			1, 1));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// Depth pyramid, each level holding the farthest depth below it
+	glGenTextures(1, &HiZTexture);
+	glBindTexture(GL_TEXTURE_2D, HiZTexture);
+	glTexStorage2D(GL_TEXTURE_2D, HiZLevels, GL_R32F, HiZWidth, HiZHeight);
+	MemoryTracker::track(MemoryTracker::TEXTURE, HiZTexture, "HiZ pyramid",
+		MemoryTracker::getImageBytes(GL_R32F, HiZWidth, HiZHeight,
+			HiZLevels, 1));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+		GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint previousFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+	glGenFramebuffers(1, &DepthFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, DepthFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+		DepthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		LOG_ERROR(RENDER, "Failed to create the culling depth target");
+		release();
+		return false;
+	}
+
+	return true;
+}
+
+/** Culls the batch and draws the survivors **/
+void Culling::draw(const glm::mat4& viewProjection) {
+	if (!Target)
+		return;
+
+	GLuint countBuffer = (UseCountBuffer ? CountBuffer : 0);
+
+	// Draws visible last frame are likely still visible, so they go first
+	// with only the frustum test, and their depth becomes this frame's
+	// occluders
+	cull(viewProjection, false);
+	Target->draw(viewProjection, OutputBuffer, countBuffer);
+	buildHiZ(viewProjection);
+
+	// Everything else is tested against them, so draws coming into view
+	// show up the frame they do
+	cull(viewProjection, true);
+	Target->draw(viewProjection, OutputBuffer, countBuffer);
+}
+
+/** Runs the culling shader over every draw in the batch, picking those
+    visible last frame, or late, those that just came into view **/
+void Culling::cull(const glm::mat4& viewProjection, bool late) {
+	TRACE_GPU_SCOPE("Cull");
+
+	// Reset the survivor count. Without a count buffer every slot is drawn,
+	// so clear the commands too and leave unused slots with no instances
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, CountBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+		GL_UNSIGNED_INT, NULL);
+
+	if (!UseCountBuffer) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, OutputBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+			GL_UNSIGNED_INT, NULL);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Pull the frustum planes out of the view-projection matrix
+	glm::vec4 planes[6];
+	for (int p = 0; p < 6; p++) {
+		int   row  = p / 2;
+		float sign = (p % 2 == 0 ? 1.0f : -1.0f);
+
+		for (int c = 0; c < 4; c++)
+			planes[p][c] = viewProjection[c][3] + sign * viewProjection[c][row];
+
+		float length = glm::length(glm::vec3(planes[p].x, planes[p].y,
+			planes[p].z));
+		planes[p] = planes[p] / length;
+	}
+
+	GLuint totalDraws = static_cast<GLuint>(Target->getDrawCount());
+
+	// Use our culling shader
+	glUseProgram(CullProgramID);
+	glUniformMatrix4fv(VPUniformID, 1, GL_FALSE, &viewProjection[0][0]);
+	glUniform4fv(FrustumUniformID, 6, &planes[0][0]);
+	glUniform1ui(TotalUniformID, totalDraws);
+	glUniform1i(LateUniformID, late ? 1 : 0);
+	glUniform2f(HiZSizeUniformID, static_cast<float>(HiZWidth),
+		static_cast<float>(HiZHeight));
+	glUniform1i(HiZLevelsUniformID, HiZLevels);
+	glUniform1i(HiZUniformID, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, HiZTexture);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, Target->getBoundsBuffer());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, Target->getCommandBuffer());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, OutputBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, CountBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, VisibilityBuffer);
+
+	glDispatchCompute((totalDraws + 63) / 64, 1, 1);
+
+	// The draw reads the results as commands and parameters. Only the
+	// visibility the late phase leaves is read back as storage, by the
+	// next frame's first phase
+	glMemoryBarrier(late ? GL_COMMAND_BARRIER_BIT |
+		GL_SHADER_STORAGE_BARRIER_BIT : GL_COMMAND_BARRIER_BIT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/** Renders the survivors' depth and reduces it into the pyramid **/
+void Culling::buildHiZ(const glm::mat4& viewProjection) {
+	TRACE_GPU_SCOPE("Build HiZ");
+
+	GLint previousFramebuffer = 0;
+	GLint viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// Depth-only pass of the survivors at pyramid resolution
+	glBindFramebuffer(GL_FRAMEBUFFER, DepthFramebuffer);
+	glViewport(0, 0, HiZWidth, HiZHeight);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	GLuint countBuffer = (UseCountBuffer ? CountBuffer : 0);
+	Target->draw(viewProjection, OutputBuffer, countBuffer);
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	// Use our pyramid shader
+	glUseProgram(HiZProgramID);
+	glUniform1i(SourceUniformID, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	for (GLint level = 0; level < HiZLevels; level++) {
+		GLsizei width  = glm::max(HiZWidth  >> level, 1);
+		GLsizei height = glm::max(HiZHeight >> level, 1);
+
+		// Level 0 copies the depth target, the rest reduce the level above
+		if (level == 0) {
+			glBindTexture(GL_TEXTURE_2D, DepthTexture);
+			glUniform1i(SourceLevelUniformID, -1);
+		} else {
+			glBindTexture(GL_TEXTURE_2D, HiZTexture);
+			glUniform1i(SourceLevelUniformID, level - 1);
+		}
+
+		glBindImageTexture(0, HiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY,
+			GL_R32F);
+		glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/** Releases the OpenGL objects owned by the culler **/
+void Culling::release() {
+	if (OutputBuffer != 0) {
+		GLuint buffers[] = { OutputBuffer, CountBuffer, VisibilityBuffer };
+		glDeleteBuffers(3, buffers);
+		MemoryTracker::release(MemoryTracker::BUFFER, 3, buffers);
+		OutputBuffer     = 0;
+		CountBuffer      = 0;
+		VisibilityBuffer = 0;
+	}
+
+	if (DepthFramebuffer != 0) {
+		glDeleteFramebuffers(1, &DepthFramebuffer);
+		DepthFramebuffer = 0;
+	}
+
+	if (DepthTexture != 0) {
+		GLuint textures[] = { DepthTexture, HiZTexture };
+		glDeleteTextures(2, textures);
+		MemoryTracker::release(MemoryTracker::TEXTURE, 2, textures);
+		DepthTexture = 0;
+		HiZTexture   = 0;
+	}
+
+	if (CullProgramID != 0) {
+		Shaders::deleteProgram(CullProgramID);
+		Shaders::deleteProgram(HiZProgramID);
+		CullProgramID = 0;
+		HiZProgramID  = 0;
+	}
+
+	Target = NULL;
+}
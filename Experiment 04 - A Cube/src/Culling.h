@@ -0,0 +1,66 @@
+#ifndef CULLING_H_INCLUDED
+#define CULLING_H_INCLUDED
+
+/*=================================                                       ----*\
+ * CULLING CLASS                                                              *
+ * - This class culls the draws of a batch on the GPU in two phases. Draws    *
+ *   that were visible last frame are tested against the view frustum and     *
+ *   drawn first, and their depth is reduced into a pyramid (Hi-Z). Every     *
+ *   other draw is then tested against that pyramid and drawn when it shows,  *
+ *   so nothing that comes into view waits a frame. Survivors are compacted   *
+ *   into an indirect draw buffer that is consumed without reading anything   *
+ *   back to the CPU.                                                         *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "Log.h"
+#include "Batch.h"
+#include "Shaders.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+class Culling {
+	public:
+		Culling();
+		~Culling();
+
+		/** Checks whether the context can run compute culling **/
+		static bool isSupported();
+
+		/** Creates the culling buffers and depth pyramid for a batch **/
+		bool build(Batch* batch, GLsizei hiZWidth, GLsizei hiZHeight);
+
+		/** Culls the batch and draws the survivors, those visible last
+		    frame first and then those the first ones leave uncovered **/
+		void draw(const glm::mat4& viewProjection);
+	protected:
+	private:
+		/** Internal variables for culling **/
+		Batch*  Target;
+		GLuint  CullProgramID, HiZProgramID;
+		GLuint  OutputBuffer, CountBuffer;
+		GLuint  VisibilityBuffer; // Whether each draw showed last frame
+		GLuint  DepthFramebuffer, DepthTexture, HiZTexture;
+		GLsizei HiZWidth, HiZHeight;
+		GLint   HiZLevels;
+		bool    UseCountBuffer;
+
+		/** Uniform locations **/
+		GLint VPUniformID, FrustumUniformID, TotalUniformID, LateUniformID;
+		GLint HiZSizeUniformID, HiZLevelsUniformID, HiZUniformID;
+		GLint SourceUniformID, SourceLevelUniformID;
+
+		/** Prevent copying, the culler owns OpenGL objects **/
+		Culling(const Culling& source);            // No copying
+		Culling& operator=(const Culling& source); // No assignment
+
+		/** Internal functions used for each culling stage **/
+		void cull(const glm::mat4& viewProjection, bool late);
+		void buildHiZ(const glm::mat4& viewProjection);
+		void release();
+};
+
+#endif // CULLING_H_INCLUDED
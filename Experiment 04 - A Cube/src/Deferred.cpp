@@ -0,0 +1,142 @@
+/*=================================                                       ----*\
+ * DEFERRED CLASS                                                             *
+ * - This class adds deferred shading to the render graph. The scene is drawn *
+ *   once into a G-buffer of color and depth, then a full screen pass lights  *
+ *   each pixel with only the lights a light grid binned into its tile.       *
+\*----                                       =================================*/
+
+#include "Deferred.h"
+
+/** Deferred constructor, OpenGL objects are created in build() **/
+Deferred::Deferred() {
+	Lights       = NULL;
+	ProgramID    = 0;
+	Background   = glm::vec3(0.0f);
+	Ambient      = glm::vec3(0.3f);
+	InverseVP    = glm::mat4(1.0f);
+	RegionWidth  = 0;
+	RegionHeight = 0;
+	Albedo       = -1;
+	Depth        = -1;
+}
+
+/** Deferred destructor **/
+Deferred::~Deferred() {
+	if (ProgramID != 0)
+		Shaders::deleteProgram(ProgramID);
+}
+
+/** Loads the lighting pass for a light grid **/
+bool Deferred::build(LightGrid* lights) {
+	Lights = lights;
+
+	// Load the lighting shaders
+	bool compiled = Shaders::loadShader("Fullscreen.vshader", GL_VERTEX_SHADER);
+	compiled = Shaders::loadShader("Lighting.fshader", GL_FRAGMENT_SHADER) &&
+		compiled;
+	ProgramID = Shaders::createProgram();
+
+	if (!compiled) {
+		LOG_ERROR(RENDER, "Failed to compile Lighting.fshader");
+		return false;
+	}
+
+	// Get handles for our uniforms
+	AlbedoUniformID     = glGetUniformLocation(ProgramID, "albedo");
+	DepthUniformID      = glGetUniformLocation(ProgramID, "depth");
+	LightsUniformID     = glGetUniformLocation(ProgramID, "lights");
+	TilesUniformID      = glGetUniformLocation(ProgramID, "tiles");
+	IndicesUniformID    = glGetUniformLocation(ProgramID, "lightIndices");
+	InverseVPUniformID  = glGetUniformLocation(ProgramID, "inverseVP");
+	RegionUniformID     = glGetUniformLocation(ProgramID, "region");
+	TileSizeUniformID   = glGetUniformLocation(ProgramID, "tileSize");
+	TilesXUniformID     = glGetUniformLocation(ProgramID, "tilesX");
+	BackgroundUniformID = glGetUniformLocation(ProgramID, "background");
+	AmbientUniformID    = glGetUniformLocation(ProgramID, "ambient");
+	return true;
+}
+
+/** Sets the color of pixels the scene doesn't cover **/
+void Deferred::setBackground(const glm::vec3& color) {
+	Background = color;
+}
+
+/** Sets the light every surface receives regardless of the grid **/
+void Deferred::setAmbient(const glm::vec3& color) {
+	Ambient = color;
+}
+
+/** Sets the camera used to rebuild positions from depth **/
+void Deferred::setCamera(const glm::mat4& viewProjection) {
+	InverseVP = glm::inverse(viewProjection);
+}
+
+/** Adds the G-buffer and lighting passes **/
+void Deferred::addPasses(RenderGraph& graph, RenderGraph::Resource target,
+	GLsizei width, GLsizei height, GLsizei regionWidth, GLsizei regionHeight,
+	RenderGraph::Execute geometry, void* data)
+{
+	RegionWidth  = regionWidth;
+	RegionHeight = regionHeight;
+
+	// Normals are rebuilt from depth, so color and depth are all the
+	// lighting needs and the vertex formats stay as they are
+	RenderGraph::TextureDesc albedoDesc = { width, height, GL_RGBA8 };
+	RenderGraph::TextureDesc depthDesc  = {
+		width, height, GL_DEPTH_COMPONENT32F
+	};
+	Albedo = graph.createTexture("GBuffer Albedo", albedoDesc);
+	Depth  = graph.createTexture("GBuffer Depth", depthDesc);
+
+	RenderGraph::PassID pass = graph.addPass("GBuffer", geometry, data);
+	graph.write(pass, Albedo, true);
+	graph.write(pass, Depth, true);
+
+	// Every pixel in the region is lit, so the target needs no clear
+	pass = graph.addPass("Lighting", lightingPass, this);
+	graph.read(pass, Albedo);
+	graph.read(pass, Depth);
+	graph.write(pass, target, false);
+}
+
+/** Lights the G-buffer **/
+void Deferred::lightingPass(RenderGraph& graph, void* data) {
+	Deferred& deferred = *static_cast<Deferred*>(data);
+
+	// The workers have been binning since the frame started
+	deferred.Lights->end();
+
+	glViewport(0, 0, deferred.RegionWidth, deferred.RegionHeight);
+	glDisable(GL_DEPTH_TEST);
+
+	// Use our lighting shader
+	glUseProgram(deferred.ProgramID);
+	glUniform1i(deferred.AlbedoUniformID,  0);
+	glUniform1i(deferred.DepthUniformID,   1);
+	glUniform1i(deferred.LightsUniformID,  2);
+	glUniform1i(deferred.TilesUniformID,   3);
+	glUniform1i(deferred.IndicesUniformID, 4);
+	glUniformMatrix4fv(deferred.InverseVPUniformID, 1, GL_FALSE,
+		&deferred.InverseVP[0][0]);
+	glUniform2i(deferred.RegionUniformID, deferred.RegionWidth,
+		deferred.RegionHeight);
+	glUniform1i(deferred.TileSizeUniformID, LightGrid::TileSize);
+	glUniform1i(deferred.TilesXUniformID, deferred.Lights->getTilesX());
+	glUniform3fv(deferred.BackgroundUniformID, 1, &deferred.Background[0]);
+	glUniform3fv(deferred.AmbientUniformID, 1, &deferred.Ambient[0]);
+
+	deferred.Lights->bind(2, 3, 4);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, graph.getTexture(deferred.Depth));
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, graph.getTexture(deferred.Albedo));
+
+	// One triangle covering the screen, generated from the vertex ID
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glEnable(GL_DEPTH_TEST);
+}
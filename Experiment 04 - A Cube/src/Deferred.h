@@ -0,0 +1,67 @@
+#ifndef DEFERRED_H_INCLUDED
+#define DEFERRED_H_INCLUDED
+
+/*=================================                                       ----*\
+ * DEFERRED CLASS                                                             *
+ * - This class adds deferred shading to the render graph. The scene is drawn *
+ *   once into a G-buffer of color and depth, then a full screen pass lights  *
+ *   each pixel with only the lights a light grid binned into its tile.       *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Log.h"
+#include "Shaders.h"
+#include "RenderGraph.h"
+#include "LightGrid.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+class Deferred {
+	public:
+		Deferred();
+		~Deferred();
+
+		/** Loads the lighting pass for a light grid **/
+		bool build(LightGrid* lights);
+
+		/** Sets the color of pixels the scene doesn't cover **/
+		void setBackground(const glm::vec3& color);
+
+		/** Sets the light every surface receives regardless of the grid **/
+		void setAmbient(const glm::vec3& color);
+
+		/** Sets the camera used to rebuild positions from depth **/
+		void setCamera(const glm::mat4& viewProjection);
+
+		/** Adds the G-buffer and lighting passes, lighting the given area
+		    into the target. The geometry callback draws the scene **/
+		void addPasses(RenderGraph& graph, RenderGraph::Resource target,
+			GLsizei width, GLsizei height, GLsizei regionWidth,
+			GLsizei regionHeight, RenderGraph::Execute geometry, void* data);
+	protected:
+	private:
+		/** Internal variables for the lighting pass **/
+		LightGrid* Lights;
+		GLuint     ProgramID;
+		GLint      AlbedoUniformID, DepthUniformID, LightsUniformID;
+		GLint      TilesUniformID, IndicesUniformID, InverseVPUniformID;
+		GLint      RegionUniformID, TileSizeUniformID, TilesXUniformID;
+		GLint      BackgroundUniformID, AmbientUniformID;
+		glm::mat4  InverseVP;
+		glm::vec3  Background, Ambient;
+		GLsizei    RegionWidth, RegionHeight;
+
+		/** Internal variables for the frame's G-buffer **/
+		RenderGraph::Resource Albedo, Depth;
+
+		/** Prevent copying, the class owns OpenGL objects **/
+		Deferred(const Deferred& source);            // No copying
+		Deferred& operator=(const Deferred& source); // No assignment
+
+		/** Render graph passes **/
+		static void lightingPass(RenderGraph& graph, void* data);
+};
+
+#endif // DEFERRED_H_INCLUDED
@@ -0,0 +1,384 @@
+/*=================================                                       ----*\
+ * DYNAMIC RESOLUTION CLASS                                                   *
+ * - This class renders the scene into an offscreen framebuffer whose size is *
+ *   scaled every frame to keep the measured GPU time within a budget, then   *
+ *   upscales and sharpens the result into the window.                        *
+\*----                                       =================================*/
+
+#include "DynamicResolution.h"
+
+/** DynamicResolution constructor, OpenGL objects are created in build() **/
+DynamicResolution::DynamicResolution() {
+	SceneFramebuffer   = 0;
+	ColorRenderbuffer  = 0;
+	DepthRenderbuffer  = 0;
+	ResolveFramebuffer = 0;
+	ResolveTexture     = 0;
+	ProgramID          = 0;
+	Width              = 0;
+	Height             = 0;
+	Samples            = 0;
+	ScaledWidth        = 0;
+	ScaledHeight       = 0;
+	QueryHead          = 0;
+	QueryPending       = 0;
+	Timing             = false;
+	Scaling            = true;
+	TargetTime         = 12.0;
+	GPUTime            = 0.0;
+	Scale              = 1.0f;
+	MinimumScale       = 0.5f;
+	Sharpness          = 0.5f;
+
+	for (int q = 0; q < QueryCount; q++)
+		Queries[q] = 0;
+}
+
+/** DynamicResolution destructor **/
+DynamicResolution::~DynamicResolution() {
+	releaseTargets();
+
+	if (Queries[0] != 0)
+		glDeleteQueries(QueryCount, Queries);
+
+	if (ProgramID != 0)
+		Shaders::deleteProgram(ProgramID);
+}
+
+/** Creates the offscreen targets at the largest size they will use **/
+bool DynamicResolution::build(GLsizei width, GLsizei height, GLsizei samples) {
+	// Load the upscale shaders
+	Shaders::loadShader("Fullscreen.vshader", GL_VERTEX_SHADER);
+	Shaders::loadShader("Upscale.fshader", GL_FRAGMENT_SHADER);
+	ProgramID = Shaders::createProgram();
+
+	// Get handles for our uniforms
+	SourceUniformID    = glGetUniformLocation(ProgramID, "source");
+	UVScaleUniformID   = glGetUniformLocation(ProgramID, "uvScale");
+	TexelUniformID     = glGetUniformLocation(ProgramID, "texel");
+	SharpnessUniformID = glGetUniformLocation(ProgramID, "sharpness");
+
+	// GPU timers for the controller
+	glGenQueries(QueryCount, Queries);
+
+	Width  = width;
+	Height = height;
+	return setSamples(samples);
+}
+
+/** Recreates the offscreen targets after the window changes size **/
+bool DynamicResolution::resize(GLsizei width, GLsizei height) {
+	if (width == Width && height == Height)
+		return true;
+
+	// Minimized windows report a zero size, keep the old targets
+	if (width <= 0 || height <= 0)
+		return false;
+
+	Width  = width;
+	Height = height;
+	releaseTargets();
+	return createTargets();
+}
+
+/** Recreates the offscreen targets with another sample count **/
+bool DynamicResolution::setSamples(GLsizei samples) {
+	// Stay within what the implementation can multisample
+	GLint maxSamples = 0;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	Samples = (samples > maxSamples ? maxSamples : samples);
+
+	releaseTargets();
+	return createTargets();
+}
+
+/** Sets the GPU time budget for the scene, in milliseconds **/
+void DynamicResolution::setTarget(double milliseconds) {
+	TargetTime = milliseconds;
+}
+
+/** Sets the smallest allowed scale, as a fraction of each axis **/
+void DynamicResolution::setMinimumScale(float scale) {
+	MinimumScale = scale;
+	if (Scale < MinimumScale)
+		Scale = MinimumScale;
+}
+
+/** Sets the strength of the sharpening filter, from 0 to 1 **/
+void DynamicResolution::setSharpness(float sharpness) {
+	Sharpness = sharpness;
+}
+
+/** Turns scaling on or off, off holds the scale at 100% **/
+void DynamicResolution::setScaling(bool enabled) {
+	Scaling = enabled;
+	if (!Scaling)
+		Scale = 1.0f;
+}
+
+/** Binds the offscreen target at the current scale **/
+void DynamicResolution::begin() {
+	ScaledWidth  = static_cast<GLsizei>(Width  * Scale + 0.5f);
+	ScaledHeight = static_cast<GLsizei>(Height * Scale + 0.5f);
+	if (ScaledWidth  < 1) ScaledWidth  = 1;
+	if (ScaledHeight < 1) ScaledHeight = 1;
+
+	// Render into the corner of the full size target, so scale changes
+	// never reallocate anything
+	glBindFramebuffer(GL_FRAMEBUFFER, SceneFramebuffer);
+	glViewport(0, 0, ScaledWidth, ScaledHeight);
+
+	// Time the scene unless every query is still waiting on the GPU
+	Timing = (QueryPending < QueryCount);
+	if (Timing)
+		glBeginQuery(GL_TIME_ELAPSED, Queries[QueryHead]);
+}
+
+/** Resolves and upscales into the window **/
+void DynamicResolution::end() {
+	present(resolve());
+}
+
+/** Resolves multisampling and returns the single sample scene **/
+GLuint DynamicResolution::resolve() {
+	// Resolve the multisampled scene
+	if (SceneFramebuffer != ResolveFramebuffer) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, SceneFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, ResolveFramebuffer);
+		glBlitFramebuffer(
+			0, 0, ScaledWidth, ScaledHeight, // source rectangle
+			0, 0, ScaledWidth, ScaledHeight, // destination rectangle
+			GL_COLOR_BUFFER_BIT, GL_NEAREST
+		);
+		glBindFramebuffer(GL_FRAMEBUFFER, ResolveFramebuffer);
+	}
+
+	return ResolveTexture;
+}
+
+/** Upscales a texture laid out like the scene into the window **/
+void DynamicResolution::present(GLuint texture) {
+	// Upscale into the window
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, Width, Height);
+	glDisable(GL_DEPTH_TEST);
+
+	// Use our upscale shader
+	glUseProgram(ProgramID);
+	glUniform1i(SourceUniformID, 0);
+	glUniform2f(UVScaleUniformID,
+		static_cast<float>(ScaledWidth)  / static_cast<float>(Width),
+		static_cast<float>(ScaledHeight) / static_cast<float>(Height));
+	glUniform2f(TexelUniformID,
+		1.0f / static_cast<float>(Width),
+		1.0f / static_cast<float>(Height));
+	// Native resolution needs no sharpening
+	glUniform1f(SharpnessUniformID, Scale < 1.0f ? Sharpness : 0.0f);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	// One triangle covering the screen, generated from the vertex ID
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glEnable(GL_DEPTH_TEST);
+
+	// The timer covers everything that scales: scene, resolve, post
+	// processing and the upscale itself
+	if (Timing) {
+		glEndQuery(GL_TIME_ELAPSED);
+		QueryHead = (QueryHead + 1) % QueryCount;
+		QueryPending++;
+	}
+
+	collectQueries();
+}
+
+/** Current scale as a fraction of each axis **/
+float DynamicResolution::getScale() const {
+	return Scale;
+}
+
+/** Last measured GPU time for the scene, in milliseconds **/
+double DynamicResolution::getGPUTime() const {
+	return GPUTime;
+}
+
+/** Width of the offscreen targets **/
+GLsizei DynamicResolution::getWidth() const {
+	return Width;
+}
+
+/** Height of the offscreen targets **/
+GLsizei DynamicResolution::getHeight() const {
+	return Height;
+}
+
+/** Width of the area rendered this frame **/
+GLsizei DynamicResolution::getScaledWidth() const {
+	return ScaledWidth;
+}
+
+/** Height of the area rendered this frame **/
+GLsizei DynamicResolution::getScaledHeight() const {
+	return ScaledHeight;
+}
+
+/** Framebuffer the scene renders into **/
+GLuint DynamicResolution::getSceneFramebuffer() const {
+	return SceneFramebuffer;
+}
+
+/** Framebuffer holding the single sample scene **/
+GLuint DynamicResolution::getResolveFramebuffer() const {
+	return ResolveFramebuffer;
+}
+
+/** Texture holding the single sample scene **/
+GLuint DynamicResolution::getResolveTexture() const {
+	return ResolveTexture;
+}
+
+/** Bytes held by the offscreen targets **/
+GLsizeiptr DynamicResolution::getMemoryUsage() const {
+	GLsizeiptr pixels  = static_cast<GLsizeiptr>(Width) * Height;
+	GLsizeiptr samples = (Samples > 0 ? Samples : 1);
+
+	// RGBA8 resolve texture, plus depth/stencil and color per sample
+	GLsizeiptr bytes = pixels * 4 + pixels * samples * 4;
+	if (Samples > 0)
+		bytes += pixels * samples * 4;
+
+	return bytes;
+}
+
+/** Creates the offscreen framebuffers at full size **/
+bool DynamicResolution::createTargets() {
+	GLint previousFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+	// Single sample texture the upscale reads from
+	glGenTextures(1, &ResolveTexture);
+	glBindTexture(GL_TEXTURE_2D, ResolveTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA,
+		GL_UNSIGNED_BYTE, NULL);
+	MemoryTracker::track(MemoryTracker::TEXTURE, ResolveTexture,
+		"Resolved scene", MemoryTracker::getImageBytes(GL_RGBA8, Width, Height,
+			1, 1));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &ResolveFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, ResolveFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+		ResolveTexture, 0);
+
+	// Without multisampling the scene renders straight into the texture
+	glGenRenderbuffers(1, &DepthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, DepthRenderbuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, Samples,
+		GL_DEPTH24_STENCIL8, Width, Height);
+	MemoryTracker::track(MemoryTracker::RENDERBUFFER, DepthRenderbuffer,
+		"Scene depth", MemoryTracker::getImageBytes(GL_DEPTH24_STENCIL8,
+			Width, Height, 1, Samples));
+
+	if (Samples > 0) {
+		glGenRenderbuffers(1, &ColorRenderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, ColorRenderbuffer);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, Samples, GL_RGBA8,
+			Width, Height);
+		MemoryTracker::track(MemoryTracker::RENDERBUFFER, ColorRenderbuffer,
+			"Multisampled scene", MemoryTracker::getImageBytes(GL_RGBA8,
+				Width, Height, 1, Samples));
+
+		glGenFramebuffers(1, &SceneFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, SceneFramebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			GL_RENDERBUFFER, ColorRenderbuffer);
+	} else {
+		SceneFramebuffer = ResolveFramebuffer;
+	}
+
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+		GL_RENDERBUFFER, DepthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		LOG_ERROR(RENDER, "Failed to create the offscreen framebuffer");
+		releaseTargets();
+		return false;
+	}
+
+	return true;
+}
+
+/** Releases the offscreen framebuffers **/
+void DynamicResolution::releaseTargets() {
+	if (SceneFramebuffer != 0 && SceneFramebuffer != ResolveFramebuffer)
+		glDeleteFramebuffers(1, &SceneFramebuffer);
+	if (ResolveFramebuffer != 0)
+		glDeleteFramebuffers(1, &ResolveFramebuffer);
+	if (ColorRenderbuffer != 0)
+		glDeleteRenderbuffers(1, &ColorRenderbuffer);
+	if (DepthRenderbuffer != 0)
+		glDeleteRenderbuffers(1, &DepthRenderbuffer);
+	if (ResolveTexture != 0)
+		glDeleteTextures(1, &ResolveTexture);
+
+	MemoryTracker::release(MemoryTracker::RENDERBUFFER, ColorRenderbuffer);
+	MemoryTracker::release(MemoryTracker::RENDERBUFFER, DepthRenderbuffer);
+	MemoryTracker::release(MemoryTracker::TEXTURE, ResolveTexture);
+
+	SceneFramebuffer   = 0;
+	ResolveFramebuffer = 0;
+	ColorRenderbuffer  = 0;
+	DepthRenderbuffer  = 0;
+	ResolveTexture     = 0;
+}
+
+/** Reads back any finished timer queries without waiting on the GPU **/
+void DynamicResolution::collectQueries() {
+	while (QueryPending > 0) {
+		int oldest = (QueryHead - QueryPending + QueryCount) % QueryCount;
+
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(Queries[oldest], GL_QUERY_RESULT_AVAILABLE,
+			&available);
+		if (available != GL_TRUE)
+			break;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(Queries[oldest], GL_QUERY_RESULT, &elapsed);
+		QueryPending--;
+
+		GPUTime = static_cast<double>(elapsed) / 1000000.0;
+		updateScale(GPUTime);
+	}
+}
+
+/** Moves the scale toward the size that fits the budget **/
+void DynamicResolution::updateScale(double milliseconds) {
+	if (!Scaling || milliseconds <= 0.0)
+		return;
+
+	// Leave small errors alone so the image doesn't shimmer
+	double error = (milliseconds - TargetTime) / TargetTime;
+	if (std::fabs(error) < 0.05)
+		return;
+
+	// Cost follows the pixel count, which goes with the square of the scale
+	double desired = Scale * std::sqrt(TargetTime / milliseconds);
+
+	// Only take part of the step each frame to damp oscillation
+	Scale += static_cast<float>((desired - Scale) * 0.25);
+
+	if (Scale < MinimumScale) Scale = MinimumScale;
+	if (Scale > 1.0f)         Scale = 1.0f;
+}
@@ -0,0 +1,107 @@
+#ifndef DYNAMICRESOLUTION_H_INCLUDED
+#define DYNAMICRESOLUTION_H_INCLUDED
+
+/*=================================                                       ----*\
+ * DYNAMIC RESOLUTION CLASS                                                   *
+ * - This class renders the scene into an offscreen framebuffer whose size is *
+ *   scaled every frame to keep the measured GPU time within a budget, then   *
+ *   upscales and sharpens the result into the window.                        *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include "Log.h"
+#include "Shaders.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+class DynamicResolution {
+	public:
+		DynamicResolution();
+		~DynamicResolution();
+
+		/** Creates the offscreen targets at the largest size they will use **/
+		bool build(GLsizei width, GLsizei height, GLsizei samples);
+
+		/** Recreates the offscreen targets after the window changes size **/
+		bool resize(GLsizei width, GLsizei height);
+
+		/** Recreates the offscreen targets with another sample count **/
+		bool setSamples(GLsizei samples);
+
+		/** Sets the GPU time budget for the scene, in milliseconds **/
+		void setTarget(double milliseconds);
+
+		/** Sets the smallest allowed scale, as a fraction of each axis **/
+		void setMinimumScale(float scale);
+
+		/** Sets the strength of the sharpening filter, from 0 to 1 **/
+		void setSharpness(float sharpness);
+
+		/** Turns scaling on or off, off holds the scale at 100% **/
+		void setScaling(bool enabled);
+
+		/** Binds the offscreen target at the current scale **/
+		void begin();
+
+		/** Resolves and upscales into the window **/
+		void end();
+
+		/** Resolves multisampling and returns the single sample scene **/
+		GLuint resolve();
+
+		/** Upscales a texture laid out like the scene into the window **/
+		void present(GLuint texture);
+
+		/** Current scale and last measured GPU time **/
+		float  getScale() const;
+		double getGPUTime() const;
+
+		/** Size of the targets and of the area rendered this frame **/
+		GLsizei getWidth() const;
+		GLsizei getHeight() const;
+		GLsizei getScaledWidth() const;
+		GLsizei getScaledHeight() const;
+
+		/** Offscreen targets, the scene and resolve framebuffers are the
+		    same one without multisampling **/
+		GLuint getSceneFramebuffer() const;
+		GLuint getResolveFramebuffer() const;
+		GLuint getResolveTexture() const;
+
+		/** Bytes held by the offscreen targets **/
+		GLsizeiptr getMemoryUsage() const;
+	protected:
+	private:
+		/** Number of timer queries in flight, avoids stalling on results **/
+		static const int QueryCount = 4;
+
+		/** Internal variables for offscreen rendering **/
+		GLuint  SceneFramebuffer, ColorRenderbuffer, DepthRenderbuffer;
+		GLuint  ResolveFramebuffer, ResolveTexture;
+		GLuint  ProgramID, SourceUniformID, UVScaleUniformID;
+		GLuint  TexelUniformID, SharpnessUniformID;
+		GLsizei Width, Height, Samples;
+		GLsizei ScaledWidth, ScaledHeight;
+
+		/** Internal variables for the controller **/
+		GLuint Queries[QueryCount];
+		int    QueryHead, QueryPending;
+		bool   Timing, Scaling;
+		double TargetTime, GPUTime;
+		float  Scale, MinimumScale, Sharpness;
+
+		/** Prevent copying, the class owns OpenGL objects **/
+		DynamicResolution(const DynamicResolution& source); // No copying
+		DynamicResolution& operator=(
+			const DynamicResolution& source);                // No assignment
+
+		/** Internal functions used for creation and control **/
+		bool createTargets();
+		void releaseTargets();
+		void collectQueries();
+		void updateScale(double milliseconds);
+};
+
+#endif // DYNAMICRESOLUTION_H_INCLUDED
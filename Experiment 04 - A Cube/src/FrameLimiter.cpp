@@ -0,0 +1,255 @@
+/*=================================                                       ----*\
+ * FRAME LIMITER CLASS                                                        *
+ * - This class keeps the driver from queuing more than a set number of       *
+ *   frames, one to three, by fencing each frame after the swap and waiting   *
+ *   on the oldest fence before the next one starts. It also follows input    *
+ *   from the moment GLFW reports it until the swap carrying its frame        *
+ *   finishes on the GPU, and prints how that latency is distributed.         *
+\*----                                       =================================*/
+
+#include "FrameLimiter.h"
+
+/** Define static member variables, logging takes them by reference **/
+const int FrameLimiter::MaxFrames;
+
+/** Latency histogram bucket edges in milliseconds **/
+static const double bucketEdges[] = { 8.0, 16.7, 33.3, 50.0, 66.7, 100.0 };
+
+/** FrameLimiter constructor, OpenGL objects are created in build() **/
+FrameLimiter::FrameLimiter() {
+	Head         = 0;
+	Pending      = 0;
+	Limit        = 2;
+	Submits      = 0;
+	PendingInput = 0.0;
+	LatchedInput = 0.0;
+	ClockOffset  = 0.0;
+	WaitTime     = 0.0;
+
+	for (int f = 0; f < MaxFrames; f++) {
+		Frames[f].Fence     = 0;
+		Frames[f].Query     = 0;
+		Frames[f].Input     = 0.0;
+		Frames[f].Submitted = 0.0;
+	}
+
+	InputLatency.Next  = 0;
+	InputLatency.Total = 0;
+	QueueLatency.Next  = 0;
+	QueueLatency.Total = 0;
+}
+
+/** FrameLimiter destructor **/
+FrameLimiter::~FrameLimiter() {
+	for (int f = 0; f < MaxFrames; f++) {
+		if (Frames[f].Fence != 0)
+			glDeleteSync(Frames[f].Fence);
+		if (Frames[f].Query != 0)
+			glDeleteQueries(1, &Frames[f].Query);
+	}
+}
+
+/** Creates the timestamp queries **/
+bool FrameLimiter::build() {
+	if (Frames[0].Query != 0)
+		return true;
+
+	for (int f = 0; f < MaxFrames; f++)
+		glGenQueries(1, &Frames[f].Query);
+
+	calibrate();
+	return true;
+}
+
+/** Sets how many frames may be queued **/
+void FrameLimiter::setLimit(int frames) {
+	if (frames < 1)
+		frames = 1;
+	if (frames > MaxFrames)
+		frames = MaxFrames;
+	Limit = frames;
+}
+
+/** How many frames may be queued **/
+int FrameLimiter::getLimit() const {
+	return Limit;
+}
+
+/** Notes an input event that changes the picture **/
+void FrameLimiter::addInput() {
+	// Later events ride along with the first, which has waited longest
+	if (PendingInput == 0.0)
+		PendingInput = glfwGetTime();
+}
+
+/** Takes the input noted so far into the frame being built **/
+void FrameLimiter::latch() {
+	// Input latched early and again late stays with the frame
+	if (PendingInput != 0.0 && LatchedInput == 0.0)
+		LatchedInput = PendingInput;
+	PendingInput = 0.0;
+}
+
+/** Reads back finished frames and waits for room in the queue **/
+void FrameLimiter::wait() {
+	TRACE_SCOPE("Frame limit");
+
+	while (Pending > 0) {
+		Frame& oldest = Frames[(Head - Pending + MaxFrames) % MaxFrames];
+
+		// Finished frames are read back whether or not the queue is full
+		GLuint64 timeout = 0;
+		double   start   = 0.0;
+		if (Pending >= Limit) {
+			timeout = 100000000; // Nanoseconds, checked again after
+			start   = glfwGetTime();
+		}
+
+		GLenum status = glClientWaitSync(oldest.Fence,
+			GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+		if (start != 0.0)
+			WaitTime += glfwGetTime() - start;
+
+		if (status == GL_TIMEOUT_EXPIRED && timeout == 0)
+			break;
+		if (status == GL_TIMEOUT_EXPIRED)
+			continue;
+
+		// A failed wait lets the frame go rather than waiting forever
+		if (status == GL_WAIT_FAILED)
+			LOG_WARNING(TIMING, "Waiting on a frame fence failed");
+		retire();
+	}
+}
+
+/** Fences the frame just swapped **/
+void FrameLimiter::submit() {
+	if (Frames[0].Query == 0)
+		return;
+
+	// Frames swapped without a wait() in between can fill every slot
+	if (Pending == MaxFrames)
+		wait();
+
+	Frame& frame    = Frames[Head];
+	glQueryCounter(frame.Query, GL_TIMESTAMP);
+	frame.Fence     = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame.Input     = LatchedInput;
+	frame.Submitted = glfwGetTime();
+	LatchedInput    = 0.0;
+
+	Head = (Head + 1) % MaxFrames;
+	Pending++;
+
+	// The two clocks drift apart slowly
+	if (++Submits % 256 == 0)
+		calibrate();
+}
+
+/** Waits for every queued frame **/
+void FrameLimiter::finish() {
+	// With a limit of one, wait() lets nothing stay queued
+	int limit = Limit;
+	Limit     = 1;
+	wait();
+	Limit     = limit;
+}
+
+/** Prints the latency distributions **/
+void FrameLimiter::report(FILE* file) const {
+	fprintf(file, "%d frames in flight, %.2f ms spent waiting on fences\n",
+		Limit, WaitTime * 1000.0);
+	fprintf(file, "%-16s %7s %8s %8s %8s %8s %8s\n", "Latency", "Frames",
+		"Mean ms", "50% ms", "90% ms", "99% ms", "Max ms");
+	printSamples(file, "Input to swap", InputLatency);
+	printSamples(file, "Submit to swap", QueueLatency);
+
+	// How the input latencies spread over the refreshes
+	if (InputLatency.Values.empty())
+		return;
+
+	const int bucketCount = sizeof(bucketEdges) / sizeof(bucketEdges[0]);
+	int       counts[bucketCount + 1] = { 0 };
+	for (size_t s = 0; s < InputLatency.Values.size(); s++) {
+		int b = 0;
+		while (b < bucketCount && InputLatency.Values[s] >= bucketEdges[b])
+			b++;
+		counts[b]++;
+	}
+
+	double total = static_cast<double>(InputLatency.Values.size());
+	for (int b = 0; b <= bucketCount; b++) {
+		char range[32];
+		if (b < bucketCount)
+			snprintf(range, sizeof(range), "< %.1f ms", bucketEdges[b]);
+		else
+			snprintf(range, sizeof(range), ">= %.1f ms",
+				bucketEdges[bucketCount - 1]);
+
+		int bar = static_cast<int>(40.0 * counts[b] / total + 0.5);
+		fprintf(file, "  %-12s %6d %5.1f%% %s\n", range, counts[b],
+			100.0 * counts[b] / total, std::string(bar, '#').c_str());
+	}
+}
+
+/** Reads back the oldest queued frame, whose fence has passed **/
+void FrameLimiter::retire() {
+	Frame& frame = Frames[(Head - Pending + MaxFrames) % MaxFrames];
+	Pending--;
+
+	glDeleteSync(frame.Fence);
+	frame.Fence = 0;
+
+	// The timestamp was written before the fence, so it's there already
+	GLuint64 timestamp = 0;
+	glGetQueryObjectui64v(frame.Query, GL_QUERY_RESULT, &timestamp);
+	double finished = static_cast<double>(timestamp) / 1000000000.0 +
+		ClockOffset;
+
+	addSample(QueueLatency, (finished - frame.Submitted) * 1000.0);
+	if (frame.Input != 0.0)
+		addSample(InputLatency, (finished - frame.Input) * 1000.0);
+}
+
+/** Lines the GPU clock up with the CPU clock **/
+void FrameLimiter::calibrate() {
+	GLint64 timestamp = 0;
+	glGetInteger64v(GL_TIMESTAMP, &timestamp);
+	ClockOffset = glfwGetTime() - static_cast<double>(timestamp) / 1000000000.0;
+}
+
+/** Adds a latency, over the oldest once the ring is full **/
+void FrameLimiter::addSample(Samples& samples, double milliseconds) {
+	// Clocks a hair apart can put a quick frame just before its input
+	milliseconds = std::max(milliseconds, 0.0);
+
+	if (samples.Values.size() < static_cast<size_t>(SampleCount))
+		samples.Values.push_back(milliseconds);
+	else
+		samples.Values[samples.Next] = milliseconds;
+
+	samples.Next = (samples.Next + 1) % SampleCount;
+	samples.Total++;
+}
+
+/** Prints the mean, percentiles and worst of some latencies **/
+void FrameLimiter::printSamples(FILE* file, const char* name,
+	const Samples& samples)
+{
+	if (samples.Values.empty()) {
+		fprintf(file, "%-16s %7d\n", name, 0);
+		return;
+	}
+
+	std::vector<double> sorted(samples.Values);
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (size_t s = 0; s < sorted.size(); s++)
+		sum += sorted[s];
+
+	size_t last = sorted.size() - 1;
+	fprintf(file, "%-16s %7lld %8.2f %8.2f %8.2f %8.2f %8.2f\n", name,
+		samples.Total, sum / sorted.size(), sorted[last * 50 / 100],
+		sorted[last * 90 / 100], sorted[last * 99 / 100], sorted[last]);
+}
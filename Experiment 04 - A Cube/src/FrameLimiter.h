@@ -0,0 +1,98 @@
+#ifndef FRAMELIMITER_H_INCLUDED
+#define FRAMELIMITER_H_INCLUDED
+
+/*=================================                                       ----*\
+ * FRAME LIMITER CLASS                                                        *
+ * - This class keeps the driver from queuing more than a set number of       *
+ *   frames, one to three, by fencing each frame after the swap and waiting   *
+ *   on the oldest fence before the next one starts. It also follows input    *
+ *   from the moment GLFW reports it until the swap carrying its frame        *
+ *   finishes on the GPU, and prints how that latency is distributed.         *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Log.h"
+#include "Trace.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+class FrameLimiter {
+	public:
+		/** Most frames that may be queued **/
+		static const int MaxFrames = 3;
+
+		FrameLimiter();
+		~FrameLimiter();
+
+		/** Creates the timestamp queries **/
+		bool build();
+
+		/** Sets how many frames may be queued, from 1 to MaxFrames **/
+		void setLimit(int frames);
+		int  getLimit() const;
+
+		/** Notes an input event that changes the picture. The first one
+		    since the last latch starts the latency clock **/
+		void addInput();
+
+		/** Takes the input noted so far into the frame being built **/
+		void latch();
+
+		/** Reads back the frames that finished, then waits on the oldest
+		    until fewer than the limit are queued **/
+		void wait();
+
+		/** Fences the frame just swapped **/
+		void submit();
+
+		/** Waits for every queued frame **/
+		void finish();
+
+		/** Prints the latency distributions **/
+		void report(FILE* file) const;
+	protected:
+	private:
+		/** Latencies kept for the report, the latest ones win **/
+		static const int SampleCount = 4096;
+
+		/** A queued frame **/
+		struct Frame {
+			GLsync Fence;
+			GLuint Query;     // GPU time the swap finished
+			double Input;     // First input it carries, 0 when none
+			double Submitted; // CPU time the swap call returned
+		};
+
+		/** Recent latencies in milliseconds, as a ring **/
+		struct Samples {
+			std::vector<double> Values;
+			size_t              Next;
+			long long           Total;
+		};
+
+		/** Internal variables for the queue **/
+		Frame  Frames[MaxFrames];
+		int    Head, Pending, Limit;
+		int    Submits;
+		double PendingInput, LatchedInput;
+		double ClockOffset; // CPU seconds less GPU seconds
+		double WaitTime;    // Seconds spent waiting on fences
+		Samples InputLatency, QueueLatency;
+
+		/** Prevent copying, the class owns OpenGL objects **/
+		FrameLimiter(const FrameLimiter& source);            // No copying
+		FrameLimiter& operator=(const FrameLimiter& source); // No assignment
+
+		/** Internal functions used for the queue and the measurements **/
+		void retire();
+		void calibrate();
+		static void addSample(Samples& samples, double milliseconds);
+		static void printSamples(FILE* file, const char* name,
+			const Samples& samples);
+};
+
+#endif // FRAMELIMITER_H_INCLUDED
@@ -0,0 +1,367 @@
+/*=================================                                       ----*\
+ * GL RECORDER CLASS                                                          *
+ * - This static class sits between the renderer and OpenGL, writing every    *
+ *   call it wraps to a compact binary file, buffer contents included. The    *
+ *   replay tool plays the file back without a window, input or timers, so    *
+ *   the same workload can be timed against different renderers and drivers.  *
+ *   Calls are counted even when nothing is written, which the benchmark      *
+ *   tool reports as draw calls and state changes per frame.                  *
+\*----                                       =================================*/
+
+#include "GLRecorder.h"
+#include <cstring>
+
+/** Define static member variables **/
+FILE*              GLRecorder::File = NULL;
+GLRecorder::Header GLRecorder::Written;
+unsigned long long GLRecorder::Counts[GLRecorder::FRAME + 1] = { 0 };
+PFNGLENABLEVERTEXATTRIBARRAYPROC  GLRecorder::RealEnableAttribute  = NULL;
+PFNGLDISABLEVERTEXATTRIBARRAYPROC GLRecorder::RealDisableAttribute = NULL;
+PFNGLVERTEXATTRIBPOINTERPROC      GLRecorder::RealAttributePointer = NULL;
+
+/** Starts writing calls to a file **/
+bool GLRecorder::start(const char* path, GLsizei width, GLsizei height) {
+	File = fopen(path, "wb");
+	if (!File) {
+		fprintf(stderr, "Failed to open recording %s\n", path);
+		return false;
+	}
+
+	// The frame count is filled in once the recording stops
+	memcpy(Written.Magic, "GLRC", 4);
+	Written.Version = FileVersion;
+	Written.Width   = width;
+	Written.Height  = height;
+	Written.Frames  = 0;
+	fwrite(&Written, sizeof(Header), 1, File);
+
+	// Vertex formats set their attributes from inline code in headers, so
+	// catch those calls inside GLEW instead
+	RealEnableAttribute  = glEnableVertexAttribArray;
+	RealDisableAttribute = glDisableVertexAttribArray;
+	RealAttributePointer = glVertexAttribPointer;
+	__glewEnableVertexAttribArray  = enableAttribute;
+	__glewDisableVertexAttribArray = disableAttribute;
+	__glewVertexAttribPointer      = attributePointer;
+
+	fprintf(stdout, "Recording OpenGL calls to %s\n", path);
+	return true;
+}
+
+/** Finishes the file **/
+void GLRecorder::stop() {
+	if (!File)
+		return;
+
+	__glewEnableVertexAttribArray  = RealEnableAttribute;
+	__glewDisableVertexAttribArray = RealDisableAttribute;
+	__glewVertexAttribPointer      = RealAttributePointer;
+
+	fseek(File, 0, SEEK_SET);
+	fwrite(&Written, sizeof(Header), 1, File);
+	fclose(File);
+	File = NULL;
+
+	fprintf(stdout, "Recorded %d frames\n", Written.Frames);
+}
+
+/** Calls made through an entry point since the last reset **/
+unsigned long long GLRecorder::getCount(Command command) {
+	return Counts[command];
+}
+
+/** Starts every count again from zero **/
+void GLRecorder::resetCounts() {
+	memset(Counts, 0, sizeof(Counts));
+}
+
+/** Checks whether calls are being written **/
+bool GLRecorder::isRecording() {
+	return File != NULL;
+}
+
+/** Marks the end of a frame **/
+void GLRecorder::frame() {
+	if (!record(FRAME))
+		return;
+
+	Written.Frames++;
+}
+
+/** Creates a shader **/
+GLuint GLRecorder::createShader(GLenum type) {
+	GLuint shader = glCreateShader(type);
+	if (record(CREATE_SHADER)) {
+		write(type);
+		write(shader);
+	}
+	return shader;
+}
+
+/** Sets a shader's source, written as one string per piece **/
+void GLRecorder::shaderSource(GLuint shader, GLsizei count,
+	const GLchar* const* strings, const GLint* lengths)
+{
+	glShaderSource(shader, count, const_cast<const GLchar**>(strings),
+		lengths);
+	if (!record(SHADER_SOURCE))
+		return;
+
+	write(shader);
+	write(count);
+	for (GLsizei s = 0; s < count; s++) {
+		// Without lengths, or a negative one, the piece ends at a null
+		bool sized = (lengths && lengths[s] >= 0);
+		writeString(strings[s], sized ? lengths[s] : strlen(strings[s]));
+	}
+}
+
+/** Compiles a shader **/
+void GLRecorder::compileShader(GLuint shader) {
+	glCompileShader(shader);
+	if (record(COMPILE_SHADER)) {
+		write(shader);
+	}
+}
+
+/** Deletes a shader **/
+void GLRecorder::deleteShader(GLuint shader) {
+	glDeleteShader(shader);
+	if (record(DELETE_SHADER)) {
+		write(shader);
+	}
+}
+
+/** Creates a program **/
+GLuint GLRecorder::createProgram() {
+	GLuint program = glCreateProgram();
+	if (record(CREATE_PROGRAM)) {
+		write(program);
+	}
+	return program;
+}
+
+/** Attaches a shader to a program **/
+void GLRecorder::attachShader(GLuint program, GLuint shader) {
+	glAttachShader(program, shader);
+	if (record(ATTACH_SHADER)) {
+		write(program);
+		write(shader);
+	}
+}
+
+/** Links a program **/
+void GLRecorder::linkProgram(GLuint program) {
+	glLinkProgram(program);
+	if (record(LINK_PROGRAM)) {
+		write(program);
+	}
+}
+
+/** Deletes a program **/
+void GLRecorder::deleteProgram(GLuint program) {
+	glDeleteProgram(program);
+	if (record(DELETE_PROGRAM)) {
+		write(program);
+	}
+}
+
+/** Installs a program **/
+void GLRecorder::useProgram(GLuint program) {
+	glUseProgram(program);
+	if (record(USE_PROGRAM)) {
+		write(program);
+	}
+}
+
+/** Looks up a uniform, keeping the name so the replay can look it up too **/
+GLint GLRecorder::getUniformLocation(GLuint program, const GLchar* name) {
+	GLint location = glGetUniformLocation(program, name);
+	if (record(GET_UNIFORM_LOCATION)) {
+		write(program);
+		writeString(name, strlen(name));
+		write(location);
+	}
+	return location;
+}
+
+/** Sets matrix uniforms of the current program **/
+void GLRecorder::uniformMatrix4fv(GLint location, GLsizei count,
+	GLboolean transpose, const GLfloat* value)
+{
+	glUniformMatrix4fv(location, count, transpose, value);
+	if (record(UNIFORM_MATRIX4)) {
+		write(location);
+		write(count);
+		write(transpose);
+		writeBytes(value, count * 16 * sizeof(GLfloat));
+	}
+}
+
+/** Sets an unsigned integer uniform of the current program **/
+void GLRecorder::uniform1ui(GLint location, GLuint value) {
+	glUniform1ui(location, value);
+	if (record(UNIFORM_UINT)) {
+		write(location);
+		write(value);
+	}
+}
+
+/** Creates buffers **/
+void GLRecorder::genBuffers(GLsizei count, GLuint* buffers) {
+	glGenBuffers(count, buffers);
+	if (record(GEN_BUFFERS)) {
+		write(count);
+		writeBytes(buffers, count * sizeof(GLuint));
+	}
+}
+
+/** Binds a buffer **/
+void GLRecorder::bindBuffer(GLenum target, GLuint buffer) {
+	glBindBuffer(target, buffer);
+	if (record(BIND_BUFFER)) {
+		write(target);
+		write(buffer);
+	}
+}
+
+/** Fills the bound buffer, copying its contents into the recording **/
+void GLRecorder::bufferData(GLenum target, GLsizeiptr size,
+	const GLvoid* data, GLenum usage)
+{
+	glBufferData(target, size, data, usage);
+	if (!record(BUFFER_DATA))
+		return;
+
+	write(target);
+	write(static_cast<long long>(size));
+	write(usage);
+	write(static_cast<unsigned char>(data != NULL));
+	if (data)
+		writeBytes(data, size);
+}
+
+/** Creates vertex arrays **/
+void GLRecorder::genVertexArrays(GLsizei count, GLuint* arrays) {
+	glGenVertexArrays(count, arrays);
+	if (record(GEN_VERTEX_ARRAYS)) {
+		write(count);
+		writeBytes(arrays, count * sizeof(GLuint));
+	}
+}
+
+/** Binds a vertex array **/
+void GLRecorder::bindVertexArray(GLuint array) {
+	glBindVertexArray(array);
+	if (record(BIND_VERTEX_ARRAY)) {
+		write(array);
+	}
+}
+
+/** Clears the bound framebuffer **/
+void GLRecorder::clear(GLbitfield mask) {
+	glClear(mask);
+	if (record(CLEAR)) {
+		write(mask);
+	}
+}
+
+/** Sets the clear color **/
+void GLRecorder::clearColor(GLfloat red, GLfloat green, GLfloat blue,
+	GLfloat alpha)
+{
+	glClearColor(red, green, blue, alpha);
+	if (record(CLEAR_COLOR)) {
+		write(red);
+		write(green);
+		write(blue);
+		write(alpha);
+	}
+}
+
+/** Turns on a capability **/
+void GLRecorder::enable(GLenum capability) {
+	glEnable(capability);
+	if (record(ENABLE)) {
+		write(capability);
+	}
+}
+
+/** Sets the depth test **/
+void GLRecorder::depthFunc(GLenum function) {
+	glDepthFunc(function);
+	if (record(DEPTH_FUNC)) {
+		write(function);
+	}
+}
+
+/** Sets the viewport **/
+void GLRecorder::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	glViewport(x, y, width, height);
+	if (record(VIEWPORT)) {
+		write(x);
+		write(y);
+		write(width);
+		write(height);
+	}
+}
+
+/** Draws from the enabled attributes **/
+void GLRecorder::drawArrays(GLenum mode, GLint first, GLsizei count) {
+	glDrawArrays(mode, first, count);
+	if (record(DRAW_ARRAYS)) {
+		write(mode);
+		write(first);
+		write(count);
+	}
+}
+
+/** Turns on an attribute, installed into GLEW **/
+void GLAPIENTRY GLRecorder::enableAttribute(GLuint index) {
+	RealEnableAttribute(index);
+	record(ENABLE_ATTRIBUTE);
+	write(index);
+}
+
+/** Turns off an attribute, installed into GLEW **/
+void GLAPIENTRY GLRecorder::disableAttribute(GLuint index) {
+	RealDisableAttribute(index);
+	record(DISABLE_ATTRIBUTE);
+	write(index);
+}
+
+/** Points an attribute at the bound buffer, installed into GLEW. Only
+    buffer offsets are recorded, the core profile has no client arrays **/
+void GLAPIENTRY GLRecorder::attributePointer(GLuint index, GLint size,
+	GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* pointer)
+{
+	RealAttributePointer(index, size, type, normalized, stride, pointer);
+	record(ATTRIBUTE_POINTER);
+	write(index);
+	write(size);
+	write(type);
+	write(normalized);
+	write(stride);
+	write(static_cast<unsigned long long>(reinterpret_cast<size_t>(pointer)));
+}
+
+/** Counts a call, then starts its command when writing a file **/
+bool GLRecorder::record(Command command) {
+	Counts[command]++;
+	if (!File)
+		return false;
+
+	write(static_cast<unsigned char>(command));
+	return true;
+}
+
+/** Appends raw bytes **/
+void GLRecorder::writeBytes(const void* data, size_t size) {
+	fwrite(data, 1, size, File);
+}
+
+/** Appends a string with its length in front **/
+void GLRecorder::writeString(const char* text, size_t length) {
+	write(static_cast<unsigned>(length));
+	writeBytes(text, length);
+}
@@ -0,0 +1,188 @@
+#ifndef GLRECORDER_H_INCLUDED
+#define GLRECORDER_H_INCLUDED
+
+/*=================================                                       ----*\
+ * GL RECORDER CLASS                                                          *
+ * - This static class sits between the renderer and OpenGL, writing every    *
+ *   call it wraps to a compact binary file, buffer contents included. The    *
+ *   replay tool plays the file back without a window, input or timers, so    *
+ *   the same workload can be timed against different renderers and drivers.  *
+ *   Calls are counted even when nothing is written, which the benchmark      *
+ *   tool reports as draw calls and state changes per frame.                  *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+class GLRecorder {
+	public:
+		/** Commands in a recording, each followed by its arguments. Names
+		    OpenGL returned are recorded so the replay can map its own **/
+		enum Command {
+			CREATE_SHADER = 1,    // Type, shader
+			SHADER_SOURCE,        // Shader, count, then sized strings
+			COMPILE_SHADER,       // Shader
+			DELETE_SHADER,        // Shader
+			CREATE_PROGRAM,       // Program
+			ATTACH_SHADER,        // Program, shader
+			LINK_PROGRAM,         // Program
+			DELETE_PROGRAM,       // Program
+			USE_PROGRAM,          // Program
+			GET_UNIFORM_LOCATION, // Program, sized name, location
+			UNIFORM_MATRIX4,      // Location, count, transpose, matrices
+			UNIFORM_UINT,         // Location, value
+			GEN_BUFFERS,          // Count, buffers
+			BIND_BUFFER,          // Target, buffer
+			BUFFER_DATA,          // Target, size, usage, has data, data
+			GEN_VERTEX_ARRAYS,    // Count, vertex arrays
+			BIND_VERTEX_ARRAY,    // Vertex array
+			ENABLE_ATTRIBUTE,     // Index
+			DISABLE_ATTRIBUTE,    // Index
+			ATTRIBUTE_POINTER,    // Index, size, type, normalized, stride,
+			                      // offset
+			CLEAR,                // Mask
+			CLEAR_COLOR,          // Red, green, blue, alpha
+			ENABLE,               // Capability
+			DEPTH_FUNC,           // Function
+			VIEWPORT,             // X, y, width, height
+			DRAW_ARRAYS,          // Mode, first, count
+			FRAME                 // End of a frame, where it was presented
+		};
+
+		/** Start of every recording **/
+		struct Header {
+			char     Magic[4]; // GLRC
+			unsigned Version;
+			GLsizei  Width, Height;
+			int      Frames;
+		};
+
+		static const unsigned FileVersion = 2;
+
+		/** Starts writing calls to a file, once GLEW is initialized **/
+		static bool start(const char* path, GLsizei width, GLsizei height);
+
+		/** Finishes the file **/
+		static void stop();
+		static bool isRecording();
+
+		/** Marks the end of a frame, where the buffers were swapped **/
+		static void frame();
+
+		/** Calls made through each wrapped entry point since the last
+		    reset, counted whether or not a file is being written **/
+		static unsigned long long getCount(Command command);
+		static void resetCounts();
+
+		/** Wrapped entry points, which files route here by defining
+		    GLRECORDER_HOOKS before including this header **/
+		static GLuint createShader(GLenum type);
+		static void   shaderSource(GLuint shader, GLsizei count,
+			const GLchar* const* strings, const GLint* lengths);
+		static void   compileShader(GLuint shader);
+		static void   deleteShader(GLuint shader);
+		static GLuint createProgram();
+		static void   attachShader(GLuint program, GLuint shader);
+		static void   linkProgram(GLuint program);
+		static void   deleteProgram(GLuint program);
+		static void   useProgram(GLuint program);
+		static GLint  getUniformLocation(GLuint program, const GLchar* name);
+		static void   uniformMatrix4fv(GLint location, GLsizei count,
+			GLboolean transpose, const GLfloat* value);
+		static void   uniform1ui(GLint location, GLuint value);
+		static void   genBuffers(GLsizei count, GLuint* buffers);
+		static void   bindBuffer(GLenum target, GLuint buffer);
+		static void   bufferData(GLenum target, GLsizeiptr size,
+			const GLvoid* data, GLenum usage);
+		static void   genVertexArrays(GLsizei count, GLuint* arrays);
+		static void   bindVertexArray(GLuint array);
+		static void   clear(GLbitfield mask);
+		static void   clearColor(GLfloat red, GLfloat green, GLfloat blue,
+			GLfloat alpha);
+		static void   enable(GLenum capability);
+		static void   depthFunc(GLenum function);
+		static void   viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+		static void   drawArrays(GLenum mode, GLint first, GLsizei count);
+	protected:
+	private:
+		/** Internal variables for the file being written **/
+		static FILE*  File;
+		static Header Written;
+
+		/** Calls made through each entry point, by command **/
+		static unsigned long long Counts[FRAME + 1];
+
+		/** The entry points replaced inside GLEW, for calls made from
+		    inline code that includes can't route, such as vertex formats **/
+		static PFNGLENABLEVERTEXATTRIBARRAYPROC  RealEnableAttribute;
+		static PFNGLDISABLEVERTEXATTRIBARRAYPROC RealDisableAttribute;
+		static PFNGLVERTEXATTRIBPOINTERPROC      RealAttributePointer;
+
+		/** No constructing, the class only has static functions **/
+		GLRecorder();
+
+		/** Replacements installed into GLEW while recording **/
+		static void GLAPIENTRY enableAttribute(GLuint index);
+		static void GLAPIENTRY disableAttribute(GLuint index);
+		static void GLAPIENTRY attributePointer(GLuint index, GLint size,
+			GLenum type, GLboolean normalized, GLsizei stride,
+			const GLvoid* pointer);
+
+		/** Internal functions used for writing **/
+		static bool record(Command command);
+		static void writeBytes(const void* data, size_t size);
+		static void writeString(const char* text, size_t length);
+		template <typename T> static void write(T value) {
+			writeBytes(&value, sizeof(T));
+		}
+};
+
+#endif // GLRECORDER_H_INCLUDED
+
+/** Files that define GLRECORDER_HOOKS before including this header send
+    their own OpenGL calls through the recorder **/
+#if defined(GLRECORDER_HOOKS) && !defined(GLRECORDER_HOOKED)
+#define GLRECORDER_HOOKED
+#undef  glCreateShader
+#define glCreateShader       GLRecorder::createShader
+#undef  glShaderSource
+#define glShaderSource       GLRecorder::shaderSource
+#undef  glCompileShader
+#define glCompileShader      GLRecorder::compileShader
+#undef  glDeleteShader
+#define glDeleteShader       GLRecorder::deleteShader
+#undef  glCreateProgram
+#define glCreateProgram      GLRecorder::createProgram
+#undef  glAttachShader
+#define glAttachShader       GLRecorder::attachShader
+#undef  glLinkProgram
+#define glLinkProgram        GLRecorder::linkProgram
+#undef  glDeleteProgram
+#define glDeleteProgram      GLRecorder::deleteProgram
+#undef  glUseProgram
+#define glUseProgram         GLRecorder::useProgram
+#undef  glGetUniformLocation
+#define glGetUniformLocation GLRecorder::getUniformLocation
+#undef  glUniformMatrix4fv
+#define glUniformMatrix4fv   GLRecorder::uniformMatrix4fv
+#undef  glUniform1ui
+#define glUniform1ui         GLRecorder::uniform1ui
+#undef  glGenBuffers
+#define glGenBuffers         GLRecorder::genBuffers
+#undef  glBindBuffer
+#define glBindBuffer         GLRecorder::bindBuffer
+#undef  glBufferData
+#define glBufferData         GLRecorder::bufferData
+#undef  glGenVertexArrays
+#define glGenVertexArrays    GLRecorder::genVertexArrays
+#undef  glBindVertexArray
+#define glBindVertexArray    GLRecorder::bindVertexArray
+#define glClear              GLRecorder::clear
+#define glClearColor         GLRecorder::clearColor
+#define glEnable             GLRecorder::enable
+#define glDepthFunc          GLRecorder::depthFunc
+#define glViewport           GLRecorder::viewport
+#define glDrawArrays         GLRecorder::drawArrays
+#endif
@@ -0,0 +1,470 @@
+/*=================================                                       ----*\
+ * GENERATORS CLASS                                                           *
+ * - This static class builds meshes and textures from parameters instead of  *
+ *   data: spheres, subdivided planes, heightmap terrain and tiling patterns. *
+ *   Grid shaped meshes split their rows across the workers, and terrain      *
+ *   heights come from noise evaluated four vertices at a time with SSE, so   *
+ *   any patch of an endless world can be made again on demand without        *
+ *   storing it.                                                              *
+\*----                                       =================================*/
+
+#include "Generators.h"
+#include <cmath>
+#include <map>
+
+/** Terrain shape: the widest features span 1 / frequency units, and heights
+    cover about the given range around zero **/
+static const GLfloat  TerrainFrequency = 1.0f / 48.0f;
+static const GLfloat  TerrainHeight    = 16.0f;
+static const unsigned TerrainSeed      = 0x2545f491u;
+
+/** Rows each worker takes at a time **/
+static const int RowGrain = 8;
+
+/** Sphere of unit radius from rings of latitude and segments of longitude **/
+void Generators::uvSphere(Mesh& mesh, int rings, int segments,
+	ThreadPool* workers)
+{
+	// The seam column is doubled so the grid closes without wrapping
+	Grid grid = { &mesh, segments, rings, 0.0f, 0.0f, 1.0f };
+	mesh.Positions.assign(3 * (segments + 1) * (rings + 1), 0.0f);
+	mesh.Colors.assign(mesh.Positions.size(), 0.0f);
+	runRows(sphereRows, grid, workers);
+
+	mesh.Indices.clear();
+	gridIndices(segments, rings, mesh.Indices);
+}
+
+/** Sphere of unit radius from a subdivided icosahedron **/
+void Generators::icoSphere(Mesh& mesh, int subdivisions) {
+	// Corners of three golden rectangles
+	const GLfloat t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+	const GLfloat corners[] = {
+		-1,  t,  0,   1,  t,  0,  -1, -t,  0,   1, -t,  0,
+		 0, -1,  t,   0,  1,  t,   0, -1, -t,   0,  1, -t,
+		 t,  0, -1,   t,  0,  1,  -t,  0, -1,  -t,  0,  1
+	};
+	const GLuint faces[] = {
+		0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+		1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+		3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+		4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1
+	};
+
+	mesh.Positions.clear();
+	for (int c = 0; c < 12; c++) {
+		GLfloat length = std::sqrt(corners[3 * c] * corners[3 * c] +
+			corners[3 * c + 1] * corners[3 * c + 1] +
+			corners[3 * c + 2] * corners[3 * c + 2]);
+		for (int a = 0; a < 3; a++)
+			mesh.Positions.push_back(corners[3 * c + a] / length);
+	}
+	mesh.Indices.assign(faces, faces + sizeof(faces) / sizeof(faces[0]));
+
+	// Each pass shares the new vertex on an edge between its two triangles,
+	// so it runs in order rather than on the workers
+	for (int s = 0; s < subdivisions; s++) {
+		std::map<unsigned long long, GLuint> midpoints;
+		std::vector<GLuint> split;
+		split.reserve(mesh.Indices.size() * 4);
+
+		for (size_t f = 0; f < mesh.Indices.size(); f += 3) {
+			GLuint middle[3];
+			for (int e = 0; e < 3; e++) {
+				GLuint a = mesh.Indices[f + e];
+				GLuint b = mesh.Indices[f + (e + 1) % 3];
+				unsigned long long key = (a < b) ?
+					(static_cast<unsigned long long>(a) << 32 | b) :
+					(static_cast<unsigned long long>(b) << 32 | a);
+
+				std::map<unsigned long long, GLuint>::iterator found =
+					midpoints.find(key);
+				if (found != midpoints.end()) {
+					middle[e] = found->second;
+					continue;
+				}
+
+				// Push the midpoint out onto the sphere
+				GLfloat point[3], length = 0.0f;
+				for (int i = 0; i < 3; i++) {
+					point[i] = (mesh.Positions[3 * a + i] +
+						mesh.Positions[3 * b + i]) * 0.5f;
+					length += point[i] * point[i];
+				}
+				length = std::sqrt(length);
+
+				middle[e] = static_cast<GLuint>(mesh.Positions.size() / 3);
+				for (int i = 0; i < 3; i++)
+					mesh.Positions.push_back(point[i] / length);
+				midpoints[key] = middle[e];
+			}
+
+			const GLuint triangles[] = {
+				mesh.Indices[f],     middle[0], middle[2],
+				mesh.Indices[f + 1], middle[1], middle[0],
+				mesh.Indices[f + 2], middle[2], middle[1],
+				middle[0],           middle[1], middle[2]
+			};
+			split.insert(split.end(), triangles, triangles + 12);
+		}
+		mesh.Indices.swap(split);
+	}
+
+	// Color by position, like the render test
+	mesh.Colors.resize(mesh.Positions.size());
+	for (size_t i = 0; i < mesh.Positions.size(); i++)
+		mesh.Colors[i] = mesh.Positions[i] * 0.5f + 0.5f;
+}
+
+/** Square in the XZ plane around the origin, split into cells **/
+void Generators::plane(Mesh& mesh, GLfloat size, int divisions,
+	ThreadPool* workers)
+{
+	Grid grid = { &mesh, divisions, divisions, 0.0f, 0.0f, size };
+	mesh.Positions.assign(3 * (divisions + 1) * (divisions + 1), 0.0f);
+	mesh.Colors.assign(mesh.Positions.size(), 0.0f);
+	runRows(planeRows, grid, workers);
+
+	mesh.Indices.clear();
+	gridIndices(divisions, divisions, mesh.Indices);
+}
+
+/** Square of terrain with its corner at x, z **/
+void Generators::terrain(Mesh& mesh, GLfloat x, GLfloat z, GLfloat size,
+	int divisions, ThreadPool* workers)
+{
+	heightfield(mesh, x, z, size, divisions, workers);
+
+	mesh.Indices.clear();
+	gridIndices(divisions, divisions, mesh.Indices);
+}
+
+/** Only the vertices of terrain() **/
+void Generators::heightfield(Mesh& mesh, GLfloat x, GLfloat z, GLfloat size,
+	int divisions, ThreadPool* workers)
+{
+	Grid grid = { &mesh, divisions, divisions, x, z, size };
+	mesh.Positions.assign(3 * (divisions + 1) * (divisions + 1), 0.0f);
+	mesh.Colors.assign(mesh.Positions.size(), 0.0f);
+	runRows(terrainRows, grid, workers);
+}
+
+/** Indices of a grid of cells, facing up for the XZ plane **/
+void Generators::gridIndices(int columns, int rows,
+	std::vector<GLuint>& indices)
+{
+	GLuint width = static_cast<GLuint>(columns + 1);
+	indices.reserve(indices.size() + 6 * columns * rows);
+
+	for (int r = 0; r < rows; r++) {
+		for (int c = 0; c < columns; c++) {
+			GLuint corner = r * width + c;
+			const GLuint cell[] = {
+				corner,     corner + width, corner + 1,
+				corner + 1, corner + width, corner + width + 1
+			};
+			indices.insert(indices.end(), cell, cell + 6);
+		}
+	}
+}
+
+/** Square RGBA8 texture of a pattern that tiles seamlessly **/
+void Generators::texture(std::vector<GLubyte>& pixels, Pattern pattern,
+	int size)
+{
+	pixels.resize(4 * size * size);
+
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			// Position across the tile from 0 to 1
+			GLfloat u     = (x + 0.5f) / size;
+			GLfloat v     = (y + 0.5f) / size;
+			GLfloat value = 1.0f;
+
+			switch (pattern) {
+				case CHECKER:
+					value = ((x * 4 / size + y * 4 / size) & 1) ? 0.55f : 0.95f;
+					break;
+				case STRIPES:
+					value = 0.7f + 0.25f * std::sin(u * 6.2831853f * 3.0f);
+					break;
+				case BRICKS: {
+					// Rows of two bricks, every other row shifted by half
+					int     row    = static_cast<int>(v * 4.0f);
+					GLfloat across = u * 2.0f + (row & 1) * 0.5f;
+					GLfloat inX    = across - std::floor(across);
+					GLfloat inY    = v * 4.0f - row;
+					value = (inX < 0.05f || inY < 0.1f) ? 0.4f : 0.9f;
+					break;
+				}
+				case DOTS: {
+					GLfloat dx = u * 4.0f - std::floor(u * 4.0f) - 0.5f;
+					GLfloat dy = v * 4.0f - std::floor(v * 4.0f) - 0.5f;
+					value = (dx * dx + dy * dy < 0.09f) ? 0.5f : 0.95f;
+					break;
+				}
+				default:
+					break;
+			}
+
+			GLubyte  grey  = static_cast<GLubyte>(value * 255.0f + 0.5f);
+			GLubyte* pixel = &pixels[4 * (y * size + x)];
+			pixel[0] = grey;
+			pixel[1] = grey;
+			pixel[2] = grey;
+			pixel[3] = 255;
+		}
+	}
+}
+
+/** Terrain height at a point, summing octaves of value noise **/
+GLfloat Generators::getHeight(GLfloat x, GLfloat z) {
+	GLfloat sum       = 0.0f;
+	GLfloat amplitude = 0.5f;
+	GLfloat frequency = TerrainFrequency;
+
+	for (int o = 0; o < Octaves; o++) {
+		// Shift each octave so their lattices don't line up
+		GLfloat shift = static_cast<GLfloat>(o) * 17.0f;
+		sum += noise(x * frequency + shift, z * frequency + shift) * amplitude;
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+
+	return (sum - 0.5f) * TerrainHeight;
+}
+
+/** Terrain heights along a row, at x = (first + i) * spacing. The SSE
+    path repeats the scalar arithmetic step for step, so both give the
+    same heights and shared edges match whichever path made them **/
+void Generators::getHeights(int first, GLfloat spacing, GLfloat z,
+	int count, GLfloat* heights)
+{
+	int i = 0;
+
+#ifdef GENERATORS_SSE
+	const __m128i lanes  = _mm_set_epi32(3, 2, 1, 0);
+	const __m128  one    = _mm_set1_ps(1.0f);
+	const __m128  two    = _mm_set1_ps(2.0f);
+	const __m128  three  = _mm_set1_ps(3.0f);
+	const __m128  toUnit = _mm_set1_ps(1.0f / 16777216.0f);
+	const __m128  step   = _mm_set1_ps(spacing);
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_mul_ps(_mm_cvtepi32_ps(
+			_mm_add_epi32(_mm_set1_epi32(first + i), lanes)), step);
+		__m128  sum       = _mm_setzero_ps();
+		GLfloat amplitude = 0.5f;
+		GLfloat frequency = TerrainFrequency;
+
+		for (int o = 0; o < Octaves; o++) {
+			GLfloat shift = static_cast<GLfloat>(o) * 17.0f;
+
+			// The row shares one z, so only x needs vectors
+			GLfloat fz     = z * frequency + shift;
+			GLfloat floorZ = std::floor(fz);
+			int     iz     = static_cast<int>(floorZ);
+			GLfloat tz     = fz - floorZ;
+			GLfloat sz     = tz * tz * (3.0f - 2.0f * tz);
+
+			// Floor by truncating and stepping down where that rounded up
+			__m128  fx     = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(frequency)),
+				_mm_set1_ps(shift));
+			__m128  floorX = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+			floorX = _mm_sub_ps(floorX,
+				_mm_and_ps(_mm_cmpgt_ps(floorX, fx), one));
+			__m128i ix = _mm_cvttps_epi32(floorX);
+			__m128  tx = _mm_sub_ps(fx, floorX);
+			__m128  sx = _mm_mul_ps(_mm_mul_ps(tx, tx),
+				_mm_sub_ps(three, _mm_mul_ps(two, tx)));
+
+			// Hash the four lattice corners around each point
+			__m128 corners[4];
+			for (int k = 0; k < 4; k++) {
+				unsigned rz = static_cast<unsigned>(iz + (k >> 1));
+				rz = ((rz << 16) | (rz >> 16)) ^ TerrainSeed;
+				__m128i h = _mm_xor_si128(
+					_mm_add_epi32(ix, _mm_set1_epi32(k & 1)),
+					_mm_set1_epi32(static_cast<int>(rz)));
+				h = _mm_xor_si128(h, _mm_slli_epi32(h, 13));
+				h = _mm_xor_si128(h, _mm_srli_epi32(h, 17));
+				h = _mm_xor_si128(h, _mm_slli_epi32(h, 5));
+				h = _mm_add_epi32(h, _mm_slli_epi32(h, 3));
+				h = _mm_xor_si128(h, _mm_srli_epi32(h, 11));
+				h = _mm_add_epi32(h, _mm_slli_epi32(h, 15));
+				corners[k] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h, 8)),
+					toUnit);
+			}
+
+			__m128 top    = _mm_add_ps(corners[0],
+				_mm_mul_ps(_mm_sub_ps(corners[1], corners[0]), sx));
+			__m128 bottom = _mm_add_ps(corners[2],
+				_mm_mul_ps(_mm_sub_ps(corners[3], corners[2]), sx));
+			__m128 value  = _mm_add_ps(top,
+				_mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(sz)));
+
+			sum = _mm_add_ps(sum, _mm_mul_ps(value, _mm_set1_ps(amplitude)));
+			amplitude *= 0.5f;
+			frequency *= 2.0f;
+		}
+
+		_mm_storeu_ps(heights + i, _mm_mul_ps(_mm_sub_ps(sum,
+			_mm_set1_ps(0.5f)), _mm_set1_ps(TerrainHeight)));
+	}
+#endif
+
+	// Whatever is left over, or everything without SSE
+	for (; i < count; i++)
+		heights[i] = getHeight(static_cast<GLfloat>(first + i) * spacing, z);
+}
+
+/** Runs rows on the workers, or here without them. Callers inside a worker
+    task must pass no workers, the pool only runs one job at a time **/
+void Generators::runRows(ThreadPool::Task task, Grid& grid,
+	ThreadPool* workers)
+{
+	if (workers)
+		workers->run(task, &grid, grid.Rows + 1, RowGrain);
+	else
+		task(&grid, 0, grid.Rows + 1);
+}
+
+/** Fills rows of a sphere, from the top pole down **/
+void Generators::sphereRows(void* data, int begin, int end) {
+	const GLfloat pi   = 3.14159265358979f;
+	const Grid&   grid = *static_cast<Grid*>(data);
+	Mesh&         mesh = *grid.Target;
+
+	for (int r = begin; r < end; r++) {
+		GLfloat phi = pi * r / grid.Rows;
+		for (int c = 0; c <= grid.Columns; c++) {
+			GLfloat theta = 2.0f * pi * c / grid.Columns;
+			size_t  v     = 3 * (r * (grid.Columns + 1) + c);
+
+			mesh.Positions[v    ] = std::sin(phi) * std::cos(theta);
+			mesh.Positions[v + 1] = std::cos(phi);
+			mesh.Positions[v + 2] = std::sin(phi) * std::sin(theta);
+			for (int a = 0; a < 3; a++)
+				mesh.Colors[v + a] = mesh.Positions[v + a] * 0.5f + 0.5f;
+		}
+	}
+}
+
+/** Fills rows of a flat plane **/
+void Generators::planeRows(void* data, int begin, int end) {
+	const Grid& grid = *static_cast<Grid*>(data);
+	Mesh&       mesh = *grid.Target;
+
+	for (int r = begin; r < end; r++) {
+		GLfloat v = static_cast<GLfloat>(r) / grid.Rows;
+		for (int c = 0; c <= grid.Columns; c++) {
+			GLfloat u     = static_cast<GLfloat>(c) / grid.Columns;
+			size_t  index = 3 * (r * (grid.Columns + 1) + c);
+
+			mesh.Positions[index    ] = (u - 0.5f) * grid.Size;
+			mesh.Positions[index + 1] = 0.0f;
+			mesh.Positions[index + 2] = (v - 0.5f) * grid.Size;
+			mesh.Colors[index    ] = u;
+			mesh.Colors[index + 1] = 0.5f;
+			mesh.Colors[index + 2] = v;
+		}
+	}
+}
+
+/** Fills rows of terrain. Vertices sit on a global lattice of the spacing,
+    so a square's edge lands on exactly the same points as its neighbor's **/
+void Generators::terrainRows(void* data, int begin, int end) {
+	const Grid& grid    = *static_cast<Grid*>(data);
+	Mesh&       mesh    = *grid.Target;
+	GLfloat     spacing = grid.Size / grid.Columns;
+	int         firstX  = static_cast<int>(std::floor(grid.X / spacing + 0.5f));
+	int         firstZ  = static_cast<int>(std::floor(grid.Z / spacing + 0.5f));
+
+	std::vector<GLfloat> heights(grid.Columns + 1);
+	for (int r = begin; r < end; r++) {
+		GLfloat z = static_cast<GLfloat>(firstZ + r) * spacing;
+		getHeights(firstX, spacing, z, grid.Columns + 1, &heights[0]);
+
+		for (int c = 0; c <= grid.Columns; c++) {
+			size_t index = 3 * (r * (grid.Columns + 1) + c);
+			mesh.Positions[index    ] =
+				static_cast<GLfloat>(firstX + c) * spacing;
+			mesh.Positions[index + 1] = heights[c];
+			mesh.Positions[index + 2] = z;
+			getTerrainColor(heights[c], &mesh.Colors[index]);
+		}
+	}
+}
+
+/** Hashes a lattice point into 32 random bits, with shifts and adds only so
+    SSE2 can do the same **/
+unsigned Generators::hash(int x, int z) {
+	unsigned rz = static_cast<unsigned>(z);
+	unsigned h  = static_cast<unsigned>(x) ^
+		(((rz << 16) | (rz >> 16)) ^ TerrainSeed);
+	h ^= h << 13;
+	h ^= h >> 17;
+	h ^= h << 5;
+	h += h << 3;
+	h ^= h >> 11;
+	h += h << 15;
+	return h;
+}
+
+/** Value noise from 0 to 1, smoothly blending the lattice around a point **/
+GLfloat Generators::noise(GLfloat x, GLfloat z) {
+	const GLfloat toUnit = 1.0f / 16777216.0f;
+
+	GLfloat floorX = std::floor(x);
+	GLfloat floorZ = std::floor(z);
+	int     ix     = static_cast<int>(floorX);
+	int     iz     = static_cast<int>(floorZ);
+	GLfloat tx     = x - floorX;
+	GLfloat tz     = z - floorZ;
+	GLfloat sx     = tx * tx * (3.0f - 2.0f * tx);
+	GLfloat sz     = tz * tz * (3.0f - 2.0f * tz);
+
+	GLfloat a = static_cast<GLfloat>(hash(ix,     iz    ) >> 8) * toUnit;
+	GLfloat b = static_cast<GLfloat>(hash(ix + 1, iz    ) >> 8) * toUnit;
+	GLfloat c = static_cast<GLfloat>(hash(ix,     iz + 1) >> 8) * toUnit;
+	GLfloat d = static_cast<GLfloat>(hash(ix + 1, iz + 1) >> 8) * toUnit;
+
+	GLfloat top    = a + (b - a) * sx;
+	GLfloat bottom = c + (d - c) * sx;
+	return top + (bottom - top) * sz;
+}
+
+/** Colors terrain in bands from water up to snow **/
+void Generators::getTerrainColor(GLfloat height, GLfloat* color) {
+	// Height as a share of the range, then the band's color
+	static const GLfloat bands[][4] = {
+		{ 0.00f,  0.10f, 0.25f, 0.55f }, // Water
+		{ 0.32f,  0.20f, 0.45f, 0.70f },
+		{ 0.36f,  0.80f, 0.75f, 0.55f }, // Sand
+		{ 0.42f,  0.30f, 0.60f, 0.20f }, // Grass
+		{ 0.58f,  0.20f, 0.40f, 0.15f },
+		{ 0.68f,  0.45f, 0.40f, 0.35f }, // Rock
+		{ 0.78f,  0.95f, 0.95f, 0.97f }, // Snow
+		{ 1.00f,  1.00f, 1.00f, 1.00f }
+	};
+	const int bandCount = sizeof(bands) / sizeof(bands[0]);
+
+	GLfloat level = height / TerrainHeight + 0.5f;
+	if (level <= bands[0][0]) {
+		color[0] = bands[0][1];
+		color[1] = bands[0][2];
+		color[2] = bands[0][3];
+		return;
+	}
+
+	int b = 1;
+	while (b < bandCount - 1 && level > bands[b][0])
+		b++;
+
+	GLfloat blend = (level - bands[b - 1][0]) / (bands[b][0] - bands[b - 1][0]);
+	if (blend > 1.0f)
+		blend = 1.0f;
+	for (int a = 0; a < 3; a++)
+		color[a] = bands[b - 1][a + 1] +
+			(bands[b][a + 1] - bands[b - 1][a + 1]) * blend;
+}
@@ -0,0 +1,112 @@
+#ifndef GENERATORS_H_INCLUDED
+#define GENERATORS_H_INCLUDED
+
+/*=================================                                       ----*\
+ * GENERATORS CLASS                                                           *
+ * - This static class builds meshes and textures from parameters instead of  *
+ *   data: spheres, subdivided planes, heightmap terrain and tiling patterns. *
+ *   Grid shaped meshes split their rows across the workers, and terrain      *
+ *   heights come from noise evaluated four vertices at a time with SSE, so   *
+ *   any patch of an endless world can be made again on demand without        *
+ *   storing it.                                                              *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "ThreadPool.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GENERATORS_SSE
+#endif
+
+class Generators {
+	public:
+		/** Tiling patterns for textures, in greys so materials can tint
+		    them **/
+		enum Pattern {
+			CHECKER,
+			STRIPES,
+			BRICKS,
+			DOTS,
+			PATTERN_COUNT
+		};
+
+		/** An indexed mesh, laid out the way Batch::addMesh() takes it **/
+		struct Mesh {
+			std::vector<GLfloat> Positions; // Three per vertex
+			std::vector<GLfloat> Colors;    // Three per vertex, 0 to 1
+			std::vector<GLuint>  Indices;   // Three per triangle
+		};
+
+		/** Sphere of unit radius from rings of latitude and segments of
+		    longitude, colored by position **/
+		static void uvSphere(Mesh& mesh, int rings, int segments,
+			ThreadPool* workers);
+
+		/** Sphere of unit radius from an icosahedron split into four
+		    triangles per subdivision, colored by position **/
+		static void icoSphere(Mesh& mesh, int subdivisions);
+
+		/** Square in the XZ plane around the origin, split into cells **/
+		static void plane(Mesh& mesh, GLfloat size, int divisions,
+			ThreadPool* workers);
+
+		/** Square of terrain with its corner at x, z. Neighboring squares
+		    share their edge heights exactly **/
+		static void terrain(Mesh& mesh, GLfloat x, GLfloat z, GLfloat size,
+			int divisions, ThreadPool* workers);
+
+		/** Only the vertices of terrain(), for callers that share one set
+		    of indices between squares **/
+		static void heightfield(Mesh& mesh, GLfloat x, GLfloat z,
+			GLfloat size, int divisions, ThreadPool* workers);
+
+		/** Indices of a grid of cells, rows of columns + 1 vertices **/
+		static void gridIndices(int columns, int rows,
+			std::vector<GLuint>& indices);
+
+		/** Square RGBA8 texture of a pattern that tiles seamlessly **/
+		static void texture(std::vector<GLubyte>& pixels, Pattern pattern,
+			int size);
+
+		/** Terrain height at a point **/
+		static GLfloat getHeight(GLfloat x, GLfloat z);
+
+		/** Terrain heights along a row, at x = (first + i) * spacing **/
+		static void getHeights(int first, GLfloat spacing, GLfloat z,
+			int count, GLfloat* heights);
+	protected:
+	private:
+		/** A grid being filled row by row **/
+		struct Grid {
+			Mesh*   Target;
+			int     Columns, Rows;
+			GLfloat X, Z, Size;
+		};
+
+		/** Octaves of noise summed for the terrain **/
+		static const int Octaves = 5;
+
+		/** No constructing, the class only has static functions **/
+		Generators();
+
+		/** Runs rows on the workers, or here without them **/
+		static void runRows(ThreadPool::Task task, Grid& grid,
+			ThreadPool* workers);
+
+		/** Row tasks for each kind of grid **/
+		static void sphereRows(void* data, int begin, int end);
+		static void planeRows(void* data, int begin, int end);
+		static void terrainRows(void* data, int begin, int end);
+
+		/** Noise helpers, identical in the scalar and SSE versions **/
+		static unsigned hash(int x, int z);
+		static GLfloat  noise(GLfloat x, GLfloat z);
+		static void     getTerrainColor(GLfloat height, GLfloat* color);
+};
+
+#endif // GENERATORS_H_INCLUDED
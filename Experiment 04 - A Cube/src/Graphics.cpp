@@ -6,21 +6,210 @@
 
 #include "Graphics.h"
 
+/** Send this file's OpenGL calls through the recorder **/
+#define GLRECORDER_HOOKS
+#include "GLRecorder.h"
+
+/** Render test cube, 12 triangles **/
+static const GLfloat testCube[] = {
+	-1.0f, -1.0f, -1.0f, // triangle : begin
+	-1.0f, -1.0f,  1.0f,
+	-1.0f,  1.0f,  1.0f,
+	-1.0f, -1.0f, -1.0f, // triangle : begin
+	-1.0f,  1.0f,  1.0f,
+	-1.0f,  1.0f, -1.0f,
+	 1.0f,  1.0f, -1.0f, // triangle : begin
+	-1.0f, -1.0f, -1.0f,
+	-1.0f,  1.0f, -1.0f,
+	 1.0f,  1.0f, -1.0f, // triangle : begin
+	 1.0f, -1.0f, -1.0f,
+	-1.0f, -1.0f, -1.0f,
+	 1.0f, -1.0f,  1.0f, // triangle : begin
+	-1.0f, -1.0f, -1.0f,
+	 1.0f, -1.0f, -1.0f,
+	 1.0f, -1.0f,  1.0f, // triangle : begin
+	-1.0f, -1.0f,  1.0f,
+	-1.0f, -1.0f, -1.0f,
+	-1.0f,  1.0f,  1.0f, // triangle : begin
+	-1.0f, -1.0f,  1.0f,
+	 1.0f, -1.0f,  1.0f,
+	 1.0f,  1.0f,  1.0f, // triangle : begin
+	-1.0f,  1.0f,  1.0f,
+	 1.0f, -1.0f,  1.0f,
+	 1.0f,  1.0f,  1.0f, // triangle : begin
+	 1.0f, -1.0f, -1.0f,
+	 1.0f,  1.0f, -1.0f,
+	 1.0f, -1.0f, -1.0f, // triangle : begin
+	 1.0f,  1.0f,  1.0f,
+	 1.0f, -1.0f,  1.0f,
+	 1.0f,  1.0f,  1.0f, // triangle : begin
+	 1.0f,  1.0f, -1.0f,
+	-1.0f,  1.0f, -1.0f,
+	 1.0f,  1.0f,  1.0f, // triangle : begin
+	-1.0f,  1.0f, -1.0f,
+	-1.0f,  1.0f,  1.0f
+};
+
+/** Every shader startup might compile, read while the window opens **/
+static const char* const startupShaders[] = {
+	"Transform.vshader", "Color.fshader", "Batch.vshader", "Cull.cshader",
+	"HiZ.cshader", "Fullscreen.vshader", "Upscale.fshader", "FXAA.fshader",
+	"SMAAEdges.fshader", "SMAAWeights.fshader", "SMAABlend.fshader",
+	"Lighting.fshader", "Particle.vshader", "ParticleUpdate.vshader",
+	"Procedural.vshader", "Batch.fshader", "Random.glsl", "Material.glsl",
+	"MultiView.glsl", "MultiView.gshader", "MultiView.fshader", "Shadow.glsl",
+	"Depth.fshader"
+};
+
+/** Shader variants every startup links, compiled together **/
+static const Shaders::Variant startupVariants[] = {
+	{ "Procedural.vshader", GL_VERTEX_SHADER,   NULL },
+	{ "Color.fshader",      GL_FRAGMENT_SHADER, NULL },
+	{ "Transform.vshader",  GL_VERTEX_SHADER,   NULL },
+	{ "Particle.vshader",   GL_VERTEX_SHADER,   NULL },
+	{ "Fullscreen.vshader", GL_VERTEX_SHADER,   NULL }
+};
+
+/** Shader variants of the textured batch, then of the shadowed one **/
+static const Shaders::Variant batchVariants[] = {
+	{ "Batch.vshader", GL_VERTEX_SHADER,   "MATERIALS" },
+	{ "Batch.fshader", GL_FRAGMENT_SHADER, "MATERIALS" },
+	{ "Batch.vshader", GL_VERTEX_SHADER,   "MATERIALS SHADOWS" },
+	{ "Batch.fshader", GL_FRAGMENT_SHADER, "MATERIALS SHADOWS" }
+};
+
 /** Define static member variables **/
-const GLfloat * Graphics::vbData; // Render Test
+const GLfloat * Graphics::vbData = testCube; // Render Test
+
+/** Turns the scene around a point by an angle about the vertical **/
+static glm::mat4 orbitAround(const glm::vec3& center, float angle) {
+	glm::mat4 orbit(1.0f);
+	orbit[0][0] = orbit[2][2] = std::cos(angle);
+	orbit[2][0] = std::sin(angle);
+	orbit[0][2] = -orbit[2][0];
+
+	return glm::translate(glm::mat4(1.0f), center) * orbit *
+		glm::translate(glm::mat4(1.0f), -center);
+}
 
 /** Defines the single Graphics instance **/
 Graphics Graphics::Instance = *(new Graphics());
 
 /** Graphics constructor **/
 Graphics::Graphics() {
-	Status = -1;
+	Status        = -1;
+	StaticBatch   = NULL;
+	Palette       = NULL;
+	StaticCulling = NULL;
+	Resolution    = NULL;
+	PostAA        = NULL;
+	Frame         = NULL;
+	FrameOutput   = -1;
+	Workers       = NULL;
+	Init          = NULL;
+	Lights        = NULL;
+	Shading       = NULL;
+	LightCount    = 0;
+	Ground        = NULL;
+	UseTerrain    = false;
+	Effects       = NULL;
+	ParticleCount = 0;
+	ParticleMode  = Particles::CPU;
+	RecordPath    = NULL;
+	Limiter       = NULL;
+	FrameLimit    = 2;
+	LateLatch     = false;
+	Dragging      = false;
+	DragStart     = 0.0;
+	TurnStart     = 0.0f;
+	Turn          = 0.0f;
+	TurnTarget    = 0.0f;
+	Views         = NULL;
+	ViewCount     = 1;
+	ViewTarget    = MultiView::VIEWPORTS;
+	Stereo        = false;
+	ViewProgramID = 0;
+	Sun           = NULL;
+	UseShadows    = false;
+	Scene         = NULL;
+	TravelNode    = SceneGraph::Root;
+	CameraNode    = SceneGraph::Root;
+	CubeNode      = SceneGraph::Root;
+	FloorNode     = SceneGraph::Root;
+	AAMode        = AntiAliasing::MSAA;
+	AASamples     = 4;
+	Width         = 640;
+	Height        = 480;
+	Invalid       = true;
+	SeedPicker.setSeed(static_cast<unsigned>(time(0)));
+	TestSeed      = SeedPicker.next();
 }
 
 /** Initializes the class and creates the game window **/
 int Graphics::initialize() {
-	// Create the game window
-	return Instance.createWindow();
+	// Workers for CPU work that splits across cores, starting with the
+	// steps that don't need the window
+	Instance.Workers = new ThreadPool();
+	Instance.Workers->start(0);
+
+	Instance.Init = new Startup();
+	Startup& init = *Instance.Init;
+
+	// Files and scene data are prepared while the window opens
+	std::vector<Startup::StepID> reads;
+	const int shaderCount = sizeof(startupShaders) / sizeof(startupShaders[0]);
+	for (int s = 0; s < shaderCount; s++)
+		reads.push_back(init.addStep(startupShaders[s], readShaderStep,
+			const_cast<char*>(startupShaders[s]), false));
+	Startup::StepID pack   = init.addStep("Pack render test", packStep,
+		NULL, false);
+	Startup::StepID scene  = init.addStep("Build scene", sceneStep,
+		NULL, false);
+
+	// Everything OpenGL waits for the context, then for what it uploads
+	Startup::StepID window = init.addStep("Create window", windowStep,
+		NULL, true);
+	Startup::StepID build  = init.addStep("Compile shaders", compileStep,
+		NULL, true);
+	Startup::StepID gl     = init.addStep("Set up OpenGL", openGLStep,
+		NULL, true);
+	Startup::StepID test   = init.addStep("Upload render test",
+		renderTestStep, NULL, true);
+	Startup::StepID batch  = init.addStep("Upload batch", batchStep,
+		NULL, true);
+	Startup::StepID ground = init.addStep("Set up terrain", terrainStep,
+		NULL, true);
+	Startup::StepID sparks = init.addStep("Set up particles", particleStep,
+		NULL, true);
+
+	init.require(build, window);
+	init.require(build, scene);
+	init.require(gl, build);
+	init.require(test, gl);
+	init.require(test, pack);
+	init.require(test, scene);
+	init.require(batch, test);
+	init.require(ground, gl);
+	init.require(sparks, gl);
+	for (size_t r = 0; r < reads.size(); r++) {
+		init.require(build, reads[r]);
+		init.require(gl, reads[r]);
+		init.require(test, reads[r]);
+		init.require(batch, reads[r]);
+		init.require(ground, reads[r]);
+		init.require(sparks, reads[r]);
+	}
+
+	bool started = init.run(Instance.Workers);
+	Shaders::clearPreloaded();
+
+	if (!started) {
+		Instance.Status = -1;
+		return Instance.Status;
+	}
+
+	LOG_INFO(GENERAL, "Started in %.2f ms", init.getElapsed());
+	return Instance.Status;
 }
 
 /** External access to the draw function **/
@@ -28,158 +217,447 @@ void Graphics::update() {
 	Instance.draw();
 }
 
+/** Marks the screen as needing a redraw **/
+void Graphics::invalidate() {
+	Instance.Invalid = true;
+}
+
+/** Checks whether anything changed since the last redraw **/
+bool Graphics::isInvalid() {
+	return Instance.Invalid;
+}
+
+/** Checks whether the scene moves on its own and needs every frame **/
+bool Graphics::isAnimating() {
+	// The deferred lights orbit with time, the camera flies over the
+	// terrain and particles never settle
+	return Instance.Lights != NULL || Instance.Ground != NULL ||
+		Instance.Effects != NULL;
+}
+
 /** Access to the GLFW window for use elsewhere **/
 GLFWwindow* Graphics::getWindow() {
 	return Instance.Window;
 }
 
-/** Initializes the render test **/
-void Graphics::initRenderTest() {
+/** Access to the current resolution scale **/
+float Graphics::getResolutionScale() {
+	return (Instance.Resolution ? Instance.Resolution->getScale() : 1.0f);
+}
+
+/** Access to the last measured GPU scene time **/
+double Graphics::getGPUTime() {
+	return (Instance.Resolution ? Instance.Resolution->getGPUTime() : 0.0);
+}
+
+/** Picks the anti-aliasing mode **/
+void Graphics::setAntiAliasing(AntiAliasing::Mode mode, GLsizei samples) {
+	// The lighting pass reads single sample G-buffer targets
+	if (Instance.Shading && mode == AntiAliasing::MSAA) {
+		LOG_WARNING(RENDER, "Deferred shading can't multisample, using FXAA");
+		mode = AntiAliasing::FXAA;
+	}
+
+	Instance.AAMode    = mode;
+	Instance.AASamples = (mode == AntiAliasing::MSAA ? samples : 0);
+
+	// Before initialization the choice is picked up by initOpenGL()
+	if (!Instance.Resolution)
+		return;
+
+	Instance.Resolution->setSamples(Instance.AASamples);
+	Instance.PostAA->build(mode, Instance.Width, Instance.Height);
+	Instance.Invalid = true;
+}
+
+/** Turns dynamic resolution on or off **/
+void Graphics::setDynamicResolution(bool enabled) {
+	if (Instance.Resolution)
+		Instance.Resolution->setScaling(enabled);
+}
+
+/** Lights the scene with deferred shading, before initialization **/
+void Graphics::setDeferredShading(int lightCount) {
+	Instance.LightCount = lightCount;
+}
+
+/** Flies the camera over streamed terrain, before initialization **/
+void Graphics::setTerrain(bool enabled) {
+	Instance.UseTerrain = enabled;
+}
+
+/** Sprays particles from the render test **/
+void Graphics::setParticles(int count, Particles::Mode mode) {
+	Instance.ParticleCount = count;
+	Instance.ParticleMode  = mode;
+
+	// Before initialization the choice is picked up by particleStep()
+	if (Instance.Status != 0)
+		return;
+
+	Instance.initParticles();
+	Instance.Invalid = true;
+}
+
+/** Milliseconds of the last particle update on the CPU **/
+double Graphics::getParticleUpdateTime() {
+	return (Instance.Effects ? Instance.Effects->getUpdateTime() : 0.0);
+}
+
+/** Milliseconds of the last measured particle update on the GPU **/
+double Graphics::getParticleGPUTime() {
+	return (Instance.Effects ? Instance.Effects->getGPUTime() : 0.0);
+}
+
+/** Records the OpenGL calls to a file, before initialization **/
+void Graphics::setRecording(const char* path) {
+	Instance.RecordPath = path;
+}
+
+/** Sets how many frames the GPU may queue **/
+void Graphics::setFrameLimit(int frames) {
+	Instance.FrameLimit = frames;
+	if (Instance.Limiter)
+		Instance.Limiter->setLimit(frames);
+}
+
+/** Draws the scene from several cameras in one pass **/
+void Graphics::setViews(int count, MultiView::Target target, bool stereo) {
+	Instance.ViewCount  = (stereo ? 2 : count);
+	Instance.ViewTarget = target;
+	Instance.Stereo     = stereo;
+}
+
+/** Casts shadows from the sun, before initialization **/
+void Graphics::setShadows(bool enabled) {
+	Instance.UseShadows = enabled;
+}
+
+/** Reads input and the camera again right before the frame is built **/
+void Graphics::setLateLatch(bool enabled) {
+	Instance.LateLatch = enabled;
+}
+
+/** Waits for the queued frames and prints the input latency **/
+void Graphics::reportLatency(FILE* file) {
+	if (!Instance.Limiter)
+		return;
+
+	Instance.Limiter->finish();
+	Instance.Limiter->report(file);
+}
+
+/** Prints how long each startup step took **/
+void Graphics::reportStartup(FILE* file) {
+	if (Instance.Init)
+		Instance.Init->report(file);
+}
+
+/** Bytes held by the offscreen render targets **/
+GLsizeiptr Graphics::getTargetMemory() {
+	if (!Instance.Resolution)
+		return 0;
+
+	return Instance.Resolution->getMemoryUsage() +
+		Instance.Frame->getMemoryUsage();
+}
+
+/** Reads a shader file, named by the data, ahead of compiling it **/
+bool Graphics::readShaderStep(void* data) {
+	// A missing file is reported again when it fails to compile
+	Shaders::preloadShader(static_cast<const char*>(data));
+	return true;
+}
+
+/** Packs the render test's vertices **/
+bool Graphics::packStep(void* data) {
+	// Pack the positions as half floats, the shader makes the colors
+	VertexPacker::packHalfPositions(testCube, 12*3,
+		Instance.TestVertices[0].Position, sizeof(HalfPosition));
+	return true;
+}
+
+/** Places the camera, the render test and the scenery in the scene **/
+bool Graphics::sceneStep(void* data) {
+	// The camera and the render test travel together
+	Instance.Scene      = new SceneGraph();
+	Instance.TravelNode = Instance.Scene->addNode(SceneGraph::Root,
+		glm::mat4(1.0f));
+	Instance.CameraNode = Instance.Scene->addNode(Instance.TravelNode,
+		glm::inverse(glm::lookAt(
+			glm::vec3(4, 3, 3), // Camera location
+			glm::vec3(0, 0, 0), // Camera aim location
+			glm::vec3(0, 1, 0)  // Head is up (0, -1, 0 is upside-down)
+		)));
+	Instance.CubeNode   = Instance.Scene->addNode(Instance.TravelNode,
+		glm::mat4(1.0f));
+
+	// The batch's calls aren't wrapped, so recordings leave it out
+	if (!Instance.RecordPath)
+		initBatchTest();
+
+	// The workers are busy running this step, so update alone
+	Instance.Scene->update(NULL);
+	return true;
+}
+
+/** Opens the window with an OpenGL context **/
+bool Graphics::windowStep(void* data) {
+	return Instance.createWindow() == 0;
+}
+
+/** Compiles the shader variants the scene links, all at once **/
+bool Graphics::compileStep(void* data) {
+	// Failures are reported again when the programs link
+	const int count = sizeof(startupVariants) / sizeof(startupVariants[0]);
+	Shaders::precompile(startupVariants, count);
+
+	// The textured scenery needs storage buffers, and links the shadowed
+	// variants when casting shadows, which several views leave out
+	bool shadowed = Instance.UseShadows && Instance.ViewCount <= 1;
+	if (Instance.Palette && Batch::isSupported() && Materials::isSupported())
+		Shaders::precompile(batchVariants + (shadowed ? 2 : 0), 2);
+	return true;
+}
+
+/** Sets up OpenGL state and the offscreen targets **/
+bool Graphics::openGLStep(void* data) {
+	Instance.initOpenGL();
+	return true;
+}
+
+/** Compiles and uploads the render test **/
+bool Graphics::renderTestStep(void* data) {
 	// Load some shaders
-	Shaders::loadShader("Transform.vshader", GL_VERTEX_SHADER);
+	Shaders::loadShader("Procedural.vshader", GL_VERTEX_SHADER);
 	Shaders::loadShader("Color.fshader", GL_FRAGMENT_SHADER);
 	Instance.ProgramID = Shaders::createProgram();
 
-	// Set up an array of vectors
-	static const GLfloat vbData[] = {
-		-1.0f, -1.0f, -1.0f, // triangle : begin
-		-1.0f, -1.0f,  1.0f,
-		-1.0f,  1.0f,  1.0f,
-		-1.0f, -1.0f, -1.0f, // triangle : begin
-		-1.0f,  1.0f,  1.0f,
-		-1.0f,  1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f, // triangle : begin
-		-1.0f, -1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f, // triangle : begin
-		 1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f,  1.0f, // triangle : begin
-		-1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f,  1.0f, // triangle : begin
-		-1.0f, -1.0f,  1.0f,
-		-1.0f, -1.0f, -1.0f,
-		-1.0f,  1.0f,  1.0f, // triangle : begin
-		-1.0f, -1.0f,  1.0f,
-		 1.0f, -1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f, // triangle : begin
-		-1.0f,  1.0f,  1.0f,
-		 1.0f, -1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f, // triangle : begin
-		 1.0f, -1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f, // triangle : begin
-		 1.0f,  1.0f,  1.0f,
-		 1.0f, -1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f, // triangle : begin
-		 1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-		 1.0f,  1.0f,  1.0f, // triangle : begin
-		-1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f,  1.0f
-	};
-
-	// Generate one buffer and bind it
+	// Generate one buffer for the positions
 	glGenBuffers(1, &Instance.VertexBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, Instance.VertexBuffer);
-	// Toss the vertices and buffer at OpenGL
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vbData), vbData, GL_STATIC_DRAW);
 
-	// Set up instance buffer
-	Instance.vbData = vbData;
+	// Get a handle for our mvp and seed uniforms
+	// Only do this at initialization
+	Instance.MVPUniformID  = glGetUniformLocation(Instance.ProgramID, "MVP");
+	Instance.SeedUniformID = glGetUniformLocation(Instance.ProgramID, "seed");
 
-	// Generate one buffer and bind it
-	glGenBuffers(1, &Instance.ColorBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, Instance.ColorBuffer);
+	// Set up the camera for the current window size
+	Instance.updateCamera();
 
-	// Get a handle for our mvp uniform
-	// Only do this at initialization
-	Instance.MVPUniformID = glGetUniformLocation(Instance.ProgramID, "MVP");
+	// The same render test again, drawn into every view at once
+	if (Instance.Views) {
+		Instance.ViewProgramID = Instance.Views->createProgram(
+			"Procedural.vshader", "Color.fshader", "");
+		Instance.ModelUniformID    = glGetUniformLocation(
+			Instance.ViewProgramID, "model");
+		Instance.ViewSeedUniformID = glGetUniformLocation(
+			Instance.ViewProgramID, "seed");
+	}
 
-	// Make a projection matrix (FoV, aspect ratio, range-min, range-max)
-	glm::mat4 proj = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 100.0f);
-	// Make a camera matrix
-	glm::mat4 view = glm::lookAt(
-		glm::vec3(4, 3, 3), // Camera location
-		glm::vec3(0, 0, 0), // Camera aim location
-		glm::vec3(0, 1, 0)  // Head is up (0, -1, 0 is upside-down)
-	);
-
-	// Make a model matrix
-	glm::mat4 mod = glm::mat4(1.0f); // Necessary for each model
-	// Our ModelViewProjection
-	Instance.MVP = proj * view * mod;
+	// The render test again, writing depth into the shadow maps
+	if (Instance.Sun) {
+		Shaders::loadShader("Procedural.vshader", GL_VERTEX_SHADER);
+		Shaders::loadShader("Depth.fshader", GL_FRAGMENT_SHADER);
+		Instance.ShadowProgramID    = Shaders::createProgram();
+		Instance.ShadowMVPUniformID = glGetUniformLocation(
+			Instance.ShadowProgramID, "MVP");
+	}
 
-	// Update the render test
-	updateRenderTest();
+	// Send the positions packed earlier, once
+	Instance.uploadRenderTest();
+	return true;
 }
 
-/** Updates the render test **/
-void Graphics::updateRenderTest() {
-	// Seed random and get base color values
-	srand(static_cast<unsigned>(time(0)));
-	float pr = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-	float nr = 1.0f - pr;
-	float pg = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-	float ng = 1.0f - pg;
-	float pb = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-	float nb = 1.0f - pb;
-
-	float modR = 0.0f;
-	float modG = 0.0f;
-	float modB = 0.0f;
-
-	// Vertex colors
-	GLfloat cbData[12*3*3];
-	// Generate vertex colors
-	for (int v = 0; v < 12 * 3; v++) {
-		if (v % 6 == 0) {
-			modR =  static_cast<float>(rand());
-			modR /= static_cast<float>(RAND_MAX);
-			modG =  static_cast<float>(rand());
-			modG /= static_cast<float>(RAND_MAX);
-			modB =  static_cast<float>(rand());
-			modB /= static_cast<float>(RAND_MAX);
+/** Builds the static scenery when batching is available **/
+bool Graphics::batchStep(void* data) {
+	if (!Instance.StaticBatch)
+		return true;
+
+	// The scenery is drawn across the views too, and receives shadows
+	Instance.StaticBatch->setViews(Instance.Views);
+	Instance.StaticBatch->setShadows(Instance.Sun);
+
+	// Without materials the scenery keeps its vertex colors
+	if (!Instance.Palette->build()) {
+		Instance.StaticBatch->setMaterials(NULL);
+		delete Instance.Palette;
+		Instance.Palette       = NULL;
+	}
+
+	if (!Batch::isSupported() || !Instance.StaticBatch->build()) {
+		delete Instance.StaticBatch;
+		Instance.StaticBatch = NULL;
+		Instance.BatchNodes.clear();
+		return true;
+	}
+
+	// Cull the batch on the GPU when compute shaders are available. It
+	// tests a single frustum, so several views draw everything
+	if (Culling::isSupported() && !Instance.Views) {
+		Instance.StaticCulling = new Culling();
+		if (!Instance.StaticCulling->build(Instance.StaticBatch, 320, 240)) {
+			delete Instance.StaticCulling;
+			Instance.StaticCulling = NULL;
 		}
+	}
+	return true;
+}
+
+/** Starts streaming terrain beneath the scenery **/
+bool Graphics::terrainStep(void* data) {
+	// Its calls aren't wrapped, so recordings leave it out
+	if (!Instance.UseTerrain || Instance.RecordPath)
+		return true;
+
+	// Chunks of 32 units reach six chunks out, below the floor
+	Instance.Ground = new Terrain();
+	if (!Instance.Ground->build(6, 32.0f, 32, -8.0f)) {
+		delete Instance.Ground;
+		Instance.Ground = NULL;
+	}
+	return true;
+}
+
+/** Starts the particles when any were asked for **/
+bool Graphics::particleStep(void* data) {
+	Instance.initParticles();
+	return true;
+}
+
+/** Fills a static batch with a floor of small cubes, without OpenGL **/
+void Graphics::initBatchTest() {
+	// Indexed cube corners, colored by position
+	static const GLfloat positions[] = {
+		-1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,
+		 1.0f,  1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,
+		-1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,
+		 1.0f,  1.0f,  1.0f,  -1.0f,  1.0f,  1.0f
+	};
+	static const GLfloat colors[] = {
+		0.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
+		1.0f, 1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 1.0f,   1.0f, 0.0f, 1.0f,
+		1.0f, 1.0f, 1.0f,   0.0f, 1.0f, 1.0f
+	};
+	static const GLuint indices[] = {
+		0, 2, 1,  0, 3, 2, // back
+		4, 5, 6,  4, 6, 7, // front
+		0, 4, 7,  0, 7, 3, // left
+		1, 2, 6,  1, 6, 5, // right
+		3, 7, 6,  3, 6, 2, // top
+		0, 1, 5,  0, 5, 4  // bottom
+	};
+
+	Instance.StaticBatch = new Batch();
+	GLuint cube = Instance.StaticBatch->addMesh(positions, colors, 8,
+		indices, 36);
+
+	// A texture per pattern, each tinted two ways, all in one array
+	static const GLfloat tints[][4] = {
+		{ 1.0f, 0.6f, 0.4f, 0.3f }, { 0.5f, 0.8f, 1.0f, 0.3f },
+		{ 0.7f, 1.0f, 0.5f, 0.3f }, { 1.0f, 0.9f, 0.5f, 0.3f },
+		{ 0.9f, 0.5f, 0.9f, 0.3f }, { 0.6f, 1.0f, 0.9f, 0.3f },
+		{ 1.0f, 1.0f, 1.0f, 0.6f }, { 0.8f, 0.7f, 0.6f, 0.3f }
+	};
+	Instance.Palette = new Materials();
+	std::vector<GLubyte> pixels;
+	for (int p = 0; p < Generators::PATTERN_COUNT; p++) {
+		Generators::texture(pixels, static_cast<Generators::Pattern>(p), 64);
+		int layer = Instance.Palette->addTexture(&pixels[0], 64, 64);
+		for (int t = 0; t < 2; t++) {
+			const GLfloat* tint = tints[2 * p + t];
+			Instance.Palette->addMaterial(layer,
+				glm::vec4(tint[0], tint[1], tint[2], tint[3]), 1.0f + t);
+		}
+	}
+	Instance.StaticBatch->setMaterials(Instance.Palette);
+	GLuint materialCount = static_cast<GLuint>(
+		Instance.Palette->getMaterialCount());
+
+	// Lay out a grid of small cubes beneath the render test, all moving
+	// with the floor
+	SceneGraph& scene = *Instance.Scene;
+	Instance.FloorNode = scene.addNode(SceneGraph::Root,
+		glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -2.0f, 0.0f)));
 
-		cbData[3 * v    ] = (Instance.vbData[3 * v    ] > 0 ? pr : nr);
-		cbData[3 * v + 1] = (Instance.vbData[3 * v + 1] > 0 ? pg : ng);
-		cbData[3 * v + 2] = (Instance.vbData[3 * v + 2] > 0 ? pb : nb);
+	const int gridSize = 32;
+	for (int x = 0; x < gridSize; x++) {
+		for (int z = 0; z < gridSize; z++) {
+			glm::vec3 offset(
+				(x - gridSize / 2) * 0.5f,
+				0.0f,
+				(z - gridSize / 2) * 0.5f
+			);
+			glm::mat4 mod = glm::translate(glm::mat4(1.0f), offset);
+			mod = glm::scale(mod, glm::vec3(0.2f));
+			Instance.BatchNodes.push_back(
+				scene.addNode(Instance.FloorNode, mod));
+		}
+	}
 
-		cbData[3 * v    ] = (cbData[3 * v    ] + modR) / 2.0f;
-		cbData[3 * v + 1] = (cbData[3 * v + 1] + modG) / 2.0f;
-		cbData[3 * v + 2] = (cbData[3 * v + 2] + modB) / 2.0f;
+	// Place the draws where the graph puts them
+	scene.update(NULL);
+	// Neighbors get different materials, yet still share one draw call
+	for (size_t i = 0; i < Instance.BatchNodes.size(); i++) {
+		GLuint material = static_cast<GLuint>(i * 7 + i / gridSize * 3) %
+			materialCount;
+		Instance.StaticBatch->addDraw(cube,
+			scene.getWorld(Instance.BatchNodes[i]), material);
 	}
+}
+
+/** Gives the render test new colors **/
+void Graphics::updateRenderTest() {
+	// Only the seed changes, nothing is uploaded
+	Instance.TestSeed = Instance.SeedPicker.next();
+	Instance.Invalid  = true;
+}
 
+/** Sends the render test's vertices to OpenGL **/
+void Graphics::uploadRenderTest() {
 	// Toss the vertices and buffer at OpenGL
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cbData), cbData, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(TestVertices), TestVertices,
+		GL_STATIC_DRAW);
+	MemoryTracker::track(MemoryTracker::BUFFER, VertexBuffer, "Render test",
+		sizeof(TestVertices));
+
+	Invalid = true;
 }
 
 /** Creates the game window and initializes OpenGL **/
 int Graphics::createWindow() {
 	// Initialize GLFW
 	if (!glfwInit()) {
-		fprintf(stderr, "Failed to initialize GLFW\n");
+		LOG_ERROR(GENERAL, "Failed to initialize GLFW");
 		Status = -1;
 		return Status;
 	}
 
-	// Set up an OpenGL window
-	glfwWindowHint(GLFW_SAMPLES, 16);              // 16x AA
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);      // Not client resizable
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3); // OGL version 3.3
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	// We don't want the deprecated OpenGL
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	// Context versions to try, newest first. 4.3 enables batching, 3.3 is
+	// the minimum the render test needs
+	static const int versions[][2] = { { 4, 5 }, { 4, 3 }, { 3, 3 } };
+	const int versionCount = sizeof(versions) / sizeof(versions[0]);
+
 	// Set the window name
 	const char* name = "Experiment 04 - A Cube";
-	// Create the window with OpenGL
-	Window = glfwCreateWindow(640, 480, name, NULL, NULL);
+	Window = NULL;
+
+	for (int v = 0; v < versionCount && !Window; v++) {
+		// Set up an OpenGL window
+		glfwWindowHint(GLFW_SAMPLES, 0);               // AA happens offscreen
+		glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);       // Client resizable
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, versions[v][0]);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, versions[v][1]);
+		// We don't want the deprecated OpenGL
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		// Create the window with OpenGL
+		Window = glfwCreateWindow(Width, Height, name, NULL, NULL);
+	}
 	// Check to see if the window opened successfully
 	if (!Window) {
-		fprintf(stderr, "Failed to open GLFW window\n");
+		LOG_ERROR(GENERAL, "Failed to open GLFW window");
 		glfwTerminate();
 		Status = -1;
 		return Status;
@@ -188,15 +666,32 @@ int Graphics::createWindow() {
 	// Set the context as current
 	glfwMakeContextCurrent(Window);
 
+	// Follow the window size
+	glfwGetFramebufferSize(Window, &Width, &Height);
+	glfwSetFramebufferSizeCallback(Window, resize);
+	glfwSetWindowRefreshCallback(Window, refresh);
+
+	// Dragging with the left button turns the camera
+	glfwSetMouseButtonCallback(Window, mouseButton);
+	glfwSetCursorPosCallback(Window, cursorMoved);
+
 	// Initialize GLEW
 	glewExperimental = GL_TRUE;
 	if (glewInit() != GLEW_OK) {
-		fprintf(stderr, "Failed to initialize GLEW\n");
+		LOG_ERROR(GENERAL, "Failed to initialize GLEW");
 		Status = -1;
 		return Status;
 	}
 
-	initOpenGL();
+	// Note the driver's free memory before anything is allocated
+	MemoryTracker::initialize();
+
+	// Start recording before anything is created, so the replay can
+	// create it too
+	if (RecordPath && !GLRecorder::start(RecordPath, Width, Height)) {
+		Status = -1;
+		return Status;
+	}
 
 	// Return OK
 	Status = 0;
@@ -205,6 +700,11 @@ int Graphics::createWindow() {
 
 /** Sets up OpenGL for the game **/
 void Graphics::initOpenGL() {
+	// Keep the driver from queuing frames past the limit
+	Limiter = new FrameLimiter();
+	Limiter->setLimit(FrameLimit);
+	Limiter->build();
+
 	// Set up the Vertex Array Object
 	glGenVertexArrays(1, &VertexArrayID);
 	glBindVertexArray(VertexArrayID);
@@ -215,12 +715,334 @@ void Graphics::initOpenGL() {
 	// Enable depth handling
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
+
+	// The lighting pass reads single sample G-buffer targets
+	if (LightCount > 0 && AAMode == AntiAliasing::MSAA) {
+		LOG_WARNING(RENDER, "Deferred shading can't multisample, using FXAA");
+		AAMode    = AntiAliasing::FXAA;
+		AASamples = 0;
+	}
+
+	// Only Graphics and Shaders calls are recorded, so recordings draw
+	// straight to the window
+	if (GLRecorder::isRecording()) {
+		LOG_INFO(RENDER, "Recording renders straight to the window");
+		return;
+	}
+
+	// Render offscreen, scaled to hold 12ms of GPU time. Multisampling
+	// happens in the offscreen target, other modes run after resolving
+	Resolution = new DynamicResolution();
+	if (Resolution->build(Width, Height, AASamples)) {
+		Resolution->setTarget(12.0);
+		Resolution->setMinimumScale(0.5f);
+
+		PostAA = new AntiAliasing();
+		PostAA->build(AAMode, Width, Height);
+		Frame = new RenderGraph();
+
+		if (LightCount > 0)
+			initDeferred();
+		LOG_INFO(RENDER, "Anti-aliasing: %s (%d samples)",
+			AntiAliasing::getModeName(AAMode), AASamples);
+	} else {
+		LOG_WARNING(RENDER, "Rendering straight to the window");
+		delete Resolution;
+		Resolution = NULL;
+	}
+
+	initViews();
+	initShadows();
+}
+
+/** Sets up deferred shading with lights drifting over the scenery **/
+void Graphics::initDeferred() {
+	Lights  = new LightGrid();
+	Shading = new Deferred();
+
+	bool built = Lights->build(Workers, LightCount,
+		glm::vec3(-8.0f, -1.8f, -8.0f), glm::vec3(8.0f, -0.6f, 8.0f));
+	if (!built || !Shading->build(Lights)) {
+		LOG_WARNING(RENDER, "Falling back to forward shading");
+		delete Shading;
+		delete Lights;
+		Shading = NULL;
+		Lights  = NULL;
+		return;
+	}
+
+	// Match the clear color used by forward rendering
+	Shading->setBackground(glm::vec3(0.0f, 0.0f, 0.4f));
+	LOG_INFO(RENDER, "Deferred shading: %d lights, %d worker threads",
+		Lights->getLightCount(), Workers->getThreadCount());
+}
+
+/** Sets up drawing several views in one pass when asked for **/
+void Graphics::initViews() {
+	if (ViewCount <= 1)
+		return;
+
+	// The lighting pass shades a single view
+	if (Shading) {
+		LOG_WARNING(RENDER, "Deferred shading draws a single view");
+		return;
+	}
+
+	Views = new MultiView();
+	if (!Views->build(ViewCount, ViewTarget)) {
+		delete Views;
+		Views = NULL;
+	}
+}
+
+/** Sets up the sun's shadow maps when asked for **/
+void Graphics::initShadows() {
+	if (!UseShadows)
+		return;
+
+	// The cascades are fitted to a single camera
+	if (Views) {
+		LOG_WARNING(RENDER, "Shadows follow a single view, leaving them out");
+		return;
+	}
+
+	// Cascades of 1024 texels reach 40 units, past the far side of the
+	// scenery, and the floor is drawn into them only when it has to be
+	Sun = new Shadows();
+	if (!Sun->build(1024, 40.0f)) {
+		delete Sun;
+		Sun = NULL;
+		return;
+	}
+
+	Sun->setLight(glm::vec3(-0.4f, -1.0f, -0.3f));
+	Sun->setCasters(drawStaticShadows, drawDynamicShadows, NULL);
+}
+
+/** Builds the particles asked for, or removes them **/
+void Graphics::initParticles() {
+	delete Effects;
+	Effects = NULL;
+
+	// Their calls aren't wrapped, so recordings leave them out
+	if (ParticleCount <= 0 || RecordPath)
+		return;
+
+	Effects = new Particles();
+	if (!Effects->build(ParticleCount, ParticleMode)) {
+		delete Effects;
+		Effects = NULL;
+		return;
+	}
+
+	LOG_INFO(RENDER, "Particles: %d on the %s", Effects->getCount(),
+		Particles::getModeName(ParticleMode));
+}
+
+/** Rebuilds the camera matrices for the current window size **/
+void Graphics::updateCamera() {
+	float aspect = static_cast<float>(Width) / static_cast<float>(Height);
+
+	// Make a projection matrix (FoV, aspect ratio, range-min, range-max)
+	Projection = glm::perspective(45.0f, aspect, 0.1f, 100.0f);
+	// The camera matrix undoes the camera's place in the scene, after
+	// orbiting the scene around the render test by the turn
+	const glm::vec4& cube = Scene->getWorld(CubeNode)[3];
+	glm::vec3 center(cube.x, cube.y, cube.z);
+	glm::mat4 camera = glm::inverse(Scene->getWorld(CameraNode));
+	View = camera * orbitAround(center, Turn);
+
+	// Our ModelViewProjection
+	VP  = Projection * View;
+	MVP = VP * Scene->getWorld(CubeNode);
+
+	// The cascades follow the camera, redrawing only those that moved a
+	// whole texel
+	if (Sun)
+		Sun->setCamera(View, Projection, 0.1f);
+
+	if (!Views)
+		return;
+
+	// Each view gets its share of the window. A stereo pair looks from
+	// either side of the camera, the left eye first, while split screen
+	// spreads the views evenly around the render test
+	const int count = Views->getCount();
+	glm::mat4 projection = glm::perspective(45.0f,
+		Views->getAspect(Width, Height), 0.1f, 100.0f);
+	for (int v = 0; v < count; v++) {
+		glm::mat4 view;
+		if (Stereo)
+			view = glm::translate(glm::mat4(1.0f),
+				glm::vec3(v == 0 ? 0.05f : -0.05f, 0.0f, 0.0f)) * View;
+		else
+			view = camera * orbitAround(center,
+				Turn + 6.2831853f * v / count);
+		Views->setView(v, projection * view);
+	}
+}
+
+/** Brings the world matrices up to date with anything that moved **/
+void Graphics::updateScene() {
+	// Fly the camera and the render test along the terrain
+	if (Ground)
+		Scene->setLocal(TravelNode, glm::translate(glm::mat4(1.0f),
+			glm::vec3(static_cast<float>(glfwGetTime()) * -8.0f, 0.0f, 0.0f)));
+
+	Scene->update(Workers);
+
+	if (Scene->hasMoved(CameraNode) || Scene->hasMoved(CubeNode))
+		updateCamera();
+
+	// Only batch draws whose nodes moved need new matrices
+	if (StaticBatch && Scene->getUpdatedCount() > 0) {
+		for (size_t i = 0; i < BatchNodes.size(); i++) {
+			if (!Scene->hasMoved(BatchNodes[i]))
+				continue;
+
+			StaticBatch->setModel(static_cast<GLuint>(i),
+				Scene->getWorld(BatchNodes[i]));
+
+			// The cached shadows of the scenery are stale now
+			if (Sun)
+				Sun->invalidate();
+		}
+		StaticBatch->upload();
+	}
+
+	// Stream the terrain around wherever the camera got to
+	if (Ground) {
+		const glm::vec4& eye = Scene->getWorld(CameraNode)[3];
+		Ground->update(glm::vec3(eye.x, eye.y, eye.z));
+	}
+
+	// Sparks leave from the top of the render test, wherever it went
+	if (Effects) {
+		const glm::vec4& cube = Scene->getWorld(CubeNode)[3];
+		Effects->setEmitter(glm::vec3(cube.x, cube.y + 1.0f, cube.z));
+		Effects->update(glfwGetTime(), Workers);
+	}
+}
+
+/** Takes the newest input into the frame being built **/
+void Graphics::latchInput() {
+	if (Limiter)
+		Limiter->latch();
+
+	if (Turn != TurnTarget) {
+		Turn = TurnTarget;
+		updateCamera();
+	}
+}
+
+/** Handles the window changing size **/
+void Graphics::resize(GLFWwindow* window, int width, int height) {
+	// Ignore minimizing, nothing is visible anyway
+	if (width <= 0 || height <= 0)
+		return;
+
+	Instance.Width  = width;
+	Instance.Height = height;
+
+	if (Instance.Resolution) {
+		Instance.Resolution->resize(width, height);
+		Instance.PostAA->resize(width, height);
+	} else
+		glViewport(0, 0, width, height);
+
+	Instance.updateCamera();
+	Instance.Invalid = true;
+}
+
+/** Handles the window contents needing to be drawn again **/
+void Graphics::refresh(GLFWwindow* window) {
+	Instance.Invalid = true;
+}
+
+/** Handles mouse buttons, the left one starts and ends dragging **/
+void Graphics::mouseButton(GLFWwindow* window, int button, int action,
+	int mods)
+{
+	if (button != GLFW_MOUSE_BUTTON_LEFT)
+		return;
+
+	double y;
+	glfwGetCursorPos(window, &Instance.DragStart, &y);
+	Instance.TurnStart = Instance.TurnTarget;
+	Instance.Dragging  = (action == GLFW_PRESS);
+}
+
+/** Handles the cursor moving, which turns the camera while dragging **/
+void Graphics::cursorMoved(GLFWwindow* window, double x, double y) {
+	if (!Instance.Dragging)
+		return;
+
+	// Half a degree a pixel
+	Instance.TurnTarget = Instance.TurnStart +
+		static_cast<float>(x - Instance.DragStart) * 0.00873f;
+	if (Instance.Limiter)
+		Instance.Limiter->addInput();
+	Instance.Invalid = true;
 }
 
 /** Updates the game screen **/
 void Graphics::draw() {
-	// Clear the screen
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	Trace::frame();
+	TRACE_SCOPE("Draw");
+	latchInput();
+	updateScene();
+
+	// Wait until the GPU is few enough frames behind. Input arriving
+	// meanwhile only makes this frame when latching late
+	if (Limiter) {
+		Limiter->wait();
+		if (LateLatch) {
+			glfwPollEvents();
+			latchInput();
+		}
+	}
+
+	// Bring the shadow maps up to date before anything samples them
+	if (Sun) {
+		TRACE_GPU_SCOPE("Shadows");
+		Sun->render();
+	}
+
+	if (Resolution) {
+		// Render into the scaled offscreen target, then anti-alias and
+		// upscale into the window
+		Resolution->begin();
+		{
+			TRACE_SCOPE("Build frame");
+			buildFrame();
+		}
+		if (Frame->compile())
+			Frame->execute();
+	} else {
+		// Clear the screen
+		TRACE_GPU_SCOPE("Scene");
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		drawScene();
+	}
+
+	// Swap buffers
+	{
+		TRACE_SCOPE("Swap");
+		glfwSwapBuffers(Window);
+	}
+	if (Limiter)
+		Limiter->submit();
+	GLRecorder::frame();
+	Invalid = false;
+}
+
+/** Draws the render test and the static scenery **/
+void Graphics::drawScene() {
+	// Several views submit everything once, instanced across them
+	if (Views) {
+		drawViews();
+		return;
+	}
 
 	// Use our shader
 	glUseProgram(ProgramID);
@@ -228,34 +1050,145 @@ void Graphics::draw() {
 	// Send the transformation to the shader for every model we render
 	glUniformMatrix4fv(MVPUniformID, 1, GL_FALSE, &MVP[0][0]);
 
-	// First attribute: vertices
-	glEnableVertexAttribArray(0);
+	// The colors come from the seed, the buffer only holds positions
+	glUniform1ui(SeedUniformID, TestSeed);
 	glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
-	glVertexAttribPointer(
-		0,        // attribute 0
-		3,        // size
-		GL_FLOAT, // type
-		GL_FALSE, // normalized?
-		0,        // stride
-		(void*) 0 // array buffer offset
-	);
-
-	// Second attribute: vertices
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, ColorBuffer);
-	glVertexAttribPointer(
-		1,        // attribute 0
-		3,        // size
-		GL_FLOAT, // type
-		GL_FALSE, // normalized?
-		0,        // stride
-		(void*) 0 // array buffer offset
-	);
+	HalfPositionFormat::setPointers();
 
 	// Draw a triangle
 	glDrawArrays(GL_TRIANGLES, 0, 12*3);
-	glDisableVertexAttribArray(0);
+	HalfPositionFormat::disable();
 
-	// Swap buffers
-	glfwSwapBuffers(Window);
+	// Draw the static scenery in one submission
+	if (StaticCulling)
+		StaticCulling->draw(VP);
+	else if (StaticBatch)
+		StaticBatch->draw(VP);
+
+	// The terrain chunks uploaded so far
+	if (Ground)
+		Ground->draw(VP);
+
+	if (Effects)
+		Effects->draw(VP);
+}
+
+/** Draws the render test and the static scenery into every view **/
+void Graphics::drawViews() {
+	Views->begin();
+
+	// The view matrices come from the views, only the model is set here
+	glUseProgram(ViewProgramID);
+	const glm::mat4& model = Scene->getWorld(CubeNode);
+	glUniformMatrix4fv(ModelUniformID, 1, GL_FALSE, &model[0][0]);
+	glUniform1ui(ViewSeedUniformID, TestSeed);
+	glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+	HalfPositionFormat::setPointers();
+
+	// One instance of the render test per view
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 12*3, Views->getCount());
+	HalfPositionFormat::disable();
+
+	if (StaticBatch)
+		StaticBatch->drawViews();
+
+	// Terrain and particles draw one view at a time, so they're left out
+	Views->end();
+}
+
+/** Declares this frame's passes **/
+void Graphics::buildFrame() {
+	Frame->reset();
+
+	RenderGraph::Resource window = Frame->importTarget("Window", 0, 0, false);
+	RenderGraph::Resource resolved;
+
+	if (Shading) {
+		// Bin the lights on the workers while the G-buffer is recorded
+		GLsizei width  = Resolution->getScaledWidth();
+		GLsizei height = Resolution->getScaledHeight();
+		Lights->begin(glfwGetTime(), View, Projection, width, height);
+		Shading->setCamera(VP);
+
+		// Light straight into the texture the post passes read
+		resolved = Frame->importTarget("Lit", Resolution->getResolveTexture(),
+			Resolution->getResolveFramebuffer(), false);
+		Shading->addPasses(*Frame, resolved, Resolution->getWidth(),
+			Resolution->getHeight(), width, height, scenePass, NULL);
+	} else {
+		resolved = addForwardPasses();
+	}
+
+	FrameOutput = PostAA->addPasses(*Frame, resolved,
+		Resolution->getScaledWidth(), Resolution->getScaledHeight());
+
+	// The upscale covers the whole window, so it needs no clear either
+	RenderGraph::PassID pass = Frame->addPass("Present", presentPass, NULL);
+	Frame->read(pass, FrameOutput);
+	Frame->write(pass, window, false);
+	Frame->setSideEffect(pass);
+}
+
+/** Declares the forward scene pass and returns the single sample scene **/
+RenderGraph::Resource Graphics::addForwardPasses() {
+	// Without multisampling the scene renders straight into the texture
+	// the post passes read, and there is nothing to resolve
+	bool multisampled = (Resolution->getSceneFramebuffer() !=
+		Resolution->getResolveFramebuffer());
+	RenderGraph::Resource scene = Frame->importTarget("Scene",
+		multisampled ? 0 : Resolution->getResolveTexture(),
+		Resolution->getSceneFramebuffer(), true);
+
+	RenderGraph::PassID pass = Frame->addPass("Scene", scenePass, NULL);
+	Frame->write(pass, scene, true);
+
+	RenderGraph::Resource resolved = scene;
+	if (multisampled) {
+		resolved = Frame->importTarget("Resolved",
+			Resolution->getResolveTexture(),
+			Resolution->getResolveFramebuffer(), false);
+
+		pass = Frame->addPass("Resolve", resolvePass, NULL);
+		Frame->read(pass, scene);
+		Frame->write(pass, resolved, false);
+	}
+
+	return resolved;
+}
+
+/** Renders the scene into the offscreen target **/
+void Graphics::scenePass(RenderGraph& graph, void* data) {
+	Instance.drawScene();
+}
+
+/** Resolves the multisampled scene **/
+void Graphics::resolvePass(RenderGraph& graph, void* data) {
+	Instance.Resolution->resolve();
+}
+
+/** Upscales the finished image into the window **/
+void Graphics::presentPass(RenderGraph& graph, void* data) {
+	Instance.Resolution->present(graph.getTexture(Instance.FrameOutput));
+}
+
+/** Draws the static scenery into a shadow map **/
+void Graphics::drawStaticShadows(const glm::mat4& lightViewProjection,
+	void* data)
+{
+	if (Instance.StaticBatch)
+		Instance.StaticBatch->drawDepth(lightViewProjection);
+}
+
+/** Draws the render test into a shadow map **/
+void Graphics::drawDynamicShadows(const glm::mat4& lightViewProjection,
+	void* data)
+{
+	glm::mat4 mvp = lightViewProjection * Instance.Scene->getWorld(
+		Instance.CubeNode);
+	glUseProgram(Instance.ShadowProgramID);
+	glUniformMatrix4fv(Instance.ShadowMVPUniformID, 1, GL_FALSE, &mvp[0][0]);
+	glBindBuffer(GL_ARRAY_BUFFER, Instance.VertexBuffer);
+	HalfPositionFormat::setPointers();
+	glDrawArrays(GL_TRIANGLES, 0, 12*3);
+	HalfPositionFormat::disable();
 }
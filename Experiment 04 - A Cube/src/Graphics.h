@@ -10,7 +10,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctime>
+#include <cmath>
+#include "Log.h"
 #include "Shaders.h"
+#include "Batch.h"
+#include "Materials.h"
+#include "Generators.h"
+#include "Culling.h"
+#include "DynamicResolution.h"
+#include "AntiAliasing.h"
+#include "RenderGraph.h"
+#include "ThreadPool.h"
+#include "Startup.h"
+#include "LightGrid.h"
+#include "Deferred.h"
+#include "VertexPacker.h"
+#include "SceneGraph.h"
+#include "Terrain.h"
+#include "Particles.h"
+#include "Trace.h"
+#include "GLRecorder.h"
+#include "Random.h"
+#include "FrameLimiter.h"
+#include "MultiView.h"
+#include "Shadows.h"
 #include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -18,17 +41,79 @@
 
 class Graphics {
 	public:
-		/** Initializes the Graphics class and creates the window **/
+		/** Initializes the Graphics class and creates the window, along
+		    with the render test **/
 		static int initialize();
 
+		/** Prints how long each startup step took **/
+		static void reportStartup(FILE* file);
+
 		/** Updates the screen **/
 		static void update();
 
+		/** Marks the screen as needing a redraw **/
+		static void invalidate();
+
+		/** Checks whether anything changed since the last redraw **/
+		static bool isInvalid();
+
+		/** Checks whether the scene moves on its own and needs every frame **/
+		static bool isAnimating();
+
 		/** Access method to grab the GLFW Window for use elsewhere **/
 		static GLFWwindow* getWindow();
 
-		/** Manages the render test **/
-		static void initRenderTest();
+		/** Current resolution scale and GPU scene time **/
+		static float  getResolutionScale();
+		static double getGPUTime();
+
+		/** Picks the anti-aliasing mode, before or after initialization **/
+		static void setAntiAliasing(AntiAliasing::Mode mode, GLsizei samples);
+
+		/** Turns dynamic resolution on or off **/
+		static void setDynamicResolution(bool enabled);
+
+		/** Lights the scene with deferred shading, before initialization **/
+		static void setDeferredShading(int lightCount);
+
+		/** Flies the camera over streamed terrain, before initialization **/
+		static void setTerrain(bool enabled);
+
+		/** Sprays particles from the render test, before or after
+		    initialization. No particles turns them off **/
+		static void setParticles(int count, Particles::Mode mode);
+
+		/** Milliseconds of the last particle update on the CPU, and of the
+		    last measured one on the GPU **/
+		static double getParticleUpdateTime();
+		static double getParticleGPUTime();
+
+		/** Records the OpenGL calls to a file for replaying, before
+		    initialization **/
+		static void setRecording(const char* path);
+
+		/** Bytes held by the offscreen render targets **/
+		static GLsizeiptr getTargetMemory();
+
+		/** Sets how many frames the GPU may queue, from 1 to 3 **/
+		static void setFrameLimit(int frames);
+
+		/** Reads input and the camera again after waiting on the queue,
+		    right before the frame is built **/
+		static void setLateLatch(bool enabled);
+
+		/** Waits for the queued frames and prints the input latency **/
+		static void reportLatency(FILE* file);
+
+		/** Draws the scene from several cameras in one pass, side by side
+		    or as a stereo pair, before initialization **/
+		static void setViews(int count, MultiView::Target target,
+			bool stereo);
+
+		/** Casts shadows from the sun, before initialization **/
+		static void setShadows(bool enabled);
+
+		/** Gives the render test new colors **/
 		static void updateRenderTest();
 	protected:
 	private:
@@ -38,18 +123,107 @@ class Graphics {
 		/** Internal variables for graphics processing **/
 		GLFWwindow* Window;
 		GLuint VertexArrayID, ProgramID, VertexBuffer, MVPUniformID;
-		GLuint ColorBuffer;
+		GLint  SeedUniformID;
 		static const GLfloat* vbData; // Render Test
-		glm::mat4 MVP;
+		HalfPosition TestVertices[12*3];
+		GLuint TestSeed; // Colors are made from it in Procedural.vshader
+		Random SeedPicker;
+		glm::mat4 MVP, VP, View, Projection;
+		Batch*   StaticBatch;
+		Materials* Palette; // Textures and materials of the batch
+		Culling* StaticCulling;
+		DynamicResolution* Resolution;
+		AntiAliasing*      PostAA;
+		AntiAliasing::Mode AAMode;
+		GLsizei            AASamples;
+		RenderGraph*       Frame;
+		RenderGraph::Resource FrameOutput;
+		ThreadPool*        Workers;
+		Startup*           Init;
+		LightGrid*         Lights;
+		Deferred*          Shading;
+		int                LightCount;
+		Terrain*           Ground;
+		bool               UseTerrain;
+		Particles*         Effects;
+		int                ParticleCount;
+		Particles::Mode    ParticleMode;
+		const char*        RecordPath;
+		FrameLimiter*      Limiter;
+		int                FrameLimit;
+		bool               LateLatch;
+		bool               Dragging;
+		double             DragStart;  // Cursor x where the drag began
+		float              TurnStart;  // Turn when the drag began
+		float              Turn;       // Radians orbited around the test
+		float              TurnTarget; // Turn the input asks for
+		MultiView*         Views;
+		int                ViewCount;
+		MultiView::Target  ViewTarget;
+		bool               Stereo;
+		GLuint             ViewProgramID; // Render test across the views
+		GLint              ModelUniformID, ViewSeedUniformID;
+		Shadows*           Sun;
+		bool               UseShadows;
+		GLuint             ShadowProgramID; // Render test as a caster
+		GLint              ShadowMVPUniformID;
+		SceneGraph*        Scene;
+		SceneGraph::Node   TravelNode, CameraNode, CubeNode, FloorNode;
+		std::vector<SceneGraph::Node> BatchNodes; // Node of each batch draw
+		int Width, Height;
 		int Status;
+		bool Invalid;
 
 		/** Private constructor to ensure only one instance exists **/
 		Graphics(); // No constructing
 
+		/** Startup steps, see initialize() for their order **/
+		static bool readShaderStep(void* data);
+		static bool packStep(void* data);
+		static bool sceneStep(void* data);
+		static bool windowStep(void* data);
+		static bool compileStep(void* data);
+		static bool openGLStep(void* data);
+		static bool renderTestStep(void* data);
+		static bool batchStep(void* data);
+		static bool terrainStep(void* data);
+		static bool particleStep(void* data);
+
 		/** Internal functions used for creation and processing **/
 		int  createWindow();
 		void initOpenGL();
+		static void initBatchTest();
+		void uploadRenderTest();
+		void initDeferred();
+		void initParticles();
+		void initViews();
+		void initShadows();
+		void updateCamera();
+		void updateScene();
+		void latchInput();
 		void draw();
+		void drawScene();
+		void drawViews();
+		void buildFrame();
+		RenderGraph::Resource addForwardPasses();
+
+		/** Render graph passes **/
+		static void scenePass(RenderGraph& graph, void* data);
+		static void resolvePass(RenderGraph& graph, void* data);
+		static void presentPass(RenderGraph& graph, void* data);
+
+		/** Shadow casters, the scenery once and the render test every frame **/
+		static void drawStaticShadows(const glm::mat4& lightViewProjection,
+			void* data);
+		static void drawDynamicShadows(const glm::mat4& lightViewProjection,
+			void* data);
+
+		/** Window callbacks **/
+		static void resize(GLFWwindow* window, int width, int height);
+		static void refresh(GLFWwindow* window);
+		static void mouseButton(GLFWwindow* window, int button, int action,
+			int mods);
+		static void cursorMoved(GLFWwindow* window, double x, double y);
 };
 
 #endif // GRAPHICS_H_INCLUDED
@@ -0,0 +1,452 @@
+/*=================================                                       ----*\
+ * LIGHT GRID CLASS                                                           *
+ * - This class animates a set of point lights and sorts them into screen     *
+ *   tiles on the CPU. Each light's screen rectangle is bounded four lights   *
+ *   at a time with SSE, then the tile rows are filled in parallel. The       *
+ *   lights, per-tile ranges and light lists are uploaded as texture buffers. *
+\*----                                       =================================*/
+
+#include "LightGrid.h"
+
+/** Random numbers each light is placed and colored with **/
+static const int RandomsPerLight = 10;
+
+/** LightGrid constructor, OpenGL objects are created in build() **/
+LightGrid::LightGrid() {
+	LightCount    = 0;
+	PaddedCount   = 0;
+	Workers       = NULL;
+	Time          = 0.0f;
+	ScaleX        = 1.0f;
+	ScaleY        = 1.0f;
+	Near          = 0.1f;
+	Far           = 100.0f;
+	Width         = 0;
+	Height        = 0;
+	TilesX        = 0;
+	TilesY        = 0;
+	LightsPerTile = 0.0f;
+	Binning       = false;
+	LightBuffer   = 0;
+	LightTexture  = 0;
+	TileBuffer    = 0;
+	TileTexture   = 0;
+	IndexBuffer   = 0;
+	IndexTexture  = 0;
+}
+
+/** LightGrid destructor **/
+LightGrid::~LightGrid() {
+	// Workers may still be reading the lights
+	if (Binning)
+		Workers->wait();
+
+	GLuint buffers[]  = { LightBuffer, TileBuffer, IndexBuffer };
+	GLuint textures[] = { LightTexture, TileTexture, IndexTexture };
+	glDeleteBuffers(3, buffers);
+	glDeleteTextures(3, textures);
+	MemoryTracker::release(MemoryTracker::BUFFER, 3, buffers);
+	MemoryTracker::release(MemoryTracker::CLIENT,
+		reinterpret_cast<size_t>(&LightData));
+}
+
+/** Scatters lights over the area and creates the texture buffers **/
+bool LightGrid::build(ThreadPool* workers, int lightCount,
+	const glm::vec3& minimum, const glm::vec3& maximum)
+{
+	// Light lists hold 16 bit indices
+	if (lightCount > 65535) {
+		LOG_WARNING(RENDER, "Limiting the light grid to 65535 lights");
+		lightCount = 65535;
+	}
+
+	Workers     = workers;
+	LightCount  = lightCount;
+	PaddedCount = (lightCount + 3) & ~3;
+
+	PositionX.assign(PaddedCount, 0.0f);
+	PositionY.assign(PaddedCount, 0.0f);
+	PositionZ.assign(PaddedCount, 0.0f);
+	Radius.assign(PaddedCount, 0.0f);
+	OrbitX.assign(PaddedCount, 0.0f);
+	OrbitZ.assign(PaddedCount, 0.0f);
+	OrbitRadius.assign(PaddedCount, 0.0f);
+	Phase.assign(PaddedCount, 0.0f);
+	Speed.assign(PaddedCount, 0.0f);
+	Colors.assign(PaddedCount * 3, 0.0f);
+	TileX0.assign(PaddedCount, 0);
+	TileX1.assign(PaddedCount, -1);
+	TileY0.assign(PaddedCount, 0);
+	TileY1.assign(PaddedCount, -1);
+	LightData.assign(LightCount * 8, 0.0f);
+
+	// Each light circles a point in the area at its own pace, the same
+	// seed every run gives the same lights
+	std::vector<GLfloat> units(LightCount * RandomsPerLight);
+	Random random(1);
+	if (!units.empty())
+		random.fillUnits(&units[0], units.size());
+
+	glm::vec3 size = maximum - minimum;
+	for (int l = 0; l < LightCount; l++) {
+		const GLfloat* unit = &units[l * RandomsPerLight];
+		OrbitX[l]      = minimum.x + unit[0] * size.x;
+		PositionY[l]   = minimum.y + unit[1] * size.y;
+		OrbitZ[l]      = minimum.z + unit[2] * size.z;
+		OrbitRadius[l] = 0.2f + unit[3] * 0.8f;
+		Phase[l]       = unit[4] * 6.2831853f;
+		Speed[l]       = (unit[5] - 0.5f) * 3.0f;
+		Radius[l]      = 0.4f + unit[6] * 0.6f;
+
+		// Saturated colors, brightest channel at full strength
+		float r = unit[7], g = unit[8], b = unit[9];
+		float brightest = glm::max(r, glm::max(g, b)) + 0.0001f;
+		Colors[3 * l    ] = r / brightest;
+		Colors[3 * l + 1] = g / brightest;
+		Colors[3 * l + 2] = b / brightest;
+	}
+
+	createTextureBuffer(LightBuffer, LightTexture, GL_RGBA32F);
+	createTextureBuffer(TileBuffer,  TileTexture,  GL_RG32UI);
+	createTextureBuffer(IndexBuffer, IndexTexture, GL_R16UI);
+
+	return (LightTexture != 0 && TileTexture != 0 && IndexTexture != 0);
+}
+
+/** Starts moving and bounding the lights for a frame **/
+void LightGrid::begin(double time, const glm::mat4& view,
+	const glm::mat4& projection, GLsizei width, GLsizei height)
+{
+	Time   = static_cast<float>(time);
+	View   = view;
+	Width  = width;
+	Height = height;
+	TilesX = (width  + TileSize - 1) / TileSize;
+	TilesY = (height + TileSize - 1) / TileSize;
+
+	// Pull the focal lengths and clip distances out of the projection
+	ScaleX = projection[0][0];
+	ScaleY = projection[1][1];
+	Near   = projection[3][2] / (projection[2][2] - 1.0f);
+	Far    = projection[3][2] / (projection[2][2] + 1.0f);
+
+	// Bound the lights on the workers while the caller records other work
+	Binning = true;
+	Workers->dispatch(boundTask, this, PaddedCount / 4, 64);
+}
+
+/** Bins the lights into tiles and uploads the results **/
+void LightGrid::end() {
+	if (!Binning)
+		return;
+
+	TRACE_SCOPE("Finish lights");
+	Workers->wait();
+	Binning = false;
+
+	// Each row collects its own lists, so rows never contend
+	int tileCount = TilesX * TilesY;
+	Rows.resize(TilesY);
+	Tiles.assign(tileCount * 2, 0);
+	Workers->run(fillTask, this, TilesY, 1);
+
+	// Join the rows, moving each row's offsets past the rows before it
+	Indices.clear();
+	for (int y = 0; y < TilesY; y++) {
+		GLuint base = static_cast<GLuint>(Indices.size());
+		for (int x = 0; x < TilesX; x++)
+			Tiles[2 * (y * TilesX + x)] += base;
+		Indices.insert(Indices.end(), Rows[y].Indices.begin(),
+			Rows[y].Indices.end());
+	}
+
+	LightsPerTile = (tileCount > 0 ? static_cast<float>(Indices.size()) /
+		static_cast<float>(tileCount) : 0.0f);
+
+	// Texture buffers can't be empty
+	if (Indices.empty())
+		Indices.push_back(0);
+
+	// Replace last frame's data rather than waiting for the GPU to finish
+	// reading it
+	glBindBuffer(GL_TEXTURE_BUFFER, LightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, LightData.size() * sizeof(float),
+		LightData.empty() ? NULL : &LightData[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, TileBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, Tiles.size() * sizeof(GLuint),
+		Tiles.empty() ? NULL : &Tiles[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, IndexBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, Indices.size() * sizeof(GLushort),
+		&Indices[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	MemoryTracker::track(MemoryTracker::BUFFER, LightBuffer, "Lights",
+		LightData.size() * sizeof(float));
+	MemoryTracker::track(MemoryTracker::BUFFER, TileBuffer, "Light tiles",
+		Tiles.size() * sizeof(GLuint));
+	MemoryTracker::track(MemoryTracker::BUFFER, IndexBuffer, "Light lists",
+		Indices.size() * sizeof(GLushort));
+	MemoryTracker::track(MemoryTracker::CLIENT,
+		reinterpret_cast<size_t>(&LightData), "Lights", getClientBytes());
+}
+
+/** Binds the lights, tile ranges and light lists **/
+void LightGrid::bind(GLuint lightUnit, GLuint tileUnit,
+	GLuint indexUnit) const
+{
+	glActiveTexture(GL_TEXTURE0 + lightUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, LightTexture);
+	glActiveTexture(GL_TEXTURE0 + tileUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, TileTexture);
+	glActiveTexture(GL_TEXTURE0 + indexUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, IndexTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/** Number of tiles across **/
+int LightGrid::getTilesX() const {
+	return TilesX;
+}
+
+/** Number of tiles down **/
+int LightGrid::getTilesY() const {
+	return TilesY;
+}
+
+/** Number of lights **/
+int LightGrid::getLightCount() const {
+	return LightCount;
+}
+
+/** Average lights per tile last frame **/
+float LightGrid::getLightsPerTile() const {
+	return LightsPerTile;
+}
+
+/** Moves a group of lights and finds the tiles each one covers **/
+void LightGrid::boundLights(int begin, int end) {
+	for (int l = begin * 4; l < end * 4 && l < LightCount; l++) {
+		float angle  = Phase[l] + Time * Speed[l];
+		PositionX[l] = OrbitX[l] + OrbitRadius[l] * std::cos(angle);
+		PositionZ[l] = OrbitZ[l] + OrbitRadius[l] * std::sin(angle);
+
+		float* data = &LightData[8 * l];
+		data[0] = PositionX[l];
+		data[1] = PositionY[l];
+		data[2] = PositionZ[l];
+		data[3] = Radius[l];
+		data[4] = Colors[3 * l];
+		data[5] = Colors[3 * l + 1];
+		data[6] = Colors[3 * l + 2];
+	}
+
+	// The sphere's view space box, divided by its nearest depth for extents
+	// below zero and its farthest for those above, bounds the projection.
+	// Clamping to the near plane keeps the part in front of the camera
+	const float halfWidth  = 0.5f * Width  / TileSize;
+	const float halfHeight = 0.5f * Height / TileSize;
+	const float lastX      = static_cast<float>(TilesX - 1);
+	const float lastY      = static_cast<float>(TilesY - 1);
+
+#ifdef LIGHTGRID_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one  = _mm_set1_ps(1.0f);
+	const __m128 near = _mm_set1_ps(Near);
+	const __m128 far  = _mm_set1_ps(Far);
+
+	for (int g = begin; g < end; g++) {
+		int l = g * 4;
+		__m128 x = _mm_loadu_ps(&PositionX[l]);
+		__m128 y = _mm_loadu_ps(&PositionY[l]);
+		__m128 z = _mm_loadu_ps(&PositionZ[l]);
+		__m128 r = _mm_loadu_ps(&Radius[l]);
+
+		// Transform four centers into view space at once
+		__m128 vx = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(View[0][0]), x),
+			_mm_mul_ps(_mm_set1_ps(View[1][0]), y)), _mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(View[2][0]), z), _mm_set1_ps(View[3][0])));
+		__m128 vy = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(View[0][1]), x),
+			_mm_mul_ps(_mm_set1_ps(View[1][1]), y)), _mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(View[2][1]), z), _mm_set1_ps(View[3][1])));
+		__m128 vz = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(View[0][2]), x),
+			_mm_mul_ps(_mm_set1_ps(View[1][2]), y)), _mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(View[2][2]), z), _mm_set1_ps(View[3][2])));
+
+		__m128 depth  = _mm_sub_ps(zero, vz);
+		__m128 nearD  = _mm_max_ps(_mm_sub_ps(depth, r), near);
+		__m128 farD   = _mm_max_ps(_mm_add_ps(depth, r), near);
+		__m128 left   = _mm_sub_ps(vx, r);
+		__m128 right  = _mm_add_ps(vx, r);
+		__m128 bottom = _mm_sub_ps(vy, r);
+		__m128 top    = _mm_add_ps(vy, r);
+
+		// Pick the depth that makes each extent widest
+		#define WIDEST(below) _mm_or_ps( \
+			_mm_and_ps(below, nearD), _mm_andnot_ps(below, farD))
+		__m128 minX = _mm_div_ps(_mm_mul_ps(left, _mm_set1_ps(ScaleX)),
+			WIDEST(_mm_cmplt_ps(left, zero)));
+		__m128 maxX = _mm_div_ps(_mm_mul_ps(right, _mm_set1_ps(ScaleX)),
+			WIDEST(_mm_cmpgt_ps(right, zero)));
+		__m128 minY = _mm_div_ps(_mm_mul_ps(bottom, _mm_set1_ps(ScaleY)),
+			WIDEST(_mm_cmplt_ps(bottom, zero)));
+		__m128 maxY = _mm_div_ps(_mm_mul_ps(top, _mm_set1_ps(ScaleY)),
+			WIDEST(_mm_cmpgt_ps(top, zero)));
+		#undef WIDEST
+
+		// Lights behind the camera, past the far plane, or off screen
+		__m128 minusOne = _mm_sub_ps(zero, one);
+		__m128 visible  = _mm_and_ps(
+			_mm_cmpgt_ps(_mm_add_ps(depth, r), near),
+			_mm_cmplt_ps(_mm_sub_ps(depth, r), far));
+		visible = _mm_and_ps(visible, _mm_and_ps(
+			_mm_cmpge_ps(maxX, minusOne), _mm_cmple_ps(minX, one)));
+		visible = _mm_and_ps(visible, _mm_and_ps(
+			_mm_cmpge_ps(maxY, minusOne), _mm_cmple_ps(minY, one)));
+
+		// Clip space to tiles, clamped to the grid before truncating
+		__m128 lastTileX = _mm_set1_ps(lastX);
+		__m128 lastTileY = _mm_set1_ps(lastY);
+		__m128 scaleX    = _mm_set1_ps(halfWidth);
+		__m128 scaleY    = _mm_set1_ps(halfHeight);
+		__m128i x0 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+			_mm_mul_ps(_mm_add_ps(minX, one), scaleX), zero), lastTileX));
+		__m128i x1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+			_mm_mul_ps(_mm_add_ps(maxX, one), scaleX), zero), lastTileX));
+		__m128i y0 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+			_mm_mul_ps(_mm_add_ps(minY, one), scaleY), zero), lastTileY));
+		__m128i y1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+			_mm_mul_ps(_mm_add_ps(maxY, one), scaleY), zero), lastTileY));
+
+		// Hidden lights get an empty range
+		__m128i mask  = _mm_castps_si128(visible);
+		__m128i empty = _mm_andnot_si128(mask, _mm_set1_epi32(-1));
+		x1 = _mm_or_si128(_mm_and_si128(mask, x1), empty);
+		y1 = _mm_or_si128(_mm_and_si128(mask, y1), empty);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&TileX0[l]), x0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&TileX1[l]), x1);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&TileY0[l]), y0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&TileY1[l]), y1);
+	}
+#else
+	for (int l = begin * 4; l < end * 4; l++) {
+		glm::vec4 center = View * glm::vec4(PositionX[l], PositionY[l],
+			PositionZ[l], 1.0f);
+		float r      = Radius[l];
+		float depth  = -center.z;
+		float nearD  = glm::max(depth - r, Near);
+		float farD   = glm::max(depth + r, Near);
+		float left   = center.x - r, right = center.x + r;
+		float bottom = center.y - r, top   = center.y + r;
+
+		float minX = ScaleX * left   / (left   < 0.0f ? nearD : farD);
+		float maxX = ScaleX * right  / (right  > 0.0f ? nearD : farD);
+		float minY = ScaleY * bottom / (bottom < 0.0f ? nearD : farD);
+		float maxY = ScaleY * top    / (top    > 0.0f ? nearD : farD);
+
+		bool visible = depth + r > Near && depth - r < Far &&
+			maxX >= -1.0f && minX <= 1.0f && maxY >= -1.0f && minY <= 1.0f;
+
+		TileX0[l] = static_cast<int>(
+			glm::clamp((minX + 1.0f) * halfWidth,  0.0f, lastX));
+		TileX1[l] = static_cast<int>(
+			glm::clamp((maxX + 1.0f) * halfWidth,  0.0f, lastX));
+		TileY0[l] = static_cast<int>(
+			glm::clamp((minY + 1.0f) * halfHeight, 0.0f, lastY));
+		TileY1[l] = static_cast<int>(
+			glm::clamp((maxY + 1.0f) * halfHeight, 0.0f, lastY));
+		if (!visible) {
+			TileX1[l] = -1;
+			TileY1[l] = -1;
+		}
+	}
+#endif
+}
+
+/** Builds the light lists for a band of tile rows **/
+void LightGrid::fillRows(int begin, int end) {
+	for (int y = begin; y < end; y++) {
+		Row& row = Rows[y];
+		GLuint* tiles = &Tiles[2 * y * TilesX];
+
+		// Only the lights touching this row need a closer look
+		row.Overlaps.clear();
+		for (int l = 0; l < LightCount; l++) {
+			if (TileY0[l] <= y && y <= TileY1[l] && TileX0[l] <= TileX1[l])
+				row.Overlaps.push_back(static_cast<GLushort>(l));
+		}
+
+		// Count the lights in each tile, then turn counts into offsets
+		for (size_t o = 0; o < row.Overlaps.size(); o++) {
+			int l = row.Overlaps[o];
+			for (int x = TileX0[l]; x <= TileX1[l]; x++)
+				tiles[2 * x + 1]++;
+		}
+
+		GLuint total = 0;
+		for (int x = 0; x < TilesX; x++) {
+			tiles[2 * x] = total;
+			total += tiles[2 * x + 1];
+			tiles[2 * x + 1] = 0;
+		}
+
+		// Fill in the lists, recounting as they go
+		row.Indices.resize(total);
+		for (size_t o = 0; o < row.Overlaps.size(); o++) {
+			int l = row.Overlaps[o];
+			for (int x = TileX0[l]; x <= TileX1[l]; x++) {
+				GLuint& count = tiles[2 * x + 1];
+				row.Indices[tiles[2 * x] + count] = static_cast<GLushort>(l);
+				count++;
+			}
+		}
+	}
+}
+
+/** Thread pool entry for bounding lights **/
+void LightGrid::boundTask(void* data, int begin, int end) {
+	TRACE_SCOPE("Bound lights");
+	static_cast<LightGrid*>(data)->boundLights(begin, end);
+}
+
+/** Thread pool entry for filling tile rows **/
+void LightGrid::fillTask(void* data, int begin, int end) {
+	TRACE_SCOPE("Fill tile rows");
+	static_cast<LightGrid*>(data)->fillRows(begin, end);
+}
+
+/** Creates a buffer and a texture that reads from it **/
+void LightGrid::createTextureBuffer(GLuint& buffer, GLuint& texture,
+	GLenum format)
+{
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+/** Bytes held by the CPU copies of the lights and tiles **/
+GLsizeiptr LightGrid::getClientBytes() const {
+	// Every per-light array grows together, so one capacity covers them
+	GLsizeiptr bytes = static_cast<GLsizeiptr>(PositionX.capacity()) *
+		(9 * sizeof(float) + 4 * sizeof(int));
+	bytes += Colors.capacity() * sizeof(float);
+	bytes += LightData.capacity() * sizeof(float);
+	bytes += Tiles.capacity() * sizeof(GLuint);
+	bytes += Indices.capacity() * sizeof(GLushort);
+
+	for (size_t r = 0; r < Rows.size(); r++)
+		bytes += (Rows[r].Indices.capacity() + Rows[r].Overlaps.capacity()) *
+			sizeof(GLushort);
+
+	return bytes;
+}
@@ -0,0 +1,108 @@
+#ifndef LIGHTGRID_H_INCLUDED
+#define LIGHTGRID_H_INCLUDED
+
+/*=================================                                       ----*\
+ * LIGHT GRID CLASS                                                           *
+ * - This class animates a set of point lights and sorts them into screen     *
+ *   tiles on the CPU. Each light's screen rectangle is bounded four lights   *
+ *   at a time with SSE, then the tile rows are filled in parallel. The       *
+ *   lights, per-tile ranges and light lists are uploaded as texture buffers. *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include "Log.h"
+#include "ThreadPool.h"
+#include "MemoryTracker.h"
+#include "Random.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LIGHTGRID_SSE
+#endif
+
+class LightGrid {
+	public:
+		/** Width and height of a tile in pixels **/
+		static const int TileSize = 16;
+
+		LightGrid();
+		~LightGrid();
+
+		/** Scatters lights over the area and creates the texture buffers **/
+		bool build(ThreadPool* workers, int lightCount,
+			const glm::vec3& minimum, const glm::vec3& maximum);
+
+		/** Starts moving and bounding the lights for a frame **/
+		void begin(double time, const glm::mat4& view,
+			const glm::mat4& projection, GLsizei width, GLsizei height);
+
+		/** Bins the lights into tiles and uploads the results **/
+		void end();
+
+		/** Binds the lights, tile ranges and light lists **/
+		void bind(GLuint lightUnit, GLuint tileUnit, GLuint indexUnit) const;
+
+		/** Layout of the tiles **/
+		int getTilesX() const;
+		int getTilesY() const;
+
+		/** Number of lights and average lights per tile last frame **/
+		int   getLightCount() const;
+		float getLightsPerTile() const;
+	protected:
+	private:
+		/** One tile row's light lists before they are joined **/
+		struct Row {
+			std::vector<GLushort> Indices;
+			std::vector<GLushort> Overlaps; // Lights touching the row
+		};
+
+		/** Internal variables for the lights, laid out four to a vector **/
+		int                LightCount, PaddedCount;
+		std::vector<float> PositionX, PositionY, PositionZ, Radius;
+		std::vector<float> OrbitX, OrbitZ, OrbitRadius, Phase, Speed;
+		std::vector<float> Colors;
+		std::vector<int>   TileX0, TileX1, TileY0, TileY1;
+
+		/** Internal variables for the frame being binned **/
+		ThreadPool*   Workers;
+		float         Time;
+		glm::mat4     View;
+		float         ScaleX, ScaleY, Near, Far;
+		GLsizei       Width, Height;
+		int           TilesX, TilesY;
+		std::vector<Row>     Rows;
+		std::vector<GLuint>  Tiles;       // Offset and count per tile
+		std::vector<GLushort> Indices;
+		std::vector<float>   LightData;   // Position, radius, color
+		float         LightsPerTile;
+		bool          Binning;
+
+		/** Internal variables for the texture buffers **/
+		GLuint LightBuffer, LightTexture;
+		GLuint TileBuffer,  TileTexture;
+		GLuint IndexBuffer, IndexTexture;
+
+		/** Prevent copying, the class owns OpenGL objects **/
+		LightGrid(const LightGrid& source);            // No copying
+		LightGrid& operator=(const LightGrid& source); // No assignment
+
+		/** Internal functions used for binning **/
+		void boundLights(int begin, int end);
+		void fillRows(int begin, int end);
+		static void boundTask(void* data, int begin, int end);
+		static void fillTask(void* data, int begin, int end);
+		static void createTextureBuffer(GLuint& buffer, GLuint& texture,
+			GLenum format);
+
+		/** Bytes held by the CPU copies of the lights and tiles **/
+		GLsizeiptr getClientBytes() const;
+};
+
+#endif // LIGHTGRID_H_INCLUDED
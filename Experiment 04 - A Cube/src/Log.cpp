@@ -0,0 +1,412 @@
+/*=================================                                       ----*\
+ * LOG CLASS                                                                  *
+ * - This class takes messages from any thread without locking or formatting  *
+ *   them. Each thread copies the format string's address and the arguments   *
+ *   into its own ring buffer, and a writer thread formats and prints them in *
+ *   the order they were logged, so console output never stalls a frame.      *
+ *   Messages below a level are compiled out, and each category can be made  *
+ *   quieter while running.                                                   *
+\*----                                       =================================*/
+
+#include "Log.h"
+#include <cstdarg>
+#include <algorithm>
+#include <chrono>
+
+/** Marks the rest of a ring's end as padding, the record starts over **/
+static const unsigned Padding = 0x80000000u;
+
+/** Longest string argument kept, longer ones are cut short **/
+static const size_t MaxString = 8192;
+
+/** How long the writer sleeps between looking for messages **/
+static const int WriterPeriod = 10; // Milliseconds
+
+/** Define static member variables. The levels start at zero, LEVEL_DEBUG,
+    like any static storage **/
+std::atomic<int>        Log::Levels[Log::CATEGORY_COUNT];
+std::atomic<unsigned>   Log::Sequence(0);
+std::mutex              Log::Lock;
+std::vector<Log::Buffer*> Log::Buffers;
+thread_local Log::Buffer* Log::Local = NULL;
+std::thread             Log::Writer;
+std::mutex              Log::DrainLock;
+std::condition_variable Log::Wake;
+bool                    Log::Quit = false;
+std::vector<Log::Pending> Log::Batch;
+std::string             Log::Line;
+
+/** Appends printf style text to a string **/
+static void append(std::string& line, const char* format, ...) {
+	char    text[256];
+	va_list arguments;
+
+	va_start(arguments, format);
+	int length = vsnprintf(text, sizeof(text), format, arguments);
+	va_end(arguments);
+	if (length < 0)
+		return;
+
+	if (static_cast<size_t>(length) < sizeof(text)) {
+		line.append(text, length);
+		return;
+	}
+
+	// Too long for the stack, such as a shader's info log
+	std::vector<char> longer(length + 1);
+	va_start(arguments, format);
+	vsnprintf(&longer[0], longer.size(), format, arguments);
+	va_end(arguments);
+	line.append(&longer[0], length);
+}
+
+/** Starts the writer thread **/
+void Log::start() {
+	static bool registered = false;
+
+	if (Writer.joinable())
+		return;
+
+	Quit   = false;
+	Writer = std::thread(run);
+
+	// Messages logged just before exiting still get printed
+	if (!registered) {
+		atexit(stop);
+		registered = true;
+	}
+}
+
+/** Prints everything logged so far **/
+void Log::flush() {
+	std::lock_guard<std::mutex> guard(DrainLock);
+	drain();
+}
+
+/** Stops the writer thread after printing everything **/
+void Log::stop() {
+	if (Writer.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(DrainLock);
+			Quit = true;
+		}
+		Wake.notify_all();
+		Writer.join();
+	}
+
+	flush();
+}
+
+/** Lowest level printed for a category **/
+void Log::setLevel(Category category, Level level) {
+	Levels[category].store(level, std::memory_order_relaxed);
+}
+
+/** Lowest level printed for every category **/
+void Log::setLevel(Level level) {
+	for (int c = 0; c < CATEGORY_COUNT; c++)
+		Levels[c].store(level, std::memory_order_relaxed);
+}
+
+/** Reads a level from its lower case name **/
+bool Log::parseLevel(const char* name, Level& level) {
+	if (strcmp(name, "debug") == 0) {
+		level = LEVEL_DEBUG;
+	} else if (strcmp(name, "info") == 0) {
+		level = LEVEL_INFO;
+	} else if (strcmp(name, "warning") == 0) {
+		level = LEVEL_WARNING;
+	} else if (strcmp(name, "error") == 0) {
+		level = LEVEL_ERROR;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/** The calling thread's buffer, created on first use **/
+Log::Buffer* Log::getBuffer() {
+	if (Local)
+		return Local;
+
+	// Buffers live until the program ends, so a thread that finishes
+	// still has its messages printed
+	Buffer* buffer = new Buffer();
+	buffer->Data.resize(BufferSize);
+	buffer->Head    = 0;
+	buffer->Tail    = 0;
+	buffer->Dropped = 0;
+	buffer->Next    = 0;
+	buffer->Drained = 0;
+
+	std::lock_guard<std::mutex> guard(Lock);
+	Buffers.push_back(buffer);
+	Local = buffer;
+	return buffer;
+}
+
+/** Space for a record in the calling thread's ring, or NULL when full **/
+char* Log::reserve(size_t bytes) {
+	Buffer& buffer = *getBuffer();
+	size_t  head   = buffer.Head.load(std::memory_order_relaxed);
+	size_t  offset = head & (BufferSize - 1);
+	size_t  left   = BufferSize - offset;
+
+	// Records never wrap, one that doesn't fit before the end skips the
+	// rest of the ring
+	size_t needed = bytes + (bytes > left ? left : 0);
+	if (head + needed - buffer.Tail.load(std::memory_order_acquire) >
+		BufferSize)
+	{
+		buffer.Dropped++;
+		return NULL;
+	}
+
+	if (bytes > left) {
+		*reinterpret_cast<unsigned*>(&buffer.Data[offset]) =
+			static_cast<unsigned>(left) | Padding;
+		offset = 0;
+	}
+
+	buffer.Next = head + needed;
+	return &buffer.Data[offset];
+}
+
+/** Hands the reserved record to the writer **/
+void Log::commit() {
+	Buffer& buffer = *Local;
+	size_t  head   = buffer.Head.load(std::memory_order_relaxed);
+	buffer.Head.store(buffer.Next, std::memory_order_release);
+
+	// Wake the writer early when a burst fills half the ring, instead of
+	// for every message
+	const size_t half = BufferSize / 2;
+	if ((buffer.Next - buffer.Tail.load(std::memory_order_relaxed)) >= half &&
+		(head - buffer.Tail.load(std::memory_order_relaxed)) < half)
+	{
+		Wake.notify_one();
+	}
+}
+
+/** Strings take a length slot and their characters **/
+size_t Log::measure(const char* value) {
+	return 8 + getStringBytes(value ? strlen(value) : 6);
+}
+
+/** Strings take a length slot and their characters **/
+size_t Log::measure(char* value) {
+	return measure(static_cast<const char*>(value));
+}
+
+/** Copies a string, cut short if it is very long **/
+char* Log::pack(char* out, unsigned char& type, const char* value) {
+	if (!value)
+		value = "(null)";
+
+	unsigned long long length = std::min(strlen(value), MaxString);
+	type = STRING;
+	memcpy(out, &length, sizeof(length));
+	memcpy(out + 8, value, length);
+	out[8 + length] = '\0';
+	return out + 8 + getStringBytes(length);
+}
+
+/** Copies a string, cut short if it is very long **/
+char* Log::pack(char* out, unsigned char& type, char* value) {
+	return pack(out, type, static_cast<const char*>(value));
+}
+
+/** Bytes a string takes after its length, with its end, 8 aligned **/
+size_t Log::getStringBytes(size_t length) {
+	return (std::min(length, MaxString) + 1 + 7) & ~static_cast<size_t>(7);
+}
+
+/** Writer thread, prints messages until stopped **/
+void Log::run() {
+	TRACE_THREAD("Log");
+	std::unique_lock<std::mutex> guard(DrainLock);
+
+	while (!Quit) {
+		Wake.wait_for(guard, std::chrono::milliseconds(WriterPeriod));
+		drain();
+	}
+}
+
+/** Prints every committed message in order, with DrainLock held **/
+void Log::drain() {
+	std::vector<Buffer*> buffers;
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		buffers = Buffers;
+	}
+
+	// Gather what each thread has committed so far
+	Batch.clear();
+	for (size_t b = 0; b < buffers.size(); b++) {
+		Buffer& buffer = *buffers[b];
+		size_t  head   = buffer.Head.load(std::memory_order_acquire);
+		size_t  at     = buffer.Tail.load(std::memory_order_relaxed);
+
+		while (at != head) {
+			const char* entry = &buffer.Data[at & (BufferSize - 1)];
+			unsigned    size  = *reinterpret_cast<const unsigned*>(entry);
+			if (size & Padding) {
+				at += size & ~Padding;
+				continue;
+			}
+
+			Pending pending;
+			pending.Entry  = reinterpret_cast<const Record*>(entry);
+			pending.Source = &buffer;
+			Batch.push_back(pending);
+			at += size;
+		}
+		buffer.Drained = head;
+	}
+
+	// Threads are merged back into the order the messages were logged
+	std::sort(Batch.begin(), Batch.end(), isEarlier);
+
+	FILE* last = NULL;
+	for (size_t p = 0; p < Batch.size(); p++) {
+		const Record& record = *Batch[p].Entry;
+		FILE* file = (record.Level >= LEVEL_WARNING ? stderr : stdout);
+
+		// Keep the two streams in order where they share a console
+		if (last && file != last)
+			fflush(last);
+		last = file;
+
+		format(record);
+		Line += '\n';
+		fputs(Line.c_str(), file);
+	}
+	if (last)
+		fflush(last);
+
+	for (size_t b = 0; b < buffers.size(); b++) {
+		Buffer& buffer = *buffers[b];
+		buffer.Tail.store(buffer.Drained, std::memory_order_release);
+
+		int dropped = buffer.Dropped.exchange(0);
+		if (dropped > 0)
+			fprintf(stderr, "Log buffer overflowed, %d messages dropped\n",
+				dropped);
+	}
+}
+
+/** Formats a record into the line, one conversion at a time **/
+void Log::format(const Record& record) {
+	const char* in       = record.Format;
+	const char* argument = reinterpret_cast<const char*>(&record) + RecordBytes;
+	int         next     = 0;
+	char        spec[32];
+
+	Line.clear();
+	while (*in) {
+		if (*in != '%') {
+			const char* text = in;
+			while (*in && *in != '%')
+				in++;
+			Line.append(text, in - text);
+			continue;
+		}
+		if (in[1] == '%') {
+			Line += '%';
+			in   += 2;
+			continue;
+		}
+
+		// Keep the flags, width and precision, the length comes from the
+		// type the argument was kept as
+		size_t length = 0;
+		spec[length++] = *in++;
+		while (*in && strchr("-+ #0123456789.", *in) &&
+			length < sizeof(spec) - 4)
+		{
+			spec[length++] = *in++;
+		}
+		while (*in && strchr("hlLjzt", *in))
+			in++;
+		char conversion = *in;
+		if (conversion)
+			in++;
+
+		if (next >= record.Count) {
+			Line += "(missing)";
+			continue;
+		}
+
+		// Read the argument as whatever it was kept as
+		unsigned char type    = record.Types[next++];
+		long long     integer = 0;
+		double        real    = 0.0;
+		const void*   pointer = NULL;
+		const char*   string  = "(not a string)";
+		if (type == STRING) {
+			unsigned long long size;
+			memcpy(&size, argument, sizeof(size));
+			string    = argument + 8;
+			argument += 8 + getStringBytes(static_cast<size_t>(size));
+		} else {
+			memcpy(&integer, argument, sizeof(integer));
+			if (type == REAL)
+				memcpy(&real, argument, sizeof(real));
+			else if (type == POINTER)
+				memcpy(&pointer, argument, sizeof(pointer));
+			argument += 8;
+		}
+
+		// Then convert it to what the format asked for
+		if (type == REAL)
+			integer = static_cast<long long>(real);
+		else if (type == SIGNED)
+			real = static_cast<double>(integer);
+		else if (type == UNSIGNED)
+			real = static_cast<double>(
+				static_cast<unsigned long long>(integer));
+
+		switch (conversion) {
+			case 'd': case 'i':
+				memcpy(spec + length, "lld", 4);
+				append(Line, spec, integer);
+				break;
+			case 'u': case 'x': case 'X': case 'o':
+				spec[length]     = 'l';
+				spec[length + 1] = 'l';
+				spec[length + 2] = conversion;
+				spec[length + 3] = '\0';
+				append(Line, spec,
+					static_cast<unsigned long long>(integer));
+				break;
+			case 'c':
+				memcpy(spec + length, "c", 2);
+				append(Line, spec, static_cast<int>(integer));
+				break;
+			case 'f': case 'F': case 'e': case 'E':
+			case 'g': case 'G': case 'a': case 'A':
+				spec[length]     = conversion;
+				spec[length + 1] = '\0';
+				append(Line, spec, real);
+				break;
+			case 's':
+				memcpy(spec + length, "s", 2);
+				append(Line, spec, string);
+				break;
+			case 'p':
+				memcpy(spec + length, "p", 2);
+				append(Line, spec, pointer);
+				break;
+			default:
+				Line += "(bad format)";
+				break;
+		}
+	}
+}
+
+/** Orders records by when they were logged, allowing for wrapping **/
+bool Log::isEarlier(const Pending& first, const Pending& second) {
+	return static_cast<int>(first.Entry->Sequence -
+		second.Entry->Sequence) < 0;
+}
@@ -0,0 +1,292 @@
+#ifndef LOG_H_INCLUDED
+#define LOG_H_INCLUDED
+
+/*=================================                                       ----*\
+ * LOG CLASS                                                                  *
+ * - This class takes messages from any thread without locking or formatting  *
+ *   them. Each thread copies the format string's address and the arguments   *
+ *   into its own ring buffer, and a writer thread formats and prints them in *
+ *   the order they were logged, so console output never stalls a frame.      *
+ *   Messages below a level are compiled out, and each category can be made  *
+ *   quieter while running.                                                   *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <type_traits>
+#include "Trace.h"
+
+/** Lowest level compiled in: 0 debug, 1 info, 2 warnings, 3 errors **/
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 1
+#endif
+
+/** Logs a printf style message. The format must outlive the program, such
+    as a string literal, the arguments are copied. No newline is needed **/
+#if LOG_LEVEL <= 0
+#define LOG_DEBUG(category, ...) \
+	Log::write(Log::LEVEL_DEBUG, Log::category, __VA_ARGS__)
+#else
+#define LOG_DEBUG(category, ...) ((void) 0)
+#endif
+#if LOG_LEVEL <= 1
+#define LOG_INFO(category, ...) \
+	Log::write(Log::LEVEL_INFO, Log::category, __VA_ARGS__)
+#else
+#define LOG_INFO(category, ...) ((void) 0)
+#endif
+#if LOG_LEVEL <= 2
+#define LOG_WARNING(category, ...) \
+	Log::write(Log::LEVEL_WARNING, Log::category, __VA_ARGS__)
+#else
+#define LOG_WARNING(category, ...) ((void) 0)
+#endif
+#define LOG_ERROR(category, ...) \
+	Log::write(Log::LEVEL_ERROR, Log::category, __VA_ARGS__)
+
+class Log {
+	public:
+		/** How serious a message is. Warnings and errors go to stderr **/
+		enum Level {
+			LEVEL_DEBUG,
+			LEVEL_INFO,
+			LEVEL_WARNING,
+			LEVEL_ERROR
+		};
+
+		/** What a message is about **/
+		enum Category {
+			GENERAL,
+			SHADERS,  // Compiling and linking
+			RENDER,   // Render targets, passes and their fallbacks
+			TIMING,   // Per-second frame statistics
+			CATEGORY_COUNT
+		};
+
+		/** Starts the writer thread, which also prints anything logged
+		    before it started. Everything is flushed on exit **/
+		static void start();
+
+		/** Prints everything logged so far before returning **/
+		static void flush();
+
+		/** Stops the writer thread after printing everything **/
+		static void stop();
+
+		/** Lowest level printed for a category, or for all of them **/
+		static void setLevel(Category category, Level level);
+		static void setLevel(Level level);
+
+		/** Reads a level from its lower case name **/
+		static bool parseLevel(const char* name, Level& level);
+
+		/** Copies a message into the calling thread's buffer. Messages
+		    that don't fit while the buffer is full are counted and
+		    dropped rather than waited on. Arguments are numbers, pointers
+		    or C strings, so they are taken by value **/
+		template <typename... Arguments>
+		static void write(Level level, Category category, const char* format,
+			Arguments... arguments);
+	protected:
+	private:
+		/** Ring bytes for each thread that logs, a power of two **/
+		static const size_t BufferSize = 1 << 18;
+
+		/** Most arguments one message can take **/
+		static const int MaxArguments = 12;
+
+		/** Types an argument is kept as **/
+		enum Type {
+			SIGNED,
+			UNSIGNED,
+			REAL,
+			STRING,
+			POINTER
+		};
+
+		/** Start of each record in a ring, padding has no format **/
+		struct Record {
+			unsigned      Size; // Bytes including this header, 8 aligned
+			unsigned      Sequence;
+			const char*   Format;
+			unsigned char Level, Category, Count;
+			unsigned char Types[MaxArguments];
+		};
+
+		/** Bytes before a record's arguments, keeping them 8 aligned **/
+		static const size_t RecordBytes = (sizeof(Record) + 7) & ~size_t(7);
+
+		/** Ring of records from one thread. Only that thread writes and
+		    advances the head, only the writer advances the tail **/
+		struct Buffer {
+			std::vector<char>   Data;
+			std::atomic<size_t> Head, Tail; // Bytes ever written and read
+			std::atomic<int>    Dropped;
+			size_t Next;    // Head once the reserved record is committed
+			size_t Drained; // Tail once the writer has printed
+		};
+
+		/** A record waiting to be printed, with where it came from **/
+		struct Pending {
+			const Record* Entry;
+			Buffer*       Source;
+		};
+
+		/** Internal variables shared by every thread. Levels can change
+		    while workers log, so they are atomic **/
+		static std::atomic<int>      Levels[CATEGORY_COUNT];
+		static std::atomic<unsigned> Sequence;
+		static std::mutex            Lock; // Registering buffers
+		static std::vector<Buffer*>  Buffers;
+		static thread_local Buffer*  Local;
+
+		/** Internal variables for the writer **/
+		static std::thread             Writer;
+		static std::mutex              DrainLock; // One drain at a time
+		static std::condition_variable Wake;
+		static bool                    Quit;
+		static std::vector<Pending>    Batch;
+		static std::string             Line;
+
+		/** No constructing, the class only has static functions **/
+		Log();
+
+		/** Internal functions used for recording **/
+		static Buffer* getBuffer();
+		static char*   reserve(size_t bytes);
+		static void    commit();
+
+		/** Sizes each kind of argument, strings are copied whole **/
+		template <typename Value>
+		static size_t measure(Value value);
+		static size_t measure(const char* value);
+		static size_t measure(char* value);
+		static size_t measureAll();
+		template <typename First, typename... Rest>
+		static size_t measureAll(First first, Rest... rest);
+
+		/** Copies each kind of argument into a record **/
+		template <typename Value>
+		static typename std::enable_if<std::is_integral<Value>::value ||
+			std::is_enum<Value>::value, char*>::type
+			pack(char* out, unsigned char& type, Value value);
+		template <typename Value>
+		static typename std::enable_if<std::is_floating_point<Value>::value,
+			char*>::type
+			pack(char* out, unsigned char& type, Value value);
+		template <typename Value>
+		static char* pack(char* out, unsigned char& type, Value* value);
+		static char* pack(char* out, unsigned char& type, const char* value);
+		static char* pack(char* out, unsigned char& type, char* value);
+		static void  packAll(char* out, unsigned char* types);
+		template <typename First, typename... Rest>
+		static void  packAll(char* out, unsigned char* types, First first,
+			Rest... rest);
+
+		/** Internal functions used by the writer **/
+		static void run();
+		static void drain();
+		static void format(const Record& record);
+		static bool isEarlier(const Pending& first, const Pending& second);
+		static size_t getStringBytes(size_t length);
+};
+
+/** Copies a message into the calling thread's buffer **/
+template <typename... Arguments>
+void Log::write(Level level, Category category, const char* format,
+	Arguments... arguments)
+{
+	static_assert(sizeof...(Arguments) <= MaxArguments,
+		"Too many arguments for one log message");
+
+	if (level < Levels[category].load(std::memory_order_relaxed))
+		return;
+
+	size_t bytes = RecordBytes + measureAll(arguments...);
+	char*  out   = reserve(bytes);
+	if (!out)
+		return;
+
+	Record& record  = *reinterpret_cast<Record*>(out);
+	record.Size     = static_cast<unsigned>(bytes);
+	record.Sequence = Sequence.fetch_add(1, std::memory_order_relaxed);
+	record.Format   = format;
+	record.Level    = static_cast<unsigned char>(level);
+	record.Category = static_cast<unsigned char>(category);
+	record.Count    = static_cast<unsigned char>(sizeof...(Arguments));
+	packAll(out + RecordBytes, record.Types, arguments...);
+	commit();
+}
+
+/** Numbers and pointers take one 8 byte slot **/
+template <typename Value>
+size_t Log::measure(Value) {
+	static_assert(std::is_arithmetic<Value>::value ||
+		std::is_enum<Value>::value || std::is_pointer<Value>::value,
+		"Log arguments must be numbers, pointers or C strings");
+	return 8;
+}
+
+/** No arguments left to size **/
+inline size_t Log::measureAll() {
+	return 0;
+}
+
+/** Sizes every argument **/
+template <typename First, typename... Rest>
+size_t Log::measureAll(First first, Rest... rest) {
+	return measure(first) + measureAll(rest...);
+}
+
+/** Copies an integer, keeping whether it was signed **/
+template <typename Value>
+typename std::enable_if<std::is_integral<Value>::value ||
+	std::is_enum<Value>::value, char*>::type
+	Log::pack(char* out, unsigned char& type, Value value)
+{
+	long long integer = static_cast<long long>(value);
+	type = (std::is_signed<Value>::value ? SIGNED : UNSIGNED);
+	memcpy(out, &integer, sizeof(integer));
+	return out + 8;
+}
+
+/** Copies a floating point number **/
+template <typename Value>
+typename std::enable_if<std::is_floating_point<Value>::value, char*>::type
+	Log::pack(char* out, unsigned char& type, Value value)
+{
+	double real = static_cast<double>(value);
+	type = REAL;
+	memcpy(out, &real, sizeof(real));
+	return out + 8;
+}
+
+/** Copies a pointer's address, not what it points to **/
+template <typename Value>
+char* Log::pack(char* out, unsigned char& type, Value* value) {
+	const void* pointer = value;
+	type = POINTER;
+	memcpy(out, &pointer, sizeof(pointer));
+	return out + 8;
+}
+
+/** No arguments left to copy **/
+inline void Log::packAll(char*, unsigned char*) {
+}
+
+/** Copies every argument, noting each one's type **/
+template <typename First, typename... Rest>
+void Log::packAll(char* out, unsigned char* types, First first,
+	Rest... rest)
+{
+	packAll(pack(out, *types, first), types + 1, rest...);
+}
+
+#endif // LOG_H_INCLUDED
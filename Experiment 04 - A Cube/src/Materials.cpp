@@ -0,0 +1,158 @@
+/*=================================                                       ----*\
+ * MATERIALS CLASS                                                            *
+ * - This class keeps every texture of one size and format as a layer of a    *
+ *   single texture array, and every material's layer, tint and tiling in one *
+ *   storage buffer. Draws pick their material by index in the shader, so     *
+ *   objects with different materials still go out in the same multi-draw     *
+ *   call without binding anything between them.                              *
+\*----                                       =================================*/
+
+#include "Materials.h"
+
+/** Materials constructor, OpenGL objects are created in build() **/
+Materials::Materials() {
+	TextureID      = 0;
+	MaterialBuffer = 0;
+	Width          = 0;
+	Height         = 0;
+	Layers         = 0;
+	Built          = false;
+}
+
+/** Materials destructor **/
+Materials::~Materials() {
+	release();
+}
+
+/** Checks whether the context can hold the materials **/
+bool Materials::isSupported() {
+	// Immutable storage is core 4.2 and storage buffers 4.3, texture arrays
+	// are older than both
+	if (GLEW_VERSION_4_3)
+		return true;
+
+	return GLEW_ARB_texture_storage && GLEW_ARB_shader_storage_buffer_object;
+}
+
+/** Adds an RGBA8 texture as the next layer **/
+int Materials::addTexture(const GLubyte* pixels, GLsizei width,
+	GLsizei height)
+{
+	// One array has one size, so the first texture sets it
+	if (Layers == 0) {
+		Width  = width;
+		Height = height;
+	} else if (width != Width || height != Height) {
+		LOG_WARNING(RENDER, "Texture is %dx%d, the material array holds "
+			"%dx%d", width, height, Width, Height);
+		return -1;
+	}
+
+	Pixels.insert(Pixels.end(), pixels, pixels + 4 * width * height);
+	return Layers++;
+}
+
+/** Adds a material using a layer and returns the material ID **/
+GLuint Materials::addMaterial(int layer, const glm::vec4& tint,
+	GLfloat scale)
+{
+	MaterialData material;
+	material.Tint       = tint;
+	material.Layer      = static_cast<GLuint>(layer < 0 ? 0 : layer);
+	material.Scale      = scale;
+	material.Padding[0] = 0;
+	material.Padding[1] = 0;
+	Data.push_back(material);
+
+	return static_cast<GLuint>(Data.size() - 1);
+}
+
+/** Uploads the texture array and the materials **/
+bool Materials::build() {
+	if (!isSupported()) {
+		LOG_ERROR(RENDER, "Texture arrays with storage buffers are not "
+			"supported");
+		return false;
+	}
+
+	// The pixels are gone once uploaded, so the first build stands
+	if (Built)
+		return true;
+	if (Layers == 0 || Data.empty())
+		return false;
+
+	// Every layer gets the full mip chain
+	GLsizei levels = 1;
+	while ((Width >> levels) > 0 || (Height >> levels) > 0)
+		levels++;
+
+	glGenTextures(1, &TextureID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, TextureID);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, Width, Height,
+		Layers);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, Width, Height, Layers,
+		GL_RGBA, GL_UNSIGNED_BYTE, &Pixels[0]);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+		GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	MemoryTracker::track(MemoryTracker::TEXTURE, TextureID, "Materials",
+		MemoryTracker::getImageBytes(GL_RGBA8, Width, Height, levels, 1) *
+			Layers);
+
+	glGenBuffers(1, &MaterialBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, MaterialBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, Data.size() * sizeof(MaterialData),
+		&Data[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	MemoryTracker::track(MemoryTracker::BUFFER, MaterialBuffer, "Materials",
+		Data.size() * sizeof(MaterialData));
+
+	// OpenGL has its own copy of the pixels now
+	std::vector<GLubyte>().swap(Pixels);
+
+	Built = true;
+	return true;
+}
+
+/** Binds the texture array and the materials **/
+void Materials::bind(GLuint textureUnit, GLuint storageBinding) const {
+	if (!Built)
+		return;
+
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, TextureID);
+	glActiveTexture(GL_TEXTURE0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, storageBinding,
+		MaterialBuffer);
+}
+
+/** Number of layers in the texture array **/
+GLsizei Materials::getLayerCount() const {
+	return Layers;
+}
+
+/** Number of materials **/
+GLsizei Materials::getMaterialCount() const {
+	return static_cast<GLsizei>(Data.size());
+}
+
+/** Releases the OpenGL objects owned by the materials **/
+void Materials::release() {
+	if (TextureID != 0) {
+		glDeleteTextures(1, &TextureID);
+		MemoryTracker::release(MemoryTracker::TEXTURE, 1, &TextureID);
+		TextureID = 0;
+	}
+
+	if (MaterialBuffer != 0) {
+		glDeleteBuffers(1, &MaterialBuffer);
+		MemoryTracker::release(MemoryTracker::BUFFER, 1, &MaterialBuffer);
+		MaterialBuffer = 0;
+	}
+
+	Built = false;
+}
@@ -0,0 +1,74 @@
+#ifndef MATERIALS_H_INCLUDED
+#define MATERIALS_H_INCLUDED
+
+/*=================================                                       ----*\
+ * MATERIALS CLASS                                                            *
+ * - This class keeps every texture of one size and format as a layer of a    *
+ *   single texture array, and every material's layer, tint and tiling in one *
+ *   storage buffer. Draws pick their material by index in the shader, so     *
+ *   objects with different materials still go out in the same multi-draw     *
+ *   call without binding anything between them.                              *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "Log.h"
+#include "MemoryTracker.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+class Materials {
+	public:
+		/** Per-material data, laid out to match std430 in Material.glsl **/
+		struct MaterialData {
+			glm::vec4 Tint;       // Alpha is how much vertex color shows
+			GLuint    Layer;      // Texture array layer
+			GLfloat   Scale;      // Texture repeats across the object
+			GLuint    Padding[2];
+		};
+
+		Materials();
+		~Materials();
+
+		/** Checks whether the context has texture arrays with immutable
+		    storage and storage buffers **/
+		static bool isSupported();
+
+		/** Adds an RGBA8 texture as the next layer and returns the layer, or
+		    -1 when its size differs from the first texture's **/
+		int addTexture(const GLubyte* pixels, GLsizei width, GLsizei height);
+
+		/** Adds a material using a layer and returns the material ID **/
+		GLuint addMaterial(int layer, const glm::vec4& tint, GLfloat scale);
+
+		/** Uploads the texture array with mipmaps and the materials, then
+		    lets go of the pixels **/
+		bool build();
+
+		/** Binds the texture array to a texture unit and the materials to
+		    a storage buffer binding **/
+		void bind(GLuint textureUnit, GLuint storageBinding) const;
+
+		/** Number of layers and materials **/
+		GLsizei getLayerCount() const;
+		GLsizei getMaterialCount() const;
+	protected:
+	private:
+		/** Internal variables for the texture array and materials **/
+		GLuint  TextureID, MaterialBuffer;
+		GLsizei Width, Height, Layers;
+		std::vector<GLubyte>      Pixels; // Layers one after another
+		std::vector<MaterialData> Data;
+		bool Built;
+
+		/** Prevent copying, the materials own OpenGL objects **/
+		Materials(const Materials& source);            // No copying
+		Materials& operator=(const Materials& source); // No assignment
+
+		/** Internal functions used for cleanup **/
+		void release();
+};
+
+#endif // MATERIALS_H_INCLUDED
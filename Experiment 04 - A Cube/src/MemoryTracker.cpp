@@ -0,0 +1,201 @@
+/*=================================                                       ----*\
+ * MEMORY TRACKER CLASS                                                       *
+ * - This static class keeps a ledger of the memory behind every buffer,      *
+ *   texture, renderbuffer and shader the renderer creates, and of the CPU    *
+ *   copies it keeps, tagged by owner. It reports current and peak bytes, and *
+ *   compares its total with the driver's own count where one is exposed.     *
+\*----                                       =================================*/
+
+#include "MemoryTracker.h"
+
+/** Define static member variables **/
+std::map<MemoryTracker::Key, MemoryTracker::Allocation>
+	MemoryTracker::Allocations;
+std::map<MemoryTracker::Group, MemoryTracker::Usage>
+	MemoryTracker::Owners;
+MemoryTracker::Usage MemoryTracker::Categories[CATEGORY_COUNT];
+MemoryTracker::Usage MemoryTracker::Device;
+GLint                MemoryTracker::DriverBaseline = 0;
+bool                 MemoryTracker::DriverKnown    = false;
+
+/** Records the driver's free memory to compare against later **/
+void MemoryTracker::initialize() {
+	DriverKnown = getDriverFree(DriverBaseline);
+}
+
+/** Sets the bytes held by an object, replacing what it held before **/
+void MemoryTracker::track(Category category, size_t object, const char* owner,
+	GLsizeiptr bytes)
+{
+	// Reallocating an object moves its bytes, possibly to a new owner
+	release(category, object);
+
+	Allocation& allocation = Allocations[Key(category, object)];
+	allocation.Owner = owner;
+	allocation.Bytes = bytes;
+
+	adjust(Owners[Group(category, allocation.Owner)], bytes, 1);
+	adjust(Categories[category], bytes, 1);
+	if (category != CLIENT)
+		adjust(Device, bytes, 1);
+}
+
+/** Forgets an object that was deleted **/
+void MemoryTracker::release(Category category, size_t object) {
+	std::map<Key, Allocation>::iterator found =
+		Allocations.find(Key(category, object));
+	if (found == Allocations.end())
+		return;
+
+	GLsizeiptr bytes = found->second.Bytes;
+	adjust(Owners[Group(category, found->second.Owner)], -bytes, -1);
+	adjust(Categories[category], -bytes, -1);
+	if (category != CLIENT)
+		adjust(Device, -bytes, -1);
+
+	Allocations.erase(found);
+}
+
+/** Forgets a list of objects that were deleted together **/
+void MemoryTracker::release(Category category, GLsizei count,
+	const GLuint* objects)
+{
+	for (GLsizei i = 0; i < count; i++)
+		release(category, objects[i]);
+}
+
+/** Bytes held by one category now **/
+GLsizeiptr MemoryTracker::getCurrent(Category category) {
+	return Categories[category].Current;
+}
+
+/** Most bytes one category has held at once **/
+GLsizeiptr MemoryTracker::getPeak(Category category) {
+	return Categories[category].Peak;
+}
+
+/** Bytes held on the GPU now **/
+GLsizeiptr MemoryTracker::getDeviceCurrent() {
+	return Device.Current;
+}
+
+/** Most bytes held on the GPU at once **/
+GLsizeiptr MemoryTracker::getDevicePeak() {
+	return Device.Peak;
+}
+
+/** Bytes the driver reports using since initialize **/
+bool MemoryTracker::getDriverUsage(GLint64& bytes) {
+	GLint free = 0;
+	if (!DriverKnown || !getDriverFree(free))
+		return false;
+
+	bytes = static_cast<GLint64>(DriverBaseline - free) * 1024;
+	return true;
+}
+
+/** Prints the ledger grouped by category and owner **/
+void MemoryTracker::report(FILE* file) {
+	fprintf(file, "%-13s %-24s %8s %12s %12s\n",
+		"Memory", "Owner", "Objects", "Current KB", "Peak KB");
+
+	// Owners sort by category first, so each category prints together
+	std::map<Group, Usage>::const_iterator o = Owners.begin();
+	for (; o != Owners.end(); ++o) {
+		const Usage& usage = o->second;
+		if (usage.Peak == 0 && usage.Objects == 0)
+			continue;
+
+		fprintf(file, "%-13s %-24s %8d %12.1f %12.1f\n",
+			getCategoryName(static_cast<Category>(o->first.first)),
+			o->first.second.c_str(), usage.Objects,
+			usage.Current / 1024.0, usage.Peak / 1024.0);
+	}
+
+	for (int c = 0; c < CATEGORY_COUNT; c++) {
+		const Usage& usage = Categories[c];
+		fprintf(file, "%-13s %-24s %8d %12.1f %12.1f\n",
+			getCategoryName(static_cast<Category>(c)), "Total",
+			usage.Objects, usage.Current / 1024.0, usage.Peak / 1024.0);
+	}
+
+	fprintf(file, "%-13s %-24s %8d %12.1f %12.1f\n", "GPU", "Total",
+		Device.Objects, Device.Current / 1024.0, Device.Peak / 1024.0);
+
+	// The driver counts its own overhead and everything else in the
+	// process, so only a growing gap points at something untracked
+	GLint64 driver = 0;
+	if (getDriverUsage(driver))
+		fprintf(file, "Driver reports %.1f KB in use since startup, "
+			"%.1f KB tracked\n", driver / 1024.0, Device.Current / 1024.0);
+}
+
+/** Size of one pixel of a sized internal format **/
+GLsizeiptr MemoryTracker::getPixelBytes(GLenum format) {
+	switch (format) {
+		case GL_R8:                 return 1;
+		case GL_RG8:                return 2;
+		case GL_R16F:               return 2;
+		case GL_RG16F:              return 4;
+		case GL_RGBA16F:            return 8;
+		case GL_RG32F:              return 8;
+		case GL_RGBA32F:            return 16;
+		case GL_DEPTH32F_STENCIL8:  return 8;
+		default:                    return 4;
+	}
+}
+
+/** Size of an image with a full or partial mip chain **/
+GLsizeiptr MemoryTracker::getImageBytes(GLenum format, GLsizei width,
+	GLsizei height, GLsizei levels, GLsizei samples)
+{
+	GLsizeiptr pixels = 0;
+
+	for (GLsizei level = 0; level < levels; level++) {
+		GLsizei w = (width  >> level > 0 ? width  >> level : 1);
+		GLsizei h = (height >> level > 0 ? height >> level : 1);
+		pixels += static_cast<GLsizeiptr>(w) * h;
+	}
+
+	return pixels * getPixelBytes(format) * (samples > 1 ? samples : 1);
+}
+
+/** Adds to a running total, keeping the peak **/
+void MemoryTracker::adjust(Usage& usage, GLsizeiptr bytes, int objects) {
+	usage.Current += bytes;
+	usage.Objects += objects;
+	if (usage.Current > usage.Peak)
+		usage.Peak = usage.Current;
+}
+
+/** Free video memory in kilobytes, from whichever extension is present **/
+bool MemoryTracker::getDriverFree(GLint& kilobytes) {
+	if (GLEW_NVX_gpu_memory_info) {
+		glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX,
+			&kilobytes);
+		return true;
+	}
+
+	// The first value is the pool's total free memory, the rest describe
+	// its largest block and the shared system memory
+	if (GLEW_ATI_meminfo) {
+		GLint info[4] = { 0, 0, 0, 0 };
+		glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, info);
+		kilobytes = info[0];
+		return true;
+	}
+
+	return false;
+}
+
+/** Name of a category for reports **/
+const char* MemoryTracker::getCategoryName(Category category) {
+	switch (category) {
+		case BUFFER:       return "Buffer";
+		case TEXTURE:      return "Texture";
+		case RENDERBUFFER: return "Renderbuffer";
+		case SHADER:       return "Shader";
+		case CLIENT:       return "CPU";
+		default:           return "Unknown";
+	}
+}
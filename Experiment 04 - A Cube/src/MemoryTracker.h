@@ -0,0 +1,104 @@
+#ifndef MEMORYTRACKER_H_INCLUDED
+#define MEMORYTRACKER_H_INCLUDED
+
+/*=================================                                       ----*\
+ * MEMORY TRACKER CLASS                                                       *
+ * - This static class keeps a ledger of the memory behind every buffer,      *
+ *   texture, renderbuffer and shader the renderer creates, and of the CPU    *
+ *   copies it keeps, tagged by owner. It reports current and peak bytes, and *
+ *   compares its total with the driver's own count where one is exposed.     *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+class MemoryTracker {
+	public:
+		/** What kind of object holds the memory **/
+		enum Category {
+			BUFFER,
+			TEXTURE,
+			RENDERBUFFER,
+			SHADER,        // Shader objects and linked programs
+			CLIENT,        // CPU copies, keyed by their address
+			CATEGORY_COUNT
+		};
+
+		/** Records the driver's free memory to compare against later. Call
+		    once the OpenGL context is current **/
+		static void initialize();
+
+		/** Sets the bytes held by an object, replacing what it held before.
+		    Only call on the thread that owns the OpenGL context **/
+		static void track(Category category, size_t object, const char* owner,
+			GLsizeiptr bytes);
+
+		/** Forgets objects that were deleted **/
+		static void release(Category category, size_t object);
+		static void release(Category category, GLsizei count,
+			const GLuint* objects);
+
+		/** Bytes held by one category now and at most **/
+		static GLsizeiptr getCurrent(Category category);
+		static GLsizeiptr getPeak(Category category);
+
+		/** Bytes held on the GPU, every category but CLIENT **/
+		static GLsizeiptr getDeviceCurrent();
+		static GLsizeiptr getDevicePeak();
+
+		/** Bytes the driver reports using since initialize, when it has
+		    an extension that says **/
+		static bool getDriverUsage(GLint64& bytes);
+
+		/** Prints the ledger grouped by category and owner **/
+		static void report(FILE* file);
+
+		/** Size of one pixel of a sized internal format **/
+		static GLsizeiptr getPixelBytes(GLenum format);
+
+		/** Size of an image with a full or partial mip chain **/
+		static GLsizeiptr getImageBytes(GLenum format, GLsizei width,
+			GLsizei height, GLsizei levels, GLsizei samples);
+	protected:
+	private:
+		/** One tracked object **/
+		struct Allocation {
+			std::string Owner;
+			GLsizeiptr  Bytes;
+		};
+
+		/** Running totals for a group of objects **/
+		struct Usage {
+			GLsizeiptr Current;
+			GLsizeiptr Peak;
+			int        Objects;
+		};
+
+		typedef std::pair<int, size_t>      Key;   // Category and object
+		typedef std::pair<int, std::string> Group; // Category and owner
+
+		/** Internal variables for the ledger **/
+		static std::map<Key, Allocation> Allocations;
+		static std::map<Group, Usage>    Owners;
+		static Usage                     Categories[CATEGORY_COUNT];
+		static Usage                     Device;
+
+		/** Internal variables for the driver's count, in kilobytes **/
+		static GLint DriverBaseline;
+		static bool  DriverKnown;
+
+		/** No constructing, the class only has static functions **/
+		MemoryTracker();
+
+		/** Internal functions used for bookkeeping **/
+		static void adjust(Usage& usage, GLsizeiptr bytes, int objects);
+		static bool getDriverFree(GLint& kilobytes);
+		static const char* getCategoryName(Category category);
+};
+
+#endif // MEMORYTRACKER_H_INCLUDED
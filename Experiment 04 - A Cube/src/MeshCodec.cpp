@@ -0,0 +1,601 @@
+/*=================================                                       ----*\
+ * MESHCODEC CLASS                                                            *
+ * - This static class stores indexed meshes compactly for disk and decodes   *
+ *   them back into the batch's packed vertex layout. Positions are quantized *
+ *   to 16 bits and stored as deltas split into byte planes, indices as       *
+ *   zigzagged varint deltas after renumbering vertices in the order they are *
+ *   first used, and an optional run-length stage squeezes the planes. Chunks *
+ *   decode independently across the workers, with SSE undoing the deltas,    *
+ *   straight into mapped OpenGL buffers.                                     *
+\*----                                       =================================*/
+
+#include "MeshCodec.h"
+#include <cstring>
+#include <algorithm>
+#include <climits>
+
+/** Define static member variables, std::min takes them by reference **/
+const GLsizei MeshCodec::ChunkVertices;
+const GLsizei MeshCodec::ChunkIndices;
+
+/** Marks the start of encoded meshes, and the layout they use **/
+static const char   Magic[4] = { 'M', 'S', 'H', 'C' };
+static const GLuint Version  = 1;
+
+/** Bytes per vertex before the run-length stage: low and high planes of
+    three position deltas, then three color planes **/
+static const size_t VertexBytes = 9;
+
+/** Run-length control bytes: below this many literals follow, from here on
+    one byte repeats control - RunBias times **/
+static const GLubyte RunControl  = 128;
+static const int     RunBias     = 125;
+static const size_t  LongestRun  = 255 - RunBias;
+static const size_t  MostLiteral = 128;
+
+/** Appends bytes that didn't repeat, in groups of up to 128 **/
+static void appendLiterals(const GLubyte* input, size_t size,
+	std::vector<GLubyte>& output)
+{
+	while (size > 0) {
+		size_t count = std::min(size, MostLiteral);
+		output.push_back(static_cast<GLubyte>(count - 1));
+		output.insert(output.end(), input, input + count);
+		input += count;
+		size  -= count;
+	}
+}
+
+/** Encodes a mesh of positions and colors **/
+void MeshCodec::encode(const GLfloat* positions, const GLfloat* colors,
+	GLsizei vertexCount, const GLuint* indices, GLsizei indexCount,
+	bool runs, std::vector<GLubyte>& encoded)
+{
+	// Number the vertices in the order the triangles first use them, so
+	// each index is close to the ones before it. Unused vertices go last
+	std::vector<GLint>  remap(vertexCount, -1);
+	std::vector<GLuint> order;
+	std::vector<GLuint> renumbered(indexCount);
+	order.reserve(vertexCount);
+	for (GLsizei i = 0; i < indexCount; i++) {
+		GLuint vertex = indices[i];
+		if (remap[vertex] < 0) {
+			remap[vertex] = static_cast<GLint>(order.size());
+			order.push_back(vertex);
+		}
+		renumbered[i] = static_cast<GLuint>(remap[vertex]);
+	}
+	for (GLsizei v = 0; v < vertexCount; v++) {
+		if (remap[v] < 0) {
+			remap[v] = static_cast<GLint>(order.size());
+			order.push_back(v);
+		}
+	}
+
+	// Quantize in the new order, the same way the batch packs meshes
+	std::vector<GLfloat> sortedPositions(3 * vertexCount);
+	std::vector<GLfloat> sortedColors(3 * vertexCount);
+	for (GLsizei v = 0; v < vertexCount; v++) {
+		memcpy(&sortedPositions[3 * v], positions + 3 * order[v],
+			3 * sizeof(GLfloat));
+		memcpy(&sortedColors[3 * v], colors + 3 * order[v],
+			3 * sizeof(GLfloat));
+	}
+
+	std::vector<QuantizedVertex> packed(vertexCount);
+	glm::mat4 dequantize(1.0f);
+	if (vertexCount > 0) {
+		dequantize = VertexPacker::quantizePositions(&sortedPositions[0],
+			vertexCount, packed[0].Position, sizeof(QuantizedVertex));
+		VertexPacker::packColors(&sortedColors[0], vertexCount,
+			packed[0].Color, sizeof(QuantizedVertex));
+	}
+
+	Header header;
+	memcpy(header.Magic, Magic, sizeof(Magic));
+	header.Version      = Version;
+	header.VertexCount  = static_cast<GLuint>(vertexCount);
+	header.IndexCount   = static_cast<GLuint>(indexCount);
+	header.VertexChunks = (vertexCount + ChunkVertices - 1) / ChunkVertices;
+	header.IndexChunks  = (indexCount + ChunkIndices - 1) / ChunkIndices;
+	memcpy(header.Dequantize, &dequantize[0][0], sizeof(header.Dequantize));
+
+	// Every chunk stands alone so they can decode in any order
+	GLuint chunkCount = header.VertexChunks + header.IndexChunks;
+	size_t start      = sizeof(Header) + chunkCount * sizeof(Chunk);
+	std::vector<Chunk>   chunks(chunkCount);
+	std::vector<GLubyte> body, raw, packedRuns;
+	for (GLuint c = 0; c < chunkCount; c++) {
+		raw.clear();
+		if (c < header.VertexChunks) {
+			GLsizei first = c * ChunkVertices;
+			encodeVertices(&packed[first],
+				std::min(ChunkVertices, vertexCount - first), raw);
+		} else {
+			GLsizei first = (c - header.VertexChunks) * ChunkIndices;
+			encodeIndices(&renumbered[first],
+				std::min(ChunkIndices, indexCount - first), raw);
+		}
+
+		// Keep the packed bytes only when they are smaller
+		const std::vector<GLubyte>* kept = &raw;
+		if (runs) {
+			packRuns(raw.empty() ? NULL : &raw[0], raw.size(), packedRuns);
+			if (packedRuns.size() < raw.size())
+				kept = &packedRuns;
+		}
+
+		chunks[c].Offset  = static_cast<GLuint>(start + body.size());
+		chunks[c].Size    = static_cast<GLuint>(kept->size());
+		chunks[c].RawSize = static_cast<GLuint>(raw.size());
+		chunks[c].Packed  = (kept == &packedRuns ? 1 : 0);
+		body.insert(body.end(), kept->begin(), kept->end());
+	}
+
+	encoded.resize(start + body.size());
+	memcpy(&encoded[0], &header, sizeof(Header));
+	if (chunkCount > 0)
+		memcpy(&encoded[sizeof(Header)], &chunks[0],
+			chunkCount * sizeof(Chunk));
+	if (!body.empty())
+		memcpy(&encoded[start], &body[0], body.size());
+}
+
+/** Reads the header of an encoded mesh **/
+bool MeshCodec::getInfo(const GLubyte* data, size_t size, Info& info) {
+	Header             header;
+	std::vector<Chunk> chunks;
+	if (!readHeader(data, size, header, chunks))
+		return false;
+
+	info.VertexCount = static_cast<GLsizei>(header.VertexCount);
+	info.IndexCount  = static_cast<GLsizei>(header.IndexCount);
+	memcpy(&info.Dequantize[0][0], header.Dequantize,
+		sizeof(header.Dequantize));
+	return true;
+}
+
+/** Decodes every chunk, spread over the workers when given **/
+bool MeshCodec::decode(const GLubyte* data, size_t size,
+	QuantizedVertex* vertices, GLuint* indices, ThreadPool* workers)
+{
+	Job job;
+	if (!readHeader(data, size, job.Head, job.Chunks))
+		return false;
+
+	job.Data     = data;
+	job.Vertices = vertices;
+	job.Indices  = indices;
+	job.Failed   = false;
+
+	// One chunk at a time, they are large enough to share out singly
+	int count = static_cast<int>(job.Chunks.size());
+	if (workers)
+		workers->run(decodeRange, &job, count, 1);
+	else
+		decodeRange(&job, 0, count);
+
+	return !job.Failed;
+}
+
+/** Sizes the buffers and decodes straight into them while mapped **/
+bool MeshCodec::upload(const GLubyte* data, size_t size,
+	GLuint vertexBuffer, GLuint indexBuffer, ThreadPool* workers)
+{
+	Info info;
+	if (!getInfo(data, size, info)) {
+		LOG_ERROR(GENERAL, "Not an encoded mesh");
+		return false;
+	}
+
+	GLsizeiptr vertexBytes = info.VertexCount * sizeof(QuantizedVertex);
+	GLsizeiptr indexBytes  = info.IndexCount * sizeof(GLuint);
+
+	// Indices go through the copy target, binding them as the element
+	// buffer would change the caller's vertex array
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+	MemoryTracker::track(MemoryTracker::BUFFER, vertexBuffer,
+		"Mesh vertices", vertexBytes);
+	MemoryTracker::track(MemoryTracker::BUFFER, indexBuffer, "Mesh indices",
+		indexBytes);
+
+	void* vertices = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexBytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	void* indices  = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, indexBytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+	bool decoded = vertices && indices && decode(data, size,
+		static_cast<QuantizedVertex*>(vertices), static_cast<GLuint*>(indices),
+		workers);
+
+	// Unmapping fails when the contents were lost while mapped
+	if (vertices && glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE)
+		decoded = false;
+	if (indices && glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_FALSE)
+		decoded = false;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (!decoded)
+		LOG_ERROR(GENERAL, "Failed to decode a mesh into its buffers");
+	return decoded;
+}
+
+/** Writes an encoded mesh to disk **/
+bool MeshCodec::save(const char* path, const std::vector<GLubyte>& data) {
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		LOG_ERROR(GENERAL, "Failed to create mesh %s", path);
+		return false;
+	}
+
+	bool written = (data.empty() ||
+		fwrite(&data[0], 1, data.size(), file) == data.size());
+	if (fclose(file) != 0)
+		written = false;
+
+	if (!written)
+		LOG_ERROR(GENERAL, "Failed to write mesh %s", path);
+	return written;
+}
+
+/** Reads an encoded mesh from disk **/
+bool MeshCodec::load(const char* path, std::vector<GLubyte>& data) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		LOG_ERROR(GENERAL, "Failed to open mesh %s", path);
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data.resize(size > 0 ? size : 0);
+	bool read = (size <= 0 ||
+		fread(&data[0], 1, size, file) == static_cast<size_t>(size));
+	fclose(file);
+
+	if (!read)
+		LOG_ERROR(GENERAL, "Failed to read mesh %s", path);
+	return read;
+}
+
+/** Copies out the header and chunk table, checking every chunk **/
+bool MeshCodec::readHeader(const GLubyte* data, size_t size,
+	Header& header, std::vector<Chunk>& chunks)
+{
+	if (!data || size < sizeof(Header))
+		return false;
+
+	memcpy(&header, data, sizeof(Header));
+	if (memcmp(header.Magic, Magic, sizeof(Magic)) != 0 ||
+		header.Version != Version || header.VertexCount == 0 ||
+		header.IndexCount == 0)
+	{
+		return false;
+	}
+
+	// Counts are handed out as GLsizei, and below INT_MAX rounding them up
+	// to whole chunks can't wrap
+	if (header.VertexCount > static_cast<GLuint>(INT_MAX) ||
+		header.IndexCount > static_cast<GLuint>(INT_MAX))
+	{
+		return false;
+	}
+
+	// Counts and chunks have to agree, so no chunk writes past the end
+	GLuint vertexChunks = (header.VertexCount + ChunkVertices - 1) /
+		ChunkVertices;
+	GLuint indexChunks  = (header.IndexCount + ChunkIndices - 1) /
+		ChunkIndices;
+	if (header.VertexChunks != vertexChunks ||
+		header.IndexChunks != indexChunks)
+	{
+		return false;
+	}
+
+	size_t count = vertexChunks + indexChunks;
+	if ((size - sizeof(Header)) / sizeof(Chunk) < count)
+		return false;
+
+	chunks.resize(count);
+	memcpy(&chunks[0], data + sizeof(Header), count * sizeof(Chunk));
+	for (size_t c = 0; c < count; c++) {
+		if (chunks[c].Offset > size || chunks[c].Size > size - chunks[c].Offset)
+			return false;
+	}
+
+	return true;
+}
+
+/** Writes a chunk of vertices as planes of bytes **/
+void MeshCodec::encodeVertices(const QuantizedVertex* vertices,
+	GLsizei count, std::vector<GLubyte>& output)
+{
+	size_t start = output.size();
+	output.resize(start + VertexBytes * count);
+	GLubyte* planes = &output[start];
+
+	// Each position component becomes deltas from the vertex before,
+	// zigzagged so small steps either way have an empty high byte
+	for (int c = 0; c < 3; c++) {
+		GLubyte* low      = planes + (2 * c) * count;
+		GLubyte* high     = planes + (2 * c + 1) * count;
+		GLushort previous = 0;
+		for (GLsizei v = 0; v < count; v++) {
+			GLushort value  = static_cast<GLushort>(vertices[v].Position[c]);
+			GLushort delta  = static_cast<GLushort>(value - previous);
+			GLushort zigzag = static_cast<GLushort>((delta << 1) ^
+				((delta & 0x8000) ? 0xffff : 0));
+			low[v]   = static_cast<GLubyte>(zigzag & 0xff);
+			high[v]  = static_cast<GLubyte>(zigzag >> 8);
+			previous = value;
+		}
+	}
+
+	// Colors are kept as they are, a plane per channel
+	for (int c = 0; c < 3; c++) {
+		GLubyte* plane = planes + (6 + c) * count;
+		for (GLsizei v = 0; v < count; v++)
+			plane[v] = vertices[v].Color[c];
+	}
+}
+
+/** Writes a chunk of indices as zigzagged varint deltas **/
+void MeshCodec::encodeIndices(const GLuint* indices, GLsizei count,
+	std::vector<GLubyte>& output)
+{
+	GLuint previous = 0;
+	for (GLsizei i = 0; i < count; i++) {
+		GLuint delta  = indices[i] - previous;
+		GLuint zigzag = (delta << 1) ^ (0u - (delta >> 31));
+		previous = indices[i];
+
+		// Seven bits a byte, the top bit says more follow
+		while (zigzag >= 0x80) {
+			output.push_back(static_cast<GLubyte>(zigzag | 0x80));
+			zigzag >>= 7;
+		}
+		output.push_back(static_cast<GLubyte>(zigzag));
+	}
+}
+
+/** Rebuilds a chunk of vertices from its planes **/
+bool MeshCodec::decodeVertices(const GLubyte* input, size_t size,
+	QuantizedVertex* vertices, GLsizei count)
+{
+	if (size < VertexBytes * count)
+		return false;
+
+	const GLubyte* colors = input + 6 * count;
+	GLushort previous[3] = { 0, 0, 0 };
+	GLsizei  v           = 0;
+
+#ifdef MESHCODEC_SSE
+	// Eight vertices at a time: join the byte planes, undo the zigzag and
+	// add up the deltas in a few shifted adds, carrying the last sum on
+	const __m128i zero  = _mm_setzero_si128();
+	const __m128i one   = _mm_set1_epi16(1);
+	const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+	__m128i carry[3] = { zero, zero, zero };
+
+	for (; v + 8 <= count; v += 8) {
+		__m128i values[3];
+		for (int c = 0; c < 3; c++) {
+			__m128i low  = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(
+				input + (2 * c) * count + v));
+			__m128i high = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(
+				input + (2 * c + 1) * count + v));
+			__m128i zigzag = _mm_unpacklo_epi8(low, high);
+			__m128i delta  = _mm_xor_si128(_mm_srli_epi16(zigzag, 1),
+				_mm_sub_epi16(zero, _mm_and_si128(zigzag, one)));
+
+			delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 2));
+			delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 4));
+			delta = _mm_add_epi16(delta, _mm_slli_si128(delta, 8));
+			values[c] = _mm_add_epi16(delta, carry[c]);
+
+			// Spread the last sum over every lane for the next eight
+			__m128i last = _mm_shufflehi_epi16(values[c],
+				_MM_SHUFFLE(3, 3, 3, 3));
+			carry[c] = _mm_unpackhi_epi64(last, last);
+		}
+
+		// Interleave into x, y, z and a zero pad for each vertex
+		__m128i xyLow  = _mm_unpacklo_epi16(values[0], values[1]);
+		__m128i xyHigh = _mm_unpackhi_epi16(values[0], values[1]);
+		__m128i zLow   = _mm_unpacklo_epi16(values[2], zero);
+		__m128i zHigh  = _mm_unpackhi_epi16(values[2], zero);
+		GLshort positions[32];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(positions),
+			_mm_unpacklo_epi32(xyLow, zLow));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(positions + 8),
+			_mm_unpackhi_epi32(xyLow, zLow));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(positions + 16),
+			_mm_unpacklo_epi32(xyHigh, zHigh));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(positions + 24),
+			_mm_unpackhi_epi32(xyHigh, zHigh));
+
+		// Colors as red, green, blue and opaque alpha
+		__m128i red   = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(
+			colors + v));
+		__m128i green = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(
+			colors + count + v));
+		__m128i blue  = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(
+			colors + 2 * count + v));
+		__m128i redGreen  = _mm_unpacklo_epi8(red, green);
+		__m128i blueAlpha = _mm_unpacklo_epi8(blue, alpha);
+		GLubyte rgba[32];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba),
+			_mm_unpacklo_epi16(redGreen, blueAlpha));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + 16),
+			_mm_unpackhi_epi16(redGreen, blueAlpha));
+
+		// The output may be mapped memory, so write it once and in order
+		for (int k = 0; k < 8; k++) {
+			memcpy(vertices[v + k].Position, positions + 4 * k,
+				sizeof(vertices[v + k].Position));
+			memcpy(vertices[v + k].Color, rgba + 4 * k,
+				sizeof(vertices[v + k].Color));
+		}
+	}
+
+	for (int c = 0; c < 3; c++)
+		previous[c] = static_cast<GLushort>(_mm_extract_epi16(carry[c], 0));
+#endif
+
+	for (; v < count; v++) {
+		QuantizedVertex vertex;
+		for (int c = 0; c < 3; c++) {
+			GLushort zigzag = static_cast<GLushort>(input[(2 * c) * count + v] |
+				(input[(2 * c + 1) * count + v] << 8));
+			GLushort delta  = static_cast<GLushort>((zigzag >> 1) ^
+				((zigzag & 1) ? 0xffff : 0));
+			previous[c] = static_cast<GLushort>(previous[c] + delta);
+			vertex.Position[c] = static_cast<GLshort>(previous[c]);
+			vertex.Color[c]    = colors[c * count + v];
+		}
+		vertex.Position[3] = 0;
+		vertex.Color[3]    = 255;
+		vertices[v] = vertex;
+	}
+
+	return true;
+}
+
+/** Rebuilds a chunk of indices from varint deltas **/
+bool MeshCodec::decodeIndices(const GLubyte* input, size_t size,
+	GLuint* indices, GLsizei count, GLuint vertexCount)
+{
+	const GLubyte* end      = input + size;
+	GLuint         previous = 0;
+
+	for (GLsizei i = 0; i < count; i++) {
+		if (input >= end)
+			return false;
+
+		// Most deltas fit one byte
+		GLubyte byte   = *input++;
+		GLuint  zigzag = byte & 0x7f;
+		for (int shift = 7; byte & 0x80; shift += 7) {
+			if (input >= end || shift > 28)
+				return false;
+			byte    = *input++;
+			zigzag |= static_cast<GLuint>(byte & 0x7f) << shift;
+		}
+
+		previous += (zigzag >> 1) ^ (0u - (zigzag & 1));
+		if (previous >= vertexCount)
+			return false;
+		indices[i] = previous;
+	}
+
+	return true;
+}
+
+/** Packs repeated bytes into runs, everything else is copied **/
+void MeshCodec::packRuns(const GLubyte* input, size_t size,
+	std::vector<GLubyte>& output)
+{
+	output.clear();
+
+	size_t literal = 0; // Start of the bytes not yet written
+	size_t i       = 0;
+	while (i < size) {
+		size_t run = 1;
+		while (i + run < size && run < LongestRun && input[i + run] == input[i])
+			run++;
+
+		// Shorter runs cost as much as copying them
+		if (run < 3) {
+			i++;
+			continue;
+		}
+
+		appendLiterals(input + literal, i - literal, output);
+		output.push_back(static_cast<GLubyte>(run + RunBias));
+		output.push_back(input[i]);
+		i      += run;
+		literal = i;
+	}
+
+	appendLiterals(input + literal, size - literal, output);
+}
+
+/** Unpacks runs, false when the bytes don't fill the output exactly **/
+bool MeshCodec::unpackRuns(const GLubyte* input, size_t size,
+	GLubyte* output, size_t outputSize)
+{
+	const GLubyte* end    = input + size;
+	GLubyte*       filled = output + outputSize;
+
+	while (input < end) {
+		GLubyte control = *input++;
+		if (control < RunControl) {
+			size_t count = control + 1;
+			if (static_cast<size_t>(end - input) < count ||
+				static_cast<size_t>(filled - output) < count)
+			{
+				return false;
+			}
+			memcpy(output, input, count);
+			input  += count;
+			output += count;
+		} else {
+			size_t count = control - RunBias;
+			if (input >= end || static_cast<size_t>(filled - output) < count)
+				return false;
+			memset(output, *input++, count);
+			output += count;
+		}
+	}
+
+	return output == filled;
+}
+
+/** Decodes a range of chunks for a job, on any thread **/
+void MeshCodec::decodeRange(void* data, int begin, int end) {
+	Job& job = *static_cast<Job*>(data);
+
+	// Packed chunks unpack here first, kept between chunks on each thread
+	static thread_local std::vector<GLubyte> unpacked;
+
+	for (int c = begin; c < end; c++) {
+		const Chunk&   chunk  = job.Chunks[c];
+		const GLubyte* source = job.Data + chunk.Offset;
+		if (chunk.Packed) {
+			unpacked.resize(chunk.RawSize);
+			if (!unpackRuns(source, chunk.Size,
+				unpacked.empty() ? NULL : &unpacked[0], chunk.RawSize))
+			{
+				job.Failed = true;
+				continue;
+			}
+			source = (unpacked.empty() ? NULL : &unpacked[0]);
+		}
+		size_t size = (chunk.Packed ? chunk.RawSize : chunk.Size);
+
+		bool decoded;
+		GLuint vertexChunks = job.Head.VertexChunks;
+		if (static_cast<GLuint>(c) < vertexChunks) {
+			GLsizei first = c * ChunkVertices;
+			GLsizei count = std::min(ChunkVertices,
+				static_cast<GLsizei>(job.Head.VertexCount) - first);
+			decoded = decodeVertices(source, size, job.Vertices + first,
+				count);
+		} else {
+			GLsizei first = (c - vertexChunks) * ChunkIndices;
+			GLsizei count = std::min(ChunkIndices,
+				static_cast<GLsizei>(job.Head.IndexCount) - first);
+			decoded = decodeIndices(source, size, job.Indices + first, count,
+				job.Head.VertexCount);
+		}
+
+		if (!decoded)
+			job.Failed = true;
+	}
+}
@@ -0,0 +1,125 @@
+#ifndef MESHCODEC_H_INCLUDED
+#define MESHCODEC_H_INCLUDED
+
+/*=================================                                       ----*\
+ * MESHCODEC CLASS                                                            *
+ * - This static class stores indexed meshes compactly for disk and decodes   *
+ *   them back into the batch's packed vertex layout. Positions are quantized *
+ *   to 16 bits and stored as deltas split into byte planes, indices as       *
+ *   zigzagged varint deltas after renumbering vertices in the order they are *
+ *   first used, and an optional run-length stage squeezes the planes. Chunks *
+ *   decode independently across the workers, with SSE undoing the deltas,    *
+ *   straight into mapped OpenGL buffers.                                     *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <atomic>
+#include "Log.h"
+#include "ThreadPool.h"
+#include "VertexPacker.h"
+#include "MemoryTracker.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESHCODEC_SSE
+#endif
+
+class MeshCodec {
+	public:
+		/** What an encoded mesh holds, read from its header **/
+		struct Info {
+			GLsizei   VertexCount;
+			GLsizei   IndexCount;
+			glm::mat4 Dequantize; // Restores the 16 bit positions
+		};
+
+		/** Encodes a mesh of positions and colors, three floats each.
+		    Vertices are renumbered by first use, the triangles keep their
+		    order. Runs packs each chunk when that makes it smaller **/
+		static void encode(const GLfloat* positions, const GLfloat* colors,
+			GLsizei vertexCount, const GLuint* indices, GLsizei indexCount,
+			bool runs, std::vector<GLubyte>& encoded);
+
+		/** Reads the header, false when the data isn't an encoded mesh **/
+		static bool getInfo(const GLubyte* data, size_t size, Info& info);
+
+		/** Decodes every chunk, spread over the workers when given **/
+		static bool decode(const GLubyte* data, size_t size,
+			QuantizedVertex* vertices, GLuint* indices, ThreadPool* workers);
+
+		/** Sizes the buffers and decodes straight into them while mapped **/
+		static bool upload(const GLubyte* data, size_t size,
+			GLuint vertexBuffer, GLuint indexBuffer, ThreadPool* workers);
+
+		/** Writes and reads encoded meshes on disk **/
+		static bool save(const char* path, const std::vector<GLubyte>& data);
+		static bool load(const char* path, std::vector<GLubyte>& data);
+	protected:
+	private:
+		/** Vertices and indices in each independently decoded chunk **/
+		static const GLsizei ChunkVertices = 4096;
+		static const GLsizei ChunkIndices  = 3 * 4096;
+
+		/** Start of the data, followed by a Chunk per chunk **/
+		struct Header {
+			char    Magic[4];
+			GLuint  Version;
+			GLuint  VertexCount, IndexCount;
+			GLuint  VertexChunks, IndexChunks;
+			GLfloat Dequantize[16];
+		};
+
+		/** Where a chunk's bytes are, from the start of the data **/
+		struct Chunk {
+			GLuint Offset;
+			GLuint Size;
+			GLuint RawSize; // Before the run-length stage
+			GLuint Packed;  // Run-length packed, else stored as is
+		};
+
+		/** One decode, shared with the workers **/
+		struct Job {
+			const GLubyte*     Data;
+			Header             Head;
+			std::vector<Chunk> Chunks;
+			QuantizedVertex*   Vertices;
+			GLuint*            Indices;
+			std::atomic<bool>  Failed;
+		};
+
+		/** No constructing, the class only has static functions **/
+		MeshCodec();
+
+		/** Copies out the header and chunk table, checking that every
+		    chunk lies within the data **/
+		static bool readHeader(const GLubyte* data, size_t size,
+			Header& header, std::vector<Chunk>& chunks);
+
+		/** Chunk encoders, appending to the output **/
+		static void encodeVertices(const QuantizedVertex* vertices,
+			GLsizei count, std::vector<GLubyte>& output);
+		static void encodeIndices(const GLuint* indices, GLsizei count,
+			std::vector<GLubyte>& output);
+
+		/** Chunk decoders, false when the bytes run out **/
+		static bool decodeVertices(const GLubyte* input, size_t size,
+			QuantizedVertex* vertices, GLsizei count);
+		static bool decodeIndices(const GLubyte* input, size_t size,
+			GLuint* indices, GLsizei count, GLuint vertexCount);
+
+		/** Run-length stage **/
+		static void packRuns(const GLubyte* input, size_t size,
+			std::vector<GLubyte>& output);
+		static bool unpackRuns(const GLubyte* input, size_t size,
+			GLubyte* output, size_t outputSize);
+
+		/** Decodes a range of chunks for a job, on any thread **/
+		static void decodeRange(void* data, int begin, int end);
+};
+
+#endif // MESHCODEC_H_INCLUDED
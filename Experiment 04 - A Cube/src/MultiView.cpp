@@ -0,0 +1,384 @@
+/*=================================                                       ----*\
+ * MULTIVIEW CLASS                                                            *
+ * - This class draws several camera views in a single pass. Each view's      *
+ *   matrix sits in a uniform buffer and every draw is instanced once per     *
+ *   view, the instance picking its view and routing it to a viewport of a    *
+ *   viewport array, or to a layer of a layered target that is composited     *
+ *   afterwards. The vertex shader routes directly where the driver allows    *
+ *   it, otherwise a small geometry shader does, so submitting the scene      *
+ *   costs the same however many views there are.                             *
+\*----                                       =================================*/
+
+#include "MultiView.h"
+
+/** Define static member variables, logging takes them by reference **/
+const int MultiView::MaxViews;
+
+/** Checks for an extension GLEW doesn't know by name **/
+static bool hasExtension(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint e = 0; e < count; e++) {
+		const GLubyte* extension = glGetStringi(GL_EXTENSIONS, e);
+		if (extension &&
+			strcmp(reinterpret_cast<const char*>(extension), name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/** MultiView constructor, OpenGL objects are created in build() **/
+MultiView::MultiView() {
+	Count               = 0;
+	Destination         = VIEWPORTS;
+	Routed              = false;
+	Changed             = false;
+	UniformBuffer       = 0;
+	ViewWidth           = 0;
+	ViewHeight          = 0;
+	Columns             = 1;
+	Rows                = 1;
+	LayerFramebuffer    = 0;
+	ColorLayers         = 0;
+	DepthLayers         = 0;
+	LayerWidth          = 0;
+	LayerHeight         = 0;
+	CompositeID         = 0;
+	CompositeArrayID    = 0;
+	OriginUniformID     = -1;
+	LayerUniformID      = -1;
+	PreviousFramebuffer = 0;
+
+	for (int v = 0; v < MaxViews; v++)
+		Views.ViewProjections[v] = glm::mat4(1.0f);
+	Views.ViewCount = 0;
+	for (int p = 0; p < 3; p++)
+		Views.Padding[p] = 0;
+	for (int a = 0; a < 4; a++)
+		Area[a] = 0;
+}
+
+/** MultiView destructor **/
+MultiView::~MultiView() {
+	release();
+}
+
+/** Checks whether the context can draw into a kind of target **/
+bool MultiView::isSupported(Target target) {
+	// Uniform buffers, instancing and geometry shaders writing gl_Layer are
+	// all core 3.3, more viewports than one came with 4.1
+	if (target == LAYERS)
+		return GLEW_VERSION_3_3 != 0;
+
+	return GLEW_VERSION_4_1 || GLEW_ARB_viewport_array;
+}
+
+/** Creates the view buffer, and the layers when drawing into them **/
+bool MultiView::build(int count, Target target) {
+	release();
+
+	if (count < 1 || count > MaxViews) {
+		LOG_ERROR(RENDER, "Views go from 1 to %d", MaxViews);
+		return false;
+	}
+
+	if (!isSupported(target)) {
+		if (target == LAYERS || !isSupported(LAYERS)) {
+			LOG_ERROR(RENDER, "Drawing across views is not supported");
+			return false;
+		}
+
+		LOG_WARNING(RENDER, "Viewport arrays are not supported, drawing the "
+			"views into layers");
+		target = LAYERS;
+	}
+
+	Count       = count;
+	Destination = target;
+
+	// Near square grid, wider than tall, so two views sit side by side
+	Columns = 1;
+	while (Columns * Columns < Count)
+		Columns++;
+	Rows = (Count + Columns - 1) / Columns;
+
+	// The vertex shader can only route by itself with the extension
+	Routed = hasExtension("GL_ARB_shader_viewport_layer_array");
+
+	Views.ViewCount = static_cast<GLuint>(Count);
+	glGenBuffers(1, &UniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, UniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewData), &Views,
+		GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	MemoryTracker::track(MemoryTracker::BUFFER, UniformBuffer, "Views",
+		sizeof(ViewData));
+	Changed = false;
+
+	if (Destination == LAYERS) {
+		// The layers are sized by the first begin(), the copy program and
+		// the framebuffer don't depend on it
+		glGenFramebuffers(1, &LayerFramebuffer);
+		glGenVertexArrays(1, &CompositeArrayID);
+
+		Shaders::loadShader("Fullscreen.vshader", GL_VERTEX_SHADER);
+		Shaders::loadShader("MultiView.fshader", GL_FRAGMENT_SHADER);
+		CompositeID     = Shaders::createProgram();
+		OriginUniformID = glGetUniformLocation(CompositeID, "origin");
+		LayerUniformID  = glGetUniformLocation(CompositeID, "layer");
+
+		glUseProgram(CompositeID);
+		glUniform1i(glGetUniformLocation(CompositeID, "colors"), 0);
+		glUniform1i(glGetUniformLocation(CompositeID, "depths"), 1);
+		glUseProgram(0);
+	}
+
+	LOG_INFO(RENDER, "Views: %d in %s, routed by the %s shader", Count,
+		getTargetName(Destination), Routed ? "vertex" : "geometry");
+	return true;
+}
+
+/** Number of views **/
+int MultiView::getCount() const {
+	return Count;
+}
+
+/** Where the views are drawn **/
+MultiView::Target MultiView::getTarget() const {
+	return Destination;
+}
+
+/** Name of a target for logging **/
+const char* MultiView::getTargetName(Target target) {
+	return (target == LAYERS ? "layers" : "viewports");
+}
+
+/** Aspect ratio of one view when they share an area **/
+float MultiView::getAspect(GLsizei width, GLsizei height) const {
+	return (static_cast<float>(width) / Columns) /
+		(static_cast<float>(height) / Rows);
+}
+
+/** Links a program whose vertex shader draws across the views **/
+GLuint MultiView::createProgram(const char* vertexPath,
+	const char* fragmentPath, const char* defines) const
+{
+	std::string keys = "MULTIVIEW";
+	if (defines && *defines)
+		keys = std::string(defines) + " " + keys;
+	if (Routed)
+		keys += " VIEW_EXTENSION";
+	if (Destination == LAYERS)
+		keys += " VIEW_LAYERS";
+
+	Shaders::loadShader(vertexPath, GL_VERTEX_SHADER, keys.c_str());
+	if (!Routed)
+		Shaders::loadShader("MultiView.gshader", GL_GEOMETRY_SHADER,
+			keys.c_str());
+	Shaders::loadShader(fragmentPath, GL_FRAGMENT_SHADER, keys.c_str());
+	GLuint programID = Shaders::createProgram();
+
+	// Every program reads the views from the same binding
+	GLuint block = glGetUniformBlockIndex(programID, "ViewBlock");
+	if (block != GL_INVALID_INDEX)
+		glUniformBlockBinding(programID, block, UniformBinding);
+	return programID;
+}
+
+/** Sets a view's matrix, uploaded by the next begin() **/
+void MultiView::setView(int view, const glm::mat4& viewProjection) {
+	if (view < 0 || view >= Count)
+		return;
+
+	Views.ViewProjections[view] = viewProjection;
+	Changed = true;
+}
+
+/** A view's matrix **/
+const glm::mat4& MultiView::getViewProjection(int view) const {
+	return Views.ViewProjections[view];
+}
+
+/** Splits the current viewport between the views and binds them **/
+void MultiView::begin() {
+	if (Count == 0)
+		return;
+
+	// Only the matrices in use go up, the count never changes
+	if (Changed) {
+		glBindBuffer(GL_UNIFORM_BUFFER, UniformBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, Count * sizeof(glm::mat4),
+			Views.ViewProjections);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		Changed = false;
+	}
+	glBindBufferBase(GL_UNIFORM_BUFFER, UniformBinding, UniformBuffer);
+
+	// The views share whatever area was set up, the scaled offscreen
+	// target or the window
+	glGetIntegerv(GL_VIEWPORT, Area);
+	ViewWidth  = Area[2] / Columns;
+	ViewHeight = Area[3] / Rows;
+	if (ViewWidth  < 1) ViewWidth  = 1;
+	if (ViewHeight < 1) ViewHeight = 1;
+
+	if (Destination == VIEWPORTS) {
+		for (int v = 0; v < Count; v++) {
+			GLint x, y;
+			getCorner(v, x, y);
+			glViewportIndexedf(v, static_cast<GLfloat>(x),
+				static_cast<GLfloat>(y), static_cast<GLfloat>(ViewWidth),
+				static_cast<GLfloat>(ViewHeight));
+		}
+		return;
+	}
+
+	// Layers only grow, so a smaller scale draws into their corners
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &PreviousFramebuffer);
+	if (!sizeLayers(ViewWidth, ViewHeight))
+		return;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, LayerFramebuffer);
+	glViewport(0, 0, ViewWidth, ViewHeight);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+/** Copies the layers into their places and restores the viewport **/
+void MultiView::end() {
+	if (Count == 0)
+		return;
+
+	if (Destination == LAYERS) {
+		glBindFramebuffer(GL_FRAMEBUFFER, PreviousFramebuffer);
+		composite();
+	}
+
+	// A single viewport replaces every one in the array
+	glViewport(Area[0], Area[1], Area[2], Area[3]);
+}
+
+/** Lower left corner of a view, the first view at the top left **/
+void MultiView::getCorner(int view, GLint& x, GLint& y) const {
+	x = Area[0] + (view % Columns) * ViewWidth;
+	y = Area[1] + (Rows - 1 - view / Columns) * ViewHeight;
+}
+
+/** Makes the layers at least a size, false when they can't be used **/
+bool MultiView::sizeLayers(GLsizei width, GLsizei height) {
+	if (ColorLayers != 0 && width <= LayerWidth && height <= LayerHeight)
+		return true;
+
+	if (width  < LayerWidth)  width  = LayerWidth;
+	if (height < LayerHeight) height = LayerHeight;
+
+	if (ColorLayers == 0) {
+		glGenTextures(1, &ColorLayers);
+		glGenTextures(1, &DepthLayers);
+	}
+
+	// Both are read with texelFetch, so they need no filtering or mipmaps
+	glBindTexture(GL_TEXTURE_2D_ARRAY, ColorLayers);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, Count, 0,
+		GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, DepthLayers);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, width, height,
+		Count, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	MemoryTracker::track(MemoryTracker::TEXTURE, ColorLayers, "Views",
+		MemoryTracker::getImageBytes(GL_RGBA8, width, height, 1, 1) * Count);
+	MemoryTracker::track(MemoryTracker::TEXTURE, DepthLayers, "Views",
+		MemoryTracker::getImageBytes(GL_DEPTH_COMPONENT24, width, height, 1,
+			1) * Count);
+
+	// Attaching whole arrays makes the framebuffer layered
+	glBindFramebuffer(GL_FRAMEBUFFER, LayerFramebuffer);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ColorLayers, 0);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, DepthLayers, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, PreviousFramebuffer);
+
+	LayerWidth  = width;
+	LayerHeight = height;
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		LOG_ERROR(RENDER, "View layers are incomplete: 0x%x", status);
+		return false;
+	}
+
+	return true;
+}
+
+/** Draws each layer over its view, color and depth **/
+void MultiView::composite() {
+	GLint previousVAO = 0, previousDepth = GL_LESS;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	glGetIntegerv(GL_DEPTH_FUNC, &previousDepth);
+
+	// The layers hold finished depth, so every pixel is copied
+	glDepthFunc(GL_ALWAYS);
+	glUseProgram(CompositeID);
+	glBindVertexArray(CompositeArrayID);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, DepthLayers);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, ColorLayers);
+
+	for (int v = 0; v < Count; v++) {
+		GLint x, y;
+		getCorner(v, x, y);
+		glViewport(x, y, ViewWidth, ViewHeight);
+		glUniform2i(OriginUniformID, x, y);
+		glUniform1i(LayerUniformID, v);
+
+		// One triangle covering the view, generated from the vertex ID
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glBindVertexArray(previousVAO);
+	glDepthFunc(previousDepth);
+}
+
+/** Releases the OpenGL objects owned by the views **/
+void MultiView::release() {
+	if (UniformBuffer != 0) {
+		glDeleteBuffers(1, &UniformBuffer);
+		MemoryTracker::release(MemoryTracker::BUFFER, 1, &UniformBuffer);
+		UniformBuffer = 0;
+	}
+
+	if (ColorLayers != 0) {
+		GLuint textures[2] = { ColorLayers, DepthLayers };
+		glDeleteTextures(2, textures);
+		MemoryTracker::release(MemoryTracker::TEXTURE, 2, textures);
+		ColorLayers = 0;
+		DepthLayers = 0;
+		LayerWidth  = 0;
+		LayerHeight = 0;
+	}
+
+	if (LayerFramebuffer != 0) {
+		glDeleteFramebuffers(1, &LayerFramebuffer);
+		LayerFramebuffer = 0;
+	}
+
+	if (CompositeID != 0) {
+		Shaders::deleteProgram(CompositeID);
+		glDeleteVertexArrays(1, &CompositeArrayID);
+		CompositeID      = 0;
+		CompositeArrayID = 0;
+	}
+
+	Count = 0;
+}
@@ -0,0 +1,118 @@
+#ifndef MULTIVIEW_H_INCLUDED
+#define MULTIVIEW_H_INCLUDED
+
+/*=================================                                       ----*\
+ * MULTIVIEW CLASS                                                            *
+ * - This class draws several camera views in a single pass. Each view's      *
+ *   matrix sits in a uniform buffer and every draw is instanced once per     *
+ *   view, the instance picking its view and routing it to a viewport of a    *
+ *   viewport array, or to a layer of a layered target that is composited     *
+ *   afterwards. The vertex shader routes directly where the driver allows    *
+ *   it, otherwise a small geometry shader does, so submitting the scene      *
+ *   costs the same however many views there are.                             *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include "Log.h"
+#include "Shaders.h"
+#include "MemoryTracker.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+class MultiView {
+	public:
+		/** Most views drawn at once, matches MultiView.glsl **/
+		static const int MaxViews = 8;
+
+		/** Where the views are drawn **/
+		enum Target {
+			VIEWPORTS, // Side by side in the bound framebuffer
+			LAYERS     // One layer each, then copied side by side
+		};
+
+		MultiView();
+		~MultiView();
+
+		/** Checks whether the context can draw into a kind of target **/
+		static bool isSupported(Target target);
+
+		/** Creates the view buffer for a number of views, and the layers
+		    when drawing into them. Viewport arrays fall back to layers
+		    where they aren't supported **/
+		bool build(int count, Target target);
+
+		/** Number of views and where they are drawn **/
+		int    getCount() const;
+		Target getTarget() const;
+
+		/** Name of a target for logging **/
+		static const char* getTargetName(Target target);
+
+		/** Aspect ratio of one view when they share an area **/
+		float getAspect(GLsizei width, GLsizei height) const;
+
+		/** Links a program whose vertex shader draws across the views,
+		    adding the routing keys and geometry shader it needs. The
+		    defines are the shaders' own permutation keys **/
+		GLuint createProgram(const char* vertexPath,
+			const char* fragmentPath, const char* defines) const;
+
+		/** Sets a view's matrix, uploaded by the next begin() **/
+		void setView(int view, const glm::mat4& viewProjection);
+		const glm::mat4& getViewProjection(int view) const;
+
+		/** Splits the current viewport between the views and binds their
+		    matrices, or binds the layers. Draws in between are instanced
+		    getCount() times per object **/
+		void begin();
+
+		/** Copies the layers into their places and brings back the
+		    viewport the views split **/
+		void end();
+	protected:
+	private:
+		/** View matrices, laid out to match std140 in MultiView.glsl **/
+		struct ViewData {
+			glm::mat4 ViewProjections[MaxViews];
+			GLuint    ViewCount;
+			GLuint    Padding[3];
+		};
+
+		/** Uniform buffer binding the view block is read from **/
+		static const GLuint UniformBinding = 0;
+
+		/** Internal variables for the views **/
+		ViewData Views;
+		int      Count;
+		Target   Destination;
+		bool     Routed;  // The vertex shader routes without a geometry
+		                  // shader
+		bool     Changed; // Matrices waiting to be uploaded
+		GLuint   UniformBuffer;
+		GLint    Area[4]; // Viewport the views split
+		GLsizei  ViewWidth, ViewHeight;
+		int      Columns, Rows;
+
+		/** Internal variables for the layers **/
+		GLuint  LayerFramebuffer, ColorLayers, DepthLayers;
+		GLsizei LayerWidth, LayerHeight;
+		GLuint  CompositeID, CompositeArrayID;
+		GLint   OriginUniformID, LayerUniformID;
+		GLint   PreviousFramebuffer;
+
+		/** Prevent copying, the views own OpenGL objects **/
+		MultiView(const MultiView& source);            // No copying
+		MultiView& operator=(const MultiView& source); // No assignment
+
+		/** Internal functions used for the layers and cleanup **/
+		void getCorner(int view, GLint& x, GLint& y) const;
+		bool sizeLayers(GLsizei width, GLsizei height);
+		void composite();
+		void release();
+};
+
+#endif // MULTIVIEW_H_INCLUDED
@@ -0,0 +1,530 @@
+/*=================================                                       ----*\
+ * PARTICLES CLASS                                                            *
+ * - This class simulates a fountain of sparks falling onto the floor. On the *
+ *   CPU the particles live in separate arrays per component, updated four at *
+ *   a time with SSE across the workers and written straight into a mapped    *
+ *   streaming buffer. On the GPU they never leave video memory, a vertex     *
+ *   shader updates them from one buffer into another with transform feedback *
+ *   and the two swap every frame.                                            *
+\*----                                       =================================*/
+
+#include "Particles.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+/** Physics shared with ParticleUpdate.vshader through its uniforms **/
+static const GLfloat Gravity     = -9.8f;
+static const GLfloat FloorHeight = -1.8f; // Top of the floor's cubes
+static const GLfloat Bounce      = 0.5f;  // Speed kept off the floor
+
+/** Mixed into every spawn so particles differ from other hashed data **/
+static const unsigned ParticleSeed = 0x2545f491u;
+
+/** Particles per job chunk, a multiple of four so SSE groups never split **/
+static const int ParticleGrain = 16384;
+
+/** Particles constructor, OpenGL objects are created in build() **/
+Particles::Particles() {
+	StreamArrayID    = 0;
+	StreamBuffer     = 0;
+	StateArrayIDs[0] = 0;
+	StateArrayIDs[1] = 0;
+	StateBuffers[0]  = 0;
+	StateBuffers[1]  = 0;
+	DrawProgramID    = 0;
+	UpdateProgramID  = 0;
+	MVPUniformID     = -1;
+	DeltaUniformID   = -1;
+	FrameUniformID   = -1;
+	EmitterUniformID = -1;
+	QueryHead        = 0;
+	QueryPending     = 0;
+	Source           = 0;
+	Count            = 0;
+	CurrentMode      = CPU;
+	Emitter          = glm::vec3(0.0f, 1.0f, 0.0f);
+	Frame            = 0;
+	LastTime         = 0.0;
+	UpdateTime       = 0.0;
+	GPUTime          = 0.0;
+	Started          = false;
+
+	for (int q = 0; q < QueryCount; q++)
+		Queries[q] = 0;
+}
+
+/** Particles destructor **/
+Particles::~Particles() {
+	release();
+}
+
+/** Creates the particles and the OpenGL objects the mode needs **/
+bool Particles::build(int count, Mode mode) {
+	if (count <= 0) {
+		LOG_ERROR(RENDER, "Particles need a positive count");
+		return false;
+	}
+
+	release();
+	Count       = (count + 3) & ~3;
+	CurrentMode = mode;
+	Frame       = 0;
+	Started     = false;
+
+	// Every particle starts at the emitter with part of a lifetime, so
+	// they leave in a stream rather than all at once
+	PositionX.resize(Count);
+	PositionY.resize(Count);
+	PositionZ.resize(Count);
+	VelocityX.resize(Count);
+	VelocityY.resize(Count);
+	VelocityZ.resize(Count);
+	Life.resize(Count);
+	for (int p = 0; p < Count; p++) {
+		spawn(p, 0);
+		Life[p] *= getUnit(hash(static_cast<unsigned>(p) + ParticleSeed));
+	}
+
+	Shaders::loadShader("Particle.vshader", GL_VERTEX_SHADER);
+	Shaders::loadShader("Color.fshader", GL_FRAGMENT_SHADER);
+	DrawProgramID = Shaders::createProgram();
+	MVPUniformID  = glGetUniformLocation(DrawProgramID, "MVP");
+
+	bool built = (mode == GPU ? buildGPU() : buildCPU());
+	if (!built)
+		release();
+	return built;
+}
+
+/** Moves the point new particles start from **/
+void Particles::setEmitter(const glm::vec3& position) {
+	Emitter = position;
+}
+
+/** Advances the particles to the time in seconds **/
+void Particles::update(double time, ThreadPool* workers) {
+	if (Count == 0)
+		return;
+
+	// Long stalls are taken as one short step rather than a leap
+	double elapsed = (Started ? std::max(time - LastTime, 0.0) : 0.0);
+	GLfloat delta  = static_cast<GLfloat>(std::min(elapsed, 0.1));
+	LastTime = time;
+	Started  = true;
+	Frame++;
+
+	double start = glfwGetTime();
+	if (CurrentMode == GPU)
+		updateGPU(delta);
+	else
+		updateCPU(delta, workers);
+	UpdateTime = (glfwGetTime() - start) * 1000.0;
+}
+
+/** Draws the particles as points **/
+void Particles::draw(const glm::mat4& viewProjection) {
+	if (Count == 0)
+		return;
+
+	// Particles hold world positions
+	glUseProgram(DrawProgramID);
+	glUniformMatrix4fv(MVPUniformID, 1, GL_FALSE, &viewProjection[0][0]);
+
+	GLint previousVAO = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	glBindVertexArray(CurrentMode == GPU ? StateArrayIDs[Source] :
+		StreamArrayID);
+	glDrawArrays(GL_POINTS, 0, Count);
+	glBindVertexArray(previousVAO);
+}
+
+/** Particle count **/
+int Particles::getCount() const {
+	return Count;
+}
+
+/** Simulation mode **/
+Particles::Mode Particles::getMode() const {
+	return CurrentMode;
+}
+
+/** Milliseconds the last update took on the CPU **/
+double Particles::getUpdateTime() const {
+	return UpdateTime;
+}
+
+/** Milliseconds the last measured GPU update took **/
+double Particles::getGPUTime() const {
+	return GPUTime;
+}
+
+/** Readable name of a mode **/
+const char* Particles::getModeName(Mode mode) {
+	return (mode == GPU ? "GPU" : "CPU");
+}
+
+/** Reads a mode from its lower case name **/
+bool Particles::parseMode(const char* name, Mode& mode) {
+	if (strcmp(name, "cpu") == 0) {
+		mode = CPU;
+	} else if (strcmp(name, "gpu") == 0) {
+		mode = GPU;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/** Creates the streaming buffer the CPU update writes into **/
+bool Particles::buildCPU() {
+	GLsizeiptr bytes = Count * sizeof(ParticleVertex);
+
+	glGenVertexArrays(1, &StreamArrayID);
+	glGenBuffers(1, &StreamBuffer);
+
+	GLint previousVAO = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	glBindVertexArray(StreamArrayID);
+	glBindBuffer(GL_ARRAY_BUFFER, StreamBuffer);
+	glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+	ParticleFormat::setPointers();
+	glBindVertexArray(previousVAO);
+
+	MemoryTracker::track(MemoryTracker::BUFFER, StreamBuffer,
+		"Particle stream", bytes);
+	MemoryTracker::track(MemoryTracker::CLIENT, reinterpret_cast<size_t>(this),
+		"Particles", 7 * Life.capacity() * sizeof(GLfloat));
+
+	// Nothing is drawn before the first update fills the stream
+	return true;
+}
+
+/** Uploads the particles into the first of two state buffers **/
+bool Particles::buildGPU() {
+	static const char* const varyings[] = {
+		"outPosition", "outLife", "outVelocity"
+	};
+
+	Shaders::loadShader("ParticleUpdate.vshader", GL_VERTEX_SHADER);
+	UpdateProgramID  = Shaders::createProgram(varyings, 3);
+	DeltaUniformID   = glGetUniformLocation(UpdateProgramID, "delta");
+	FrameUniformID   = glGetUniformLocation(UpdateProgramID, "frame");
+	EmitterUniformID = glGetUniformLocation(UpdateProgramID, "emitter");
+	if (DeltaUniformID < 0 || FrameUniformID < 0 || EmitterUniformID < 0) {
+		LOG_ERROR(RENDER, "Particle update shader failed to link");
+		return false;
+	}
+
+	glUseProgram(UpdateProgramID);
+	glUniform1f(glGetUniformLocation(UpdateProgramID, "gravity"), Gravity);
+	glUniform1f(glGetUniformLocation(UpdateProgramID, "floorHeight"),
+		FloorHeight);
+	glUniform1f(glGetUniformLocation(UpdateProgramID, "bounce"), Bounce);
+
+	// Interleave the starting particles the way the shader captures them
+	std::vector<ParticleState> states(Count);
+	for (int p = 0; p < Count; p++) {
+		states[p].Position[0] = PositionX[p];
+		states[p].Position[1] = PositionY[p];
+		states[p].Position[2] = PositionZ[p];
+		states[p].Life        = Life[p];
+		states[p].Velocity[0] = VelocityX[p];
+		states[p].Velocity[1] = VelocityY[p];
+		states[p].Velocity[2] = VelocityZ[p];
+	}
+	GLsizeiptr bytes = Count * sizeof(ParticleState);
+
+	glGenVertexArrays(2, StateArrayIDs);
+	glGenBuffers(2, StateBuffers);
+	glGenQueries(QueryCount, Queries);
+
+	GLint previousVAO = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	for (int s = 0; s < 2; s++) {
+		glBindVertexArray(StateArrayIDs[s]);
+		glBindBuffer(GL_ARRAY_BUFFER, StateBuffers[s]);
+		glBufferData(GL_ARRAY_BUFFER, bytes, (s == 0 ? &states[0] : NULL),
+			GL_DYNAMIC_COPY);
+		ParticleStateFormat::setPointers();
+	}
+	glBindVertexArray(previousVAO);
+	MemoryTracker::track(MemoryTracker::BUFFER, StateBuffers[0],
+		"Particle state", bytes);
+	MemoryTracker::track(MemoryTracker::BUFFER, StateBuffers[1],
+		"Particle state", bytes);
+
+	// The CPU copy isn't needed again
+	std::vector<GLfloat>().swap(PositionX);
+	std::vector<GLfloat>().swap(PositionY);
+	std::vector<GLfloat>().swap(PositionZ);
+	std::vector<GLfloat>().swap(VelocityX);
+	std::vector<GLfloat>().swap(VelocityY);
+	std::vector<GLfloat>().swap(VelocityZ);
+	std::vector<GLfloat>().swap(Life);
+	Source = 0;
+	return true;
+}
+
+/** Updates every particle on the workers, straight into the stream **/
+void Particles::updateCPU(GLfloat delta, ThreadPool* workers) {
+	GLsizeiptr bytes = Count * sizeof(ParticleVertex);
+
+	// Invalidating lets the driver hand over fresh memory instead of
+	// waiting for the last frame's draw to finish reading
+	glBindBuffer(GL_ARRAY_BUFFER, StreamBuffer);
+	void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!mapped) {
+		LOG_ERROR(RENDER, "Failed to map the particle stream");
+		return;
+	}
+
+	Step step;
+	step.Owner  = this;
+	step.Target = static_cast<ParticleVertex*>(mapped);
+	step.Delta  = delta;
+	step.Frame  = Frame;
+
+	{
+		TRACE_SCOPE("Update particles");
+		if (workers)
+			workers->run(updateRange, &step, Count, ParticleGrain);
+		else
+			updateRange(&step, 0, Count);
+	}
+
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+/** Updates every particle with transform feedback into the other buffer **/
+void Particles::updateGPU(GLfloat delta) {
+	collectQueries();
+
+	// Time the update unless every query is still waiting on the GPU
+	bool timing = (QueryPending < QueryCount);
+	if (timing)
+		glBeginQuery(GL_TIME_ELAPSED, Queries[QueryHead]);
+
+	glUseProgram(UpdateProgramID);
+	glUniform1f(DeltaUniformID, delta);
+	glUniform1ui(FrameUniformID, Frame);
+	glUniform3f(EmitterUniformID, Emitter.x, Emitter.y, Emitter.z);
+
+	GLint previousVAO = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	glBindVertexArray(StateArrayIDs[Source]);
+
+	// Only the captured outputs matter, nothing is rasterized
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, StateBuffers[1 - Source]);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, Count);
+	glEndTransformFeedback();
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glDisable(GL_RASTERIZER_DISCARD);
+
+	glBindVertexArray(previousVAO);
+	Source = 1 - Source;
+
+	if (timing) {
+		glEndQuery(GL_TIME_ELAPSED);
+		QueryHead = (QueryHead + 1) % QueryCount;
+		QueryPending++;
+	}
+}
+
+/** Reads back any finished timer queries without waiting on the GPU **/
+void Particles::collectQueries() {
+	while (QueryPending > 0) {
+		int oldest = (QueryHead - QueryPending + QueryCount) % QueryCount;
+
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(Queries[oldest], GL_QUERY_RESULT_AVAILABLE,
+			&available);
+		if (available != GL_TRUE)
+			break;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(Queries[oldest], GL_QUERY_RESULT, &elapsed);
+		QueryPending--;
+
+		GPUTime = static_cast<double>(elapsed) / 1000000.0;
+	}
+}
+
+/** Starts a particle again from the emitter, as ParticleUpdate.vshader
+    does for the same index and frame **/
+void Particles::spawn(int index, unsigned frame) {
+	unsigned h = hash(static_cast<unsigned>(index) * 2654435769u ^
+		frame * 2246822507u ^ ParticleSeed);
+	GLfloat angle  = 6.2831853f * getUnit(h);
+	h = hash(h);
+	GLfloat spread = 0.35f * getUnit(h);
+	h = hash(h);
+	GLfloat speed  = 5.0f + 3.0f * getUnit(h);
+	h = hash(h);
+
+	Life[index]      = 2.0f + 2.0f * getUnit(h);
+	PositionX[index] = Emitter.x;
+	PositionY[index] = Emitter.y;
+	PositionZ[index] = Emitter.z;
+	VelocityX[index] = std::cos(angle) * spread * speed;
+	VelocityY[index] = speed;
+	VelocityZ[index] = std::sin(angle) * spread * speed;
+}
+
+/** Releases the particles and OpenGL objects **/
+void Particles::release() {
+	if (StreamArrayID != 0) {
+		glDeleteBuffers(1, &StreamBuffer);
+		MemoryTracker::release(MemoryTracker::BUFFER, StreamBuffer);
+		MemoryTracker::release(MemoryTracker::CLIENT,
+			reinterpret_cast<size_t>(this));
+		glDeleteVertexArrays(1, &StreamArrayID);
+		StreamArrayID = 0;
+		StreamBuffer  = 0;
+	}
+
+	if (StateArrayIDs[0] != 0) {
+		glDeleteBuffers(2, StateBuffers);
+		MemoryTracker::release(MemoryTracker::BUFFER, 2, StateBuffers);
+		glDeleteVertexArrays(2, StateArrayIDs);
+		glDeleteQueries(QueryCount, Queries);
+		for (int s = 0; s < 2; s++) {
+			StateArrayIDs[s] = 0;
+			StateBuffers[s]  = 0;
+		}
+		QueryHead    = 0;
+		QueryPending = 0;
+	}
+
+	if (UpdateProgramID != 0) {
+		Shaders::deleteProgram(UpdateProgramID);
+		UpdateProgramID = 0;
+	}
+	if (DrawProgramID != 0) {
+		Shaders::deleteProgram(DrawProgramID);
+		DrawProgramID = 0;
+	}
+
+	PositionX.clear();
+	PositionY.clear();
+	PositionZ.clear();
+	VelocityX.clear();
+	VelocityY.clear();
+	VelocityZ.clear();
+	Life.clear();
+	Count = 0;
+}
+
+/** Updates a range of particles, four at a time where SSE is available **/
+void Particles::updateRange(void* data, int begin, int end) {
+	const Step& step = *static_cast<Step*>(data);
+	Particles&  owner = *step.Owner;
+	GLfloat* px   = &owner.PositionX[0];
+	GLfloat* py   = &owner.PositionY[0];
+	GLfloat* pz   = &owner.PositionZ[0];
+	GLfloat* vx   = &owner.VelocityX[0];
+	GLfloat* vy   = &owner.VelocityY[0];
+	GLfloat* vz   = &owner.VelocityZ[0];
+	GLfloat* life = &owner.Life[0];
+	GLfloat  fall = Gravity * step.Delta;
+	int      p    = begin;
+
+#ifdef PARTICLES_SSE
+	const __m128 delta  = _mm_set1_ps(step.Delta);
+	const __m128 fall4  = _mm_set1_ps(fall);
+	const __m128 floor4 = _mm_set1_ps(FloorHeight);
+	const __m128 bounce = _mm_set1_ps(-Bounce);
+	const __m128 zero   = _mm_setzero_ps();
+
+	// The arrays are only 8 byte aligned on some allocators, so every
+	// access is unaligned
+	for (; p + 4 <= end; p += 4) {
+		__m128 velocityX = _mm_loadu_ps(vx + p);
+		__m128 velocityY = _mm_add_ps(_mm_loadu_ps(vy + p), fall4);
+		__m128 velocityZ = _mm_loadu_ps(vz + p);
+		__m128 x = _mm_add_ps(_mm_loadu_ps(px + p),
+			_mm_mul_ps(velocityX, delta));
+		__m128 y = _mm_add_ps(_mm_loadu_ps(py + p),
+			_mm_mul_ps(velocityY, delta));
+		__m128 z = _mm_add_ps(_mm_loadu_ps(pz + p),
+			_mm_mul_ps(velocityZ, delta));
+		__m128 l = _mm_sub_ps(_mm_loadu_ps(life + p), delta);
+
+		// Lanes that fell through the floor sit on it and bounce
+		__m128 below = _mm_cmplt_ps(y, floor4);
+		y = _mm_or_ps(_mm_and_ps(below, floor4), _mm_andnot_ps(below, y));
+		velocityY = _mm_or_ps(_mm_and_ps(below, _mm_mul_ps(velocityY, bounce)),
+			_mm_andnot_ps(below, velocityY));
+
+		_mm_storeu_ps(px + p, x);
+		_mm_storeu_ps(py + p, y);
+		_mm_storeu_ps(pz + p, z);
+		_mm_storeu_ps(vy + p, velocityY);
+		_mm_storeu_ps(life + p, l);
+
+		// Spent particles are rare, so they respawn one at a time
+		int dead = _mm_movemask_ps(_mm_cmple_ps(l, zero));
+		if (dead != 0) {
+			for (int lane = 0; lane < 4; lane++) {
+				if (dead & (1 << lane))
+					owner.spawn(p + lane, step.Frame);
+			}
+			x = _mm_loadu_ps(px + p);
+			y = _mm_loadu_ps(py + p);
+			z = _mm_loadu_ps(pz + p);
+			l = _mm_loadu_ps(life + p);
+		}
+
+		// Turn the four components into four vertices, written in order
+		// so the write-combined mapping is filled without gaps
+		_MM_TRANSPOSE4_PS(x, y, z, l);
+		GLfloat* out = step.Target[p].Position;
+		_mm_storeu_ps(out,      x);
+		_mm_storeu_ps(out + 4,  y);
+		_mm_storeu_ps(out + 8,  z);
+		_mm_storeu_ps(out + 12, l);
+	}
+#endif
+
+	// Whatever is left over, or everything without SSE
+	for (; p < end; p++) {
+		vy[p] += fall;
+		px[p] += vx[p] * step.Delta;
+		py[p] += vy[p] * step.Delta;
+		pz[p] += vz[p] * step.Delta;
+		life[p] -= step.Delta;
+
+		if (py[p] < FloorHeight) {
+			py[p] = FloorHeight;
+			vy[p] = vy[p] * -Bounce;
+		}
+		if (life[p] <= 0.0f)
+			owner.spawn(p, step.Frame);
+
+		ParticleVertex& vertex = step.Target[p];
+		vertex.Position[0] = px[p];
+		vertex.Position[1] = py[p];
+		vertex.Position[2] = pz[p];
+		vertex.Life        = life[p];
+	}
+}
+
+/** Integer hash, the same in ParticleUpdate.vshader **/
+unsigned Particles::hash(unsigned value) {
+	value ^= value << 13;
+	value ^= value >> 17;
+	value ^= value << 5;
+	value += value << 3;
+	value ^= value >> 11;
+	value += value << 15;
+	return value;
+}
+
+/** Top 24 bits of a hash as 0 up to, but not including, 1 **/
+GLfloat Particles::getUnit(unsigned value) {
+	return static_cast<GLfloat>(value >> 8) / 16777216.0f;
+}
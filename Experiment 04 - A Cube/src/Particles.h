@@ -0,0 +1,151 @@
+#ifndef PARTICLES_H_INCLUDED
+#define PARTICLES_H_INCLUDED
+
+/*=================================                                       ----*\
+ * PARTICLES CLASS                                                            *
+ * - This class simulates a fountain of sparks falling onto the floor. On the *
+ *   CPU the particles live in separate arrays per component, updated four at *
+ *   a time with SSE across the workers and written straight into a mapped    *
+ *   streaming buffer. On the GPU they never leave video memory, a vertex     *
+ *   shader updates them from one buffer into another with transform feedback *
+ *   and the two swap every frame.                                            *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "Log.h"
+#include "VertexFormat.h"
+#include "ThreadPool.h"
+#include "Shaders.h"
+#include "MemoryTracker.h"
+#include "Trace.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLES_SSE
+#endif
+
+/** Particle as drawn from the streaming buffer, 16 bytes **/
+struct ParticleVertex {
+	GLfloat Position[3];
+	GLfloat Life;
+};
+
+/** Particle as kept on the GPU, in the order ParticleUpdate.vshader
+    captures it, 28 bytes **/
+struct ParticleState {
+	GLfloat Position[3];
+	GLfloat Life;
+	GLfloat Velocity[3];
+};
+
+/** Attribute layout matching the inputs of Particle.vshader **/
+typedef VertexFormat<ParticleVertex,
+	VERTEX_ATTRIBUTE(ParticleVertex, Position, 0, 3, GL_FLOAT, FLOAT),
+	VERTEX_ATTRIBUTE(ParticleVertex, Life, 1, 1, GL_FLOAT, FLOAT)
+> ParticleFormat;
+
+/** Attribute layout matching the inputs of ParticleUpdate.vshader, which
+    Particle.vshader shares **/
+typedef VertexFormat<ParticleState,
+	VERTEX_ATTRIBUTE(ParticleState, Position, 0, 3, GL_FLOAT, FLOAT),
+	VERTEX_ATTRIBUTE(ParticleState, Life, 1, 1, GL_FLOAT, FLOAT),
+	VERTEX_ATTRIBUTE(ParticleState, Velocity, 2, 3, GL_FLOAT, FLOAT)
+> ParticleStateFormat;
+
+class Particles {
+	public:
+		/** Where the simulation runs **/
+		enum Mode {
+			CPU, // SSE on the workers, streamed to OpenGL every frame
+			GPU  // Transform feedback between two buffers
+		};
+
+		Particles();
+		~Particles();
+
+		/** Creates the particles, rounded up to a multiple of four, and
+		    the OpenGL objects the mode needs **/
+		bool build(int count, Mode mode);
+
+		/** Moves the point new particles start from **/
+		void setEmitter(const glm::vec3& position);
+
+		/** Advances the particles to the time in seconds **/
+		void update(double time, ThreadPool* workers);
+
+		/** Draws the particles as points **/
+		void draw(const glm::mat4& viewProjection);
+
+		/** Particle count and simulation mode **/
+		int  getCount() const;
+		Mode getMode() const;
+
+		/** Milliseconds the last update took on the CPU, and the last
+		    measured GPU update in GPU mode **/
+		double getUpdateTime() const;
+		double getGPUTime() const;
+
+		/** Name of a mode, and the mode named by a string **/
+		static const char* getModeName(Mode mode);
+		static bool parseMode(const char* name, Mode& mode);
+	protected:
+	private:
+		/** Timer queries in flight before results are dropped **/
+		static const int QueryCount = 4;
+
+		/** One frame of the CPU update, shared with the workers **/
+		struct Step {
+			Particles*      Owner;
+			ParticleVertex* Target; // Mapped streaming buffer
+			GLfloat         Delta;
+			unsigned        Frame;
+		};
+
+		/** Particle components for the CPU update **/
+		std::vector<GLfloat> PositionX, PositionY, PositionZ;
+		std::vector<GLfloat> VelocityX, VelocityY, VelocityZ;
+		std::vector<GLfloat> Life;
+
+		/** Internal variables for rendering and the GPU update **/
+		GLuint  StreamArrayID, StreamBuffer;
+		GLuint  StateArrayIDs[2], StateBuffers[2];
+		GLuint  DrawProgramID, UpdateProgramID;
+		GLint   MVPUniformID, DeltaUniformID, FrameUniformID;
+		GLint   EmitterUniformID;
+		GLuint  Queries[QueryCount];
+		int     QueryHead, QueryPending;
+		int     Source; // State buffer holding the current particles
+		int     Count;
+		Mode    CurrentMode;
+		glm::vec3 Emitter;
+		unsigned  Frame;
+		double    LastTime, UpdateTime, GPUTime;
+		bool      Started;
+
+		/** Prevent copying, the particles own OpenGL objects **/
+		Particles(const Particles& source);            // No copying
+		Particles& operator=(const Particles& source); // No assignment
+
+		/** Internal functions used for simulating **/
+		bool buildCPU();
+		bool buildGPU();
+		void updateCPU(GLfloat delta, ThreadPool* workers);
+		void updateGPU(GLfloat delta);
+		void collectQueries();
+		void spawn(int index, unsigned frame);
+		void release();
+
+		/** Updates a range of particles for a step, on any thread **/
+		static void updateRange(void* data, int begin, int end);
+
+		/** Hash shared with ParticleUpdate.vshader, and its 0 to 1 value **/
+		static unsigned hash(unsigned value);
+		static GLfloat  getUnit(unsigned value);
+};
+
+#endif // PARTICLES_H_INCLUDED
@@ -0,0 +1,167 @@
+/*=================================                                       ----*\
+ * RANDOM CLASS                                                               *
+ * - This class generates repeatable random numbers on the CPU with four      *
+ *   xoshiro128** streams side by side, advanced together with SSE so arrays  *
+ *   fill four values per step. A counter-based hash, shared with the         *
+ *   procedural shaders, gives one value per index where a stream won't do.   *
+\*----                                       =================================*/
+
+#include "Random.h"
+
+/** Golden ratio step between the seeding values **/
+static const unsigned SeedStep = 0x9e3779b9u;
+
+/** Rotates bits left **/
+static inline unsigned rotate(unsigned value, int bits) {
+	return (value << bits) | (value >> (32 - bits));
+}
+
+#ifdef RANDOM_SSE
+/** Rotates the bits of four values left **/
+static inline __m128i rotate(__m128i value, int bits) {
+	return _mm_or_si128(_mm_slli_epi32(value, bits),
+		_mm_srli_epi32(value, 32 - bits));
+}
+#endif
+
+/** Starts the streams from a seed **/
+Random::Random(unsigned seed) {
+	setSeed(seed);
+}
+
+/** Starts the streams again from a seed **/
+void Random::setSeed(unsigned seed) {
+	// Every state word comes from the next splitmix value, so no stream
+	// starts at zero and nearby seeds still give unrelated streams
+	unsigned counter = seed;
+	for (int word = 0; word < 4; word++) {
+		for (int lane = 0; lane < 4; lane++) {
+			unsigned value = (counter += SeedStep);
+			value = (value ^ (value >> 16)) * 0x85ebca6bu;
+			value = (value ^ (value >> 13)) * 0xc2b2ae35u;
+			State[word][lane] = value ^ (value >> 16);
+		}
+	}
+
+	Used = 4;
+}
+
+/** Next 32 random bits **/
+unsigned Random::next() {
+	if (Used == 4) {
+		step(Block);
+		Used = 0;
+	}
+
+	return Block[Used++];
+}
+
+/** Next number from 0 up to, but not including, 1 **/
+GLfloat Random::nextUnit() {
+	return toUnit(next());
+}
+
+/** Fills an array with random bits, four at a time **/
+void Random::fill(unsigned* values, size_t count) {
+	size_t done = 0;
+
+	// Use up what next() left of the last step first, so mixing the two
+	// still gives each number once
+	for (; done < count && Used < 4; done++)
+		values[done] = Block[Used++];
+
+	for (; done + 4 <= count; done += 4)
+		step(values + done);
+
+	for (; done < count; done++)
+		values[done] = next();
+}
+
+/** Fills an array with numbers from 0 up to, but not including, 1 **/
+void Random::fillUnits(GLfloat* values, size_t count) {
+	size_t   done = 0;
+	unsigned bits[4];
+
+	for (; done < count && Used < 4; done++)
+		values[done] = toUnit(Block[Used++]);
+
+	for (; done + 4 <= count; done += 4) {
+		step(bits);
+#ifdef RANDOM_SSE
+		// Exactly what toUnit() gives, 24 bits fit a float without
+		// rounding
+		__m128i top = _mm_srli_epi32(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(bits)), 8);
+		_mm_storeu_ps(values + done, _mm_mul_ps(_mm_cvtepi32_ps(top),
+			_mm_set1_ps(1.0f / 16777216.0f)));
+#else
+		for (int b = 0; b < 4; b++)
+			values[done + b] = toUnit(bits[b]);
+#endif
+	}
+
+	for (; done < count; done++)
+		values[done] = nextUnit();
+}
+
+/** PCG hash, the same as hash() in the procedural shaders **/
+unsigned Random::hash(unsigned counter) {
+	unsigned state = counter * 747796405u + 2891336453u;
+	unsigned word  = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+	return (word >> 22) ^ word;
+}
+
+/** Top 24 bits as a number from 0 up to, but not including, 1 **/
+GLfloat Random::toUnit(unsigned bits) {
+	return static_cast<GLfloat>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+/** Advances all four streams, one result each **/
+void Random::step(unsigned* results) {
+#ifdef RANDOM_SSE
+	__m128i* state = reinterpret_cast<__m128i*>(State);
+	__m128i  s0 = _mm_loadu_si128(state + 0);
+	__m128i  s1 = _mm_loadu_si128(state + 1);
+	__m128i  s2 = _mm_loadu_si128(state + 2);
+	__m128i  s3 = _mm_loadu_si128(state + 3);
+
+	// SSE2 has no 32 bit multiply, times 5 and times 9 are shifts and adds
+	__m128i times5 = _mm_add_epi32(_mm_slli_epi32(s1, 2), s1);
+	__m128i turned = rotate(times5, 7);
+	__m128i result = _mm_add_epi32(_mm_slli_epi32(turned, 3), turned);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(results), result);
+
+	__m128i shifted = _mm_slli_epi32(s1, 9);
+	s2 = _mm_xor_si128(s2, s0);
+	s3 = _mm_xor_si128(s3, s1);
+	s1 = _mm_xor_si128(s1, s2);
+	s0 = _mm_xor_si128(s0, s3);
+	s2 = _mm_xor_si128(s2, shifted);
+	s3 = rotate(s3, 11);
+
+	_mm_storeu_si128(state + 0, s0);
+	_mm_storeu_si128(state + 1, s1);
+	_mm_storeu_si128(state + 2, s2);
+	_mm_storeu_si128(state + 3, s3);
+#else
+	for (int lane = 0; lane < 4; lane++) {
+		unsigned s0 = State[0][lane], s1 = State[1][lane];
+		unsigned s2 = State[2][lane], s3 = State[3][lane];
+
+		results[lane] = rotate(s1 * 5, 7) * 9;
+
+		unsigned shifted = s1 << 9;
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= shifted;
+		s3  = rotate(s3, 11);
+
+		State[0][lane] = s0;
+		State[1][lane] = s1;
+		State[2][lane] = s2;
+		State[3][lane] = s3;
+	}
+#endif
+}
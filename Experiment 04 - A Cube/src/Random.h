@@ -0,0 +1,65 @@
+#ifndef RANDOM_H_INCLUDED
+#define RANDOM_H_INCLUDED
+
+/*=================================                                       ----*\
+ * RANDOM CLASS                                                               *
+ * - This class generates repeatable random numbers on the CPU with four      *
+ *   xoshiro128** streams side by side, advanced together with SSE so arrays  *
+ *   fill four values per step. A counter-based hash, shared with the         *
+ *   procedural shaders, gives one value per index where a stream won't do.   *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RANDOM_SSE
+#endif
+
+class Random {
+	public:
+		/** Starts the streams from a seed, the same seed gives the same
+		    numbers with or without SSE **/
+		Random(unsigned seed = 1);
+
+		/** Starts the streams again from a seed **/
+		void setSeed(unsigned seed);
+
+		/** Next 32 random bits **/
+		unsigned next();
+
+		/** Next number from 0 up to, but not including, 1 **/
+		GLfloat nextUnit();
+
+		/** Fills an array with random bits, four at a time **/
+		void fill(unsigned* values, size_t count);
+
+		/** Fills an array with numbers from 0 up to, but not including, 1,
+		    four at a time **/
+		void fillUnits(GLfloat* values, size_t count);
+
+		/** Random bits for a counter, the same as hash() in the
+		    procedural shaders **/
+		static unsigned hash(unsigned counter);
+
+		/** Top 24 bits as a number from 0 up to, but not including, 1 **/
+		static GLfloat toUnit(unsigned bits);
+	protected:
+	private:
+		/** Four streams' states, word by word so each word of all four
+		    loads into one vector **/
+		unsigned State[4][4];
+
+		/** One step of all four streams, handed out by next() **/
+		unsigned Block[4];
+		int      Used;
+
+		/** Advances all four streams, one result each **/
+		void step(unsigned* results);
+};
+
+#endif // RANDOM_H_INCLUDED
@@ -0,0 +1,564 @@
+/*=================================                                       ----*\
+ * RENDER GRAPH CLASS                                                         *
+ * - This class collects the passes of a frame along with the resources each  *
+ *   one reads and writes. Compiling the graph culls passes whose results are *
+ *   never used, orders the rest by their dependencies, and backs transient   *
+ *   render targets with pooled textures shared by targets whose lifetimes    *
+ *   do not overlap. Clears and memory barriers are only issued when a pass   *
+ *   asks for them.                                                           *
+\*----                                       =================================*/
+
+#include "RenderGraph.h"
+
+/** RenderGraph constructor, OpenGL objects are created while compiling **/
+RenderGraph::RenderGraph() {
+}
+
+/** RenderGraph destructor **/
+RenderGraph::~RenderGraph() {
+	for (size_t f = 0; f < Framebuffers.size(); f++)
+		glDeleteFramebuffers(1, &Framebuffers[f].Framebuffer);
+	for (size_t p = 0; p < Pool.size(); p++) {
+		glDeleteTextures(1, &Pool[p].Texture);
+		MemoryTracker::release(MemoryTracker::TEXTURE, Pool[p].Texture);
+	}
+}
+
+/** Starts declaring a new frame, pooled textures carry over **/
+void RenderGraph::reset() {
+	Passes.clear();
+	Resources.clear();
+	Order.clear();
+}
+
+/** Brings an existing target into the graph **/
+RenderGraph::Resource RenderGraph::importTarget(const char* name,
+	GLuint texture, GLuint framebuffer, bool hasDepth)
+{
+	ResourceNode node;
+	node.Name        = name;
+	node.Imported    = true;
+	node.Desc.Width  = 0;
+	node.Desc.Height = 0;
+	node.Desc.Format = GL_NONE;
+	node.Texture     = texture;
+	node.Framebuffer = framebuffer;
+	node.HasDepth    = hasDepth;
+	node.FirstUse    = -1;
+	node.LastUse     = -1;
+	node.Readers     = 0;
+	node.Stored      = false;
+
+	Resources.push_back(node);
+	return static_cast<Resource>(Resources.size() - 1);
+}
+
+/** Declares a texture that only lives for part of the frame **/
+RenderGraph::Resource RenderGraph::createTexture(const char* name,
+	const TextureDesc& desc)
+{
+	ResourceNode node;
+	node.Name        = name;
+	node.Imported    = false;
+	node.Desc        = desc;
+	node.Texture     = 0;
+	node.Framebuffer = 0;
+	node.HasDepth    = isDepthFormat(desc.Format);
+	node.FirstUse    = -1;
+	node.LastUse     = -1;
+	node.Readers     = 0;
+	node.Stored      = false;
+
+	Resources.push_back(node);
+	return static_cast<Resource>(Resources.size() - 1);
+}
+
+/** Adds a pass, run in dependency order rather than declaration order **/
+RenderGraph::PassID RenderGraph::addPass(const char* name, Execute execute,
+	void* data)
+{
+	PassNode node;
+	node.Name       = name;
+	node.Callback   = execute;
+	node.Data       = data;
+	node.SideEffect = false;
+	node.Culled     = false;
+	node.References = 0;
+
+	Passes.push_back(node);
+	return static_cast<PassID>(Passes.size() - 1);
+}
+
+/** Declares that a pass samples a resource **/
+void RenderGraph::read(PassID pass, Resource resource) {
+	Use use = { resource, READ };
+	Passes[pass].Uses.push_back(use);
+}
+
+/** Declares that a pass renders to a resource, optionally cleared **/
+void RenderGraph::write(PassID pass, Resource resource, bool clear) {
+	Use use = { resource, clear ? WRITE_CLEAR : WRITE };
+	Passes[pass].Uses.push_back(use);
+}
+
+/** Declares that a pass writes a resource with image stores **/
+void RenderGraph::writeStorage(PassID pass, Resource resource) {
+	Use use = { resource, WRITE_STORAGE };
+	Passes[pass].Uses.push_back(use);
+}
+
+/** Keeps a pass even when nothing reads its results **/
+void RenderGraph::setSideEffect(PassID pass) {
+	Passes[pass].SideEffect = true;
+}
+
+/** Culls, orders and allocates the frame **/
+bool RenderGraph::compile() {
+	cullPasses();
+
+	if (!orderPasses()) {
+		LOG_ERROR(RENDER, "The render graph has a dependency cycle");
+		return false;
+	}
+
+	allocateTextures();
+	return true;
+}
+
+/** Runs the compiled passes **/
+void RenderGraph::execute() {
+	for (size_t o = 0; o < Order.size(); o++) {
+		PassNode& pass = Passes[Order[o]];
+		TRACE_SCOPE(pass.Name);
+		TRACE_GPU_SCOPE(pass.Name);
+		GLbitfield barriers = 0;
+		bool       renders  = false;
+
+		// Image stores are only visible to later passes after a barrier, and
+		// only resources written that way need one
+		for (size_t u = 0; u < pass.Uses.size(); u++) {
+			const Use& use = pass.Uses[u];
+			ResourceNode& resource = Resources[use.Target];
+
+			if (use.Type == WRITE || use.Type == WRITE_CLEAR)
+				renders = true;
+
+			if (!resource.Stored)
+				continue;
+
+			if (use.Type == READ)
+				barriers |= GL_TEXTURE_FETCH_BARRIER_BIT;
+			else if (use.Type == WRITE_STORAGE)
+				barriers |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+			else
+				barriers |= GL_FRAMEBUFFER_BARRIER_BIT;
+			resource.Stored = false;
+		}
+
+		if (barriers != 0)
+			glMemoryBarrier(barriers);
+
+		// Compute passes keep whatever is bound
+		if (renders) {
+			glBindFramebuffer(GL_FRAMEBUFFER, getFramebuffer(pass));
+			clearTargets(pass);
+		}
+
+		pass.Callback(*this, pass.Data);
+
+		for (size_t u = 0; u < pass.Uses.size(); u++) {
+			if (pass.Uses[u].Type == WRITE_STORAGE)
+				Resources[pass.Uses[u].Target].Stored = true;
+		}
+	}
+}
+
+/** Texture backing a resource, for use inside a pass **/
+GLuint RenderGraph::getTexture(Resource resource) const {
+	return Resources[resource].Texture;
+}
+
+/** Bytes held by the transient texture pool **/
+GLsizeiptr RenderGraph::getMemoryUsage() const {
+	GLsizeiptr bytes = 0;
+
+	for (size_t p = 0; p < Pool.size(); p++) {
+		const TextureDesc& desc = Pool[p].Desc;
+		bytes += static_cast<GLsizeiptr>(desc.Width) * desc.Height *
+			MemoryTracker::getPixelBytes(desc.Format);
+	}
+
+	return bytes;
+}
+
+/** Removes passes whose outputs nothing needs **/
+void RenderGraph::cullPasses() {
+	// Count the readers of every resource and the outputs of every pass
+	for (size_t p = 0; p < Passes.size(); p++) {
+		for (size_t u = 0; u < Passes[p].Uses.size(); u++) {
+			const Use& use = Passes[p].Uses[u];
+			if (use.Type == READ)
+				Resources[use.Target].Readers++;
+			else
+				Passes[p].References++;
+		}
+	}
+
+	// Outputs nobody reads don't keep their writers alive
+	for (size_t p = 0; p < Passes.size(); p++) {
+		for (size_t u = 0; u < Passes[p].Uses.size(); u++) {
+			const Use& use = Passes[p].Uses[u];
+			if (use.Type != READ && Resources[use.Target].Readers == 0)
+				Passes[p].References--;
+		}
+	}
+
+	std::vector<PassID> unused;
+	for (size_t p = 0; p < Passes.size(); p++) {
+		if (Passes[p].References == 0 && !Passes[p].SideEffect)
+			unused.push_back(static_cast<PassID>(p));
+	}
+
+	// Culling a pass releases what it read, which may leave more passes
+	// with nothing to do
+	while (!unused.empty()) {
+		PassNode& pass = Passes[unused.back()];
+		unused.pop_back();
+		pass.Culled = true;
+
+		for (size_t u = 0; u < pass.Uses.size(); u++) {
+			const Use& use = pass.Uses[u];
+			if (use.Type != READ || --Resources[use.Target].Readers > 0)
+				continue;
+
+			for (size_t w = 0; w < Passes.size(); w++) {
+				PassNode& writer = Passes[w];
+				if (writer.Culled || writer.SideEffect)
+					continue;
+
+				for (size_t x = 0; x < writer.Uses.size(); x++) {
+					if (writer.Uses[x].Target == use.Target &&
+						writer.Uses[x].Type != READ &&
+						--writer.References == 0)
+					{
+						unused.push_back(static_cast<PassID>(w));
+					}
+				}
+			}
+		}
+	}
+}
+
+/** Sorts the surviving passes so every write lands before its reads **/
+bool RenderGraph::orderPasses() {
+	size_t passCount = Passes.size();
+	std::vector< std::vector<PassID> > dependents(passCount);
+	std::vector<int> waiting(passCount, 0);
+
+	// Writers of a resource run in declaration order, and every reader
+	// waits for all of them, so passes can be declared in any order
+	for (size_t r = 0; r < Resources.size(); r++) {
+		PassID lastWriter = -1;
+		std::vector<PassID> writers, readers;
+
+		for (size_t p = 0; p < passCount; p++) {
+			if (Passes[p].Culled)
+				continue;
+
+			for (size_t u = 0; u < Passes[p].Uses.size(); u++) {
+				const Use& use = Passes[p].Uses[u];
+				if (use.Target != static_cast<Resource>(r))
+					continue;
+
+				if (use.Type == READ) {
+					readers.push_back(static_cast<PassID>(p));
+				} else {
+					PassID pass = static_cast<PassID>(p);
+					if (lastWriter >= 0 && lastWriter != pass) {
+						dependents[lastWriter].push_back(pass);
+						waiting[p]++;
+					}
+					lastWriter = pass;
+					writers.push_back(pass);
+				}
+			}
+		}
+
+		for (size_t d = 0; d < readers.size(); d++) {
+			for (size_t w = 0; w < writers.size(); w++) {
+				if (readers[d] == writers[w])
+					continue;
+				dependents[writers[w]].push_back(readers[d]);
+				waiting[readers[d]]++;
+			}
+		}
+	}
+
+	// Take the earliest declared pass that is ready, so independent passes
+	// keep the order they were written in
+	size_t liveCount = 0;
+	for (size_t p = 0; p < passCount; p++) {
+		if (!Passes[p].Culled)
+			liveCount++;
+	}
+
+	std::vector<bool> done(passCount, false);
+	while (Order.size() < liveCount) {
+		PassID next = -1;
+		for (size_t p = 0; p < passCount && next < 0; p++) {
+			if (!Passes[p].Culled && !done[p] && waiting[p] == 0)
+				next = static_cast<PassID>(p);
+		}
+
+		if (next < 0)
+			return false;
+
+		done[next] = true;
+		Order.push_back(next);
+		for (size_t d = 0; d < dependents[next].size(); d++)
+			waiting[dependents[next][d]]--;
+	}
+
+	// Record when each resource is first and last touched
+	for (size_t o = 0; o < Order.size(); o++) {
+		const PassNode& pass = Passes[Order[o]];
+		for (size_t u = 0; u < pass.Uses.size(); u++) {
+			ResourceNode& resource = Resources[pass.Uses[u].Target];
+			if (resource.FirstUse < 0)
+				resource.FirstUse = static_cast<int>(o);
+			resource.LastUse = static_cast<int>(o);
+		}
+	}
+
+	return true;
+}
+
+/** Backs transient resources with pooled textures **/
+void RenderGraph::allocateTextures() {
+	for (size_t p = 0; p < Pool.size(); p++)
+		Pool[p].BusyUntil = -1;
+
+	// Walk the transients in the order they come alive. A pooled texture
+	// with the same description is free once its last user has run
+	for (size_t o = 0; o < Order.size(); o++) {
+		for (size_t r = 0; r < Resources.size(); r++) {
+			ResourceNode& resource = Resources[r];
+			if (resource.Imported || resource.FirstUse != static_cast<int>(o))
+				continue;
+
+			int slot = -1;
+			for (size_t p = 0; p < Pool.size() && slot < 0; p++) {
+				if (Pool[p].BusyUntil < resource.FirstUse &&
+					sameDesc(Pool[p].Desc, resource.Desc))
+				{
+					slot = static_cast<int>(p);
+				}
+			}
+
+			if (slot < 0) {
+				Physical physical;
+				physical.Desc       = resource.Desc;
+				physical.Texture    = createPooledTexture(resource.Desc);
+				physical.BusyUntil  = -1;
+				physical.IdleFrames = 0;
+				Pool.push_back(physical);
+				slot = static_cast<int>(Pool.size() - 1);
+			}
+
+			Pool[slot].BusyUntil  = resource.LastUse;
+			Pool[slot].IdleFrames = 0;
+			resource.Texture      = Pool[slot].Texture;
+		}
+	}
+
+	releaseIdleTextures();
+}
+
+/** Frees pooled textures that have gone unused for a while **/
+void RenderGraph::releaseIdleTextures() {
+	for (size_t p = Pool.size(); p-- > 0; ) {
+		if (Pool[p].BusyUntil >= 0 || ++Pool[p].IdleFrames <= IdleFrameLimit)
+			continue;
+
+		// Framebuffers built around the texture go with it
+		for (size_t f = Framebuffers.size(); f-- > 0; ) {
+			const std::vector<GLuint>& attachments =
+				Framebuffers[f].Attachments;
+			for (size_t a = 0; a < attachments.size(); a++) {
+				if (attachments[a] == Pool[p].Texture) {
+					glDeleteFramebuffers(1, &Framebuffers[f].Framebuffer);
+					Framebuffers.erase(Framebuffers.begin() + f);
+					break;
+				}
+			}
+		}
+
+		glDeleteTextures(1, &Pool[p].Texture);
+		MemoryTracker::release(MemoryTracker::TEXTURE, Pool[p].Texture);
+		Pool.erase(Pool.begin() + p);
+	}
+}
+
+/** Creates a texture for the pool **/
+GLuint RenderGraph::createPooledTexture(const TextureDesc& desc) {
+	GLenum format = GL_RGBA;
+	GLenum type   = GL_UNSIGNED_BYTE;
+
+	switch (desc.Format) {
+		case GL_R8:                 format = GL_RED;  break;
+		case GL_RG8:                format = GL_RG;   break;
+		case GL_R32F:               format = GL_RED;  type = GL_FLOAT; break;
+		case GL_RG16F:
+			format = GL_RG;
+			type   = GL_HALF_FLOAT;
+			break;
+		case GL_RGBA16F:            type = GL_HALF_FLOAT; break;
+		case GL_RGBA32F:            type = GL_FLOAT; break;
+		case GL_DEPTH_COMPONENT24:
+			format = GL_DEPTH_COMPONENT;
+			type   = GL_UNSIGNED_INT;
+			break;
+		case GL_DEPTH_COMPONENT32F:
+			format = GL_DEPTH_COMPONENT;
+			type   = GL_FLOAT;
+			break;
+		case GL_DEPTH24_STENCIL8:
+			format = GL_DEPTH_STENCIL;
+			type   = GL_UNSIGNED_INT_24_8;
+			break;
+		default:
+			break;
+	}
+
+	// Depth is read back exactly, color is filtered when upscaled
+	GLint filter = (isDepthFormat(desc.Format) ? GL_NEAREST : GL_LINEAR);
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, desc.Format, desc.Width, desc.Height, 0,
+		format, type, NULL);
+	MemoryTracker::track(MemoryTracker::TEXTURE, texture, "Render graph pool",
+		MemoryTracker::getImageBytes(desc.Format, desc.Width, desc.Height,
+			1, 1));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return texture;
+}
+
+/** Finds or builds the framebuffer a pass renders into **/
+GLuint RenderGraph::getFramebuffer(const PassNode& pass) {
+	std::vector<GLuint> attachments;
+
+	for (size_t u = 0; u < pass.Uses.size(); u++) {
+		const Use& use = pass.Uses[u];
+		if (use.Type != WRITE && use.Type != WRITE_CLEAR)
+			continue;
+
+		// Imported targets bring their own framebuffer
+		const ResourceNode& resource = Resources[use.Target];
+		if (resource.Imported)
+			return resource.Framebuffer;
+
+		attachments.push_back(resource.Texture);
+	}
+
+	for (size_t f = 0; f < Framebuffers.size(); f++) {
+		if (Framebuffers[f].Attachments == attachments)
+			return Framebuffers[f].Framebuffer;
+	}
+
+	// Colors take attachment points in the order they were declared
+	CachedFramebuffer cached;
+	cached.Attachments = attachments;
+	glGenFramebuffers(1, &cached.Framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, cached.Framebuffer);
+
+	std::vector<GLenum> drawBuffers;
+	size_t attachment = 0;
+	for (size_t u = 0; u < pass.Uses.size(); u++) {
+		const Use& use = pass.Uses[u];
+		if (use.Type != WRITE && use.Type != WRITE_CLEAR)
+			continue;
+
+		const ResourceNode& resource = Resources[use.Target];
+		GLenum point;
+		if (resource.Desc.Format == GL_DEPTH24_STENCIL8) {
+			point = GL_DEPTH_STENCIL_ATTACHMENT;
+		} else if (resource.HasDepth) {
+			point = GL_DEPTH_ATTACHMENT;
+		} else {
+			point = GL_COLOR_ATTACHMENT0 +
+				static_cast<GLenum>(drawBuffers.size());
+			drawBuffers.push_back(point);
+		}
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, point, GL_TEXTURE_2D,
+			attachments[attachment++], 0);
+	}
+
+	if (drawBuffers.empty())
+		glDrawBuffer(GL_NONE);
+	else
+		glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()),
+			&drawBuffers[0]);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		LOG_ERROR(RENDER, "Failed to create the framebuffer for %s",
+			pass.Name);
+
+	Framebuffers.push_back(cached);
+	return cached.Framebuffer;
+}
+
+/** Clears the targets a pass asked to have cleared, and nothing else **/
+void RenderGraph::clearTargets(const PassNode& pass) {
+	static const GLfloat black[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	static const GLfloat far     = 1.0f;
+	GLint colorIndex = 0;
+
+	for (size_t u = 0; u < pass.Uses.size(); u++) {
+		const Use& use = pass.Uses[u];
+		if (use.Type != WRITE && use.Type != WRITE_CLEAR)
+			continue;
+
+		const ResourceNode& resource = Resources[use.Target];
+		bool clear = (use.Type == WRITE_CLEAR);
+
+		// Imported targets use the clear values set by their owner
+		if (resource.Imported) {
+			if (clear) {
+				glClear(GL_COLOR_BUFFER_BIT | (resource.HasDepth ?
+					GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT : 0));
+			}
+			return;
+		}
+
+		if (resource.Desc.Format == GL_DEPTH24_STENCIL8) {
+			if (clear)
+				glClearBufferfi(GL_DEPTH_STENCIL, 0, far, 0);
+		} else if (resource.HasDepth) {
+			if (clear)
+				glClearBufferfv(GL_DEPTH, 0, &far);
+		} else {
+			if (clear)
+				glClearBufferfv(GL_COLOR, colorIndex, black);
+			colorIndex++;
+		}
+	}
+}
+
+/** Whether two transients could share a texture **/
+bool RenderGraph::sameDesc(const TextureDesc& a, const TextureDesc& b) {
+	return a.Width == b.Width && a.Height == b.Height && a.Format == b.Format;
+}
+
+/** Whether a format attaches as depth **/
+bool RenderGraph::isDepthFormat(GLenum format) {
+	return format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F ||
+		format == GL_DEPTH24_STENCIL8;
+}
@@ -0,0 +1,151 @@
+#ifndef RENDERGRAPH_H_INCLUDED
+#define RENDERGRAPH_H_INCLUDED
+
+/*=================================                                       ----*\
+ * RENDER GRAPH CLASS                                                         *
+ * - This class collects the passes of a frame along with the resources each  *
+ *   one reads and writes. Compiling the graph culls passes whose results are *
+ *   never used, orders the rest by their dependencies, and backs transient   *
+ *   render targets with pooled textures shared by targets whose lifetimes    *
+ *   do not overlap. Clears and memory barriers are only issued when a pass   *
+ *   asks for them.                                                           *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "Log.h"
+#include "Trace.h"
+#include "MemoryTracker.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+class RenderGraph {
+	public:
+		/** Handles to resources and passes within the current frame **/
+		typedef int Resource;
+		typedef int PassID;
+
+		/** Callback that records a pass, with its target already bound **/
+		typedef void (*Execute)(RenderGraph& graph, void* data);
+
+		/** Description of a transient texture **/
+		struct TextureDesc {
+			GLsizei Width, Height;
+			GLenum  Format; // Sized internal format, such as GL_RGBA8
+		};
+
+		RenderGraph();
+		~RenderGraph();
+
+		/** Starts declaring a new frame **/
+		void reset();
+
+		/** Brings an existing target into the graph. The texture may be zero
+		    for targets that cannot be sampled, like the window **/
+		Resource importTarget(const char* name, GLuint texture,
+			GLuint framebuffer, bool hasDepth);
+
+		/** Declares a texture that only lives for part of the frame **/
+		Resource createTexture(const char* name, const TextureDesc& desc);
+
+		/** Adds a pass, run in dependency order rather than declaration
+		    order **/
+		PassID addPass(const char* name, Execute execute, void* data);
+
+		/** Declares that a pass samples a resource **/
+		void read(PassID pass, Resource resource);
+
+		/** Declares that a pass renders to a resource, optionally cleared **/
+		void write(PassID pass, Resource resource, bool clear);
+
+		/** Declares that a pass writes a resource with image stores **/
+		void writeStorage(PassID pass, Resource resource);
+
+		/** Keeps a pass even when nothing reads its results **/
+		void setSideEffect(PassID pass);
+
+		/** Culls, orders and allocates the frame **/
+		bool compile();
+
+		/** Runs the compiled passes **/
+		void execute();
+
+		/** Texture backing a resource, for use inside a pass **/
+		GLuint getTexture(Resource resource) const;
+
+		/** Bytes held by the transient texture pool **/
+		GLsizeiptr getMemoryUsage() const;
+	protected:
+	private:
+		/** How a pass touches a resource **/
+		enum Access { READ, WRITE, WRITE_CLEAR, WRITE_STORAGE };
+
+		struct Use {
+			Resource Target;
+			Access   Type;
+		};
+
+		struct PassNode {
+			const char*      Name;
+			Execute          Callback;
+			void*            Data;
+			std::vector<Use> Uses;
+			bool             SideEffect;
+			bool             Culled;
+			int              References; // Outputs still needed
+		};
+
+		struct ResourceNode {
+			const char* Name;
+			bool        Imported;
+			TextureDesc Desc;
+			GLuint      Texture;     // Imported, or pooled once compiled
+			GLuint      Framebuffer; // Imported targets only
+			bool        HasDepth;
+			int         FirstUse, LastUse; // Positions in the compiled order
+			int         Readers;     // Passes still reading it
+			bool        Stored;      // Last written with image stores
+		};
+
+		/** A pooled texture and the last position that uses it **/
+		struct Physical {
+			TextureDesc Desc;
+			GLuint      Texture;
+			int         BusyUntil;  // -1 when unused this frame
+			int         IdleFrames;
+		};
+
+		/** Frames a pooled texture may go unused before it is released **/
+		static const int IdleFrameLimit = 16;
+
+		/** A framebuffer built for a set of pooled attachments **/
+		struct CachedFramebuffer {
+			std::vector<GLuint> Attachments;
+			GLuint              Framebuffer;
+		};
+
+		/** Internal variables for the graph **/
+		std::vector<PassNode>          Passes;
+		std::vector<ResourceNode>      Resources;
+		std::vector<PassID>            Order;
+		std::vector<Physical>          Pool;
+		std::vector<CachedFramebuffer> Framebuffers;
+
+		/** Prevent copying, the graph owns OpenGL objects **/
+		RenderGraph(const RenderGraph& source);            // No copying
+		RenderGraph& operator=(const RenderGraph& source); // No assignment
+
+		/** Internal functions used for compiling and execution **/
+		void cullPasses();
+		bool orderPasses();
+		void allocateTextures();
+		void releaseIdleTextures();
+		GLuint createPooledTexture(const TextureDesc& desc);
+		GLuint getFramebuffer(const PassNode& pass);
+		void clearTargets(const PassNode& pass);
+		static bool sameDesc(const TextureDesc& a, const TextureDesc& b);
+		static bool isDepthFormat(GLenum format);
+};
+
+#endif // RENDERGRAPH_H_INCLUDED
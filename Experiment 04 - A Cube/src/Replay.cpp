@@ -0,0 +1,416 @@
+/*=================================                                       ----*\
+ * REPLAY TOOL                                                                *
+ * - This program plays a recording from GLRecorder back into an offscreen    *
+ *   framebuffer as fast as it can, without presenting, and prints how long   *
+ *   each frame took to submit on the CPU and to run on the GPU.              *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include "GLRecorder.h"
+#include "Tools.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+/** Reads values out of a recording held in memory **/
+struct Reader {
+	const char* Cursor;
+	const char* End;
+	bool        Failed;
+
+	/** Copies the next value, failing past the end of the recording **/
+	template <typename T> T read() {
+		T value = T();
+		readBytes(&value, sizeof(T));
+		return value;
+	}
+
+	/** Copies the next bytes **/
+	void readBytes(void* data, size_t size) {
+		if (Failed || static_cast<size_t>(End - Cursor) < size) {
+			Failed = true;
+			memset(data, 0, size);
+			return;
+		}
+		memcpy(data, Cursor, size);
+		Cursor += size;
+	}
+
+	/** Points at the next bytes without copying them **/
+	const char* skip(size_t size) {
+		if (Failed || static_cast<size_t>(End - Cursor) < size) {
+			Failed = true;
+			return NULL;
+		}
+		const char* data = Cursor;
+		Cursor += size;
+		return data;
+	}
+
+	/** Reads a string written with its length in front **/
+	std::string readString() {
+		unsigned length = read<unsigned>();
+		const char* text = skip(length);
+		return (text ? std::string(text, length) : std::string());
+	}
+};
+
+/** Names the recording used, mapped to the ones the replay created **/
+struct Names {
+	std::map<GLuint, GLuint> Objects; // Shaders and programs
+	std::map<GLuint, GLuint> Buffers;
+	std::map<GLuint, GLuint> VertexArrays;
+	std::map<std::pair<GLuint, GLint>, GLint> Locations; // Program, location
+	GLuint Program;                   // Recorded program in use
+};
+
+/** Looks up a replayed name, zero stays zero **/
+GLuint mapName(const std::map<GLuint, GLuint>& names, GLuint name) {
+	std::map<GLuint, GLuint>::const_iterator found = names.find(name);
+	return (found != names.end() ? found->second : 0);
+}
+
+/** Looks up a replayed uniform location of the program in use **/
+GLint mapLocation(const Names& names, GLint recorded) {
+	std::map<std::pair<GLuint, GLint>, GLint>::const_iterator found =
+		names.Locations.find(std::make_pair(names.Program, recorded));
+	return (found != names.Locations.end() ? found->second : recorded);
+}
+
+/** Plays commands up to the end of the next frame, returning false once
+    the recording runs out or can't be read **/
+bool replayFrame(Reader& reader, Names& names) {
+	while (reader.Cursor < reader.End) {
+		GLRecorder::Command command =
+			static_cast<GLRecorder::Command>(reader.read<unsigned char>());
+
+		switch (command) {
+			case GLRecorder::CREATE_SHADER: {
+				GLenum type     = reader.read<GLenum>();
+				GLuint recorded = reader.read<GLuint>();
+				names.Objects[recorded] = glCreateShader(type);
+				break;
+			}
+			case GLRecorder::SHADER_SOURCE: {
+				GLuint  shader = mapName(names.Objects, reader.read<GLuint>());
+				GLsizei count  = reader.read<GLsizei>();
+				std::vector<std::string> pieces(count);
+				std::vector<const GLchar*> strings(count);
+				std::vector<GLint> lengths(count);
+				for (GLsizei s = 0; s < count; s++) {
+					pieces[s]  = reader.readString();
+					strings[s] = pieces[s].c_str();
+					lengths[s] = static_cast<GLint>(pieces[s].size());
+				}
+				if (count > 0)
+					glShaderSource(shader, count, &strings[0], &lengths[0]);
+				break;
+			}
+			case GLRecorder::COMPILE_SHADER:
+				glCompileShader(mapName(names.Objects, reader.read<GLuint>()));
+				break;
+			case GLRecorder::DELETE_SHADER:
+				glDeleteShader(mapName(names.Objects, reader.read<GLuint>()));
+				break;
+			case GLRecorder::CREATE_PROGRAM:
+				names.Objects[reader.read<GLuint>()] = glCreateProgram();
+				break;
+			case GLRecorder::ATTACH_SHADER: {
+				GLuint program = mapName(names.Objects, reader.read<GLuint>());
+				GLuint shader  = mapName(names.Objects, reader.read<GLuint>());
+				glAttachShader(program, shader);
+				break;
+			}
+			case GLRecorder::LINK_PROGRAM:
+				glLinkProgram(mapName(names.Objects, reader.read<GLuint>()));
+				break;
+			case GLRecorder::DELETE_PROGRAM:
+				glDeleteProgram(mapName(names.Objects, reader.read<GLuint>()));
+				break;
+			case GLRecorder::USE_PROGRAM:
+				names.Program = reader.read<GLuint>();
+				glUseProgram(mapName(names.Objects, names.Program));
+				break;
+			case GLRecorder::GET_UNIFORM_LOCATION: {
+				GLuint      program  = reader.read<GLuint>();
+				std::string name     = reader.readString();
+				GLint       recorded = reader.read<GLint>();
+				names.Locations[std::make_pair(program, recorded)] =
+					glGetUniformLocation(mapName(names.Objects, program),
+						name.c_str());
+				break;
+			}
+			case GLRecorder::UNIFORM_MATRIX4: {
+				GLint     recorded  = reader.read<GLint>();
+				GLsizei   count     = reader.read<GLsizei>();
+				GLboolean transpose = reader.read<GLboolean>();
+				const char* value   = reader.skip(count * 16 * sizeof(GLfloat));
+
+				// The matrices may not be aligned inside the recording
+				std::vector<GLfloat> matrices(count * 16);
+				if (value && count > 0)
+					memcpy(&matrices[0], value,
+						matrices.size() * sizeof(GLfloat));
+
+				if (count > 0)
+					glUniformMatrix4fv(mapLocation(names, recorded), count,
+						transpose, &matrices[0]);
+				break;
+			}
+			case GLRecorder::UNIFORM_UINT: {
+				GLint  recorded = reader.read<GLint>();
+				GLuint value    = reader.read<GLuint>();
+				glUniform1ui(mapLocation(names, recorded), value);
+				break;
+			}
+			case GLRecorder::GEN_BUFFERS: {
+				GLsizei count = reader.read<GLsizei>();
+				for (GLsizei b = 0; b < count; b++) {
+					GLuint buffer = 0;
+					glGenBuffers(1, &buffer);
+					names.Buffers[reader.read<GLuint>()] = buffer;
+				}
+				break;
+			}
+			case GLRecorder::BIND_BUFFER: {
+				GLenum target = reader.read<GLenum>();
+				GLuint buffer = reader.read<GLuint>();
+				glBindBuffer(target, mapName(names.Buffers, buffer));
+				break;
+			}
+			case GLRecorder::BUFFER_DATA: {
+				GLenum     target  = reader.read<GLenum>();
+				GLsizeiptr size    = static_cast<GLsizeiptr>(
+					reader.read<long long>());
+				GLenum     usage   = reader.read<GLenum>();
+				bool       hasData = (reader.read<unsigned char>() != 0);
+				const char* data   = (hasData ? reader.skip(size) : NULL);
+				glBufferData(target, size, data, usage);
+				break;
+			}
+			case GLRecorder::GEN_VERTEX_ARRAYS: {
+				GLsizei count = reader.read<GLsizei>();
+				for (GLsizei v = 0; v < count; v++) {
+					GLuint array = 0;
+					glGenVertexArrays(1, &array);
+					names.VertexArrays[reader.read<GLuint>()] = array;
+				}
+				break;
+			}
+			case GLRecorder::BIND_VERTEX_ARRAY:
+				glBindVertexArray(mapName(names.VertexArrays,
+					reader.read<GLuint>()));
+				break;
+			case GLRecorder::ENABLE_ATTRIBUTE:
+				glEnableVertexAttribArray(reader.read<GLuint>());
+				break;
+			case GLRecorder::DISABLE_ATTRIBUTE:
+				glDisableVertexAttribArray(reader.read<GLuint>());
+				break;
+			case GLRecorder::ATTRIBUTE_POINTER: {
+				GLuint    index      = reader.read<GLuint>();
+				GLint     size       = reader.read<GLint>();
+				GLenum    type       = reader.read<GLenum>();
+				GLboolean normalized = reader.read<GLboolean>();
+				GLsizei   stride     = reader.read<GLsizei>();
+				size_t    offset     = static_cast<size_t>(
+					reader.read<unsigned long long>());
+				glVertexAttribPointer(index, size, type, normalized, stride,
+					reinterpret_cast<const GLvoid*>(offset));
+				break;
+			}
+			case GLRecorder::CLEAR:
+				glClear(reader.read<GLbitfield>());
+				break;
+			case GLRecorder::CLEAR_COLOR: {
+				GLfloat red   = reader.read<GLfloat>();
+				GLfloat green = reader.read<GLfloat>();
+				GLfloat blue  = reader.read<GLfloat>();
+				GLfloat alpha = reader.read<GLfloat>();
+				glClearColor(red, green, blue, alpha);
+				break;
+			}
+			case GLRecorder::ENABLE:
+				glEnable(reader.read<GLenum>());
+				break;
+			case GLRecorder::DEPTH_FUNC:
+				glDepthFunc(reader.read<GLenum>());
+				break;
+			case GLRecorder::VIEWPORT: {
+				GLint   x      = reader.read<GLint>();
+				GLint   y      = reader.read<GLint>();
+				GLsizei width  = reader.read<GLsizei>();
+				GLsizei height = reader.read<GLsizei>();
+				glViewport(x, y, width, height);
+				break;
+			}
+			case GLRecorder::DRAW_ARRAYS: {
+				GLenum  mode  = reader.read<GLenum>();
+				GLint   first = reader.read<GLint>();
+				GLsizei count = reader.read<GLsizei>();
+				glDrawArrays(mode, first, count);
+				break;
+			}
+			case GLRecorder::FRAME:
+				return !reader.Failed;
+			default:
+				fprintf(stderr, "Unknown command %d in the recording\n",
+					static_cast<int>(command));
+				reader.Failed = true;
+				return false;
+		}
+
+		if (reader.Failed)
+			break;
+	}
+
+	if (reader.Failed)
+		fprintf(stderr, "The recording ends partway through a command\n");
+	return false;
+}
+
+/** Loads a whole file into memory **/
+bool loadFile(const char* path, std::vector<char>& data) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "Failed to open recording %s\n", path);
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data.resize(size > 0 ? size : 0);
+	bool read = (size <= 0 ||
+		fread(&data[0], 1, size, file) == static_cast<size_t>(size));
+	fclose(file);
+
+	if (!read)
+		fprintf(stderr, "Failed to read recording %s\n", path);
+	return read;
+}
+
+int main(int argc, char* argv[]) {
+	const char* path  = NULL;
+	bool        quiet = false;
+
+	// Read the command line
+	for (int a = 1; a < argc; a++) {
+		if (strcmp(argv[a], "--quiet") == 0)
+			quiet = true;
+		else
+			path = argv[a];
+	}
+
+	if (!path) {
+		fprintf(stderr, "Usage: Replay [--quiet] recording.glr\n");
+		return -1;
+	}
+
+	std::vector<char> data;
+	if (!loadFile(path, data))
+		return -1;
+
+	GLRecorder::Header header;
+	if (data.size() < sizeof(header)) {
+		fprintf(stderr, "%s is not a recording\n", path);
+		return -1;
+	}
+	memcpy(&header, &data[0], sizeof(header));
+
+	if (memcmp(header.Magic, "GLRC", 4) != 0 ||
+		header.Version != GLRecorder::FileVersion)
+	{
+		fprintf(stderr, "%s is not a version %u recording\n", path,
+			GLRecorder::FileVersion);
+		return -1;
+	}
+
+	// The recording never binds a framebuffer of its own, so everything
+	// it draws to the window lands in the offscreen one
+	GLuint renderbuffers[2];
+	if (!Tools::createContext("Replay", header.Width, header.Height,
+		renderbuffers))
+		return -1;
+
+	fprintf(stdout, "Replaying %d frames at %dx%d\n", header.Frames,
+		header.Width, header.Height);
+
+	// One GPU timer per frame, read back once everything is submitted so
+	// waiting on results never stalls the replay
+	std::vector<GLuint> queries(header.Frames > 0 ? header.Frames : 1);
+	glGenQueries(static_cast<GLsizei>(queries.size()), &queries[0]);
+	std::vector<double> cpuTimes;
+
+	Reader reader;
+	reader.Cursor = &data[0] + sizeof(header);
+	reader.End    = &data[0] + data.size();
+	reader.Failed = false;
+
+	Names names;
+	names.Program = 0;
+
+	double start = glfwGetTime();
+	for (;;) {
+		size_t frame   = cpuTimes.size();
+		bool   timed   = (frame < queries.size());
+		double begin   = glfwGetTime();
+
+		if (timed)
+			glBeginQuery(GL_TIME_ELAPSED, queries[frame]);
+		bool played = replayFrame(reader, names);
+		if (timed)
+			glEndQuery(GL_TIME_ELAPSED);
+
+		if (!played)
+			break;
+		cpuTimes.push_back((glfwGetTime() - begin) * 1000.0);
+	}
+	glFinish();
+	double total = (glfwGetTime() - start) * 1000.0;
+
+	if (reader.Failed)
+		return -1;
+
+	int    frames   = static_cast<int>(cpuTimes.size());
+	double cpuTotal = 0.0, gpuTotal = 0.0;
+	double gpuMin   = 0.0, gpuMax   = 0.0;
+
+	if (!quiet)
+		fprintf(stdout, "%6s %12s %12s\n", "Frame", "CPU ms", "GPU ms");
+
+	for (int f = 0; f < frames; f++) {
+		GLuint64 elapsed = 0;
+		if (f < static_cast<int>(queries.size()))
+			glGetQueryObjectui64v(queries[f], GL_QUERY_RESULT, &elapsed);
+		double gpuTime = elapsed / 1000000.0;
+
+		if (!quiet)
+			fprintf(stdout, "%6d %12.3f %12.3f\n", f, cpuTimes[f], gpuTime);
+
+		// The first frame carries the loading, so it stays out of the
+		// averages when there is anything else
+		if (f == 0 && frames > 1)
+			continue;
+		cpuTotal += cpuTimes[f];
+		gpuTotal += gpuTime;
+		if (gpuTime < gpuMin || gpuMin == 0.0)
+			gpuMin = gpuTime;
+		if (gpuTime > gpuMax)
+			gpuMax = gpuTime;
+	}
+
+	int averaged = (frames > 1 ? frames - 1 : frames);
+	if (averaged > 0)
+		fprintf(stdout, "%d frames in %.3f ms: %.3f ms CPU, %.3f ms GPU "
+			"(%.3f to %.3f) per frame\n", frames, total, cpuTotal / averaged,
+			gpuTotal / averaged, gpuMin, gpuMax);
+
+	glfwTerminate();
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*=================================                                       ----*\
+ * SCENE GRAPH CLASS                                                          *
+ * - This class keeps a hierarchy of transforms in flat arrays sorted by      *
+ *   depth, so every parent comes before its children. Changing a node marks  *
+ *   it dirty, and an update only recomputes the world matrices of dirty      *
+ *   nodes and their descendants, one depth level at a time across workers.   *
+\*----                                       =================================*/
+
+#include "SceneGraph.h"
+#include <climits>
+
+/** SceneGraph constructor **/
+SceneGraph::SceneGraph() {
+	Generation   = 0;
+	DirtyDepth   = INT_MAX;
+	Sorted       = true;
+	LevelStart   = 0;
+	UpdatedCount = 0;
+}
+
+/** Adds a node under a parent and returns its handle **/
+SceneGraph::Node SceneGraph::addNode(Node parent, const glm::mat4& local) {
+	int  parentSlot = (parent == Root ? -1 : Slots[parent]);
+	int  depth      = (parent == Root ? 0 : Depths[parentSlot] + 1);
+	Node node       = static_cast<Node>(Slots.size());
+
+	// Append for now, the levels are sorted out before the next update
+	Slots.push_back(static_cast<int>(Handles.size()));
+	Handles.push_back(node);
+	Locals.push_back(local);
+	Worlds.push_back(local);
+	Parents.push_back(parentSlot);
+	Depths.push_back(depth);
+	Updated.push_back(0);
+	Dirty.push_back(1);
+
+	DirtyDepth = glm::min(DirtyDepth, depth);
+	Sorted     = false;
+	return node;
+}
+
+/** Moves a node relative to its parent **/
+void SceneGraph::setLocal(Node node, const glm::mat4& local) {
+	int slot = Slots[node];
+	Locals[slot] = local;
+	Dirty[slot]  = 1;
+	DirtyDepth   = glm::min(DirtyDepth, Depths[slot]);
+}
+
+/** The node's transform relative to its parent **/
+const glm::mat4& SceneGraph::getLocal(Node node) const {
+	return Locals[Slots[node]];
+}
+
+/** Recomputes the world matrices that changed **/
+void SceneGraph::update(ThreadPool* workers) {
+	// Levels smaller than this aren't worth waking the workers for
+	const int parallelLevel = 1024;
+	TRACE_SCOPE("Scene update");
+
+	if (!Sorted)
+		sort();
+
+	// A new generation makes every node from the last update unmoved
+	// without touching them
+	Generation++;
+	UpdatedCount = 0;
+
+	int levels = static_cast<int>(LevelStarts.size()) - 1;
+	if (DirtyDepth >= levels)
+		return;
+
+	// Levels above the shallowest dirty node can't have changed. Each
+	// level only reads the one above it, so its nodes can split freely
+	for (int level = DirtyDepth; level < levels; level++) {
+		int begin = LevelStarts[level];
+		int end   = LevelStarts[level + 1];
+
+		if (workers && end - begin >= parallelLevel) {
+			LevelStart = begin;
+			workers->run(updateTask, this, end - begin, 256);
+		} else
+			updateLevel(begin, end);
+	}
+
+	DirtyDepth = INT_MAX;
+}
+
+/** The node's transform relative to the world **/
+const glm::mat4& SceneGraph::getWorld(Node node) const {
+	return Worlds[Slots[node]];
+}
+
+/** Checks whether the last update changed the node's world matrix **/
+bool SceneGraph::hasMoved(Node node) const {
+	return Updated[Slots[node]] == Generation;
+}
+
+/** Number of nodes in the graph **/
+int SceneGraph::getNodeCount() const {
+	return static_cast<int>(Handles.size());
+}
+
+/** Number of world matrices the last update computed **/
+int SceneGraph::getUpdatedCount() const {
+	return UpdatedCount;
+}
+
+/** Reorders the nodes by depth, keeping their order within a level **/
+void SceneGraph::sort() {
+	int count    = static_cast<int>(Handles.size());
+	int maxDepth = 0;
+	for (int i = 0; i < count; i++)
+		maxDepth = glm::max(maxDepth, Depths[i]);
+
+	// Count the nodes on each level, then turn the counts into offsets
+	LevelStarts.assign(maxDepth + 2, 0);
+	for (int i = 0; i < count; i++)
+		LevelStarts[Depths[i] + 1]++;
+	for (int level = 0; level <= maxDepth; level++)
+		LevelStarts[level + 1] += LevelStarts[level];
+
+	std::vector<int> order(count);
+	std::vector<int> next(LevelStarts.begin(), LevelStarts.end() - 1);
+	for (int i = 0; i < count; i++)
+		order[i] = next[Depths[i]]++;
+
+	// Move every array into the new order
+	std::vector<glm::mat4> locals(count), worlds(count);
+	std::vector<int>       parents(count), depths(count);
+	std::vector<unsigned>  updated(count);
+	std::vector<char>      dirty(count);
+	std::vector<Node>      handles(count);
+
+	for (int i = 0; i < count; i++) {
+		int slot = order[i];
+		locals[slot]  = Locals[i];
+		worlds[slot]  = Worlds[i];
+		parents[slot] = (Parents[i] < 0 ? -1 : order[Parents[i]]);
+		depths[slot]  = Depths[i];
+		updated[slot] = Updated[i];
+		dirty[slot]   = Dirty[i];
+		handles[slot] = Handles[i];
+		Slots[Handles[i]] = slot;
+	}
+
+	Locals.swap(locals);
+	Worlds.swap(worlds);
+	Parents.swap(parents);
+	Depths.swap(depths);
+	Updated.swap(updated);
+	Dirty.swap(dirty);
+	Handles.swap(handles);
+	Sorted = true;
+}
+
+/** Updates the world matrices of one level's changed nodes **/
+void SceneGraph::updateLevel(int begin, int end) {
+	int updated = 0;
+
+	for (int i = begin; i < end; i++) {
+		int parent = Parents[i];
+		bool moved = (parent >= 0 && Updated[parent] == Generation);
+
+		// A node changes when it was moved or anything above it was
+		if (!Dirty[i] && !moved)
+			continue;
+
+		Worlds[i]  = (parent >= 0 ? Worlds[parent] * Locals[i] : Locals[i]);
+		Updated[i] = Generation;
+		Dirty[i]   = 0;
+		updated++;
+	}
+
+	UpdatedCount += updated;
+}
+
+/** Worker entry point, ranges are relative to the current level **/
+void SceneGraph::updateTask(void* data, int begin, int end) {
+	TRACE_SCOPE("Update transforms");
+	SceneGraph& graph = *static_cast<SceneGraph*>(data);
+	graph.updateLevel(graph.LevelStart + begin, graph.LevelStart + end);
+}
@@ -0,0 +1,78 @@
+#ifndef SCENEGRAPH_H_INCLUDED
+#define SCENEGRAPH_H_INCLUDED
+
+/*=================================                                       ----*\
+ * SCENE GRAPH CLASS                                                          *
+ * - This class keeps a hierarchy of transforms in flat arrays sorted by      *
+ *   depth, so every parent comes before its children. Changing a node marks  *
+ *   it dirty, and an update only recomputes the world matrices of dirty      *
+ *   nodes and their descendants, one depth level at a time across workers.   *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <atomic>
+#include "ThreadPool.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+class SceneGraph {
+	public:
+		/** Handle to a node, stable while nodes are added **/
+		typedef int Node;
+
+		/** Parent of nodes at the top of the hierarchy **/
+		static const Node Root = -1;
+
+		SceneGraph();
+
+		/** Adds a node under a parent and returns its handle **/
+		Node addNode(Node parent, const glm::mat4& local);
+
+		/** Moves a node relative to its parent **/
+		void setLocal(Node node, const glm::mat4& local);
+		const glm::mat4& getLocal(Node node) const;
+
+		/** Recomputes the world matrices that changed, splitting large
+		    levels across the workers when there are any **/
+		void update(ThreadPool* workers);
+
+		/** The node's transform relative to the world **/
+		const glm::mat4& getWorld(Node node) const;
+
+		/** Checks whether the last update changed the node's world matrix **/
+		bool hasMoved(Node node) const;
+
+		/** Number of nodes, and world matrices the last update computed **/
+		int getNodeCount() const;
+		int getUpdatedCount() const;
+	protected:
+	private:
+		/** Internal variables for the nodes, in depth order **/
+		std::vector<glm::mat4> Locals, Worlds;
+		std::vector<int>       Parents;  // Slot of the parent, or -1
+		std::vector<int>       Depths;
+		std::vector<unsigned>  Updated;  // Update the world was last set in
+		std::vector<char>      Dirty;    // Local changed since last update
+		std::vector<Node>      Handles;  // Node held by each slot
+		std::vector<int>       LevelStarts;
+
+		/** Internal variables for mapping handles to slots **/
+		std::vector<int> Slots;
+
+		/** Internal variables for tracking changes **/
+		unsigned         Generation;
+		int              DirtyDepth; // Shallowest dirty node
+		bool             Sorted;
+		int              LevelStart; // Level being updated
+		std::atomic<int> UpdatedCount;
+
+		/** Internal functions used for updating **/
+		void sort();
+		void updateLevel(int begin, int end);
+		static void updateTask(void* data, int begin, int end);
+};
+
+#endif // SCENEGRAPH_H_INCLUDED
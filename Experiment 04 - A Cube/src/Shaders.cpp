@@ -1,59 +1,136 @@
 /*=================================                                       ----*\
  * SHADERS CLASS                                                              *
  * - This static class operates as a factory to load, compile, and install    *
- *   shaders for use in rendering.                                            *
+ *   shaders for use in rendering. Sources are preprocessed first: #include   *
+ *   pulls in shared files, and permutation keys become #defines after the    *
+ *   #version line. Compiled shaders are cached by a hash of the expanded     *
+ *   source, so identical variants compile once however many programs use     *
+ *   them.                                                                    *
 \*----                                       =================================*/
 
 #include "Shaders.h"
 
+/** Send this file's OpenGL calls through the recorder **/
+#define GLRECORDER_HOOKS
+#include "GLRecorder.h"
+
 /** Tracks shaders that have been defined but not used **/
 std::vector<GLuint> Shaders::shaders;
 
+/** Holds compiled shaders for reuse **/
+std::map<unsigned long long, Shaders::Compiled> Shaders::cache;
+
+/** Holds sources read ahead of time **/
+std::map<std::string, std::string> Shaders::preloaded;
+std::mutex                         Shaders::preloadLock;
+
+/** FNV-1a hash of a shader type and source **/
+static unsigned long long hashSource(GLenum type, const std::string& source) {
+	unsigned long long hash = 14695981039346656037ull;
+
+	for (int b = 0; b < 4; b++) {
+		hash ^= (type >> (8 * b)) & 0xff;
+		hash *= 1099511628211ull;
+	}
+
+	for (size_t c = 0; c < source.size(); c++) {
+		hash ^= static_cast<unsigned char>(source[c]);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+/** Whether a character can be part of a name **/
+static inline bool isNameChar(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		(c >= '0' && c <= '9') || c == '_';
+}
+
+/** Whether a source uses a name anywhere as a whole word **/
+static bool usesName(const std::string& source, const std::string& name) {
+	size_t at = source.find(name);
+
+	while (at != std::string::npos) {
+		size_t after = at + name.size();
+		if ((at == 0 || !isNameChar(source[at - 1])) &&
+			(after == source.size() || !isNameChar(source[after])))
+			return true;
+		at = source.find(name, at + 1);
+	}
+
+	return false;
+}
+
 /** Loads, compiles, and tests a shader **/
 bool Shaders::loadShader(const char* path, GLenum type) {
-	// Create the shader
-	GLuint shaderID = glCreateShader(type);
+	return loadShader(path, type, NULL);
+}
 
-	// Initialize the shader stream
-	std::string   shaderCode;
-	std::ifstream shaderStream(path, std::ios::in);
+/** Loads a variant of a shader with permutation keys defined **/
+bool Shaders::loadShader(const char* path, GLenum type, const char* defines)
+{
+	TRACE_SCOPE("Load shader");
+
+	Compiled* shader = compile(path, type, defines);
+	if (!shader)
+		return false;
 
-	// Read the stream to code
-	if (shaderStream.is_open()) {
-		std::string line = "";
+	shaders.push_back(shader->ShaderID);
+	return check(*shader);
+}
 
-		while (getline(shaderStream, line))
-			shaderCode += "\n" + line;
+/** Compiles variants into the cache ahead of the programs **/
+bool Shaders::precompile(const Variant* variants, int count) {
+	TRACE_SCOPE("Precompile shaders");
 
-		shaderStream.close();
+	// Drivers that compile on their own threads get every shader before
+	// the first status query waits on one
+	std::vector<Compiled*> started;
+	bool success = true;
+	for (int v = 0; v < count; v++) {
+		Compiled* shader = compile(variants[v].Path, variants[v].Type,
+			variants[v].Defines);
+		if (shader)
+			started.push_back(shader);
+		else
+			success = false;
 	}
 
-	GLint result = GL_FALSE;
-	int   logLength;
+	for (size_t s = 0; s < started.size(); s++)
+		success = check(*started[s]) && success;
 
-	// Compile the shader
-	printf("Compiling shader : %s\n", path);
-	const char* sourcePointer = shaderCode.c_str();
-	glShaderSource(shaderID, 1, &sourcePointer, NULL);
-	glCompileShader(shaderID);
+	return success;
+}
 
-	// Check the shader
-	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
-	glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &logLength);
-	std::vector<char> errMsg(logLength);
-	glGetShaderInfoLog(shaderID, logLength, NULL, &errMsg[0]);
-	if (errMsg.size() > 0)
-		fprintf(stdout, "%s\n", &errMsg[0]);
+/** Reads a shader's source ahead of loading it, from any thread **/
+bool Shaders::preloadShader(const char* path) {
+	std::string shaderCode;
+	if (!readSource(path, shaderCode))
+		return false;
 
-	shaders.push_back(shaderID);
+	std::lock_guard<std::mutex> guard(preloadLock);
+	preloaded[path].swap(shaderCode);
+	return true;
+}
 
-	return (result == GL_TRUE);
+/** Forgets the sources read ahead of time **/
+void Shaders::clearPreloaded() {
+	std::lock_guard<std::mutex> guard(preloadLock);
+	preloaded.clear();
 }
 
 /** Creates a shader program **/
 GLuint Shaders::createProgram() {
+	return createProgram(NULL, 0);
+}
+
+/** Creates a shader program whose outputs are captured **/
+GLuint Shaders::createProgram(const char* const* varyings, GLsizei count) {
+	TRACE_SCOPE("Link program");
+
 	// Create the program
-	fprintf(stdout, "Linking shader program\n");
+	LOG_INFO(SHADERS, "Linking shader program");
 	GLuint programID = glCreateProgram();
 
 	// Attach the current shader list
@@ -62,6 +139,11 @@ GLuint Shaders::createProgram() {
 		glAttachShader(programID, *e);
 	}
 
+	// Captured outputs must be named before linking
+	if (count > 0)
+		glTransformFeedbackVaryings(programID, count,
+			const_cast<const GLchar**>(varyings), GL_INTERLEAVED_ATTRIBS);
+
 	// Link the shaders
 	glLinkProgram(programID);
 
@@ -71,18 +153,262 @@ GLuint Shaders::createProgram() {
 	glGetProgramiv(programID, GL_LINK_STATUS, &result);
 	glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &logLength);
 
-	if (logLength > 0) {
+	if (logLength > 1) {
 		std::vector<char> errMsg(logLength);
 		glGetProgramInfoLog(programID, logLength, NULL, &errMsg[0]);
-		fprintf(stdout, "%s\n", &errMsg[0]);
+		if (result == GL_TRUE)
+			LOG_INFO(SHADERS, "%s", &errMsg[0]);
+		else
+			LOG_ERROR(SHADERS, "%s", &errMsg[0]);
 	}
 
-	// Delete the attached shaders
-	e = shaders.begin();
-	for(; e != shaders.end(); ++e) {
-		glDeleteShader(*e);
-	}
+	// The linked binary stands in for the program's size, where the
+	// driver will say
+	GLint binaryLength = 0;
+	if (GLEW_ARB_get_program_binary && result == GL_TRUE)
+		glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	MemoryTracker::track(MemoryTracker::SHADER, programID, "Programs",
+		binaryLength);
 
+	// The attached shaders stay in the cache for the next program using
+	// the same variants
 	shaders.clear();
 	return programID;
 }
+
+/** Deletes a shader program and its memory accounting **/
+void Shaders::deleteProgram(GLuint programID) {
+	glDeleteProgram(programID);
+	MemoryTracker::release(MemoryTracker::SHADER, programID);
+}
+
+/** Reads a shader file into a string **/
+bool Shaders::readSource(const char* path, std::string& shaderCode) {
+	// Initialize the shader stream
+	std::ifstream shaderStream(path, std::ios::in | std::ios::binary);
+	if (!shaderStream.is_open()) {
+		LOG_ERROR(SHADERS, "Failed to open shader %s", path);
+		return false;
+	}
+
+	// Read the whole file in one go
+	shaderStream.seekg(0, std::ios::end);
+	std::streamoff size = shaderStream.tellg();
+	shaderStream.seekg(0, std::ios::beg);
+
+	shaderCode.clear();
+	if (size > 0) {
+		shaderCode.resize(static_cast<size_t>(size));
+		shaderStream.read(&shaderCode[0], size);
+	}
+
+	shaderStream.close();
+	return true;
+}
+
+/** Takes the source read ahead of time, or reads it now **/
+bool Shaders::getSource(const std::string& path, std::string& shaderCode) {
+	{
+		std::lock_guard<std::mutex> guard(preloadLock);
+		std::map<std::string, std::string>::iterator source =
+			preloaded.find(path);
+		if (source != preloaded.end()) {
+			shaderCode = source->second;
+			return true;
+		}
+	}
+
+	return readSource(path.c_str(), shaderCode);
+}
+
+/** Replaces #include lines with the files they name **/
+bool Shaders::expand(const std::string& path, std::string& output,
+	std::vector<std::string>& files)
+{
+	// Each file goes in once, which also ends include cycles
+	if (std::find(files.begin(), files.end(), path) != files.end())
+		return true;
+
+	std::string source;
+	if (!getSource(path, source))
+		return false;
+
+	// Errors name the file by its source string number
+	int  number = static_cast<int>(files.size());
+	char marker[32];
+	files.push_back(path);
+	if (number > 0) {
+		snprintf(marker, sizeof(marker), "#line 1 %d\n", number);
+		output += marker;
+	}
+
+	// Included files are found next to the file including them
+	std::string folder = path.substr(0, path.find_last_of("/\\") + 1);
+
+	size_t start = 0;
+	int    line  = 1;
+	while (start < source.size()) {
+		size_t end = source.find('\n', start);
+		end = (end == std::string::npos ? source.size() : end + 1);
+
+		size_t first = source.find_first_not_of(" \t", start);
+		if (first < end && source.compare(first, 8, "#include") == 0) {
+			size_t open  = source.find('"', first + 8);
+			size_t close = (open < end ? source.find('"', open + 1) : end);
+			if (close >= end) {
+				LOG_ERROR(SHADERS, "%s(%d): #include needs a \"file\"",
+					path.c_str(), line);
+				return false;
+			}
+
+			if (!expand(folder + source.substr(open + 1, close - open - 1),
+				output, files))
+				return false;
+
+			// Carry on from the line after the #include
+			snprintf(marker, sizeof(marker), "#line %d %d\n", line + 1,
+				number);
+			output += marker;
+		} else {
+			output.append(source, start, end - start);
+		}
+
+		start = end;
+		line++;
+	}
+
+	// The next file has to start on a line of its own
+	if (!output.empty() && output[output.size() - 1] != '\n')
+		output += '\n';
+
+	return true;
+}
+
+/** Adds #defines after #version for the keys the source uses **/
+void Shaders::define(std::string& source, const char* defines) {
+	if (!defines)
+		return;
+
+	// Sorted and without repeats, so the same keys given in any order
+	// make the same source
+	std::vector<std::string> keys;
+	const char* key = defines;
+	while (*key) {
+		size_t length = strcspn(key, " \t");
+		if (length > 0)
+			keys.push_back(std::string(key, length));
+		key += length;
+		key += strspn(key, " \t");
+	}
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	// Keys the source never mentions are left out, otherwise each one
+	// would split a variant into copies that compile to the same thing
+	std::string lines;
+	for (size_t k = 0; k < keys.size(); k++) {
+		size_t      equals = keys[k].find('=');
+		std::string name   = keys[k].substr(0, equals);
+		if (!usesName(source, name))
+			continue;
+
+		lines += "#define " + name;
+		if (equals != std::string::npos)
+			lines += " " + keys[k].substr(equals + 1);
+		lines += "\n";
+	}
+	if (lines.empty())
+		return;
+
+	// #version has to come first, the defines follow it and then the line
+	// numbers pick up where they were
+	size_t at      = 0;
+	size_t version = source.find("#version");
+	if (version != std::string::npos)
+		at = source.find('\n', version) + 1;
+
+	char marker[32];
+	snprintf(marker, sizeof(marker), "#line %d 0\n",
+		static_cast<int>(std::count(source.begin(), source.begin() + at,
+			'\n')) + 1);
+	source.insert(at, lines + marker);
+}
+
+/** Expands a variant and starts compiling it, unless already cached **/
+Shaders::Compiled* Shaders::compile(const char* path, GLenum type,
+	const char* defines)
+{
+	std::string              source;
+	std::vector<std::string> files;
+	if (!expand(path, source, files))
+		return NULL;
+	define(source, defines);
+
+	// Identical sources share one shader. A hash shared by different
+	// sources moves on to the next hash.
+	unsigned long long hash = hashSource(type, source);
+	std::map<unsigned long long, Compiled>::iterator found = cache.find(hash);
+	while (found != cache.end() && (found->second.Type != type ||
+		found->second.Source != source))
+		found = cache.find(++hash);
+
+	std::string name = path;
+	if (defines && *defines)
+		name += std::string(" (") + defines + ")";
+	if (found != cache.end()) {
+		LOG_INFO(SHADERS, "Reusing shader : %s", name.c_str());
+		return &found->second;
+	}
+
+	LOG_INFO(SHADERS, "Compiling shader : %s", name.c_str());
+	Compiled& shader = cache[hash];
+	shader.ShaderID  = glCreateShader(type);
+	shader.Type      = type;
+	shader.Checked   = false;
+	shader.Success   = false;
+	shader.Source.swap(source);
+
+	char number[16];
+	for (size_t f = 0; f < files.size(); f++) {
+		snprintf(number, sizeof(number), "%s%d ", f > 0 ? ", " : "",
+			static_cast<int>(f));
+		shader.Files += number + files[f];
+	}
+
+	const char* sourcePointer = shader.Source.c_str();
+	glShaderSource(shader.ShaderID, 1, &sourcePointer, NULL);
+	glCompileShader(shader.ShaderID);
+
+	// The driver keeps the source until the shader is deleted
+	MemoryTracker::track(MemoryTracker::SHADER, shader.ShaderID, path,
+		static_cast<GLsizeiptr>(shader.Source.size()));
+
+	return &shader;
+}
+
+/** Reads the compile status and log of a cached shader **/
+bool Shaders::check(Compiled& shader) {
+	if (shader.Checked)
+		return shader.Success;
+
+	GLint result = GL_FALSE;
+	int   logLength;
+
+	// Check the shader
+	glGetShaderiv(shader.ShaderID, GL_COMPILE_STATUS, &result);
+	glGetShaderiv(shader.ShaderID, GL_INFO_LOG_LENGTH, &logLength);
+	if (logLength > 1) {
+		std::vector<char> errMsg(logLength);
+		glGetShaderInfoLog(shader.ShaderID, logLength, NULL, &errMsg[0]);
+		if (result == GL_TRUE)
+			LOG_INFO(SHADERS, "%s", &errMsg[0]);
+		else
+			LOG_ERROR(SHADERS, "%s", &errMsg[0]);
+	}
+	if (result != GL_TRUE)
+		LOG_ERROR(SHADERS, "Source strings: %s", shader.Files.c_str());
+
+	shader.Checked = true;
+	shader.Success = (result == GL_TRUE);
+	return shader.Success;
+}
@@ -4,7 +4,11 @@
 /*=================================                                       ----*\
  * SHADERS CLASS                                                              *
  * - This static class operates as a factory to load, compile, and install    *
- *   shaders for use in rendering.                                            *
+ *   shaders for use in rendering. Sources are preprocessed first: #include   *
+ *   pulls in shared files, and permutation keys become #defines after the    *
+ *   #version line. Compiled shaders are cached by a hash of the expanded     *
+ *   source, so identical variants compile once however many programs use     *
+ *   them.                                                                    *
 \*----                                       =================================*/
 
 #include <stdio.h>
@@ -13,16 +17,52 @@
 #include <vector>
 #include <fstream>
 #include <cstring>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include "Log.h"
+#include "Trace.h"
+#include "MemoryTracker.h"
 #include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
 #include <GLFW/glfw3.h>
 
 class Shaders {
 	public:
+		/** A shader variant. Defines are permutation keys separated by
+		    spaces, each KEY or KEY=VALUE **/
+		struct Variant {
+			const char* Path;
+			GLenum      Type;
+			const char* Defines;
+		};
+
 		/** Loads, compiles, and tests a shader **/
 		static bool   loadShader(const char* path, GLenum type);
 
+		/** Loads a variant of a shader with permutation keys defined **/
+		static bool   loadShader(const char* path, GLenum type,
+			const char* defines);
+
+		/** Compiles variants into the cache ahead of the programs that
+		    need them, checking them only once all have been started **/
+		static bool   precompile(const Variant* variants, int count);
+
+		/** Reads a shader's source ahead of loading it, from any thread **/
+		static bool   preloadShader(const char* path);
+
+		/** Forgets the sources read ahead of time **/
+		static void   clearPreloaded();
+
 		/** Creates a shader program **/
 		static GLuint createProgram();
+
+		/** Creates a shader program whose outputs are captured, interleaved,
+		    with transform feedback **/
+		static GLuint createProgram(const char* const* varyings,
+			GLsizei count);
+
+		/** Deletes a shader program and its memory accounting **/
+		static void   deleteProgram(GLuint programID);
 	protected:
 	private:
 		/** Prevent instantiation of the class **/
@@ -30,8 +70,48 @@ class Shaders {
 		Shaders(const Shaders& source);            // No copying
 		Shaders& operator=(const Shaders& source); // No assignment
 
+		/** A compiled shader, kept for every program using its source **/
+		struct Compiled {
+			GLuint      ShaderID;
+			GLenum      Type;
+			std::string Source;
+			std::string Files;   // Source string numbers, for errors
+			bool        Checked; // Compile status has been read
+			bool        Success;
+		};
+
 		/** Internal variable for shader processing **/
 		static std::vector<GLuint> shaders;
+
+		/** Compiled shaders, by hash of type and expanded source **/
+		static std::map<unsigned long long, Compiled> cache;
+
+		/** Sources read ahead of time, by path **/
+		static std::map<std::string, std::string> preloaded;
+		static std::mutex                         preloadLock;
+
+		/** Reads a shader file into a string **/
+		static bool readSource(const char* path, std::string& shaderCode);
+
+		/** Takes the source read ahead of time, or reads it now **/
+		static bool getSource(const std::string& path,
+			std::string& shaderCode);
+
+		/** Replaces #include lines with the files they name, each file
+		    once, marking where every file starts with #line **/
+		static bool expand(const std::string& path, std::string& output,
+			std::vector<std::string>& files);
+
+		/** Adds #defines after #version for the keys the source uses **/
+		static void define(std::string& source, const char* defines);
+
+		/** Expands a variant and starts compiling it, unless the same
+		    source is already in the cache **/
+		static Compiled* compile(const char* path, GLenum type,
+			const char* defines);
+
+		/** Reads the compile status and log of a cached shader **/
+		static bool check(Compiled& shader);
 };
 
 #endif // SHADERS_H_INCLUDED
@@ -0,0 +1,358 @@
+/*=================================                                       ----*\
+ * SHADOWS CLASS                                                              *
+ * - This class casts shadows from a directional light with cascaded shadow   *
+ *   maps. Static casters are rendered once into a cached layer per cascade   *
+ *   and only again when the light or a static object changes, or when the    *
+ *   cascade snaps to a new texel-aligned position as the camera moves. Each  *
+ *   frame the cached layers are copied into the maps the scene samples and   *
+ *   only the dynamic casters are drawn on top.                               *
+\*----                                       =================================*/
+
+#include "Shadows.h"
+
+/** Define static member variables, logging takes them by reference **/
+const int Shadows::CascadeCount;
+
+/** Balance between even and logarithmic cascade splits **/
+static const float splitBlend = 0.75f;
+
+/** Part of its radius a cascade reaches past its slice of view **/
+static const float cascadeMargin = 0.25f;
+
+/** How far past a cascade's sphere casters still throw shadows into it **/
+static const float casterReach = 20.0f;
+
+/** Shadows constructor, OpenGL objects are created in build() **/
+Shadows::Shadows() {
+	StaticLayers      = 0;
+	ShadowLayers      = 0;
+	StaticFramebuffer = 0;
+	ShadowFramebuffer = 0;
+	UniformBuffer     = 0;
+	Size              = 0;
+	Distance          = 0.0f;
+	Direction         = glm::vec3(0.0f, -1.0f, 0.0f);
+	LightView         = glm::mat4(1.0f);
+	StaticCasters     = NULL;
+	DynamicCasters    = NULL;
+	CasterData        = NULL;
+
+	for (int c = 0; c < CascadeCount; c++) {
+		Cascades[c].LightViewProjection = glm::mat4(1.0f);
+		Cascades[c].End    = 0.0f;
+		Cascades[c].Radius = 0.0f;
+		Cascades[c].Center = glm::vec3(0.0f);
+		Cascades[c].Dirty  = true;
+		Data.LightViewProjections[c] = glm::mat4(1.0f);
+	}
+	Data.CascadeEnds = glm::vec4(0.0f);
+	Data.Eye         = glm::vec4(0.0f);
+	Data.Forward     = glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
+}
+
+/** Shadows destructor **/
+Shadows::~Shadows() {
+	release();
+}
+
+/** Checks whether the context can hold the shadow maps **/
+bool Shadows::isSupported() {
+	// Depth texture arrays with comparison are core since 3.0
+	return GLEW_VERSION_3_3 != 0;
+}
+
+/** Creates the cached and sampled maps **/
+bool Shadows::build(GLsizei size, float distance) {
+	release();
+
+	if (!isSupported()) {
+		LOG_ERROR(RENDER, "Shadow map arrays are not supported");
+		return false;
+	}
+
+	Size     = size;
+	Distance = distance;
+
+	// The cached layers are only ever copied, the sampled ones are compared
+	// against with filtering
+	GLuint textures[2];
+	glGenTextures(2, textures);
+	StaticLayers = textures[0];
+	ShadowLayers = textures[1];
+	for (int t = 0; t < 2; t++) {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textures[t]);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, Size, Size,
+			CascadeCount, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S,
+			GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T,
+			GL_CLAMP_TO_EDGE);
+		MemoryTracker::track(MemoryTracker::TEXTURE, textures[t], "Shadows",
+			MemoryTracker::getImageBytes(GL_DEPTH_COMPONENT24, Size, Size, 1,
+				1) * CascadeCount);
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, StaticLayers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowLayers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+		GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// Depth only, a layer is attached whenever one is drawn
+	GLuint framebuffers[2];
+	glGenFramebuffers(2, framebuffers);
+	StaticFramebuffer = framebuffers[0];
+	ShadowFramebuffer = framebuffers[1];
+	for (int f = 0; f < 2; f++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[f]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+			textures[f], 0, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			LOG_ERROR(RENDER, "Shadow framebuffer is incomplete: 0x%x",
+				status);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			release();
+			return false;
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(1, &UniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, UniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowData), &Data,
+		GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	MemoryTracker::track(MemoryTracker::BUFFER, UniformBuffer, "Shadows",
+		sizeof(ShadowData));
+
+	for (int c = 0; c < CascadeCount; c++)
+		Cascades[c].Dirty = true;
+
+	LOG_INFO(RENDER, "Shadows: %d cascades of %dx%d reaching %.0f units",
+		CascadeCount, Size, Size, Distance);
+	return true;
+}
+
+/** Sets the functions drawing the static and dynamic casters **/
+void Shadows::setCasters(DrawFunction staticCasters,
+	DrawFunction dynamicCasters, void* data)
+{
+	StaticCasters  = staticCasters;
+	DynamicCasters = dynamicCasters;
+	CasterData     = data;
+	invalidate();
+}
+
+/** Points the light, redrawing the static casters when it turned **/
+void Shadows::setLight(const glm::vec3& direction) {
+	glm::vec3 facing = glm::normalize(direction);
+	if (facing == Direction)
+		return;
+
+	// Only the light's rotation is kept, the cascades place themselves
+	Direction = facing;
+	glm::vec3 up = (std::fabs(Direction.y) > 0.99f ?
+		glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+	LightView = glm::lookAt(glm::vec3(0.0f), Direction, up);
+	invalidate();
+}
+
+/** Fits the cascades to the camera **/
+void Shadows::setCamera(const glm::mat4& view, const glm::mat4& projection,
+	float nearPlane)
+{
+	glm::mat4 camera = glm::inverse(view);
+	glm::vec3 eye(camera[3].x, camera[3].y, camera[3].z);
+	glm::vec3 forward(-camera[2].x, -camera[2].y, -camera[2].z);
+	Data.Eye     = glm::vec4(eye, 1.0f);
+	Data.Forward = glm::vec4(forward, 0.0f);
+
+	// Squared spread of the frustum's corners per unit of depth
+	float tanY   = 1.0f / projection[1][1];
+	float tanX   = 1.0f / projection[0][0];
+	float spread = tanX * tanX + tanY * tanY;
+
+	float begin = nearPlane;
+	for (int c = 0; c < CascadeCount; c++) {
+		// Near cascades split logarithmically, where detail matters most
+		float part     = static_cast<float>(c + 1) / CascadeCount;
+		float even     = nearPlane + (Distance - nearPlane) * part;
+		float ratio    = nearPlane * std::pow(Distance / nearPlane, part);
+		float end      = splitBlend * ratio + (1.0f - splitBlend) * even;
+		Cascade& slice = Cascades[c];
+		slice.End      = end;
+		Data.CascadeEnds[c] = end;
+
+		// Smallest sphere around the slice's corners, centered on the
+		// view axis. Its radius only changes with the projection, and is
+		// rounded up so the map's scale stays put between small changes
+		float center = (begin + end) * (1.0f + spread) * 0.5f;
+		if (center > end)
+			center = end;
+		float back   = end - center;
+		float radius = std::sqrt(back * back + end * end * spread);
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		// The map covers a margin around the sphere, so the camera can
+		// move that far before the cascade has to follow. It then moves
+		// by whole texels in light space, keeping the static casters
+		// rasterizing the same way wherever it lands
+		float     margin = radius * cascadeMargin;
+		float     extent = radius + margin;
+		float     texel  = 2.0f * extent / Size;
+		glm::vec3 middle = eye + forward * center;
+		glm::vec4 light  = LightView * glm::vec4(middle, 1.0f);
+		glm::vec3 offset = glm::vec3(light.x, light.y, light.z) - slice.Center;
+		float     slack  = margin - texel; // Snapping moved it up to a texel
+		bool      inside = glm::dot(offset, offset) <= slack * slack;
+
+		if (radius != slice.Radius || !inside) {
+			glm::vec3 snap(std::floor(light.x / texel) * texel,
+				std::floor(light.y / texel) * texel,
+				std::floor(light.z / texel) * texel);
+
+			// The light looks down -z, the near plane reaches back past
+			// the map for casters between it and the light
+			slice.LightViewProjection = glm::ortho(snap.x - extent,
+				snap.x + extent, snap.y - extent, snap.y + extent,
+				-snap.z - extent - casterReach, -snap.z + extent) * LightView;
+			slice.Radius = radius;
+			slice.Center = snap;
+			slice.Dirty  = true;
+			Data.LightViewProjections[c] = slice.LightViewProjection;
+		}
+
+		begin = end;
+	}
+}
+
+/** Redraws the static casters, after any of them moved **/
+void Shadows::invalidate() {
+	for (int c = 0; c < CascadeCount; c++)
+		Cascades[c].Dirty = true;
+}
+
+/** Brings the cached layers up to date and draws the dynamic casters **/
+void Shadows::render() {
+	if (ShadowFramebuffer == 0)
+		return;
+
+	GLint previousFramebuffer = 0, viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// Biased by slope, so surfaces facing the light don't shadow themselves
+	glViewport(0, 0, Size, Size);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+
+	for (int c = 0; c < CascadeCount; c++) {
+		if (!Cascades[c].Dirty)
+			continue;
+
+		drawLayer(StaticFramebuffer, StaticLayers, c, StaticCasters);
+		Cascades[c].Dirty = false;
+		LOG_DEBUG(RENDER, "Shadow cascade %d drew its static casters", c);
+	}
+
+	// The sampled maps start from the static casters every frame, then
+	// take the ones that move
+	copyLayers();
+	for (int c = 0; c < CascadeCount; c++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, ShadowFramebuffer);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+			ShadowLayers, 0, c);
+		if (DynamicCasters)
+			DynamicCasters(Cascades[c].LightViewProjection, CasterData);
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	// The cascades move with the camera, so they go up every frame
+	glBindBuffer(GL_UNIFORM_BUFFER, UniformBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ShadowData), &Data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/** Binds the maps and the cascades **/
+void Shadows::bind(GLuint textureUnit, GLuint uniformBinding) const {
+	if (ShadowLayers == 0)
+		return;
+
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, ShadowLayers);
+	glActiveTexture(GL_TEXTURE0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, uniformBinding, UniformBuffer);
+}
+
+/** Clears one layer of a map and draws casters into it **/
+void Shadows::drawLayer(GLuint framebuffer, GLuint texture, int cascade,
+	DrawFunction casters)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture,
+		0, cascade);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	if (casters)
+		casters(Cascades[cascade].LightViewProjection, CasterData);
+}
+
+/** Copies every cached layer into the sampled maps **/
+void Shadows::copyLayers() {
+	// One call copies the whole array where the driver can
+	if (GLEW_VERSION_4_3 || GLEW_ARB_copy_image) {
+		glCopyImageSubData(StaticLayers, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+			ShadowLayers, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+			Size, Size, CascadeCount);
+		return;
+	}
+
+	// Otherwise blit them a layer at a time
+	for (int c = 0; c < CascadeCount; c++) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, StaticFramebuffer);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+			StaticLayers, 0, c);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, ShadowFramebuffer);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+			ShadowLayers, 0, c);
+		glBlitFramebuffer(0, 0, Size, Size, 0, 0, Size, Size,
+			GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	}
+}
+
+/** Releases the OpenGL objects owned by the shadows **/
+void Shadows::release() {
+	if (StaticLayers != 0) {
+		GLuint textures[2] = { StaticLayers, ShadowLayers };
+		glDeleteTextures(2, textures);
+		MemoryTracker::release(MemoryTracker::TEXTURE, 2, textures);
+		StaticLayers = 0;
+		ShadowLayers = 0;
+	}
+
+	if (StaticFramebuffer != 0) {
+		GLuint framebuffers[2] = { StaticFramebuffer, ShadowFramebuffer };
+		glDeleteFramebuffers(2, framebuffers);
+		StaticFramebuffer = 0;
+		ShadowFramebuffer = 0;
+	}
+
+	if (UniformBuffer != 0) {
+		glDeleteBuffers(1, &UniformBuffer);
+		MemoryTracker::release(MemoryTracker::BUFFER, 1, &UniformBuffer);
+		UniformBuffer = 0;
+	}
+}
@@ -0,0 +1,112 @@
+#ifndef SHADOWS_H_INCLUDED
+#define SHADOWS_H_INCLUDED
+
+/*=================================                                       ----*\
+ * SHADOWS CLASS                                                              *
+ * - This class casts shadows from a directional light with cascaded shadow   *
+ *   maps. Static casters are rendered once into a cached layer per cascade   *
+ *   and only again when the light or a static object changes, or when the    *
+ *   cascade snaps to a new texel-aligned position as the camera moves. Each  *
+ *   frame the cached layers are copied into the maps the scene samples and   *
+ *   only the dynamic casters are drawn on top.                               *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include "Log.h"
+#include "MemoryTracker.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+class Shadows {
+	public:
+		/** Cascades splitting the view, matches Shadow.glsl **/
+		static const int CascadeCount = 4;
+
+		/** Draws shadow casters with a light's view and projection **/
+		typedef void (*DrawFunction)(const glm::mat4& lightViewProjection,
+			void* data);
+
+		Shadows();
+		~Shadows();
+
+		/** Checks whether the context can hold the shadow maps **/
+		static bool isSupported();
+
+		/** Creates the cached and sampled maps, size texels square, with
+		    the cascades reaching a distance from the camera **/
+		bool build(GLsizei size, float distance);
+
+		/** Sets the functions drawing the static and dynamic casters **/
+		void setCasters(DrawFunction staticCasters,
+			DrawFunction dynamicCasters, void* data);
+
+		/** Points the light, redrawing the static casters when it turned **/
+		void setLight(const glm::vec3& direction);
+
+		/** Fits the cascades to the camera, redrawing the static casters of
+		    any cascade that had to move, snapped to a new texel **/
+		void setCamera(const glm::mat4& view, const glm::mat4& projection,
+			float nearPlane);
+
+		/** Redraws the static casters, after any of them moved **/
+		void invalidate();
+
+		/** Brings the cached layers up to date and draws the dynamic
+		    casters over a copy of them **/
+		void render();
+
+		/** Binds the maps to a texture unit and the cascades to a uniform
+		    buffer binding **/
+		void bind(GLuint textureUnit, GLuint uniformBinding) const;
+	protected:
+	private:
+		/** Where one cascade's map is and what it covers **/
+		struct Cascade {
+			glm::mat4 LightViewProjection;
+			float     End;     // View depth where the cascade ends
+			float     Radius;  // Of the sphere around its slice of view
+			glm::vec3 Center;  // Light space, on a whole texel
+			bool      Dirty;   // Static casters need drawing again
+		};
+
+		/** Cascades, laid out to match std140 in Shadow.glsl **/
+		struct ShadowData {
+			glm::mat4 LightViewProjections[CascadeCount];
+			glm::vec4 CascadeEnds;
+			glm::vec4 Eye;
+			glm::vec4 Forward;
+		};
+
+		/** Internal variables for the maps **/
+		GLuint  StaticLayers, ShadowLayers; // Cached, and sampled
+		GLuint  StaticFramebuffer, ShadowFramebuffer;
+		GLuint  UniformBuffer;
+		GLsizei Size;
+		float   Distance;
+
+		/** Internal variables for the cascades **/
+		Cascade    Cascades[CascadeCount];
+		ShadowData Data;
+		glm::vec3  Direction;
+		glm::mat4  LightView; // Turns world space to face the light
+
+		/** Internal variables for drawing the casters **/
+		DrawFunction StaticCasters, DynamicCasters;
+		void*        CasterData;
+
+		/** Prevent copying, the maps are OpenGL objects **/
+		Shadows(const Shadows& source);            // No copying
+		Shadows& operator=(const Shadows& source); // No assignment
+
+		/** Internal functions used for drawing and cleanup **/
+		void drawLayer(GLuint framebuffer, GLuint texture, int cascade,
+			DrawFunction casters);
+		void copyLayers();
+		void release();
+};
+
+#endif // SHADOWS_H_INCLUDED
@@ -0,0 +1,206 @@
+/*=================================                                       ----*\
+ * STARTUP CLASS                                                              *
+ * - This class runs the steps of initialization as a dependency graph. Steps *
+ *   that don't touch OpenGL, like reading files and building meshes, go to   *
+ *   the workers as soon as their inputs are ready, while steps that need the *
+ *   context run in order on the calling thread. Each step is timed for a     *
+ *   report of where startup spent its time.                                  *
+\*----                                       =================================*/
+
+#include "Startup.h"
+
+/** Startup constructor **/
+Startup::Startup() {
+	Finished = 0;
+}
+
+/** Adds a step to the graph **/
+Startup::StepID Startup::addStep(const char* name, Execute execute,
+	void* data, bool needsContext)
+{
+	StepNode step;
+	step.Name         = name;
+	step.Callback     = execute;
+	step.Data         = data;
+	step.NeedsContext = needsContext;
+	step.Status       = WAITING;
+	step.Succeeded    = false;
+	step.OnWorker     = false;
+	step.Start        = 0;
+	step.End          = 0;
+	Steps.push_back(step);
+
+	return static_cast<StepID>(Steps.size()) - 1;
+}
+
+/** Holds a step back until another has finished **/
+void Startup::require(StepID step, StepID dependency) {
+	Steps[step].Dependencies.push_back(dependency);
+}
+
+/** Runs every step, skipping those that depend on a failed one **/
+bool Startup::run(ThreadPool* workers) {
+	Origin   = std::chrono::steady_clock::now();
+	Caller   = std::this_thread::get_id();
+	Finished = 0;
+
+	for (;;) {
+		// Steps behind a failure never run, which may block others in turn
+		bool skipped = true;
+		while (skipped) {
+			skipped = false;
+			for (size_t s = 0; s < Steps.size(); s++) {
+				if (Steps[s].Status == WAITING && isBlocked(s)) {
+					Steps[s].Status = SKIPPED;
+					skipped = true;
+				}
+			}
+		}
+
+		// Hand every ready background step to the workers as one job. The
+		// pool runs one job at a time, so later ones wait for the next round
+		if (Running.empty()) {
+			for (size_t s = 0; s < Steps.size(); s++) {
+				if (Steps[s].Status == WAITING && !Steps[s].NeedsContext &&
+					isReady(s))
+				{
+					Steps[s].Status = RUNNING;
+					Running.push_back(s);
+				}
+			}
+
+			if (!Running.empty())
+				workers->dispatch(backgroundTask, this,
+					static_cast<int>(Running.size()), 1);
+		}
+
+		// Meanwhile take the context steps in the order they were added
+		StepID next = -1;
+		for (size_t s = 0; s < Steps.size() && next < 0; s++) {
+			if (Steps[s].Status == WAITING && Steps[s].NeedsContext &&
+				isReady(s))
+				next = s;
+		}
+
+		if (next >= 0) {
+			runStep(next);
+			Steps[next].Status = (Steps[next].Succeeded ? DONE : FAILED);
+			if (Steps[next].End > Finished)
+				Finished = Steps[next].End;
+			continue;
+		}
+
+		// Nothing more can start until the background steps finish
+		if (!Running.empty()) {
+			finishJob(workers);
+			continue;
+		}
+
+		break;
+	}
+
+	// Anything still waiting depends on itself
+	bool succeeded = true;
+	for (size_t s = 0; s < Steps.size(); s++) {
+		if (Steps[s].Status == WAITING) {
+			LOG_ERROR(GENERAL, "Startup step %s has circular dependencies",
+				Steps[s].Name);
+			Steps[s].Status = SKIPPED;
+		}
+		if (Steps[s].Status != DONE)
+			succeeded = false;
+	}
+
+	return succeeded;
+}
+
+/** Milliseconds from the start of run() until its last step ended **/
+double Startup::getElapsed() const {
+	return Finished / 1000.0;
+}
+
+/** Prints each step's thread, start and duration **/
+void Startup::report(FILE* file) const {
+	fprintf(file, "%-28s %-8s %10s %10s\n",
+		"Startup step", "Thread", "Start ms", "Time ms");
+
+	long long busy = 0;
+	for (size_t s = 0; s < Steps.size(); s++) {
+		const StepNode& step = Steps[s];
+		if (step.Status == SKIPPED) {
+			fprintf(file, "%-28s %-8s\n", step.Name, "skipped");
+			continue;
+		}
+
+		fprintf(file, "%-28s %-8s %10.2f %10.2f%s\n", step.Name,
+			(step.OnWorker ? "worker" : "main"), step.Start / 1000.0,
+			(step.End - step.Start) / 1000.0,
+			(step.Status == FAILED ? " failed" : ""));
+		busy += step.End - step.Start;
+	}
+
+	// Steps that overlapped make the total shorter than their sum
+	fprintf(file, "Startup took %.2f ms for %.2f ms of steps\n",
+		Finished / 1000.0, busy / 1000.0);
+}
+
+/** Checks whether every step this one depends on has finished **/
+bool Startup::isReady(StepID step) const {
+	const std::vector<StepID>& dependencies = Steps[step].Dependencies;
+	for (size_t d = 0; d < dependencies.size(); d++) {
+		if (Steps[dependencies[d]].Status != DONE)
+			return false;
+	}
+	return true;
+}
+
+/** Checks whether a step this one depends on failed or was skipped **/
+bool Startup::isBlocked(StepID step) const {
+	const std::vector<StepID>& dependencies = Steps[step].Dependencies;
+	for (size_t d = 0; d < dependencies.size(); d++) {
+		State status = Steps[dependencies[d]].Status;
+		if (status == FAILED || status == SKIPPED)
+			return true;
+	}
+	return false;
+}
+
+/** Runs and times a step, from whichever thread picked it up **/
+void Startup::runStep(StepID step) {
+	// Each step only writes its own node, the calling thread alone updates
+	// the states
+	StepNode& node = Steps[step];
+	node.OnWorker  = (std::this_thread::get_id() != Caller);
+	node.Start     = now();
+	{
+		TRACE_SCOPE(node.Name);
+		node.Succeeded = node.Callback(node.Data);
+	}
+	node.End = now();
+}
+
+/** Waits for the background steps, helping with them, and marks them done **/
+void Startup::finishJob(ThreadPool* workers) {
+	workers->wait();
+
+	for (size_t r = 0; r < Running.size(); r++) {
+		StepNode& step = Steps[Running[r]];
+		step.Status = (step.Succeeded ? DONE : FAILED);
+		if (step.End > Finished)
+			Finished = step.End;
+	}
+	Running.clear();
+}
+
+/** Microseconds since run() started **/
+long long Startup::now() const {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - Origin).count();
+}
+
+/** Worker task running a slice of the background steps **/
+void Startup::backgroundTask(void* data, int begin, int end) {
+	Startup* startup = static_cast<Startup*>(data);
+	for (int r = begin; r < end; r++)
+		startup->runStep(startup->Running[r]);
+}
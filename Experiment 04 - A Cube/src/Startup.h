@@ -0,0 +1,87 @@
+#ifndef STARTUP_H_INCLUDED
+#define STARTUP_H_INCLUDED
+
+/*=================================                                       ----*\
+ * STARTUP CLASS                                                              *
+ * - This class runs the steps of initialization as a dependency graph. Steps *
+ *   that don't touch OpenGL, like reading files and building meshes, go to   *
+ *   the workers as soon as their inputs are ready, while steps that need the *
+ *   context run in order on the calling thread. Each step is timed for a     *
+ *   report of where startup spent its time.                                  *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "Log.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+class Startup {
+	public:
+		/** Handle to a step **/
+		typedef int StepID;
+
+		/** Callback that performs a step, false when it failed **/
+		typedef bool (*Execute)(void* data);
+
+		Startup();
+
+		/** Adds a step. Steps that need the OpenGL context run on the thread
+		    calling run(), the rest may run on the workers **/
+		StepID addStep(const char* name, Execute execute, void* data,
+			bool needsContext);
+
+		/** Holds a step back until another has finished **/
+		void require(StepID step, StepID dependency);
+
+		/** Runs every step, skipping those that depend on a failed one. The
+		    workers must not be given other jobs until it returns **/
+		bool run(ThreadPool* workers);
+
+		/** Milliseconds from the start of run() until its last step ended **/
+		double getElapsed() const;
+
+		/** Prints each step's thread, start and duration **/
+		void report(FILE* file) const;
+	protected:
+	private:
+		enum State { WAITING, RUNNING, DONE, FAILED, SKIPPED };
+
+		struct StepNode {
+			const char*         Name;
+			Execute             Callback;
+			void*               Data;
+			bool                NeedsContext;
+			std::vector<StepID> Dependencies;
+			State               Status;
+			bool                Succeeded;
+			bool                OnWorker;   // Ran away from the calling thread
+			long long           Start, End; // Microseconds since run()
+		};
+
+		/** Internal variables for the graph **/
+		std::vector<StepNode> Steps;
+		std::vector<StepID>   Running; // Steps of the job on the workers
+		std::thread::id       Caller;
+		std::chrono::steady_clock::time_point Origin;
+		long long             Finished;
+
+		/** Prevent copying, steps point into the caller's data **/
+		Startup(const Startup& source);            // No copying
+		Startup& operator=(const Startup& source); // No assignment
+
+		/** Internal functions used for running **/
+		bool  isReady(StepID step) const;
+		bool  isBlocked(StepID step) const;
+		void  runStep(StepID step);
+		void  finishJob(ThreadPool* workers);
+		long long now() const;
+
+		/** Worker task running a slice of the background steps **/
+		static void backgroundTask(void* data, int begin, int end);
+};
+
+#endif // STARTUP_H_INCLUDED
@@ -0,0 +1,339 @@
+/*=================================                                       ----*\
+ * TERRAIN CLASS                                                              *
+ * - This class streams an endless terrain in square chunks around the        *
+ *   camera. A background thread generates the chunks nearest first, and the  *
+ *   render thread uploads the finished ones within a byte budget per frame,  *
+ *   reusing the buffers of chunks left behind. Nothing is stored, a chunk    *
+ *   that comes back into range is generated again.                           *
+\*----                                       =================================*/
+
+#include "Terrain.h"
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+/** Terrain constructor, OpenGL objects and the thread start in build() **/
+Terrain::Terrain() {
+	VertexArrayID = 0;
+	IndexBuffer   = 0;
+	ProgramID     = 0;
+	MVPUniformID  = -1;
+	IndexCount    = 0;
+	VertexCount   = 0;
+	Radius        = 0;
+	Divisions     = 0;
+	ChunkSize     = 0.0f;
+	Base          = 0.0f;
+	UploadBudget  = 256 * 1024;
+	CenterX       = 0;
+	CenterZ       = 0;
+	Centered      = false;
+	Quit          = false;
+}
+
+/** Terrain destructor **/
+Terrain::~Terrain() {
+	release();
+}
+
+/** Loads the shaders and starts the generator thread **/
+bool Terrain::build(int radius, GLfloat chunkSize, int divisions,
+	GLfloat base)
+{
+	if (radius < 0 || chunkSize <= 0.0f || divisions < 1) {
+		LOG_ERROR(RENDER, "Terrain needs a positive chunk size and divisions");
+		return false;
+	}
+
+	release();
+	Radius    = radius;
+	ChunkSize = chunkSize;
+	Divisions = divisions;
+	Base      = base;
+
+	// Chunks share the render test's shaders
+	Shaders::loadShader("Transform.vshader", GL_VERTEX_SHADER);
+	Shaders::loadShader("Color.fshader", GL_FRAGMENT_SHADER);
+	ProgramID    = Shaders::createProgram();
+	MVPUniformID = glGetUniformLocation(ProgramID, "MVP");
+
+	// Every chunk has the same grid, so one index buffer serves them all
+	std::vector<GLuint> indices;
+	Generators::gridIndices(divisions, divisions, indices);
+	IndexCount  = static_cast<GLsizei>(indices.size());
+	VertexCount = (divisions + 1) * (divisions + 1);
+
+	glGenVertexArrays(1, &VertexArrayID);
+	glGenBuffers(1, &IndexBuffer);
+
+	// The index buffer is captured by the terrain's own vertex array
+	GLint previousVAO = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	glBindVertexArray(VertexArrayID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+		&indices[0], GL_STATIC_DRAW);
+	glBindVertexArray(previousVAO);
+	MemoryTracker::track(MemoryTracker::BUFFER, IndexBuffer, "Terrain indices",
+		indices.size() * sizeof(GLuint));
+
+	Quit      = false;
+	Generator = std::thread(&Terrain::generate, this);
+	return true;
+}
+
+/** Bytes of chunks uploaded per frame **/
+void Terrain::setUploadBudget(GLsizeiptr bytes) {
+	UploadBudget = bytes;
+}
+
+/** Follows the camera and uploads finished chunks **/
+void Terrain::update(const glm::vec3& camera) {
+	if (VertexArrayID == 0)
+		return;
+
+	GLint x = static_cast<GLint>(std::floor(camera.x / ChunkSize));
+	GLint z = static_cast<GLint>(std::floor(camera.z / ChunkSize));
+	if (!Centered || x != CenterX || z != CenterZ)
+		recenter(x, z);
+
+	// Upload what the generator finished, keeping to the budget after the
+	// first chunk so streaming never stalls entirely
+	GLsizeiptr chunkBytes = VertexCount * sizeof(TerrainVertex);
+	GLsizeiptr budget     = UploadBudget;
+	bool       first      = true;
+
+	for (;;) {
+		Result result;
+		{
+			std::lock_guard<std::mutex> guard(Lock);
+			if (Results.empty() || (!first && budget < chunkBytes))
+				break;
+			result = std::move(Results.front());
+			Results.pop_front();
+		}
+
+		// The camera may have moved on while the chunk was generated
+		Requested.erase(getKey(result.X, result.Z));
+		if (!isInRange(result.X, result.Z, 1))
+			continue;
+
+		TRACE_SCOPE("Upload chunk");
+		upload(result);
+		budget -= chunkBytes;
+		first   = false;
+	}
+}
+
+/** Draws the uploaded chunks **/
+void Terrain::draw(const glm::mat4& viewProjection) {
+	if (Chunks.empty())
+		return;
+
+	// Chunks hold world positions, only the base height is left to add
+	glm::mat4 mvp = viewProjection *
+		glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, Base, 0.0f));
+	glUseProgram(ProgramID);
+	glUniformMatrix4fv(MVPUniformID, 1, GL_FALSE, &mvp[0][0]);
+
+	GLint previousVAO = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	glBindVertexArray(VertexArrayID);
+
+	for (size_t c = 0; c < Chunks.size(); c++) {
+		glBindBuffer(GL_ARRAY_BUFFER, Chunks[c].Buffer);
+		TerrainFormat::setPointers();
+		glDrawElements(GL_TRIANGLES, IndexCount, GL_UNSIGNED_INT, (void*) 0);
+	}
+
+	glBindVertexArray(previousVAO);
+}
+
+/** Chunks uploaded **/
+int Terrain::getChunkCount() const {
+	return static_cast<int>(Chunks.size());
+}
+
+/** Chunks requested but not yet uploaded **/
+int Terrain::getPendingCount() const {
+	return static_cast<int>(Requested.size());
+}
+
+/** Moves the range to a new center chunk **/
+void Terrain::recenter(GLint x, GLint z) {
+	CenterX  = x;
+	CenterZ  = z;
+	Centered = true;
+
+	// Chunks a step past the range stay, so wandering back and forth over
+	// a border doesn't throw them away and generate them again
+	std::set<long long> present;
+	for (size_t c = 0; c < Chunks.size();) {
+		if (isInRange(Chunks[c].X, Chunks[c].Z, 1)) {
+			present.insert(getKey(Chunks[c].X, Chunks[c].Z));
+			c++;
+			continue;
+		}
+
+		FreeBuffers.push_back(Chunks[c].Buffer);
+		Chunks[c] = Chunks.back();
+		Chunks.pop_back();
+	}
+
+	std::vector<std::pair<GLint, long long> > wanted;
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+
+		// Chunks still queued are queued again nearest the new center, and
+		// those that left the range aren't
+		for (size_t r = 0; r < Requests.size(); r++)
+			Requested.erase(Requests[r]);
+		Requests.clear();
+
+		for (GLint dz = -Radius; dz <= Radius; dz++) {
+			for (GLint dx = -Radius; dx <= Radius; dx++) {
+				long long key = getKey(x + dx, z + dz);
+				if (present.count(key) == 0 && Requested.count(key) == 0)
+					wanted.push_back(std::make_pair(dx * dx + dz * dz, key));
+			}
+		}
+
+		std::sort(wanted.begin(), wanted.end());
+		for (size_t w = 0; w < wanted.size(); w++) {
+			Requests.push_back(wanted[w].second);
+			Requested.insert(wanted[w].second);
+		}
+	}
+	Wake.notify_one();
+}
+
+/** Sends a finished chunk to OpenGL **/
+void Terrain::upload(Result& result) {
+	GLsizeiptr bytes = result.Vertices.size() * sizeof(TerrainVertex);
+
+	Chunk chunk;
+	chunk.X = result.X;
+	chunk.Z = result.Z;
+
+	// Every chunk is the same size, so a buffer left behind takes the new
+	// one in place without reallocating
+	if (!FreeBuffers.empty()) {
+		chunk.Buffer = FreeBuffers.back();
+		FreeBuffers.pop_back();
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.Buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &result.Vertices[0]);
+	} else {
+		glGenBuffers(1, &chunk.Buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.Buffer);
+		glBufferData(GL_ARRAY_BUFFER, bytes, &result.Vertices[0],
+			GL_STATIC_DRAW);
+		MemoryTracker::track(MemoryTracker::BUFFER, chunk.Buffer,
+			"Terrain chunks", bytes);
+	}
+
+	Chunks.push_back(chunk);
+}
+
+/** Checks whether a chunk is within the range, plus some slack **/
+bool Terrain::isInRange(GLint x, GLint z, int slack) const {
+	return std::abs(x - CenterX) <= Radius + slack &&
+		std::abs(z - CenterZ) <= Radius + slack;
+}
+
+/** Generator thread, works through the requests nearest first **/
+void Terrain::generate() {
+	TRACE_THREAD("Terrain");
+	std::unique_lock<std::mutex> guard(Lock);
+
+	while (!Quit) {
+		if (Requests.empty()) {
+			Wake.wait(guard);
+			continue;
+		}
+
+		long long key = Requests.front();
+		Requests.pop_front();
+		guard.unlock();
+
+		Result result;
+		getCoordinates(key, result.X, result.Z);
+		{
+			TRACE_SCOPE("Generate chunk");
+
+			// The workers belong to the render thread's frames, so this
+			// thread generates alone
+			Generators::Mesh mesh;
+			Generators::heightfield(mesh, result.X * ChunkSize,
+				result.Z * ChunkSize, ChunkSize, Divisions, NULL);
+
+			GLsizei count = static_cast<GLsizei>(mesh.Positions.size() / 3);
+			result.Vertices.resize(count);
+			for (GLsizei v = 0; v < count; v++) {
+				result.Vertices[v].Position[0] = mesh.Positions[3 * v];
+				result.Vertices[v].Position[1] = mesh.Positions[3 * v + 1];
+				result.Vertices[v].Position[2] = mesh.Positions[3 * v + 2];
+			}
+			VertexPacker::packColors(&mesh.Colors[0], count,
+				result.Vertices[0].Color, sizeof(TerrainVertex));
+		}
+
+		guard.lock();
+		Results.push_back(std::move(result));
+	}
+}
+
+/** Stops the generator and releases the OpenGL objects **/
+void Terrain::release() {
+	if (Generator.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(Lock);
+			Quit = true;
+		}
+		Wake.notify_all();
+		Generator.join();
+	}
+
+	Requests.clear();
+	Results.clear();
+	Requested.clear();
+	Centered = false;
+
+	std::vector<GLuint> buffers(FreeBuffers);
+	for (size_t c = 0; c < Chunks.size(); c++)
+		buffers.push_back(Chunks[c].Buffer);
+	if (!buffers.empty()) {
+		GLsizei count = static_cast<GLsizei>(buffers.size());
+		glDeleteBuffers(count, &buffers[0]);
+		MemoryTracker::release(MemoryTracker::BUFFER, count, &buffers[0]);
+	}
+	Chunks.clear();
+	FreeBuffers.clear();
+
+	if (VertexArrayID != 0) {
+		glDeleteBuffers(1, &IndexBuffer);
+		MemoryTracker::release(MemoryTracker::BUFFER, IndexBuffer);
+		glDeleteVertexArrays(1, &VertexArrayID);
+		VertexArrayID = 0;
+		IndexBuffer   = 0;
+	}
+
+	if (ProgramID != 0) {
+		Shaders::deleteProgram(ProgramID);
+		ProgramID = 0;
+	}
+}
+
+/** Packs chunk coordinates into one key. Chunks behind the origin have
+    negative coordinates, so the words are joined unsigned rather than
+    shifting a negative value **/
+long long Terrain::getKey(GLint x, GLint z) {
+	unsigned long long high = static_cast<unsigned>(x);
+	return static_cast<long long>((high << 32) | static_cast<unsigned>(z));
+}
+
+/** Unpacks the chunk coordinates of a key **/
+void Terrain::getCoordinates(long long key, GLint& x, GLint& z) {
+	unsigned long long bits = static_cast<unsigned long long>(key);
+	x = static_cast<GLint>(static_cast<unsigned>(bits >> 32));
+	z = static_cast<GLint>(static_cast<unsigned>(bits & 0xffffffffULL));
+}
@@ -0,0 +1,120 @@
+#ifndef TERRAIN_H_INCLUDED
+#define TERRAIN_H_INCLUDED
+
+/*=================================                                       ----*\
+ * TERRAIN CLASS                                                              *
+ * - This class streams an endless terrain in square chunks around the        *
+ *   camera. A background thread generates the chunks nearest first, and the  *
+ *   render thread uploads the finished ones within a byte budget per frame,  *
+ *   reusing the buffers of chunks left behind. Nothing is stored, a chunk    *
+ *   that comes back into range is generated again.                           *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <deque>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Log.h"
+#include "Generators.h"
+#include "VertexFormat.h"
+#include "VertexPacker.h"
+#include "Shaders.h"
+#include "MemoryTracker.h"
+#include "Trace.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+/** Terrain vertex with world positions and 8 bit colors, 16 bytes **/
+struct TerrainVertex {
+	GLfloat Position[3];
+	GLubyte Color[4];
+};
+
+/** Attribute layout matching the inputs of Transform.vshader **/
+typedef VertexFormat<TerrainVertex,
+	VERTEX_ATTRIBUTE(TerrainVertex, Position, 0, 3, GL_FLOAT, FLOAT),
+	VERTEX_ATTRIBUTE(TerrainVertex, Color, 1, 4, GL_UNSIGNED_BYTE, NORMALIZED)
+> TerrainFormat;
+
+class Terrain {
+	public:
+		Terrain();
+		~Terrain();
+
+		/** Loads the shaders and starts the generator thread. Chunks reach
+		    radius chunks out from the camera's, and sit at the base height **/
+		bool build(int radius, GLfloat chunkSize, int divisions,
+			GLfloat base);
+
+		/** Bytes of chunks uploaded per frame. At least one chunk goes up
+		    each frame that has one waiting **/
+		void setUploadBudget(GLsizeiptr bytes);
+
+		/** Follows the camera, requesting and releasing chunks, and uploads
+		    finished ones. Call once per frame on the OpenGL thread **/
+		void update(const glm::vec3& camera);
+
+		/** Draws the uploaded chunks **/
+		void draw(const glm::mat4& viewProjection);
+
+		/** Chunks uploaded, and chunks requested but not yet uploaded **/
+		int getChunkCount() const;
+		int getPendingCount() const;
+	protected:
+	private:
+		/** An uploaded chunk **/
+		struct Chunk {
+			GLint  X, Z;
+			GLuint Buffer;
+		};
+
+		/** A chunk the generator has finished **/
+		struct Result {
+			GLint X, Z;
+			std::vector<TerrainVertex> Vertices;
+		};
+
+		/** Internal variables for the render thread **/
+		std::vector<Chunk>  Chunks;
+		std::vector<GLuint> FreeBuffers; // Of chunks that left the range
+		std::set<long long> Requested;   // Chunks asked for, not uploaded
+		GLuint     VertexArrayID, IndexBuffer, ProgramID;
+		GLint      MVPUniformID;
+		GLsizei    IndexCount, VertexCount;
+		int        Radius, Divisions;
+		GLfloat    ChunkSize, Base;
+		GLsizeiptr UploadBudget;
+		GLint      CenterX, CenterZ;
+		bool       Centered;
+
+		/** Internal variables shared with the generator thread **/
+		std::thread             Generator;
+		std::mutex              Lock;
+		std::condition_variable Wake;
+		std::deque<long long>   Requests; // Nearest first
+		std::deque<Result>      Results;
+		bool                    Quit;
+
+		/** Prevent copying, the terrain owns a thread and OpenGL objects **/
+		Terrain(const Terrain& source);            // No copying
+		Terrain& operator=(const Terrain& source); // No assignment
+
+		/** Internal functions used for streaming **/
+		void recenter(GLint x, GLint z);
+		void upload(Result& result);
+		bool isInRange(GLint x, GLint z, int slack) const;
+		void generate();
+		void release();
+
+		/** Packs chunk coordinates into one key, and back **/
+		static long long getKey(GLint x, GLint z);
+		static void getCoordinates(long long key, GLint& x, GLint& z);
+};
+
+#endif // TERRAIN_H_INCLUDED
@@ -0,0 +1,126 @@
+/*=================================                                       ----*\
+ * THREAD POOL CLASS                                                          *
+ * - This class keeps a set of worker threads waiting for work. A job is a    *
+ *   range of items split into chunks, which the workers and the thread that  *
+ *   waits on the job take from a shared counter until none are left.         *
+\*----                                       =================================*/
+
+#include "ThreadPool.h"
+
+/** ThreadPool constructor, threads are created in start() **/
+ThreadPool::ThreadPool() {
+	Quit        = false;
+	Generation  = 0;
+	Active      = 0;
+	CurrentTask = NULL;
+	CurrentData = NULL;
+	Count       = 0;
+	Grain       = 1;
+	Next        = 0;
+	Remaining   = 0;
+}
+
+/** ThreadPool destructor, finishes the current job first **/
+ThreadPool::~ThreadPool() {
+	wait();
+
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		Quit = true;
+	}
+	Wake.notify_all();
+
+	for (size_t t = 0; t < Threads.size(); t++)
+		Threads[t].join();
+}
+
+/** Starts the workers, zero picks one less than the core count **/
+void ThreadPool::start(int threads) {
+	if (threads <= 0) {
+		// The thread that waits on a job works too, so leave it a core
+		threads = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+		if (threads < 0)
+			threads = 0;
+	}
+
+	for (int t = 0; t < threads; t++)
+		Threads.push_back(std::thread(&ThreadPool::work, this));
+}
+
+/** Starts a job without waiting for it, after finishing any other **/
+void ThreadPool::dispatch(Task task, void* data, int count, int grain) {
+	wait();
+
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		CurrentTask = task;
+		CurrentData = data;
+		Count       = count;
+		Grain       = (grain > 0 ? grain : 1);
+		Next        = 0;
+		Remaining   = count;
+		Generation++;
+	}
+	Wake.notify_all();
+}
+
+/** Helps with the current job until it is done **/
+void ThreadPool::wait() {
+	execute();
+
+	// Workers may still be finishing their last chunk
+	std::unique_lock<std::mutex> guard(Lock);
+	while (Remaining > 0 || Active > 0)
+		Done.wait(guard);
+}
+
+/** Runs a job to completion **/
+void ThreadPool::run(Task task, void* data, int count, int grain) {
+	dispatch(task, data, count, grain);
+	wait();
+}
+
+/** Number of worker threads, not counting the caller **/
+int ThreadPool::getThreadCount() const {
+	return static_cast<int>(Threads.size());
+}
+
+/** Worker loop, sleeps until a new job arrives **/
+void ThreadPool::work() {
+	TRACE_THREAD("Worker");
+	unsigned seen = 0;
+	std::unique_lock<std::mutex> guard(Lock);
+
+	while (!Quit) {
+		if (Generation == seen) {
+			Wake.wait(guard);
+			continue;
+		}
+
+		// Jobs only change while no worker is active, so the job read here
+		// stays valid until this worker checks out
+		seen = Generation;
+		Active++;
+		guard.unlock();
+		execute();
+		guard.lock();
+		Active--;
+
+		if (Active == 0 && Remaining == 0)
+			Done.notify_all();
+	}
+}
+
+/** Takes chunks of the current job until there are none left **/
+void ThreadPool::execute() {
+	for (;;) {
+		int begin = Next.fetch_add(Grain);
+		if (begin >= Count)
+			return;
+
+		int end = (begin + Grain < Count ? begin + Grain : Count);
+		TRACE_SCOPE("Task");
+		CurrentTask(CurrentData, begin, end);
+		Remaining -= end - begin;
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef THREADPOOL_H_INCLUDED
+#define THREADPOOL_H_INCLUDED
+
+/*=================================                                       ----*\
+ * THREAD POOL CLASS                                                          *
+ * - This class keeps a set of worker threads waiting for work. A job is a    *
+ *   range of items split into chunks, which the workers and the thread that  *
+ *   waits on the job take from a shared counter until none are left.         *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "Trace.h"
+
+class ThreadPool {
+	public:
+		/** Work on the items from begin up to, but not including, end **/
+		typedef void (*Task)(void* data, int begin, int end);
+
+		ThreadPool();
+		~ThreadPool();
+
+		/** Starts the workers, zero picks one less than the core count **/
+		void start(int threads);
+
+		/** Starts a job without waiting for it, after finishing any other **/
+		void dispatch(Task task, void* data, int count, int grain);
+
+		/** Helps with the current job until it is done **/
+		void wait();
+
+		/** Runs a job to completion **/
+		void run(Task task, void* data, int count, int grain);
+
+		/** Number of worker threads, not counting the caller **/
+		int getThreadCount() const;
+	protected:
+	private:
+		/** Internal variables for the workers **/
+		std::vector<std::thread> Threads;
+		std::mutex               Lock;
+		std::condition_variable  Wake, Done;
+		bool                     Quit;
+		unsigned                 Generation; // Bumped for every job
+		int                      Active;     // Workers inside a job
+
+		/** Internal variables for the current job **/
+		Task             CurrentTask;
+		void*            CurrentData;
+		int              Count, Grain;
+		std::atomic<int> Next, Remaining;
+
+		/** Prevent copying, the pool owns threads **/
+		ThreadPool(const ThreadPool& source);            // No copying
+		ThreadPool& operator=(const ThreadPool& source); // No assignment
+
+		/** Internal functions used by the workers **/
+		void work();
+		void execute();
+};
+
+#endif // THREADPOOL_H_INCLUDED
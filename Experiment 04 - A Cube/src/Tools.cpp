@@ -0,0 +1,84 @@
+/*=================================                                       ----*\
+ * TOOLS CLASS                                                                *
+ * - This static class holds what the Replay and Benchmark tools share: a     *
+ *   hidden window whose context draws into an offscreen framebuffer instead, *
+ *   and the JSON string writer that Trace uses as well.                      *
+\*----                                       =================================*/
+
+#include "Tools.h"
+
+/** Creates a hidden window for its context, and a framebuffer to draw
+    into instead **/
+GLFWwindow* Tools::createContext(const char* name, GLsizei width,
+	GLsizei height, GLuint renderbuffers[2])
+{
+	if (!glfwInit()) {
+		fprintf(stderr, "Failed to initialize GLFW\n");
+		return NULL;
+	}
+
+	// Same versions the renderer asks for, newest first
+	static const int versions[][2] = { { 4, 5 }, { 4, 3 }, { 3, 3 } };
+	const int versionCount = sizeof(versions) / sizeof(versions[0]);
+	GLFWwindow* window = NULL;
+
+	for (int v = 0; v < versionCount && !window; v++) {
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, versions[v][0]);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, versions[v][1]);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		window = glfwCreateWindow(64, 64, name, NULL, NULL);
+	}
+
+	if (!window) {
+		fprintf(stderr, "Failed to create an OpenGL context\n");
+		glfwTerminate();
+		return NULL;
+	}
+
+	glfwMakeContextCurrent(window);
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK) {
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		glfwTerminate();
+		return NULL;
+	}
+
+	// Nothing is presented, so the window's swap interval and compositor
+	// stay out of the timings
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+	GLuint framebuffer = 0;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_RENDERBUFFER, renderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+		GL_RENDERBUFFER, renderbuffers[1]);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Failed to create the %s framebuffer\n", name);
+		glfwTerminate();
+		return NULL;
+	}
+
+	glViewport(0, 0, width, height);
+	return window;
+}
+
+/** Writes a quoted JSON string **/
+void Tools::writeString(FILE* file, const char* text) {
+	fputc('"', file);
+	for (; *text; text++) {
+		if (*text == '"' || *text == '\\')
+			fputc('\\', file);
+		if (static_cast<unsigned char>(*text) >= 0x20)
+			fputc(*text, file);
+	}
+	fputc('"', file);
+}
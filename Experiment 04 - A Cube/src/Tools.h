@@ -0,0 +1,34 @@
+#ifndef TOOLS_H_INCLUDED
+#define TOOLS_H_INCLUDED
+
+/*=================================                                       ----*\
+ * TOOLS CLASS                                                                *
+ * - This static class holds what the Replay and Benchmark tools share: a     *
+ *   hidden window whose context draws into an offscreen framebuffer instead, *
+ *   and the JSON string writer that Trace uses as well.                      *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+class Tools {
+	public:
+		/** Creates a hidden window for its context, and a framebuffer of
+		    the given size to draw into instead, left bound with a matching
+		    viewport. The color and depth renderbuffers are returned so the
+		    caller can account for them. NULL when any step fails **/
+		static GLFWwindow* createContext(const char* name, GLsizei width,
+			GLsizei height, GLuint renderbuffers[2]);
+
+		/** Writes a quoted JSON string, escaping quotes and backslashes
+		    and dropping control characters **/
+		static void writeString(FILE* file, const char* text);
+	protected:
+	private:
+		/** No constructing, the class only has static functions **/
+		Tools();
+};
+
+#endif // TOOLS_H_INCLUDED
@@ -0,0 +1,273 @@
+/*=================================                                       ----*\
+ * TRACE CLASS                                                                *
+ * - This class records timed scopes from every thread into per-thread        *
+ *   buffers without locking, and GPU scopes with timestamp queries aligned   *
+ *   to the CPU clock. A recording is written as Chrome trace event JSON,     *
+ *   which chrome://tracing and the Perfetto UI both open.                    *
+\*----                                       =================================*/
+
+#include "Trace.h"
+#include "Tools.h"
+
+/** Define static member variables **/
+std::mutex                    Trace::Lock;
+std::vector<Trace::Buffer*>   Trace::Buffers;
+thread_local Trace::Buffer*   Trace::Local = NULL;
+std::atomic<bool>             Trace::Recording(false);
+std::chrono::steady_clock::time_point Trace::Origin;
+std::vector<Trace::GPUEvent>  Trace::PendingGPU;
+std::vector<Trace::Event>     Trace::GPUEvents;
+std::vector<GLuint>           Trace::FreeQueries;
+long long                     Trace::GPUOffset = 0;
+int                           Trace::GPUBase   = 0;
+
+/** Starts timing a scope **/
+Trace::Scope::Scope(const char* name) {
+	Name  = name;
+	Start = (Recording ? now() : -1);
+}
+
+/** Records the scope, unless recording started partway through it **/
+Trace::Scope::~Scope() {
+	if (Start >= 0 && Recording)
+		record(Name, Start, now());
+}
+
+/** Marks the start of a scope in the GPU command stream **/
+Trace::GPUScope::GPUScope(const char* name) {
+	Event = (Recording ? beginGPU(name) : -1);
+}
+
+/** Marks the end of a scope in the GPU command stream **/
+Trace::GPUScope::~GPUScope() {
+	if (Event >= 0)
+		endGPU(Event);
+}
+
+/** Checks whether the markers were compiled in **/
+bool Trace::isAvailable() {
+#ifdef TRACING
+	return true;
+#else
+	return false;
+#endif
+}
+
+/** Starts recording **/
+void Trace::start() {
+	Origin    = std::chrono::steady_clock::now();
+	Recording = true;
+	frame();
+}
+
+/** Checks whether scopes are being recorded **/
+bool Trace::isRecording() {
+	return Recording;
+}
+
+/** Names the calling thread in the trace **/
+void Trace::nameThread(const char* name) {
+	getBuffer()->Name = name;
+}
+
+/** Collects finished GPU timings and realigns the GPU clock **/
+void Trace::frame() {
+	if (!Recording)
+		return;
+
+	collectGPU(false);
+
+	// The two clocks drift apart, so line them up again every frame. The
+	// timestamp is taken once earlier commands reach the GPU, without
+	// waiting for them to finish
+	GLint64 gpuTime = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+	GPUOffset = now() - static_cast<long long>(gpuTime);
+}
+
+/** Stops recording and writes the trace **/
+bool Trace::write(const char* path) {
+	if (!Recording)
+		return false;
+
+	Recording = false;
+	collectGPU(true);
+
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "Failed to write trace %s\n", path);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(Lock);
+	int gpuThread = static_cast<int>(Buffers.size()) + 1;
+	int dropped   = 0;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\","
+		"\"args\":{\"name\":\"GPU\"}}", gpuThread);
+
+	// Complete events carry their own start and duration in microseconds,
+	// so nothing needs matching up in the viewer
+	for (size_t b = 0; b < Buffers.size(); b++) {
+		const Buffer& buffer = *Buffers[b];
+		int count = buffer.Count.load(std::memory_order_acquire);
+		dropped += buffer.Dropped;
+
+		if (buffer.Name) {
+			fprintf(file, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+				"\"name\":\"thread_name\",\"args\":{\"name\":",
+				buffer.ThreadID);
+			Tools::writeString(file, buffer.Name);
+			fprintf(file, "}}");
+		}
+
+		for (int e = 0; e < count; e++) {
+			const Event& event = buffer.Events[e];
+			fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":",
+				buffer.ThreadID);
+			Tools::writeString(file, event.Name);
+			fprintf(file, ",\"ts\":%.3f,\"dur\":%.3f}",
+				event.Start / 1000.0, event.Duration / 1000.0);
+		}
+	}
+
+	for (size_t e = 0; e < GPUEvents.size(); e++) {
+		const Event& event = GPUEvents[e];
+		fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":",
+			gpuThread);
+		Tools::writeString(file, event.Name);
+		fprintf(file, ",\"ts\":%.3f,\"dur\":%.3f}",
+			event.Start / 1000.0, event.Duration / 1000.0);
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	if (dropped > 0)
+		fprintf(stderr, "Trace buffers overflowed, %d events dropped\n",
+			dropped);
+	fprintf(stdout, "Wrote trace %s\n", path);
+	return true;
+}
+
+/** Nanoseconds since recording started **/
+long long Trace::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - Origin).count();
+}
+
+/** The calling thread's buffer, created on first use **/
+Trace::Buffer* Trace::getBuffer() {
+	if (Local)
+		return Local;
+
+	// Buffers live until the program ends, so a thread that finishes
+	// still has its events written
+	Buffer* buffer = new Buffer();
+	buffer->Count   = 0;
+	buffer->Dropped = 0;
+	buffer->Name    = NULL;
+
+	std::lock_guard<std::mutex> guard(Lock);
+	buffer->ThreadID = static_cast<int>(Buffers.size()) + 1;
+	Buffers.push_back(buffer);
+	Local = buffer;
+	return buffer;
+}
+
+/** Adds a finished scope to the calling thread's buffer **/
+void Trace::record(const char* name, long long start, long long end) {
+	Buffer& buffer = *getBuffer();
+	int count = buffer.Count.load(std::memory_order_relaxed);
+
+	// Space is only set aside once a thread records something. Nothing is
+	// read past the count, so growing it here is safe
+	if (buffer.Events.empty())
+		buffer.Events.resize(BufferSize);
+
+	if (count >= BufferSize) {
+		buffer.Dropped++;
+		return;
+	}
+
+	Event& event = buffer.Events[count];
+	event.Name     = name;
+	event.Start    = start;
+	event.Duration = end - start;
+
+	// Publish the event to the thread that writes the trace
+	buffer.Count.store(count + 1, std::memory_order_release);
+}
+
+/** Issues the timestamp at the start of a GPU scope **/
+int Trace::beginGPU(const char* name) {
+	GPUEvent event;
+	event.Name       = name;
+	event.Queries[0] = getQuery();
+	event.Queries[1] = getQuery();
+	event.Offset     = GPUOffset;
+	event.Closed     = false;
+	glQueryCounter(event.Queries[0], GL_TIMESTAMP);
+
+	PendingGPU.push_back(event);
+	return GPUBase + static_cast<int>(PendingGPU.size()) - 1;
+}
+
+/** Issues the timestamp at the end of a GPU scope **/
+void Trace::endGPU(int event) {
+	GPUEvent& pending = PendingGPU[event - GPUBase];
+	glQueryCounter(pending.Queries[1], GL_TIMESTAMP);
+	pending.Closed = true;
+}
+
+/** Reads back finished GPU scopes, oldest first **/
+void Trace::collectGPU(bool wait) {
+	size_t done = 0;
+
+	for (; done < PendingGPU.size(); done++) {
+		GPUEvent& event = PendingGPU[done];
+		if (!event.Closed)
+			break;
+
+		// Timestamps finish in order, so the end stands for both
+		if (!wait) {
+			GLint available = 0;
+			glGetQueryObjectiv(event.Queries[1], GL_QUERY_RESULT_AVAILABLE,
+				&available);
+			if (!available)
+				break;
+		}
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(event.Queries[0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(event.Queries[1], GL_QUERY_RESULT, &end);
+
+		Event finished;
+		finished.Name     = event.Name;
+		finished.Start    = static_cast<long long>(begin) + event.Offset;
+		finished.Duration = static_cast<long long>(end - begin);
+		GPUEvents.push_back(finished);
+
+		FreeQueries.push_back(event.Queries[0]);
+		FreeQueries.push_back(event.Queries[1]);
+	}
+
+	// Only finished scopes at the front are removed, so the handles of
+	// open scopes stay valid
+	PendingGPU.erase(PendingGPU.begin(), PendingGPU.begin() + done);
+	GPUBase += static_cast<int>(done);
+}
+
+/** Takes a timestamp query from the pool **/
+GLuint Trace::getQuery() {
+	if (FreeQueries.empty()) {
+		GLuint queries[64];
+		glGenQueries(64, queries);
+		FreeQueries.insert(FreeQueries.end(), queries, queries + 64);
+	}
+
+	GLuint query = FreeQueries.back();
+	FreeQueries.pop_back();
+	return query;
+}
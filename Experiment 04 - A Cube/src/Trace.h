@@ -0,0 +1,130 @@
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+/*=================================                                       ----*\
+ * TRACE CLASS                                                                *
+ * - This class records timed scopes from every thread into per-thread        *
+ *   buffers without locking, and GPU scopes with timestamp queries aligned   *
+ *   to the CPU clock. A recording is written as Chrome trace event JSON,     *
+ *   which chrome://tracing and the Perfetto UI both open.                    *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+/** Scoped markers, only compiled in when TRACING is defined. Names must
+    outlive the recording, such as string literals **/
+#ifdef TRACING
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b)  TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_JOIN(traceScope, __LINE__)(name)
+#define TRACE_GPU_SCOPE(name) \
+	Trace::GPUScope TRACE_JOIN(traceGPUScope, __LINE__)(name)
+#define TRACE_THREAD(name) Trace::nameThread(name)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_GPU_SCOPE(name)
+#define TRACE_THREAD(name)
+#endif
+
+class Trace {
+	public:
+		/** Times the code from here to the end of the enclosing block **/
+		class Scope {
+			public:
+				Scope(const char* name);
+				~Scope();
+			private:
+				const char* Name;
+				long long   Start;
+		};
+
+		/** Times the GPU commands issued in the enclosing block. Only use
+		    on the thread that owns the OpenGL context **/
+		class GPUScope {
+			public:
+				GPUScope(const char* name);
+				~GPUScope();
+			private:
+				int Event;
+		};
+
+		/** Checks whether the markers were compiled in **/
+		static bool isAvailable();
+
+		/** Starts recording, on the thread that owns the OpenGL context **/
+		static void start();
+		static bool isRecording();
+
+		/** Names the calling thread in the trace **/
+		static void nameThread(const char* name);
+
+		/** Collects finished GPU timings and realigns the GPU clock, once
+		    per frame on the OpenGL thread **/
+		static void frame();
+
+		/** Stops recording and writes the trace **/
+		static bool write(const char* path);
+	protected:
+	private:
+		/** One finished scope, times in nanoseconds since the start **/
+		struct Event {
+			const char* Name;
+			long long   Start, Duration;
+		};
+
+		/** Events from one thread. Only that thread writes, and publishes
+		    each event by bumping the count **/
+		struct Buffer {
+			std::vector<Event> Events;
+			std::atomic<int>   Count;
+			std::atomic<int>   Dropped;
+			const char*        Name;
+			int                ThreadID;
+		};
+
+		/** A GPU scope waiting on its timestamp queries **/
+		struct GPUEvent {
+			const char* Name;
+			GLuint      Queries[2];
+			long long   Offset; // CPU minus GPU clock when it was issued
+			bool        Closed;
+		};
+
+		/** Events each thread can hold before dropping the rest **/
+		static const int BufferSize = 1 << 17;
+
+		/** Internal variables for the CPU timeline **/
+		static std::mutex               Lock;
+		static std::vector<Buffer*>     Buffers;
+		static thread_local Buffer*     Local;
+		static std::atomic<bool>        Recording;
+		static std::chrono::steady_clock::time_point Origin;
+
+		/** Internal variables for the GPU timeline **/
+		static std::vector<GPUEvent> PendingGPU;
+		static std::vector<Event>    GPUEvents;
+		static std::vector<GLuint>   FreeQueries;
+		static long long             GPUOffset;
+		static int                   GPUBase;    // Handle of the oldest pending
+
+		/** No constructing, the class only has static functions **/
+		Trace();
+
+		/** Internal functions used for recording **/
+		static long long now();
+		static Buffer* getBuffer();
+		static void record(const char* name, long long start, long long end);
+		static int  beginGPU(const char* name);
+		static void endGPU(int event);
+		static void collectGPU(bool wait);
+		static GLuint getQuery();
+};
+
+#endif // TRACE_H_INCLUDED
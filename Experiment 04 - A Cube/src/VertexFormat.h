@@ -0,0 +1,216 @@
+#ifndef VERTEXFORMAT_H_INCLUDED
+#define VERTEXFORMAT_H_INCLUDED
+
+/*=================================                                       ----*\
+ * VERTEX FORMAT TEMPLATES                                                    *
+ * - These templates describe a vertex struct's attributes once and generate  *
+ *   the attribute setup from the description. Offsets, sizes and types are   *
+ *   checked against the struct while compiling, and the setup inlines down   *
+ *   to the same constant OpenGL calls that would be written by hand.         *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <type_traits>
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+
+/** Describes one attribute from a member of a vertex struct **/
+#define VERTEX_ATTRIBUTE(vertex, member, location, size, glType, mode) \
+	VertexAttribute<location, size, glType, VertexAttributes::mode,        \
+		offsetof(vertex, member), sizeof(vertex::member),                   \
+		sizeof(std::remove_all_extents<decltype(vertex::member)>::type)>
+
+class VertexAttributes {
+	public:
+		/** How the shader receives an attribute's components **/
+		enum Mode {
+			FLOAT,      // Converted to float as they are
+			NORMALIZED, // Mapped into 0 to 1, or -1 to 1 when signed
+			INTEGER     // Read by integer inputs unconverted
+		};
+
+		/** Size of one component, or of the whole attribute when packed.
+		    Unknown types have no size **/
+		static constexpr size_t getComponentBytes(GLenum type) {
+			return (type == GL_BYTE  || type == GL_UNSIGNED_BYTE)  ? 1 :
+			       (type == GL_SHORT || type == GL_UNSIGNED_SHORT ||
+			        type == GL_HALF_FLOAT)                         ? 2 :
+			       (type == GL_INT   || type == GL_UNSIGNED_INT   ||
+			        type == GL_FLOAT || type == GL_FIXED ||
+			        isPacked(type))                                ? 4 :
+			       (type == GL_DOUBLE)                             ? 8 : 0;
+		}
+
+		/** Checks for the four component types packed into one integer **/
+		static constexpr bool isPacked(GLenum type) {
+			return type == GL_INT_2_10_10_10_REV ||
+			       type == GL_UNSIGNED_INT_2_10_10_10_REV;
+		}
+
+		/** Checks for types an integer input can read **/
+		static constexpr bool isInteger(GLenum type) {
+			return type == GL_BYTE  || type == GL_UNSIGNED_BYTE  ||
+			       type == GL_SHORT || type == GL_UNSIGNED_SHORT ||
+			       type == GL_INT   || type == GL_UNSIGNED_INT;
+		}
+
+		/** True when no two attributes in the list share a location **/
+		template <typename... List> struct UniqueLocations;
+
+		/** True when no two attributes in the list share any bytes **/
+		template <typename... List> struct Disjoint;
+	protected:
+	private:
+		/** No constructing, the class only holds shared definitions **/
+		VertexAttributes();
+};
+
+template <GLuint Location, GLint Size, GLenum Type, VertexAttributes::Mode Mode,
+	size_t Offset, size_t MemberBytes, size_t ElementBytes>
+class VertexAttribute {
+	public:
+		/** Where the attribute sits, for checks across a whole format **/
+		static const GLuint Index = Location;
+		static const size_t Begin = Offset;
+		static const size_t End   = Offset +
+			(VertexAttributes::isPacked(Type) ? 4 :
+				Size * VertexAttributes::getComponentBytes(Type));
+
+		static_assert(VertexAttributes::getComponentBytes(Type) != 0,
+			"Unknown attribute type");
+		static_assert(Size >= 1 && Size <= 4,
+			"Attributes have one to four components");
+		static_assert(!VertexAttributes::isPacked(Type) || Size == 4,
+			"Packed attributes have four components");
+		static_assert(VertexAttributes::isPacked(Type) ||
+			ElementBytes == VertexAttributes::getComponentBytes(Type),
+			"The member's element size doesn't match the attribute type");
+		static_assert(End - Offset <= MemberBytes,
+			"The attribute reads past the end of its member");
+		static_assert(Offset % 4 == 0,
+			"Attributes must start on a four byte boundary");
+		static_assert(Mode != VertexAttributes::INTEGER ||
+			VertexAttributes::isInteger(Type),
+			"Only integer types can feed integer inputs");
+		static_assert(Mode != VertexAttributes::NORMALIZED ||
+			VertexAttributes::isInteger(Type) ||
+			VertexAttributes::isPacked(Type),
+			"Only integer types can be normalized");
+
+		/** Points the attribute at the bound array buffer **/
+		static void setPointer(GLsizei stride) {
+			glEnableVertexAttribArray(Location);
+			if (Mode == VertexAttributes::INTEGER)
+				glVertexAttribIPointer(Location, Size, Type, stride,
+					(void*) Offset);
+			else
+				glVertexAttribPointer(Location, Size, Type,
+					Mode == VertexAttributes::NORMALIZED ? GL_TRUE : GL_FALSE,
+					stride, (void*) Offset);
+		}
+
+		/** Sets the attribute's format and ties it to a buffer binding **/
+		static void setFormat(GLuint binding) {
+			glEnableVertexAttribArray(Location);
+			if (Mode == VertexAttributes::INTEGER)
+				glVertexAttribIFormat(Location, Size, Type, Offset);
+			else
+				glVertexAttribFormat(Location, Size, Type,
+					Mode == VertexAttributes::NORMALIZED ? GL_TRUE : GL_FALSE,
+					Offset);
+			glVertexAttribBinding(Location, binding);
+		}
+
+		/** Steps the attribute per instance instead of per vertex **/
+		static void setDivisor(GLuint divisor) {
+			glVertexAttribDivisor(Location, divisor);
+		}
+
+		/** Stops reading the attribute **/
+		static void disable() {
+			glDisableVertexAttribArray(Location);
+		}
+	protected:
+	private:
+		/** No constructing, the class only has static functions **/
+		VertexAttribute();
+};
+
+template <typename Vertex, typename... Attributes>
+class VertexFormat {
+	public:
+		/** Distance between vertices in the buffer **/
+		static const GLsizei Stride = sizeof(Vertex);
+
+		static_assert(sizeof...(Attributes) > 0,
+			"A vertex format needs at least one attribute");
+		static_assert(std::is_standard_layout<Vertex>::value,
+			"Vertices need a standard layout for their offsets to be known");
+		static_assert(sizeof(Vertex) % 4 == 0,
+			"Vertices must be a multiple of four bytes");
+		static_assert(VertexAttributes::UniqueLocations<Attributes...>::Value,
+			"Two attributes share a location");
+		static_assert(VertexAttributes::Disjoint<Attributes...>::Value,
+			"Two attributes overlap");
+
+		/** Points every attribute at the bound array buffer **/
+		static void setPointers() {
+			// Expands to one call per attribute, in declaration order
+			int expand[] = { 0, (Attributes::setPointer(Stride), 0)... };
+			(void) expand;
+		}
+
+		/** Sets every attribute's format for one buffer binding, to be
+		    bound with glBindVertexBuffer(binding, buffer, 0, Stride) **/
+		static void setFormat(GLuint binding) {
+			int expand[] = { 0, (Attributes::setFormat(binding), 0)... };
+			(void) expand;
+		}
+
+		/** Steps every attribute per instance instead of per vertex **/
+		static void setDivisor(GLuint divisor) {
+			int expand[] = { 0, (Attributes::setDivisor(divisor), 0)... };
+			(void) expand;
+		}
+
+		/** Stops reading every attribute **/
+		static void disable() {
+			int expand[] = { 0, (Attributes::disable(), 0)... };
+			(void) expand;
+		}
+	protected:
+	private:
+		/** No constructing, the class only has static functions **/
+		VertexFormat();
+};
+
+/** An empty or single attribute list can't conflict **/
+template <typename... List>
+struct VertexAttributes::UniqueLocations {
+	static const bool Value = true;
+};
+
+template <typename... List>
+struct VertexAttributes::Disjoint {
+	static const bool Value = true;
+};
+
+/** Compare the first attribute with each later one, then move along **/
+template <typename First, typename Second, typename... Rest>
+struct VertexAttributes::UniqueLocations<First, Second, Rest...> {
+	static const bool Value = First::Index != Second::Index &&
+		UniqueLocations<First, Rest...>::Value &&
+		UniqueLocations<Second, Rest...>::Value;
+};
+
+template <typename First, typename Second, typename... Rest>
+struct VertexAttributes::Disjoint<First, Second, Rest...> {
+	static const bool Value =
+		(First::End <= Second::Begin || Second::End <= First::Begin) &&
+		Disjoint<First, Rest...>::Value &&
+		Disjoint<Second, Rest...>::Value;
+};
+
+#endif // VERTEXFORMAT_H_INCLUDED
@@ -0,0 +1,236 @@
+/*=================================                                       ----*\
+ * VERTEX PACKER CLASS                                                        *
+ * - This class converts float vertex data into compact attribute encodings:  *
+ *   16 bit positions quantized within the mesh's bounds, half float          *
+ *   positions, 8 bit colors and 10 bit normals. Each converter works on four *
+ *   vertices at a time with SSE and writes into interleaved vertices.        *
+\*----                                       =================================*/
+
+#include "VertexPacker.h"
+#include <cmath>
+#include <vector>
+
+/** Quantizes positions to 16 bits within their bounds **/
+glm::mat4 VertexPacker::quantizePositions(const GLfloat* positions,
+	GLsizei count, void* output, GLsizei stride)
+{
+	if (count <= 0)
+		return glm::mat4(1.0f);
+
+	glm::vec3 low(positions[0], positions[1], positions[2]);
+	glm::vec3 high = low;
+	for (GLsizei v = 1; v < count; v++) {
+		glm::vec3 p(positions[3 * v], positions[3 * v + 1],
+			positions[3 * v + 2]);
+		low  = glm::min(low, p);
+		high = glm::max(high, p);
+	}
+
+	// Map the box onto the full signed 16 bit range. Flat axes keep a
+	// tiny extent so they don't divide by zero
+	glm::vec3 center = (low + high) * 0.5f;
+	glm::vec3 extent = glm::max((high - low) * 0.5f, glm::vec3(1e-20f));
+
+	std::vector<GLint> values(count * 3);
+	convert(positions, count, center, glm::vec3(32767.0f) / extent,
+		glm::vec3(-32767.0f), glm::vec3(32767.0f), &values[0]);
+
+	GLubyte* vertex = static_cast<GLubyte*>(output);
+	for (GLsizei v = 0; v < count; v++, vertex += stride) {
+		GLshort* position = reinterpret_cast<GLshort*>(vertex);
+		position[0] = static_cast<GLshort>(values[3 * v]);
+		position[1] = static_cast<GLshort>(values[3 * v + 1]);
+		position[2] = static_cast<GLshort>(values[3 * v + 2]);
+	}
+
+	// Integers come into the shader unnormalized, so the matrix scales by
+	// the step size as well as moving back to the center
+	glm::mat4 restore = glm::translate(glm::mat4(1.0f), center);
+	return glm::scale(restore, extent / 32767.0f);
+}
+
+/** Converts positions to half floats **/
+void VertexPacker::packHalfPositions(const GLfloat* positions, GLsizei count,
+	void* output, GLsizei stride)
+{
+	GLubyte* vertex = static_cast<GLubyte*>(output);
+	GLsizei  v      = 0;
+
+#ifdef VERTEXPACKER_SSE
+	// Rounds to nearest even like the scalar version, four values at a time
+	const __m128i minNormal    = _mm_set1_epi32(113 << 23);
+	const __m128i halfMaximum  = _mm_set1_epi32((127 + 16) << 23);
+	const __m128i denormMagic  =
+		_mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+	const __m128i normalBias   = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+	const __m128i infinity     = _mm_set1_epi32(0x7c00);
+	const __m128i quietNaN     = _mm_set1_epi32(0x200);
+	const __m128  signMask     = _mm_set1_ps(-0.0f);
+
+	for (; v + 4 <= count; v += 4) {
+		GLhalf halves[12];
+
+		for (int q = 0; q < 3; q++) {
+			__m128  value    = _mm_loadu_ps(positions + 3 * v + 4 * q);
+			__m128  sign     = _mm_and_ps(value, signMask);
+			__m128  absolute = _mm_xor_ps(value, sign);
+			__m128i bits     = _mm_castps_si128(absolute);
+
+			// Too small for a normal half, let float addition do the shift
+			__m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(
+				absolute, _mm_castsi128_ps(denormMagic))), denormMagic);
+
+			// Rebias the exponent and round on the dropped mantissa bits
+			__m128i odd    = _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+			__m128i normal = _mm_srli_epi32(_mm_sub_epi32(
+				_mm_add_epi32(bits, normalBias), odd), 13);
+
+			__m128i isDenormal = _mm_cmpgt_epi32(minNormal, bits);
+			__m128i isRegular  = _mm_cmpgt_epi32(halfMaximum, bits);
+			__m128i special    = _mm_or_si128(infinity, _mm_and_si128(quietNaN,
+				_mm_castps_si128(_mm_cmpunord_ps(absolute, absolute))));
+
+			__m128i result = _mm_or_si128(_mm_and_si128(isDenormal, denormal),
+				_mm_andnot_si128(isDenormal, normal));
+			result = _mm_or_si128(_mm_and_si128(isRegular, result),
+				_mm_andnot_si128(isRegular, special));
+			result = _mm_or_si128(result,
+				_mm_srli_epi32(_mm_castps_si128(sign), 16));
+
+			GLint lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), result);
+			for (int l = 0; l < 4; l++)
+				halves[4 * q + l] = static_cast<GLhalf>(lanes[l]);
+		}
+
+		for (int c = 0; c < 4; c++, vertex += stride)
+			memcpy(vertex, &halves[3 * c], 3 * sizeof(GLhalf));
+	}
+#endif
+
+	for (; v < count; v++, vertex += stride) {
+		GLhalf* position = reinterpret_cast<GLhalf*>(vertex);
+		position[0] = toHalf(positions[3 * v]);
+		position[1] = toHalf(positions[3 * v + 1]);
+		position[2] = toHalf(positions[3 * v + 2]);
+	}
+}
+
+/** Converts colors from 0 to 1 into 8 bits, with opaque alpha **/
+void VertexPacker::packColors(const GLfloat* colors, GLsizei count,
+	void* output, GLsizei stride)
+{
+	std::vector<GLint> values(count * 3);
+	convert(colors, count, glm::vec3(0.0f), glm::vec3(255.0f),
+		glm::vec3(0.0f), glm::vec3(255.0f), &values[0]);
+
+	GLubyte* vertex = static_cast<GLubyte*>(output);
+	for (GLsizei v = 0; v < count; v++, vertex += stride) {
+		vertex[0] = static_cast<GLubyte>(values[3 * v]);
+		vertex[1] = static_cast<GLubyte>(values[3 * v + 1]);
+		vertex[2] = static_cast<GLubyte>(values[3 * v + 2]);
+		vertex[3] = 255;
+	}
+}
+
+/** Converts unit normals into GL_INT_2_10_10_10_REV **/
+void VertexPacker::packNormals(const GLfloat* normals, GLsizei count,
+	void* output, GLsizei stride)
+{
+	std::vector<GLint> values(count * 3);
+	convert(normals, count, glm::vec3(0.0f), glm::vec3(511.0f),
+		glm::vec3(-511.0f), glm::vec3(511.0f), &values[0]);
+
+	// X in the low bits, then Y and Z, with the two bit W left at zero
+	GLubyte* vertex = static_cast<GLubyte*>(output);
+	for (GLsizei v = 0; v < count; v++, vertex += stride) {
+		GLuint packed =
+			 (static_cast<GLuint>(values[3 * v])     & 0x3ff) |
+			((static_cast<GLuint>(values[3 * v + 1]) & 0x3ff) << 10) |
+			((static_cast<GLuint>(values[3 * v + 2]) & 0x3ff) << 20);
+		memcpy(vertex, &packed, sizeof(GLuint));
+	}
+}
+
+/** Converts one float to a half float, rounding to nearest even **/
+GLhalf VertexPacker::toHalf(GLfloat value) {
+	GLuint bits;
+	memcpy(&bits, &value, sizeof(GLuint));
+
+	GLuint sign = (bits >> 16) & 0x8000;
+	bits &= 0x7fffffff;
+
+	GLuint half;
+	if (bits >= static_cast<GLuint>((127 + 16) << 23)) {
+		// Too large becomes infinity, NaN stays NaN
+		half = (bits > 0x7f800000 ? 0x7e00 : 0x7c00);
+	} else if (bits < static_cast<GLuint>(113 << 23)) {
+		// Too small for a normal half, let float addition do the shift
+		const GLuint magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+		GLfloat magic, sum;
+		memcpy(&magic, &magicBits, sizeof(GLfloat));
+		memcpy(&sum, &bits, sizeof(GLfloat));
+		sum += magic;
+		memcpy(&half, &sum, sizeof(GLuint));
+		half -= magicBits;
+	} else {
+		// Rebias the exponent and round on the dropped mantissa bits. The
+		// bias is subtracted unsigned, bits is past it in this range
+		GLuint odd = (bits >> 13) & 1;
+		half = (bits - ((127u - 15u) << 23) + 0xfffu + odd) >> 13;
+	}
+
+	return static_cast<GLhalf>(half | sign);
+}
+
+/** Scales and offsets three-component data, rounding to integers **/
+void VertexPacker::convert(const GLfloat* input, GLsizei count,
+	const glm::vec3& offset, const glm::vec3& scale,
+	const glm::vec3& low, const glm::vec3& high, GLint* output)
+{
+	GLsizei v = 0;
+
+#ifdef VERTEXPACKER_SSE
+	// Twelve floats hold four vertices, starting on x, then y, then z
+	const __m128 offsets[3] = {
+		_mm_setr_ps(offset.x, offset.y, offset.z, offset.x),
+		_mm_setr_ps(offset.y, offset.z, offset.x, offset.y),
+		_mm_setr_ps(offset.z, offset.x, offset.y, offset.z)
+	};
+	const __m128 scales[3] = {
+		_mm_setr_ps(scale.x, scale.y, scale.z, scale.x),
+		_mm_setr_ps(scale.y, scale.z, scale.x, scale.y),
+		_mm_setr_ps(scale.z, scale.x, scale.y, scale.z)
+	};
+	const __m128 lows[3] = {
+		_mm_setr_ps(low.x, low.y, low.z, low.x),
+		_mm_setr_ps(low.y, low.z, low.x, low.y),
+		_mm_setr_ps(low.z, low.x, low.y, low.z)
+	};
+	const __m128 highs[3] = {
+		_mm_setr_ps(high.x, high.y, high.z, high.x),
+		_mm_setr_ps(high.y, high.z, high.x, high.y),
+		_mm_setr_ps(high.z, high.x, high.y, high.z)
+	};
+
+	for (; v + 4 <= count; v += 4) {
+		for (int q = 0; q < 3; q++) {
+			__m128 value = _mm_loadu_ps(input + 3 * v + 4 * q);
+			value = _mm_mul_ps(_mm_sub_ps(value, offsets[q]), scales[q]);
+			value = _mm_min_ps(_mm_max_ps(value, lows[q]), highs[q]);
+
+			// Converting uses the default round to nearest even
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output + 3 * v + 4 * q),
+				_mm_cvtps_epi32(value));
+		}
+	}
+#endif
+
+	for (; v < count; v++) {
+		for (int c = 0; c < 3; c++) {
+			float value = (input[3 * v + c] - offset[c]) * scale[c];
+			value = glm::clamp(value, low[c], high[c]);
+			output[3 * v + c] = static_cast<GLint>(std::lrint(value));
+		}
+	}
+}
@@ -0,0 +1,98 @@
+#ifndef VERTEXPACKER_H_INCLUDED
+#define VERTEXPACKER_H_INCLUDED
+
+/*=================================                                       ----*\
+ * VERTEX PACKER CLASS                                                        *
+ * - This class converts float vertex data into compact attribute encodings:  *
+ *   16 bit positions quantized within the mesh's bounds, half float          *
+ *   positions, 8 bit colors and 10 bit normals. Each converter works on four *
+ *   vertices at a time with SSE and writes into interleaved vertices.        *
+\*----                                       =================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "VertexFormat.h"
+#include <GL/glew.h> // GLEW must be included before gl.h or glfw.h
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VERTEXPACKER_SSE
+#endif
+
+/** Interleaved vertex with quantized positions and 8 bit colors, 12 bytes.
+    Positions are read as plain integers and restored by the matrix
+    quantizePositions() returns **/
+struct QuantizedVertex {
+	GLshort Position[4]; // Fourth value pads the color to four bytes
+	GLubyte Color[4];
+};
+
+/** Interleaved vertex with half float positions and 8 bit colors, 12 bytes **/
+struct HalfVertex {
+	GLhalf  Position[4]; // Fourth value pads the color to four bytes
+	GLubyte Color[4];
+};
+
+/** Half float position alone, for shaders that make their own colors,
+    8 bytes **/
+struct HalfPosition {
+	GLhalf Position[4]; // Fourth value keeps vertices four byte aligned
+};
+
+/** Attribute layouts of the packed vertices. Locations match the
+    position and color inputs of Transform.vshader and Batch.vshader **/
+typedef VertexFormat<QuantizedVertex,
+	VERTEX_ATTRIBUTE(QuantizedVertex, Position, 0, 3, GL_SHORT, FLOAT),
+	VERTEX_ATTRIBUTE(QuantizedVertex, Color, 1, 4, GL_UNSIGNED_BYTE, NORMALIZED)
+> QuantizedFormat;
+
+typedef VertexFormat<HalfVertex,
+	VERTEX_ATTRIBUTE(HalfVertex, Position, 0, 3, GL_HALF_FLOAT, FLOAT),
+	VERTEX_ATTRIBUTE(HalfVertex, Color, 1, 4, GL_UNSIGNED_BYTE, NORMALIZED)
+> HalfFormat;
+
+/** Attribute layout matching the input of Procedural.vshader **/
+typedef VertexFormat<HalfPosition,
+	VERTEX_ATTRIBUTE(HalfPosition, Position, 0, 3, GL_HALF_FLOAT, FLOAT)
+> HalfPositionFormat;
+
+class VertexPacker {
+	public:
+		/** Quantizes positions to 16 bits within their bounds and returns
+		    the matrix that restores them, to be folded into the model **/
+		static glm::mat4 quantizePositions(const GLfloat* positions,
+			GLsizei count, void* output, GLsizei stride);
+
+		/** Converts positions to half floats **/
+		static void packHalfPositions(const GLfloat* positions, GLsizei count,
+			void* output, GLsizei stride);
+
+		/** Converts colors from 0 to 1 into 8 bits, with opaque alpha **/
+		static void packColors(const GLfloat* colors, GLsizei count,
+			void* output, GLsizei stride);
+
+		/** Converts unit normals into GL_INT_2_10_10_10_REV **/
+		static void packNormals(const GLfloat* normals, GLsizei count,
+			void* output, GLsizei stride);
+
+		/** Converts one float to a half float **/
+		static GLhalf toHalf(GLfloat value);
+	protected:
+	private:
+		/** Scales and offsets three-component data, rounding to integers.
+		    Four vertices fill three vectors, so the per-axis constants are
+		    rotated to line up with each one **/
+		static void convert(const GLfloat* input, GLsizei count,
+			const glm::vec3& offset, const glm::vec3& scale,
+			const glm::vec3& low, const glm::vec3& high, GLint* output);
+
+		/** No constructing, the class only has static functions **/
+		VertexPacker();
+};
+
+#endif // VERTEXPACKER_H_INCLUDED
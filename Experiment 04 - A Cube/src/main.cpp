@@ -1,55 +1,448 @@
 #include "Graphics.h"
+#include "MeshCodec.h"
 #include <ctime>
+#include <thread>
+#include <chrono>
+#include <cmath>
+
+/** Closes the window when escape is pressed **/
+void keyPressed(GLFWwindow* window, int key, int scancode, int action,
+	int mods)
+{
+	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, GL_TRUE);
+}
+
+/** Processes window events, waiting up to the timeout for one to arrive **/
+void waitEvents(double timeout) {
+	if (timeout <= 0.0) {
+		glfwPollEvents();
+		return;
+	}
+
+#if GLFW_VERSION_MAJOR > 3 || \
+	(GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 2)
+	glfwWaitEventsTimeout(timeout);
+#else
+	// Older GLFW can't wake from a timeout, so nap in short steps to keep
+	// input responsive
+	double nap = (timeout < 0.01 ? timeout : 0.01);
+	std::this_thread::sleep_for(std::chrono::microseconds(
+		static_cast<long long>(nap * 1000000.0)));
+	glfwPollEvents();
+#endif
+}
+
+/** Renders a fixed number of frames in every anti-aliasing mode **/
+void benchmarkAntiAliasing() {
+	static const char* modes[] = {
+		"none", "fxaa", "smaa", "msaa2", "msaa4", "msaa8", "msaa16"
+	};
+	const int modeCount   = sizeof(modes) / sizeof(modes[0]);
+	const int warmup      = 30;
+	const int frameCount  = 300;
+
+	// Measure at full resolution so every mode covers the same pixels
+	Graphics::setDynamicResolution(false);
+
+	// The table prints directly, after anything already logged
+	Log::flush();
+	fprintf(stdout, "%-8s %12s %12s %12s\n",
+		"Mode", "CPU ms", "GPU ms", "Targets MB");
+
+	for (int m = 0; m < modeCount; m++) {
+		AntiAliasing::Mode mode;
+		GLsizei samples;
+		AntiAliasing::parseMode(modes[m], mode, samples);
+		Graphics::setAntiAliasing(mode, samples);
+
+		double gpuTotal  = 0.0;
+		int    gpuFrames = 0;
+		double start     = 0.0;
+
+		for (int f = 0; f < warmup + frameCount; f++) {
+			if (f == warmup)
+				start = glfwGetTime();
+
+			Graphics::update();
+			glfwPollEvents();
+
+			if (f >= warmup && Graphics::getGPUTime() > 0.0) {
+				gpuTotal += Graphics::getGPUTime();
+				gpuFrames++;
+			}
+		}
+
+		double cpuTime = (glfwGetTime() - start) * 1000.0 / frameCount;
+		double gpuTime = (gpuFrames > 0 ? gpuTotal / gpuFrames : 0.0);
+		double memory  = Graphics::getTargetMemory() / (1024.0 * 1024.0);
+
+		Log::flush();
+		fprintf(stdout, "%-8s %12.3f %12.3f %12.2f\n",
+			modes[m], cpuTime, gpuTime, memory);
+	}
+}
+
+/** Simulates a million particles in each mode **/
+void benchmarkParticles() {
+	static const Particles::Mode modes[] = { Particles::CPU, Particles::GPU };
+	const int modeCount  = sizeof(modes) / sizeof(modes[0]);
+	const int particles  = 1000000;
+	const int warmup     = 30;
+	const int frameCount = 300;
+
+	// Keep the frame the same size so only the update differs
+	Graphics::setDynamicResolution(false);
+
+	// The table prints directly, after anything already logged
+	Log::flush();
+	fprintf(stdout, "%-8s %12s %12s %12s\n",
+		"Mode", "Frame ms", "Update ms", "GPU ms");
+
+	for (int m = 0; m < modeCount; m++) {
+		Graphics::setParticles(particles, modes[m]);
+
+		double updateTotal = 0.0;
+		double gpuTotal    = 0.0;
+		int    gpuFrames   = 0;
+		double start       = 0.0;
+
+		for (int f = 0; f < warmup + frameCount; f++) {
+			if (f == warmup)
+				start = glfwGetTime();
+
+			Graphics::update();
+			glfwPollEvents();
+
+			if (f < warmup)
+				continue;
+			updateTotal += Graphics::getParticleUpdateTime();
+			if (Graphics::getParticleGPUTime() > 0.0) {
+				gpuTotal += Graphics::getParticleGPUTime();
+				gpuFrames++;
+			}
+		}
+
+		double frameTime  = (glfwGetTime() - start) * 1000.0 / frameCount;
+		double updateTime = updateTotal / frameCount;
+		double gpuTime    = (gpuFrames > 0 ? gpuTotal / gpuFrames : 0.0);
+
+		Log::flush();
+		fprintf(stdout, "%-8s %12.3f %12.3f %12.3f\n",
+			Particles::getModeName(modes[m]), frameTime, updateTime, gpuTime);
+	}
+}
+
+/** Milliseconds since a point in time **/
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count() / 1000.0;
+}
+
+/** Encodes generated meshes with and without the run-length stage, and
+    times decoding them against their raw float arrays **/
+void benchmarkMeshes() {
+	static const char* names[] = {
+		"Ico sphere", "UV sphere", "Plane", "Terrain"
+	};
+	const int meshCount = sizeof(names) / sizeof(names[0]);
+	const int repeats   = 20;
+
+	ThreadPool workers;
+	workers.start(0);
+
+	Log::flush();
+	fprintf(stdout, "%-11s %-5s %10s %10s %7s %10s %8s %10s\n", "Mesh", "Runs",
+		"Raw KB", "Coded KB", "Ratio", "Decode ms", "GB/s", "Upload ms");
+
+	for (int m = 0; m < meshCount; m++) {
+		Generators::Mesh mesh;
+		if (m == 0)
+			Generators::icoSphere(mesh, 6);
+		else if (m == 1)
+			Generators::uvSphere(mesh, 256, 512, &workers);
+		else if (m == 2)
+			Generators::plane(mesh, 16.0f, 512, &workers);
+		else
+			Generators::terrain(mesh, 0.0f, 0.0f, 256.0f, 512, &workers);
+
+		// Raw is positions and colors as floats like the render test's
+		// vertices, with 32 bit indices
+		GLsizei vertexCount = static_cast<GLsizei>(mesh.Positions.size() / 3);
+		GLsizei indexCount  = static_cast<GLsizei>(mesh.Indices.size());
+		double  rawBytes    = vertexCount * 6.0 * sizeof(GLfloat) +
+			indexCount * sizeof(GLuint);
+		double  outputBytes = vertexCount * sizeof(QuantizedVertex) +
+			indexCount * sizeof(GLuint);
+
+		for (int runs = 0; runs < 2; runs++) {
+			std::vector<GLubyte> encoded;
+			MeshCodec::encode(&mesh.Positions[0], &mesh.Colors[0],
+				vertexCount, &mesh.Indices[0], indexCount, runs != 0, encoded);
+
+			// Decode once to check every corner lands where it started
+			std::vector<QuantizedVertex> vertices(vertexCount);
+			std::vector<GLuint>          indices(indexCount);
+			MeshCodec::Info info;
+			bool decoded = MeshCodec::getInfo(&encoded[0], encoded.size(),
+				info) && MeshCodec::decode(&encoded[0], encoded.size(),
+				&vertices[0], &indices[0], &workers);
+			glm::vec3 step(info.Dequantize[0][0], info.Dequantize[1][1],
+				info.Dequantize[2][2]);
+			for (GLsizei i = 0; decoded && i < indexCount; i++) {
+				const GLfloat* source = &mesh.Positions[3 * mesh.Indices[i]];
+				const GLshort* packed = vertices[indices[i]].Position;
+				glm::vec4 restored = info.Dequantize *
+					glm::vec4(packed[0], packed[1], packed[2], 1.0f);
+				for (int c = 0; c < 3; c++) {
+					if (std::fabs(restored[c] - source[c]) > step[c])
+						decoded = false;
+				}
+			}
+			if (!decoded) {
+				LOG_ERROR(GENERAL, "%s did not decode to the mesh encoded",
+					names[m]);
+				continue;
+			}
+
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			for (int r = 0; r < repeats; r++) {
+				MeshCodec::decode(&encoded[0], encoded.size(), &vertices[0],
+					&indices[0], &workers);
+			}
+			double decodeTime = millisecondsSince(start) / repeats;
+
+			// Straight into mapped buffers, as loading would
+			GLuint buffers[2];
+			glGenBuffers(2, buffers);
+			start = std::chrono::steady_clock::now();
+			MeshCodec::upload(&encoded[0], encoded.size(), buffers[0],
+				buffers[1], &workers);
+			double uploadTime = millisecondsSince(start);
+			glDeleteBuffers(2, buffers);
+			MemoryTracker::release(MemoryTracker::BUFFER, 2, buffers);
+
+			Log::flush();
+			fprintf(stdout,
+				"%-11s %-5s %10.1f %10.1f %7.2f %10.3f %8.2f %10.3f\n",
+				names[m], runs ? "yes" : "no", rawBytes / 1024.0,
+				encoded.size() / 1024.0, rawBytes / encoded.size(), decodeTime,
+				outputBytes / (decodeTime * 1000000.0), uploadTime);
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	// Time to the first frame counts from launch
+	std::chrono::steady_clock::time_point launched =
+		std::chrono::steady_clock::now();
+
+	// Print from a writer thread so console output never holds up a frame
+	Log::start();
+
+	bool        benchmark  = false;
+	bool        continuous = false;
+	const char* tracePath  = NULL;
+	bool        memory     = false;
+	bool        startup    = false;
+	bool        sparks     = false; // Particle benchmark
+	bool        meshes     = false; // Mesh codec benchmark
+	bool        latency    = false;
+
+	// Views asked for on the command line
+	int               views      = 1;
+	MultiView::Target viewTarget = MultiView::VIEWPORTS;
+	bool              stereo     = false;
+
+	// Particles asked for on the command line
+	int             particles    = 0;
+	Particles::Mode particleMode = Particles::CPU;
+
+	// Read the command line
+	for (int a = 1; a < argc; a++) {
+		if (strncmp(argv[a], "--aa=", 5) == 0) {
+			AntiAliasing::Mode mode;
+			GLsizei samples;
+			if (!AntiAliasing::parseMode(argv[a] + 5, mode, samples)) {
+				LOG_ERROR(GENERAL, "Unknown anti-aliasing mode %s",
+					argv[a] + 5);
+				return -1;
+			}
+			Graphics::setAntiAliasing(mode, samples);
+		} else if (strcmp(argv[a], "--aa-benchmark") == 0) {
+			benchmark = true;
+		} else if (strcmp(argv[a], "--particle-benchmark") == 0) {
+			sparks = true;
+		} else if (strcmp(argv[a], "--mesh-benchmark") == 0) {
+			meshes = true;
+		} else if (strncmp(argv[a], "--particle-mode=", 16) == 0) {
+			if (!Particles::parseMode(argv[a] + 16, particleMode)) {
+				LOG_ERROR(GENERAL, "Unknown particle mode %s", argv[a] + 16);
+				return -1;
+			}
+		} else if (strncmp(argv[a], "--particles", 11) == 0) {
+			// The count follows an equals sign, a million when left out
+			particles = (argv[a][11] == '=' ? atoi(argv[a] + 12) : 1000000);
+			if (particles <= 0) {
+				LOG_ERROR(GENERAL, "Particles need a positive count");
+				return -1;
+			}
+		} else if (strncmp(argv[a], "--log=", 6) == 0) {
+			Log::Level level;
+			if (!Log::parseLevel(argv[a] + 6, level)) {
+				LOG_ERROR(GENERAL, "Unknown log level %s", argv[a] + 6);
+				return -1;
+			}
+			Log::setLevel(level);
+		} else if (strcmp(argv[a], "--continuous") == 0) {
+			continuous = true;
+		} else if (strcmp(argv[a], "--memory") == 0) {
+			memory = true;
+		} else if (strcmp(argv[a], "--terrain") == 0) {
+			Graphics::setTerrain(true);
+		} else if (strcmp(argv[a], "--shadows") == 0) {
+			Graphics::setShadows(true);
+		} else if (strcmp(argv[a], "--startup") == 0) {
+			startup = true;
+		} else if (strncmp(argv[a], "--frames-in-flight=", 19) == 0) {
+			int frames = atoi(argv[a] + 19);
+			if (frames < 1 || frames > FrameLimiter::MaxFrames) {
+				LOG_ERROR(GENERAL, "Frames in flight go from 1 to %d",
+					FrameLimiter::MaxFrames);
+				return -1;
+			}
+			Graphics::setFrameLimit(frames);
+		} else if (strncmp(argv[a], "--views=", 8) == 0) {
+			views = atoi(argv[a] + 8);
+			if (views < 1 || views > MultiView::MaxViews) {
+				LOG_ERROR(GENERAL, "Views go from 1 to %d",
+					MultiView::MaxViews);
+				return -1;
+			}
+		} else if (strcmp(argv[a], "--view-layers") == 0) {
+			viewTarget = MultiView::LAYERS;
+		} else if (strcmp(argv[a], "--stereo") == 0) {
+			stereo = true;
+		} else if (strcmp(argv[a], "--late-latch") == 0) {
+			Graphics::setLateLatch(true);
+		} else if (strcmp(argv[a], "--latency") == 0) {
+			latency = true;
+		} else if (strncmp(argv[a], "--record=", 9) == 0) {
+			Graphics::setRecording(argv[a] + 9);
+		} else if (strncmp(argv[a], "--trace=", 8) == 0) {
+			tracePath = argv[a] + 8;
+		} else if (strncmp(argv[a], "--deferred", 10) == 0) {
+			// The light count follows an equals sign, 2048 when left out
+			int lights = (argv[a][10] == '=' ? atoi(argv[a] + 11) : 2048);
+			if (lights <= 0) {
+				LOG_ERROR(GENERAL, "Deferred shading needs a light");
+				return -1;
+			}
+			Graphics::setDeferredShading(lights);
+		}
+	}
+
+	if (particles > 0)
+		Graphics::setParticles(particles, particleMode);
+	if (views > 1 || stereo)
+		Graphics::setViews(views, viewTarget, stereo);
 
-int main() {
 	// Initialize and check Graphics
 	if (Graphics::initialize() != 0)
 		return -1;
+	if (startup) {
+		Log::flush();
+		Graphics::reportStartup(stdout);
+	}
+
+	// Record from here on, the markers only exist in tracing builds
+	TRACE_THREAD("Main");
+	if (tracePath) {
+		if (Trace::isAvailable())
+			Trace::start();
+		else
+			LOG_ERROR(GENERAL, "Tracing needs a build with TRACING defined");
+	}
 
-	// Initialize the render test
-	Graphics::initRenderTest();
+	if (benchmark || sparks || meshes) {
+		if (benchmark)
+			benchmarkAntiAliasing();
+		if (sparks)
+			benchmarkParticles();
+		if (meshes)
+			benchmarkMeshes();
+		Log::flush();
+		if (memory)
+			MemoryTracker::report(stdout);
+		if (tracePath)
+			Trace::write(tracePath);
+		GLRecorder::stop();
+		return 0;
+	}
 
 	// Get the game window for future use
 	GLFWwindow* window = Graphics::getWindow();
-	// Ensure capture of the escape key
-	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+	// Escape closes the window as soon as it's pressed
+	glfwSetKeyCallback(window, keyPressed);
 
-	// Set up an actual game loop
-	bool   running    = true;
-	double lastSync   = glfwGetTime();
+	// Set up an actual game loop. Frames are only drawn when something
+	// changed, or every time with --continuous
+	double lastSync   = 0.0;
 	double targetRate = 16.0 / 1000.0;
 
-	// Set up a frame counter
+	// Set up a frame counter, which also drives the render test
 	double lastTime = glfwGetTime();
 	int    frames   = 0;
+	bool   drawn    = false;
 
-	while (running) {
-		// Measure frame speed
+	while (!glfwWindowShouldClose(window)) {
+		TRACE_SCOPE("Frame");
 		double cTime = glfwGetTime();
-		frames++;
 
 		if (cTime - lastTime >= 1.0) {
-			fprintf(stdout, "%f ms/frame\n", 1000.0/double(frames));
+			LOG_INFO(TIMING, "%d frames drawn, %f ms GPU, %d%% resolution, "
+				"%.1f MB GPU memory", frames, Graphics::getGPUTime(),
+				static_cast<int>(Graphics::getResolutionScale() * 100.0f),
+				MemoryTracker::getDeviceCurrent() / (1024.0 * 1024.0));
 			frames = 0;
 			lastTime += 1.0;
 
+			TRACE_SCOPE("Render test update");
 			Graphics::updateRenderTest();
 		}
 
 		// Update graphics if appropriate
-		if (cTime - lastSync >= targetRate) { //16MS = 60FPS
+		bool redraw = (continuous || Graphics::isAnimating() ||
+			Graphics::isInvalid());
+		if (redraw && cTime - lastSync >= targetRate) { //16MS = 60FPS
 			Graphics::update();
+			frames++;
+			if (!drawn) {
+				LOG_INFO(GENERAL, "First frame after %.2f ms",
+					millisecondsSince(launched));
+				drawn = true;
+			}
 			// Update sync
 			lastSync = glfwGetTime();
 		}
 
-		// Poll events
-		glfwPollEvents();
-
-		if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS ||
-			glfwWindowShouldClose(window))
-		{
-			running = false;
-		}
+		// Sleep until input arrives or the next frame or render test update
+		// is due
+		double wake = lastTime + 1.0;
+		if (redraw && lastSync + targetRate < wake)
+			wake = lastSync + targetRate;
+		TRACE_SCOPE("Wait");
+		waitEvents(wake - glfwGetTime());
 	}
+
+	// Print the ledger while everything is still allocated
+	Log::flush();
+	if (latency)
+		Graphics::reportLatency(stdout);
+	if (memory)
+		MemoryTracker::report(stdout);
+	if (tracePath)
+		Trace::write(tracePath);
+	GLRecorder::stop();
 }
@@ -0,0 +1,30 @@
+// Textured materials for the batch, picked per draw
+uniform sampler2DArray textures;
+
+struct MaterialData {
+	vec4  tint;
+	uint  layer;
+	float scale;
+};
+
+layout(std430, binding = 1) readonly buffer MaterialBuffer {
+	MaterialData materials[];
+};
+
+// Colors a point of a box-mapped object, with the box position from 0 to 1
+vec3 shade(vec3 color, vec3 box, uint id) {
+	MaterialData material = materials[id];
+
+	// Project the texture along the axis the face looks down, found from
+	// how the box position changes across the screen
+	vec3 facing = abs(cross(dFdx(box), dFdy(box)));
+	vec2 uv     = box.xy;
+	if (facing.x > facing.y && facing.x > facing.z)
+		uv = box.zy;
+	else if (facing.y > facing.z)
+		uv = box.xz;
+
+	vec3 texel = texture(textures,
+		vec3(uv * material.scale, float(material.layer))).rgb;
+	return texel * material.tint.rgb * mix(vec3(1.0), color, material.tint.a);
+}
@@ -0,0 +1,38 @@
+// Drawing instanced across the views of MultiView. Each instance is one
+// object seen from one view, the views counting fastest
+#ifdef MULTIVIEW
+layout(std140) uniform ViewBlock {
+	mat4 viewProjections[8]; // MultiView::MaxViews
+	uint viewCount;
+};
+
+#ifndef VIEW_EXTENSION
+// Without writing the routing here, MultiView.gshader does it for each
+// triangle, so the outputs pass through it under other names
+#define fColor    gColor
+#define fBox      gBox
+#define fMaterial gMaterial
+flat out uint gView;
+#endif
+
+// The view an instance draws into
+uint getView() {
+	return uint(gl_InstanceID) % viewCount;
+}
+
+// The object an instance draws
+uint getObject() {
+	return uint(gl_InstanceID) / viewCount;
+}
+
+// Sends the vertex to a view's viewport or layer
+void routeView(uint view) {
+#if defined(VIEW_EXTENSION) && defined(VIEW_LAYERS)
+	gl_Layer = int(view);
+#elif defined(VIEW_EXTENSION)
+	gl_ViewportIndex = int(view);
+#else
+	gView = view;
+#endif
+}
+#endif
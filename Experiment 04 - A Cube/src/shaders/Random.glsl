@@ -0,0 +1,18 @@
+// PCG hash, the same as Random::hash() on the CPU
+uint hash(uint v) {
+	uint state = v * 747796405u + 2891336453u;
+	uint word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float unit(uint h) {
+	return float(h >> 8u) / 16777216.0;
+}
+
+// Three values from 0 to 1 for a counter, each one hashed on from the last
+vec3 random3(uint counter) {
+	uint r = hash(counter);
+	uint g = hash(r);
+	uint b = hash(g);
+	return vec3(unit(r), unit(g), unit(b));
+}
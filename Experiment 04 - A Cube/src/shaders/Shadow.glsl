@@ -0,0 +1,34 @@
+// Cascaded shadows from a directional light, kept by Shadows
+layout(std140, binding = 1) uniform ShadowBlock {
+	mat4 lightViewProjections[4]; // Shadows::CascadeCount
+	vec4 cascadeEnds;             // View depth where each cascade ends
+	vec4 eye;                     // Camera position
+	vec4 forward;                 // Camera direction
+};
+
+layout(binding = 2) uniform sampler2DArrayShadow shadowMaps;
+
+// How much light reaches a point, from 0 in full shadow to 1
+float shadow(vec3 world) {
+	// The first cascade reaching past the point covers it best
+	float depth   = dot(world - eye.xyz, forward.xyz);
+	int   cascade = 0;
+	while (cascade < 4 && depth > cascadeEnds[cascade])
+		cascade++;
+	if (cascade == 4)
+		return 1.0;
+
+	// The maps already hold the depth bias. Four filtered comparisons
+	// around the point soften the edges
+	vec4  light  = lightViewProjections[cascade] * vec4(world, 1);
+	vec3  coords = light.xyz / light.w * 0.5 + 0.5;
+	float texel  = 1.0 / float(textureSize(shadowMaps, 0).x);
+	float lit    = 0.0;
+	for (int t = 0; t < 4; t++) {
+		vec2 offset = (vec2(t & 1, t >> 1) - 0.5) * texel;
+		lit += texture(shadowMaps,
+			vec4(coords.xy + offset, float(cascade), coords.z));
+	}
+
+	return lit / 4.0;
+}